@@ -0,0 +1,81 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import std;
+import lysa.aabb;
+import lysa.benchmark;
+import lysa.math;
+
+namespace lysa {
+
+    constexpr auto AABBS_COUNT{100000u};
+
+    // Reference method : the 8 transformed corners
+    AABB toGlobalCorners(const AABB& aabb, const float4x4& transform) {
+        auto lower = float3{std::numeric_limits<float>::max()};
+        auto upper = float3{std::numeric_limits<float>::lowest()};
+        for (auto i = 0; i < 8; i++) {
+            const auto corner = float4{
+                (i & 1) ? aabb.max.x : aabb.min.x,
+                (i & 2) ? aabb.max.y : aabb.min.y,
+                (i & 4) ? aabb.max.z : aabb.min.z,
+                1.0f};
+            const auto position = mul(corner, transform).xyz;
+            lower = min(lower, float3(position));
+            upper = max(upper, float3(position));
+        }
+        return {lower, upper};
+    }
+
+    // World AABBs of boxes with random rotations, scales and translations
+    void aabbBenchmark() {
+        auto random = std::mt19937{42};
+        auto distribution = std::uniform_real_distribution<float>{-1.0f, 1.0f};
+        auto aabbs = std::vector<AABB>{};
+        auto transforms = std::vector<float4x4>{};
+        for (auto i = 0u; i < AABBS_COUNT; i++) {
+            const auto center = float3{distribution(random), distribution(random), distribution(random)};
+            const auto extent = float3{distribution(random), distribution(random), distribution(random)};
+            aabbs.push_back({center - abs(extent), center + abs(extent)});
+            transforms.push_back(mul(mul(
+                float4x4::scale(1.5f + distribution(random)),
+                float4x4::rotation_y(distribution(random) * 3.14f)),
+                float4x4::translation(distribution(random) * 100.0f, 0.0f, distribution(random) * 100.0f)));
+        }
+        auto results = std::vector<AABB>(AABBS_COUNT);
+
+        benchmark::measure("8 corners", AABBS_COUNT, [&] {
+            for (auto i = 0u; i < AABBS_COUNT; i++) {
+                results[i] = toGlobalCorners(aabbs[i], transforms[i]);
+            }
+            benchmark::keep(results);
+        });
+        benchmark::measure("center/extent, one box", AABBS_COUNT, [&] {
+            for (auto i = 0u; i < AABBS_COUNT; i++) {
+                results[i] = aabbs[i].toGlobal(transforms[i]);
+            }
+            benchmark::keep(results);
+        });
+        benchmark::measure("center/extent, 4 boxes SoA", AABBS_COUNT, [&] {
+            AABB::toGlobal(aabbs, transforms, results);
+            benchmark::keep(results);
+        });
+
+        // The batch gives the same boxes as the corners
+        auto mismatches = 0u;
+        for (auto i = 0u; i < AABBS_COUNT; i++) {
+            const auto reference = toGlobalCorners(aabbs[i], transforms[i]);
+            if (any(abs(reference.min - results[i].min) > float3{1e-3f}) ||
+                any(abs(reference.max - results[i].max) > float3{1e-3f})) {
+                mismatches++;
+            }
+        }
+        std::println("  {:<48} {:>12}", "boxes different from the 8 corners", mismatches);
+    }
+
+    const auto aabbRegistration = benchmark::Registration{"AABB", aabbBenchmark};
+
+}
@@ -0,0 +1,89 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.benchmark;
+
+import std;
+
+export namespace lysa::benchmark {
+
+    /**
+     * Number of timed runs of each measure, the fastest one is reported
+     */
+    constexpr auto RUNS{5};
+
+    /**
+     * Registers a benchmark at static initialization time.<br>
+     * Each benchmark source file declares one static Registration.
+     */
+    class Registration {
+    public:
+        Registration(const std::string& name, std::function<void()> run) {
+            getBenchmarks().push_back({name, std::move(run)});
+        }
+
+        /**
+         * Runs the registered benchmarks whose name contains the filter, all of them if the filter is empty
+         */
+        static void runAll(const std::string& filter) {
+            for (const auto& benchmark : getBenchmarks()) {
+                if (!filter.empty() && !benchmark.name.contains(filter)) { continue; }
+                std::println("{}", benchmark.name);
+                benchmark.run();
+            }
+        }
+
+    private:
+        struct Benchmark {
+            std::string name;
+            std::function<void()> run;
+        };
+
+        static std::vector<Benchmark>& getBenchmarks() {
+            static std::vector<Benchmark> benchmarks;
+            return benchmarks;
+        }
+    };
+
+    /**
+     * Keeps a value computed by a benchmark from being optimized away
+     */
+    template<typename T>
+    void keep(const T& value) {
+        static const void* volatile sink;
+        sink = std::addressof(value);
+    }
+
+    /**
+     * Times a function and prints the duration of one operation
+     * @param label Name of the measure
+     * @param operations Number of operations done by one call of the function
+     * @param fn Measured function, called once to warm up then RUNS times
+     * @param setup Function called before each call of the measured function, not timed
+     */
+    template<typename F, typename S>
+    void measure(const std::string& label, const std::size_t operations, F&& fn, S&& setup) {
+        setup();
+        fn();
+        auto best = std::chrono::nanoseconds::max();
+        for (auto run = 0; run < RUNS; run++) {
+            setup();
+            const auto start = std::chrono::steady_clock::now();
+            fn();
+            best = std::min(best, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start));
+        }
+        const auto perOperation = static_cast<double>(best.count()) / static_cast<double>(std::max(operations, std::size_t{1}));
+        std::println("  {:<48} {:>12.2f} ms {:>10.2f} ns/op",
+            label, static_cast<double>(best.count()) / 1e6, perOperation);
+    }
+
+    template<typename F>
+    void measure(const std::string& label, const std::size_t operations, F&& fn) {
+        measure(label, operations, std::forward<F>(fn), []{});
+    }
+
+}
@@ -0,0 +1,63 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+module lysa.benchmark.scene;
+
+namespace lysa::benchmark {
+
+    BenchmarkScene::BenchmarkScene(const uint32 meshesCount, const uint32 instancesCount, const float spacing) {
+        auto& materialManager = lysa.ctx.res.get<MaterialManager>();
+        auto& meshManager = lysa.ctx.res.get<MeshManager>();
+
+        auto vertices = std::vector<Vertex>(8);
+        for (auto i = 0; i < 8; i++) {
+            vertices[i].position = float3{
+                (i & 1) ? 0.5f : -0.5f,
+                (i & 2) ? 0.5f : -0.5f,
+                (i & 4) ? 0.5f : -0.5f};
+            vertices[i].normal = normalize(vertices[i].position);
+        }
+        const auto indices = std::vector<uint32>{
+            0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,
+            0, 1, 4, 1, 5, 4,  2, 6, 3, 3, 6, 7,
+            0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5,
+        };
+        const auto& material = materialManager.create();
+        auto meshes = std::vector<const Mesh*>{};
+        for (auto i = 0u; i < meshesCount; i++) {
+            auto& mesh = meshManager.create(
+                vertices,
+                indices,
+                {MeshSurface{0, static_cast<uint32>(indices.size())}},
+                "Cube " + std::to_string(i));
+            mesh.setSurfaceMaterial(0, material.id);
+            meshes.push_back(&mesh);
+        }
+        meshManager.flush();
+
+        const auto side = static_cast<uint32>(std::ceil(std::sqrt(static_cast<float>(instancesCount))));
+        meshInstances.reserve(instancesCount);
+        for (auto i = 0u; i < instancesCount; i++) {
+            auto meshInstance = std::make_unique<MeshInstance>(lysa.ctx, *meshes[i % meshesCount]);
+            meshInstance->setTransform(float4x4::translation(
+                static_cast<float>(i % side) * spacing,
+                0.0f,
+                static_cast<float>(i / side) * spacing));
+            meshInstances.push_back(std::move(meshInstance));
+        }
+    }
+
+    void BenchmarkScene::submit(const std::function<void(vireo::CommandList&)>& record) {
+        const auto commandAllocator = lysa.ctx.vireo->createCommandAllocator(vireo::CommandType::GRAPHIC);
+        const auto commandList = commandAllocator->createCommandList();
+        commandList->begin();
+        record(*commandList);
+        commandList->end();
+        lysa.ctx.graphicQueue->submit({commandList});
+        lysa.ctx.graphicQueue->waitIdle();
+    }
+
+}
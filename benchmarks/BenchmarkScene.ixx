@@ -0,0 +1,42 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.benchmark.scene;
+
+import lysa;
+
+export namespace lysa::benchmark {
+
+    /**
+     * Headless engine instance with cube meshes sharing one standard material, and mesh instances
+     * of these meshes laid out on a grid. The GPU is only used for the buffers allocations, a
+     * software Vulkan device (i.e. lavapipe) is enough.
+     */
+    class BenchmarkScene {
+    public:
+        /**
+         * @param meshesCount Number of distinct cube meshes, one draw group each
+         * @param instancesCount Number of mesh instances, the meshes being used in turn
+         * @param spacing Distance between two instances on the grid
+         */
+        BenchmarkScene(uint32 meshesCount, uint32 instancesCount, float spacing = 4.0f);
+
+        Context& getContext() { return lysa.ctx; }
+
+        /**
+         * Records commands in a graphic command list, submits it and waits for its completion
+         */
+        void submit(const std::function<void(vireo::CommandList&)>& record);
+
+        const auto& getMeshInstances() const { return meshInstances; }
+
+    private:
+        // Declared first, destroyed after the mesh instances
+        Lysa lysa;
+        std::vector<std::unique_ptr<MeshInstance>> meshInstances;
+    };
+
+}
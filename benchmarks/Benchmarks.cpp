@@ -0,0 +1,14 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import std;
+import lysa.benchmark;
+
+// Usage : lysa_benchmarks [name filter]
+int main(const int argc, char** argv) {
+    lysa::benchmark::Registration::runAll(argc > 1 ? argv[1] : "");
+    return 0;
+}
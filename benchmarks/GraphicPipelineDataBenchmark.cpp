@@ -0,0 +1,68 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import lysa;
+import lysa.benchmark;
+import lysa.benchmark.scene;
+
+namespace lysa {
+
+    constexpr auto PIPELINE_INSTANCES_COUNT{100000u};
+    constexpr auto PIPELINE_MESHES_COUNT{100u};
+    // 1% of the instances removed then added again each frame
+    constexpr auto CHURN_COUNT{PIPELINE_INSTANCES_COUNT / 100};
+    constexpr auto CHURN_FRAMES{10u};
+
+    // Incremental add & remove of the draw commands of a pipeline
+    void graphicPipelineDataBenchmark() {
+        auto scene = benchmark::BenchmarkScene(PIPELINE_MESHES_COUNT, PIPELINE_INSTANCES_COUNT);
+        const auto& meshInstances = scene.getMeshInstances();
+        const auto pipelineId = scene.getContext().res.get<MaterialManager>()[meshInstances[0]->getSurfaceMaterial(0)].getPipelineId();
+
+        // Slots of the mesh instances in the scene instances array
+        auto meshInstancesDataMemoryBlocks = std::unordered_map<const MeshInstance*, MemoryBlock>{};
+        for (auto i = 0u; i < meshInstances.size(); i++) {
+            meshInstancesDataMemoryBlocks[meshInstances[i].get()] = {i, i * sizeof(MeshInstanceData), sizeof(MeshInstanceData)};
+        }
+
+        auto pipelineData = std::unique_ptr<GraphicPipelineData>{};
+        benchmark::measure("add all", PIPELINE_INSTANCES_COUNT, [&] {
+            for (const auto& meshInstance : meshInstances) {
+                pipelineData->addInstance(meshInstance.get(), meshInstancesDataMemoryBlocks);
+            }
+        }, [&] {
+            pipelineData.reset();
+            pipelineData = std::make_unique<GraphicPipelineData>(scene.getContext(), pipelineId, 0, PIPELINE_INSTANCES_COUNT);
+        });
+
+        // Same random instances each run, the frames use different ones
+        auto churned = std::vector<const MeshInstance*>{};
+        for (const auto& meshInstance : meshInstances) {
+            churned.push_back(meshInstance.get());
+        }
+        std::ranges::shuffle(churned, std::mt19937{42});
+        churned.resize(CHURN_COUNT * CHURN_FRAMES);
+
+        benchmark::measure("1% churn per frame", CHURN_COUNT * 2 * CHURN_FRAMES, [&] {
+            for (auto frame = 0u; frame < CHURN_FRAMES; frame++) {
+                const auto first = churned.begin() + frame * CHURN_COUNT;
+                for (auto it = first; it != first + CHURN_COUNT; ++it) {
+                    pipelineData->removeInstance(*it);
+                }
+                for (auto it = first; it != first + CHURN_COUNT; ++it) {
+                    pipelineData->addInstance(*it, meshInstancesDataMemoryBlocks);
+                }
+            }
+        }, [&] {
+            // Upload of the previous run, not timed
+            scene.submit([&](vireo::CommandList& commandList) { pipelineData->updateData(commandList); });
+        });
+    }
+
+    const auto graphicPipelineDataRegistration = benchmark::Registration{
+        "GraphicPipelineData", graphicPipelineDataBenchmark};
+
+}
@@ -0,0 +1,124 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import std;
+import lysa.benchmark;
+import lysa.math;
+import lysa.mesh_simplifier;
+import lysa.resources.mesh;
+
+namespace lysa {
+
+    constexpr auto CITY_BLOCKS{12u};
+    constexpr auto CITY_BLOCK_SIZE{10.0f};
+    // Subdivisions of each side of a building face and of the ground
+    constexpr auto CITY_BUILDING_SUBDIVISIONS{8u};
+    constexpr auto CITY_GROUND_SUBDIVISIONS{64u};
+
+    struct City {
+        std::vector<float3> positions;
+        std::vector<uint32> indices;
+    };
+
+    // Closed box with subdivided faces, the edges shared by two faces having the same positions
+    void addBuilding(City& city, const std::array<float, 3>& min, const std::array<float, 3>& max) {
+        constexpr auto n = CITY_BUILDING_SUBDIVISIONS;
+        const auto coordinate = [&](const uint32 axis, const uint32 k) {
+            return min[axis] + (max[axis] - min[axis]) * static_cast<float>(k) / static_cast<float>(n);
+        };
+        for (auto axis = 0u; axis < 3; axis++) {
+            for (const auto side : { 0u, n }) {
+                const auto first = static_cast<uint32>(city.positions.size());
+                for (auto j = 0u; j <= n; j++) {
+                    for (auto i = 0u; i <= n; i++) {
+                        auto k = std::array<uint32, 3>{};
+                        k[axis] = side;
+                        k[(axis + 1) % 3] = i;
+                        k[(axis + 2) % 3] = j;
+                        city.positions.push_back(float3{coordinate(0, k[0]), coordinate(1, k[1]), coordinate(2, k[2])});
+                    }
+                }
+                for (auto j = 0u; j < n; j++) {
+                    for (auto i = 0u; i < n; i++) {
+                        const auto v = first + j * (n + 1) + i;
+                        // Facing the axis on the max side, the opposite way on the min side
+                        if (side == n) {
+                            city.indices.insert(city.indices.end(), { v, v + 1, v + n + 1 });
+                            city.indices.insert(city.indices.end(), { v + 1, v + n + 2, v + n + 1 });
+                        } else {
+                            city.indices.insert(city.indices.end(), { v, v + n + 1, v + 1 });
+                            city.indices.insert(city.indices.end(), { v + 1, v + n + 1, v + n + 2 });
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Flat ground with an open border and a grid of buildings of random heights
+    City buildCity() {
+        auto city = City{};
+        constexpr auto size = CITY_BLOCKS * CITY_BLOCK_SIZE;
+        constexpr auto n = CITY_GROUND_SUBDIVISIONS;
+        for (auto z = 0u; z <= n; z++) {
+            for (auto x = 0u; x <= n; x++) {
+                city.positions.push_back(float3{
+                    size * static_cast<float>(x) / static_cast<float>(n),
+                    0.0f,
+                    size * static_cast<float>(z) / static_cast<float>(n)});
+            }
+        }
+        for (auto z = 0u; z < n; z++) {
+            for (auto x = 0u; x < n; x++) {
+                const auto v = z * (n + 1) + x;
+                city.indices.insert(city.indices.end(), { v, v + n + 1, v + 1 });
+                city.indices.insert(city.indices.end(), { v + 1, v + n + 1, v + n + 2 });
+            }
+        }
+        auto random = std::mt19937{42};
+        auto heights = std::uniform_real_distribution{8.0f, 60.0f};
+        for (auto z = 0u; z < CITY_BLOCKS; z++) {
+            for (auto x = 0u; x < CITY_BLOCKS; x++) {
+                const auto left = static_cast<float>(x) * CITY_BLOCK_SIZE + 2.0f;
+                const auto front = static_cast<float>(z) * CITY_BLOCK_SIZE + 2.0f;
+                addBuilding(city,
+                    { left, 0.0f, front },
+                    { left + CITY_BLOCK_SIZE - 4.0f, heights(random), front + CITY_BLOCK_SIZE - 4.0f });
+            }
+        }
+        return city;
+    }
+
+    // Detail levels of a city surface, built like Mesh::generateLods()
+    void meshSimplifierBenchmark() {
+        const auto city = buildCity();
+        auto levels = std::vector<MeshSimplifier::Level>{};
+        benchmark::measure("city detail levels", city.indices.size() / 3, [&] {
+            auto simplifier = MeshSimplifier(city.positions, city.indices);
+            auto indexCount = static_cast<uint32>(city.indices.size());
+            for (auto level = 1; level < MESH_LODS_MAX; level++) {
+                auto simplified = simplifier.simplify(indexCount / 6 * 3);
+                if (simplified.indices.empty() || simplified.indices.size() > indexCount * 3 / 4) {
+                    break;
+                }
+                indexCount = static_cast<uint32>(simplified.indices.size());
+                levels.push_back(std::move(simplified));
+            }
+            benchmark::keep(levels);
+        }, [&] {
+            levels.clear();
+        });
+        std::println("  {:<48} {:>12} triangles", "level 0", city.indices.size() / 3);
+        for (auto level = 0; level < levels.size(); level++) {
+            std::println("  {:<48} {:>12} triangles {:>10.4f} error",
+                std::format("level {}", level + 1), levels[level].indices.size() / 3, levels[level].error);
+        }
+    }
+
+    const auto meshSimplifierRegistration = benchmark::Registration{
+        "MeshSimplifier", meshSimplifierBenchmark};
+
+}
@@ -0,0 +1,92 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import std;
+import lysa.benchmark;
+import lysa.resources;
+import lysa.resources.manager;
+import lysa.types;
+
+namespace lysa {
+
+    struct BenchmarkContext {};
+
+    struct BenchmarkResource : ManagedResource {
+        uint32 value;
+        BenchmarkResource(const BenchmarkContext&, const uint32 value) : value(value) {}
+    };
+
+    class BenchmarkResourcesManager : public ResourcesManager<const BenchmarkContext, BenchmarkResource> {
+    public:
+        BenchmarkResourcesManager(const BenchmarkContext& ctx, const size_t capacity) :
+            ResourcesManager(ctx, capacity, "BenchmarkResourcesManager") {}
+    };
+
+    constexpr auto RESOURCES_COUNT{100000u};
+
+    // Handle create/destroy/lookup throughput of the generational pool
+    void resourcesManagerBenchmark() {
+        const auto ctx = BenchmarkContext{};
+        auto ids = std::vector<unique_id>(RESOURCES_COUNT);
+
+        // Fresh pool each run, so the measure includes the growth of the pool
+        auto growing = std::unique_ptr<BenchmarkResourcesManager>{};
+        benchmark::measure("create, growing pool", RESOURCES_COUNT, [&] {
+            for (auto i = 0u; i < RESOURCES_COUNT; i++) {
+                ids[i] = growing->create(i).id;
+            }
+        }, [&] {
+            growing.reset();
+            growing = std::make_unique<BenchmarkResourcesManager>(ctx, BenchmarkResourcesManager::CHUNK_SIZE);
+        });
+        growing.reset();
+
+        auto manager = BenchmarkResourcesManager(ctx, RESOURCES_COUNT);
+        benchmark::measure("create & destroy, reused slots", RESOURCES_COUNT, [&] {
+            for (auto i = 0u; i < RESOURCES_COUNT; i++) {
+                ids[i] = manager.create(i).id;
+            }
+            for (auto i = 0u; i < RESOURCES_COUNT; i++) {
+                manager.destroy(ids[i]);
+            }
+        });
+
+        for (auto i = 0u; i < RESOURCES_COUNT; i++) {
+            ids[i] = manager.create(i).id;
+        }
+        // Random access order, like handles stored in the scene
+        auto order = ids;
+        std::ranges::shuffle(order, std::mt19937{42});
+
+        benchmark::measure("lookup", RESOURCES_COUNT, [&] {
+            auto sum = uint64{0};
+            for (const auto id : order) {
+                sum += manager[id].value;
+            }
+            benchmark::keep(sum);
+        });
+        benchmark::measure("have", RESOURCES_COUNT, [&] {
+            auto count = 0u;
+            for (const auto id : order) {
+                count += manager.have(id) ? 1 : 0;
+            }
+            benchmark::keep(count);
+        });
+        benchmark::measure("forEach", RESOURCES_COUNT, [&] {
+            auto sum = uint64{0};
+            manager.forEach([&](const BenchmarkResource& res) { sum += res.value; });
+            benchmark::keep(sum);
+        });
+
+        for (const auto id : ids) {
+            manager.destroy(id);
+        }
+    }
+
+    const auto resourcesManagerRegistration = benchmark::Registration{
+        "ResourcesManager", resourcesManagerBenchmark};
+
+}
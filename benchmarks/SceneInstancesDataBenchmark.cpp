@@ -0,0 +1,79 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import std;
+import lysa;
+import lysa.benchmark;
+import lysa.benchmark.scene;
+
+namespace lysa {
+
+    constexpr auto SCENE_INSTANCES_COUNT{100000u};
+    constexpr auto SCENE_MESHES_COUNT{100u};
+    // 1% of the instances removed then added again each frame
+    constexpr auto SCENE_CHURN_COUNT{SCENE_INSTANCES_COUNT / 100};
+    constexpr auto SCENE_CHURN_FRAMES{10u};
+
+    // Add & remove of the mesh instances of a scene, with the lookup of their pipelines data
+    void sceneInstancesDataBenchmark() {
+        auto scene = benchmark::BenchmarkScene(SCENE_MESHES_COUNT, SCENE_INSTANCES_COUNT);
+        const auto& meshInstances = scene.getMeshInstances();
+        auto instancesData = SceneInstancesData(scene.getContext(), SCENE_INSTANCES_COUNT, SCENE_INSTANCES_COUNT);
+
+        // Uploads the modifications of the previous run, not timed
+        const auto upload = [&] {
+            scene.submit([&](vireo::CommandList& commandList) { instancesData.update(commandList); });
+        };
+        const auto addAll = [&] {
+            for (const auto& meshInstance : meshInstances) {
+                instancesData.addInstance(meshInstance.get());
+            }
+        };
+        const auto removeAll = [&] {
+            for (const auto& meshInstance : meshInstances) {
+                instancesData.removeInstance(meshInstance.get());
+            }
+        };
+
+        benchmark::measure("add all", SCENE_INSTANCES_COUNT, addAll, [&] {
+            if (instancesData.haveInstance(meshInstances[0].get())) {
+                removeAll();
+            }
+            upload();
+        });
+
+        benchmark::measure("remove all", SCENE_INSTANCES_COUNT, removeAll, [&] {
+            addAll();
+            upload();
+        });
+
+        // Same random instances each run, the frames use different ones
+        auto churned = std::vector<const MeshInstance*>{};
+        for (const auto& meshInstance : meshInstances) {
+            churned.push_back(meshInstance.get());
+        }
+        std::ranges::shuffle(churned, std::mt19937{42});
+        churned.resize(SCENE_CHURN_COUNT * SCENE_CHURN_FRAMES);
+
+        addAll();
+        benchmark::measure("1% churn per frame", SCENE_CHURN_COUNT * 2 * SCENE_CHURN_FRAMES, [&] {
+            for (auto frame = 0u; frame < SCENE_CHURN_FRAMES; frame++) {
+                const auto first = churned.begin() + frame * SCENE_CHURN_COUNT;
+                for (auto it = first; it != first + SCENE_CHURN_COUNT; ++it) {
+                    instancesData.removeInstance(*it);
+                }
+                for (auto it = first; it != first + SCENE_CHURN_COUNT; ++it) {
+                    instancesData.addInstance(*it);
+                }
+            }
+        }, upload);
+        removeAll();
+    }
+
+    const auto sceneInstancesDataRegistration = benchmark::Registration{
+        "SceneInstancesData", sceneInstancesDataBenchmark};
+
+}
@@ -0,0 +1,74 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import std;
+import lysa;
+import lysa.benchmark;
+import lysa.benchmark.scene;
+
+namespace lysa {
+
+    constexpr auto SHADOW_INSTANCES_COUNT{4096u};
+    constexpr auto SHADOW_MESHES_COUNT{16u};
+    constexpr auto SHADOW_SPACING{3.0f};
+    constexpr auto SHADOW_FRAMES{10u};
+
+    // Omni light shadow map with its six faces rendered in one pass or one pass per face
+    void shadowCubeMapBenchmark() {
+        auto benchmarkScene = benchmark::BenchmarkScene(SHADOW_MESHES_COUNT, SHADOW_INSTANCES_COUNT, SHADOW_SPACING);
+        auto& ctx = benchmarkScene.getContext();
+        auto& meshManager = ctx.res.get<MeshManager>();
+        auto scene = Scene(ctx, { .maxMeshInstances = SHADOW_INSTANCES_COUNT });
+        for (const auto& meshInstance : benchmarkScene.getMeshInstances()) {
+            scene.addInstance(*meshInstance, false);
+        }
+
+        // In the middle of the grid, every instance in its range and seen from one face or more
+        const auto size = std::ceil(std::sqrt(static_cast<float>(SHADOW_INSTANCES_COUNT))) * SHADOW_SPACING;
+        const auto center = float4x4::translation(size * 0.5f, 4.0f, size * 0.5f);
+        const auto light = Light(LightType::LIGHT_OMNI, float3{1.0f}, 1.0f, center, size, 1.3f, 1.4f, true, 1024);
+        scene.addLight(light);
+        scene.processDeferredOperations();
+        // The camera is in the range of the light, the shadow maps have their full size
+        const auto camera = Camera(center, perspective(radians(75.0f), 16.0f / 9.0f, 0.1f, 1000.0f), 0.1f, 1000.0f);
+
+        auto& frame = scene.get(0);
+        auto config = RendererConfiguration{};
+        // Rendered each frame
+        config.shadowStaticCacheEnabled = false;
+        for (const auto singlePass : { false, true }) {
+            config.shadowCubeMapSinglePassEnabled = singlePass;
+            // Same submissions as a render target, the culling and the rendering are timed
+            const auto render = [&] {
+                benchmarkScene.submit([&](vireo::CommandList& commandList) {
+                    frame.update(commandList, camera, config, 0);
+                });
+                benchmarkScene.submit([&](vireo::CommandList& commandList) {
+                    frame.compute(commandList, camera);
+                });
+                benchmarkScene.submit([&](vireo::CommandList& commandList) {
+                    commandList.bindVertexBuffer(meshManager.getVertexBuffer());
+                    commandList.bindIndexBuffer(meshManager.getIndexBuffer());
+                    for (const auto& shadowMapRenderer : frame.getShadowMapRenderers()) {
+                        std::static_pointer_cast<ShadowMapPass>(shadowMapRenderer)->render(commandList, frame);
+                    }
+                });
+            };
+            benchmark::measure(
+                singlePass ? "cube map, single pass" : "cube map, one pass per face",
+                SHADOW_FRAMES,
+                [&] {
+                    for (auto i = 0u; i < SHADOW_FRAMES; i++) {
+                        render();
+                    }
+                });
+        }
+    }
+
+    const auto shadowCubeMapRegistration = benchmark::Registration{
+        "ShadowCubeMap", shadowCubeMapBenchmark};
+
+}
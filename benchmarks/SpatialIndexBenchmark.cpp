@@ -0,0 +1,89 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import lysa;
+import lysa.benchmark;
+import lysa.benchmark.scene;
+
+namespace lysa {
+
+    constexpr auto SPATIAL_INSTANCES_COUNT{100000u};
+    constexpr auto SPATIAL_QUERIES_COUNT{1000u};
+
+    // Insertion, per frame update and queries of 100k moving mesh instances
+    void spatialIndexBenchmark() {
+        auto scene = benchmark::BenchmarkScene(1, SPATIAL_INSTANCES_COUNT);
+        auto meshInstances = std::vector<MeshInstance*>{};
+        auto instances = std::vector<const MeshInstance*>{};
+        auto positions = std::vector<float3>{};
+        for (const auto& meshInstance : scene.getMeshInstances()) {
+            meshInstances.push_back(meshInstance.get());
+            instances.push_back(meshInstance.get());
+            positions.push_back(meshInstance->getTransform()[3].xyz);
+        }
+
+        auto index = std::unique_ptr<SpatialIndex>{};
+        benchmark::measure("insert", SPATIAL_INSTANCES_COUNT, [&] {
+            for (const auto* meshInstance : instances) {
+                index->insert(meshInstance);
+            }
+        }, [&] {
+            index.reset();
+            index = std::make_unique<SpatialIndex>();
+        });
+
+        // All the instances move each frame, the transforms are not timed
+        auto random = std::mt19937{42};
+        auto transforms = std::vector<float4x4>(SPATIAL_INSTANCES_COUNT);
+        const auto move = [&](const float distance) {
+            auto distribution = std::uniform_real_distribution<float>{-distance, distance};
+            for (auto i = 0u; i < SPATIAL_INSTANCES_COUNT; i++) {
+                positions[i] += float3{distribution(random), 0.0f, distribution(random)};
+                transforms[i] = float4x4::translation(positions[i]);
+            }
+            MeshInstance::setTransforms(meshInstances, transforms);
+        };
+        benchmark::measure("update, moves inside the margins", SPATIAL_INSTANCES_COUNT, [&] {
+            index->update(instances);
+        }, [&] { move(0.02f); });
+        benchmark::measure("update, moves outside the margins", SPATIAL_INSTANCES_COUNT, [&] {
+            index->update(instances);
+        }, [&] { move(0.5f); });
+
+        const auto side = std::sqrt(static_cast<float>(SPATIAL_INSTANCES_COUNT)) * 4.0f;
+        auto distribution = std::uniform_real_distribution<float>{0.0f, side};
+        auto centers = std::vector<float3>(SPATIAL_QUERIES_COUNT);
+        for (auto& center : centers) {
+            center = float3{distribution(random), 0.0f, distribution(random)};
+        }
+        auto results = std::vector<const MeshInstance*>{};
+        benchmark::measure("sphere queries, radius 20", SPATIAL_QUERIES_COUNT, [&] {
+            for (const auto& center : centers) {
+                results.clear();
+                index->query(center, 20.0f, results);
+            }
+            benchmark::keep(results);
+        });
+        const auto projection = perspective(radians(75.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+        benchmark::measure("frustum queries, far 200", SPATIAL_QUERIES_COUNT, [&] {
+            for (const auto& center : centers) {
+                results.clear();
+                const auto view = look_at(center + float3{0.0f, 10.0f, 0.0f}, center + float3{10.0f, 0.0f, 10.0f}, AXIS_UP);
+                index->query(mul(view, projection), results);
+            }
+            benchmark::keep(results);
+        });
+        benchmark::measure("nearest raycasts", SPATIAL_QUERIES_COUNT, [&] {
+            for (const auto& center : centers) {
+                benchmark::keep(index->raycast(center + float3{0.0f, 0.5f, 0.0f}, normalize(float3{1.0f, 0.0f, 1.0f})));
+            }
+        });
+    }
+
+    const auto spatialIndexRegistration = benchmark::Registration{
+        "SpatialIndex", spatialIndexBenchmark};
+
+}
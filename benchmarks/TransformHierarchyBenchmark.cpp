@@ -0,0 +1,59 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import std;
+import lysa.benchmark;
+import lysa.math;
+import lysa.resources.transform_hierarchy;
+import lysa.types;
+
+namespace lysa {
+
+    constexpr auto HIERARCHY_NODES_COUNT{100000u};
+    constexpr auto HIERARCHY_CHILDREN_COUNT{8u};
+    // 5% of the nodes modified each frame
+    constexpr auto HIERARCHY_DIRTY_COUNT{HIERARCHY_NODES_COUNT / 20};
+
+    // Propagation of the modified local transforms to the world transforms
+    void transformHierarchyBenchmark() {
+        auto hierarchy = TransformHierarchy(HIERARCHY_NODES_COUNT);
+        auto nodes = std::vector<unique_id>(HIERARCHY_NODES_COUNT);
+        // Complete tree, the nodes of a level are the children of the nodes of the previous level
+        for (auto i = 0u; i < HIERARCHY_NODES_COUNT; i++) {
+            nodes[i] = hierarchy.create(
+                float4x4::translation(1.0f, 0.0f, 0.0f),
+                i == 0 ? INVALID_ID : nodes[(i - 1) / HIERARCHY_CHILDREN_COUNT]);
+        }
+        benchmark::measure("sort & update all", HIERARCHY_NODES_COUNT, [&] {
+            benchmark::keep(hierarchy.update());
+        }, [&] {
+            // A structural change re-sorts and updates all the nodes
+            hierarchy.setParent(nodes[1], nodes[0]);
+            hierarchy.setLocalTransform(nodes[0], float4x4::translation(0.0f, 1.0f, 0.0f));
+        });
+
+        auto random = std::mt19937{42};
+        auto distribution = std::uniform_int_distribution<uint32>{0, HIERARCHY_NODES_COUNT - 1};
+        auto dirtyNodes = std::vector<unique_id>(HIERARCHY_DIRTY_COUNT);
+        auto angle = 0.0f;
+        benchmark::measure("5% dirty, set & update", HIERARCHY_DIRTY_COUNT, [&] {
+            for (const auto node : dirtyNodes) {
+                hierarchy.setLocalTransform(node, float4x4::rotation_y(angle));
+            }
+            benchmark::keep(hierarchy.update());
+        }, [&] {
+            // The root and its first levels would make all the nodes dirty
+            for (auto& node : dirtyNodes) {
+                node = nodes[std::max(distribution(random), HIERARCHY_CHILDREN_COUNT * HIERARCHY_CHILDREN_COUNT)];
+            }
+            angle += 0.1f;
+        });
+    }
+
+    const auto transformHierarchyRegistration = benchmark::Registration{
+        "TransformHierarchy", transformHierarchyBenchmark};
+
+}
@@ -6,36 +6,88 @@
 */
 module lysa.aabb;
 
+import lysa.exception;
+
 namespace lysa {
 
-    // https://ktstephano.github.io/rendering/stratusgfx/aabbs
+    // Center/extent method (J. Arvo, "Transforming Axis-Aligned Bounding Boxes", Graphics Gems, 1990)
+    // The extent is transformed by the absolute value of the rotation/scale part of the matrix,
+    // which gives the same box as transforming the 8 corners, with one SIMD multiply-add per matrix row.
     AABB AABB::toGlobal(const float4x4& transform) const {
-        // First extract the 8 transformed corners of the box using vmin/vmax
-        const float3 corners[8] = {
-            float3(mul(float4(min.x, min.y, min.z, 1.0f), transform).xyz),
-            float3(mul(float4(min.x, max.y, min.z, 1.0f), transform).xyz),
-            float3(mul(float4(min.x, min.y, max.z, 1.0f), transform).xyz),
-            float3(mul(float4(min.x, max.y, max.z, 1.0f), transform).xyz),
-            float3(mul(float4(max.x, min.y, min.z, 1.0f), transform).xyz),
-            float3(mul(float4(max.x, max.y, min.z, 1.0f), transform).xyz),
-            float3(mul(float4(max.x, min.y, max.z, 1.0f), transform).xyz),
-            float3(mul(float4(max.x, max.y, max.z, 1.0f), transform).xyz)
-        };
-
-        // Now apply the min/max algorithm from before using the 8 transformed
-        // corners
-        auto newVmin = corners[0];
-        auto newVmax = newVmin;
+        const float3 center = (min + max) * 0.5f;
+        const float3 extent = (max - min) * 0.5f;
+        const float4 newCenter =
+            center.x * transform[0] +
+            center.y * transform[1] +
+            center.z * transform[2] +
+            transform[3];
+        const float4 newExtent =
+            extent.x * abs(transform[0]) +
+            extent.y * abs(transform[1]) +
+            extent.z * abs(transform[2]);
+        return { float3(newCenter.xyz - newExtent.xyz), float3(newCenter.xyz + newExtent.xyz) };
+    }
 
-        // Start looping from corner 1 onwards
-        for (auto i = 1; i < 8; ++i) {
-            const auto& current = corners[i];
-            newVmin = lysa::min(newVmin, current);
-            newVmax = lysa::max(newVmax, current);
+    void AABB::toGlobal(
+        const std::span<const AABB> aabbs,
+        const std::span<const float4x4> transforms,
+        const std::span<AABB> results) {
+        assert([&]{ return aabbs.size() == transforms.size() && aabbs.size() == results.size(); },
+            "AABB::toGlobal : arrays sizes mismatch");
+        // Blocks of 4 boxes transposed in structure-of-arrays registers : each float4 holds one coordinate
+        // or one matrix element of the 4 boxes, and the center/extent method is applied to the 4 boxes at once
+        const auto blocksEnd = aabbs.size() & ~size_t{3};
+        for (auto i = size_t{0}; i < blocksEnd; i += 4) {
+            const auto mins = transpose(float4x4{
+                float4{aabbs[i].min, 0.0f},
+                float4{aabbs[i + 1].min, 0.0f},
+                float4{aabbs[i + 2].min, 0.0f},
+                float4{aabbs[i + 3].min, 0.0f}});
+            const auto maxs = transpose(float4x4{
+                float4{aabbs[i].max, 0.0f},
+                float4{aabbs[i + 1].max, 0.0f},
+                float4{aabbs[i + 2].max, 0.0f},
+                float4{aabbs[i + 3].max, 0.0f}});
+            const float4 center[3] = {
+                (mins[0] + maxs[0]) * 0.5f,
+                (mins[1] + maxs[1]) * 0.5f,
+                (mins[2] + maxs[2]) * 0.5f};
+            const float4 extent[3] = {
+                (maxs[0] - mins[0]) * 0.5f,
+                (maxs[1] - mins[1]) * 0.5f,
+                (maxs[2] - mins[2]) * 0.5f};
+            // rows[r][c] : element (r, c) of the 4 matrices
+            const float4x4 rows[4] = {
+                transpose(float4x4{transforms[i][0], transforms[i + 1][0], transforms[i + 2][0], transforms[i + 3][0]}),
+                transpose(float4x4{transforms[i][1], transforms[i + 1][1], transforms[i + 2][1], transforms[i + 3][1]}),
+                transpose(float4x4{transforms[i][2], transforms[i + 1][2], transforms[i + 2][2], transforms[i + 3][2]}),
+                transpose(float4x4{transforms[i][3], transforms[i + 1][3], transforms[i + 2][3], transforms[i + 3][3]}),
+            };
+            float4 newMin[3];
+            float4 newMax[3];
+            for (auto c = 0; c < 3; c++) {
+                const float4 newCenter =
+                    center[0] * rows[0][c] +
+                    center[1] * rows[1][c] +
+                    center[2] * rows[2][c] +
+                    rows[3][c];
+                const float4 newExtent =
+                    extent[0] * abs(rows[0][c]) +
+                    extent[1] * abs(rows[1][c]) +
+                    extent[2] * abs(rows[2][c]);
+                newMin[c] = newCenter - newExtent;
+                newMax[c] = newCenter + newExtent;
+            }
+            // Back to one box per row
+            const auto resultMins = transpose(float4x4{newMin[0], newMin[1], newMin[2], float4{0.0f}});
+            const auto resultMaxs = transpose(float4x4{newMax[0], newMax[1], newMax[2], float4{0.0f}});
+            for (auto k = 0; k < 4; k++) {
+                results[i + k] = { float3(resultMins[k].xyz), float3(resultMaxs[k].xyz) };
+            }
+        }
+        for (auto i = blocksEnd; i < aabbs.size(); i++) {
+            results[i] = aabbs[i].toGlobal(transforms[i]);
         }
-
-        // Now pack them into our new bounding box
-        return { newVmin, newVmax };
     }
 
 }
\ No newline at end of file
@@ -66,5 +66,18 @@ export namespace lysa {
          * @return The transformed, axis-aligned bounding box.
          */
         AABB toGlobal(const float4x4& transform) const;
+
+        /**
+         * Compute the world-space AABB of a batch of boxes, results[i] = aabbs[i].toGlobal(transforms[i]).
+         * The boxes are transformed 4 at a time in structure-of-arrays SIMD registers.
+         *
+         * @param aabbs Boxes in local/object space.
+         * @param transforms 4x4 row-major transforms (object -> world), one per box.
+         * @param results Transformed, axis-aligned bounding boxes, one per box.
+         */
+        static void toGlobal(
+            std::span<const AABB> aabbs,
+            std::span<const float4x4> transforms,
+            std::span<AABB> results);
     };
 }
\ No newline at end of file
@@ -13,20 +13,23 @@ import lysa.resources.image;
 import lysa.resources.material;
 import lysa.resources.mesh;
 import lysa.resources.render_target;
+import lysa.resources.residency;
 
 namespace lysa {
 
     void AssetsPack::load(Context& ctx, const std::string &fileURI, const Callback& callback) {
         auto stream = ctx.fs.openReadStream(fileURI);
-        return load(ctx, stream, callback);
+        AssetsPack loader;
+        loader.loadScene(ctx, stream, fileURI, callback);
     }
 
     void AssetsPack::load(Context& ctx,  std::ifstream &stream, const Callback& callback) {
         AssetsPack loader;
-        loader.loadScene(ctx, stream, callback);
+        // Without a file URI the images can't be reloaded and will never be evicted from VRAM
+        loader.loadScene(ctx, stream, "", callback);
     }
 
-    void AssetsPack::loadScene(Context& ctx, std::ifstream& stream, const Callback& callback) {
+    void AssetsPack::loadScene(Context& ctx, std::ifstream& stream, const std::string& fileURI, const Callback& callback) {
         auto& imageManager = ctx.res.get<ImageManager>();
         auto& materialManager = ctx.res.get<MaterialManager>();
         auto& meshManager = ctx.res.get<MeshManager>();
@@ -101,33 +104,16 @@ namespace lysa {
             stream.read(reinterpret_cast<std::istream::char_type *>(tracksInfos[animationIndex].data()), sizeof(TrackInfo) * tracksInfos[animationIndex].size());
         }
 
-        // Read the meshes data
-        uint32 count{0};
-        stream.read(reinterpret_cast<std::istream::char_type *>(&count), sizeof(uint32));
-        std::vector<uint32> indices(count);
-        stream.read(reinterpret_cast<std::istream::char_type *>(indices.data()), count * sizeof(uint32));
-
-        stream.read(reinterpret_cast<std::istream::char_type *>(&count), sizeof(uint32));
-        std::vector<float3> positions(count);
-        stream.read(reinterpret_cast<std::istream::char_type *>(positions.data()), count * sizeof(float3));
-
-        stream.read(reinterpret_cast<std::istream::char_type *>(&count), sizeof(uint32));
-        std::vector<float3> normals(count);
-        stream.read(reinterpret_cast<std::istream::char_type *>(normals.data()), count * sizeof(float3));
-
-        stream.read(reinterpret_cast<std::istream::char_type *>(&count), sizeof(uint32));
-        std::vector<float2> uvs(count);
-        stream.read(reinterpret_cast<std::istream::char_type *>(uvs.data()), count * sizeof(float2));
-
-        stream.read(reinterpret_cast<std::istream::char_type *>(&count), sizeof(uint32));
-        std::vector<float4> tangents(count);
-        stream.read(reinterpret_cast<std::istream::char_type *>(tangents.data()), count * sizeof(float4));
-
-        // INFO(std::format("{} indices, {} positions, {} normals, {} uvs, {} tangents",
-            // indices.size(), positions.size(), normals.size(), uvs.size(), tangents.size()));
-        // for(auto& pos : positions) {
-        //     log(to_string(pos));
-        // }
+        // Read the meshes data, the offsets are kept to re-fetch the data of the discarded meshes
+        auto meshData = std::array<std::vector<char>, MESH_DATA_ARRAYS_COUNT>{};
+        auto meshDataOffsets = std::array<uint64, MESH_DATA_ARRAYS_COUNT>{};
+        for (auto array = 0; array < MESH_DATA_ARRAYS_COUNT; ++array) {
+            uint32 count{0};
+            stream.read(reinterpret_cast<std::istream::char_type *>(&count), sizeof(uint32));
+            meshDataOffsets[array] = static_cast<uint64>(stream.tellg());
+            meshData[array].resize(count * MESH_DATA_ELEMENT_SIZE[array]);
+            stream.read(meshData[array].data(), static_cast<std::streamsize>(meshData[array].size()));
+        }
 
         // Read the animations data
         // auto animationPlayers = std::map<uint32, std::shared_ptr<AnimationPlayer>>{};
@@ -178,6 +164,7 @@ namespace lysa {
                 *textureStagingBuffer,
                 *command.commandList,
                 stream,
+                fileURI,
                 imageHeaders,
                 levelHeaders,
                 textureHeaders);
@@ -236,56 +223,31 @@ namespace lysa {
         }
 
         // Create the Mesh, Surface & Vertex objects
+        const auto readMeshData = [&](const MeshDataArray array, const DataInfo& info, void* destination) {
+            const auto elementSize = MESH_DATA_ELEMENT_SIZE[array];
+            std::memcpy(destination, meshData[array].data() + info.first * elementSize, info.count * elementSize);
+        };
         std::vector<unique_id> meshes(header.meshesCount);
+        auto loadedMeshes = std::vector<Mesh*>(header.meshesCount);
         for (auto meshIndex = 0; meshIndex < header.meshesCount; ++meshIndex) {
             auto& header   = meshesHeaders[meshIndex];
             auto& mesh     = meshManager.create(std::string(header.name));
-            auto& meshVertices = mesh.getVertices();
-            auto& meshIndices  = mesh.getIndices();
+            auto texCoords = std::vector<int32>(header.surfacesCount, -1);
+            uint32 firstIndex{0};
             // print(header);
             for (auto surfaceIndex = 0; surfaceIndex < header.surfacesCount; ++surfaceIndex) {
                 auto &info = surfaceInfo.at(meshIndex)[surfaceIndex];
                 // print(info);
-                uint32 firstIndex = meshIndices.size();
-                uint32 firstVertex  = meshVertices.size();
                 auto surface = MeshSurface{firstIndex, info.indices.count};
-                // Load indices
-                meshIndices.reserve(meshIndices.size() + info.indices.count);
-                for(auto i = 0; i < info.indices.count; ++i) {
-                    meshIndices.push_back(indices[info.indices.first + i]);
-                }
-                // Load positions
-                meshVertices.resize(meshVertices.size() + info.positions.count);
-                for(auto i = 0; i < info.positions.count; ++i) {
-                    meshVertices[firstVertex + i] = {
-                        .position = positions[info.positions.first + i],
-                    };
-                }
-                // Load normals
-                for(auto i = 0; i < info.normals.count; ++i) {
-                    meshVertices[firstVertex + i].normal = normals[info.normals.first + i];
-                }
-                // Load tangents
-                for(auto i = 0; i < info.tangents.count; ++i) {
-                    meshVertices[firstVertex + i].tangent = tangents[info.tangents.first + i];
-                }
+                firstIndex += info.indices.count;
                 if (info.materialIndex != -1) {
                     // associate material to surface & mesh
                     const auto& material = materials[info.materialIndex];
                     surface.material = material;
                     materialManager.use(material);
                     mesh.getMaterials().insert(material);
-                    // load UVs
-                    auto texCoord = 0;
-                    if (materialsTexCoords.contains(material)) {
-                        texCoord = materialsTexCoords.at(material);
-                    }
-                    if (!uvsInfos.at(meshIndex)[surfaceIndex].empty()) {
-                        const auto& texCoordInfo = uvsInfos.at(meshIndex)[surfaceIndex][texCoord];
-                        for(auto i = 0; i < texCoordInfo.count; i++) {
-                            meshVertices[firstVertex + i].uv = uvs[texCoordInfo.first + i];
-                        }
-                    }
+                    // UVs used by the material
+                    texCoords[surfaceIndex] = materialsTexCoords.contains(material) ? materialsTexCoords.at(material) : 0;
                 } else {
                     // Mesh have no material, use a default one
                     const auto &material =  materialManager.create();
@@ -293,33 +255,36 @@ namespace lysa {
                     materialManager.use(material.id);
                     mesh.getMaterials().insert(material.id);
                 }
-                // calculate missing tangents
-                if (info.tangents.count == 0) {
-                    for (auto i = 0; i < meshIndices.size(); i += 3) {
-                        auto &vertex1  = meshVertices[meshIndices[i]];
-                        auto &vertex2  = meshVertices[meshIndices[i + 1]];
-                        auto &vertex3  = meshVertices[meshIndices[i + 2]];
-                        float3 edge1    = vertex2.position - vertex1.position;
-                        float3 edge2    = vertex3.position - vertex1.position;
-                        float2 deltaUV1 = vertex2.uv - vertex1.uv;
-                        float2 deltaUV2 = vertex3.uv - vertex1.uv;
-
-                        float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-                        float3  tangent{
-                            f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x),
-                            f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y),
-                            f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z),
-                        };
-                        vertex1.tangent = float4{tangent, 1.0};
-                        vertex2.tangent = float4{tangent, 1.0};
-                        vertex3.tangent = float4{tangent, 1.0};
-                    }
-                }
                 mesh.getSurfaces().push_back(surface);
             }
+            loadMeshData(readMeshData,
+                surfaceInfo[meshIndex],
+                uvsInfos[meshIndex],
+                texCoords,
+                mesh.getVertices(),
+                mesh.getIndices());
             mesh.buildAABB();
+            if (!fileURI.empty()) {
+                mesh.setDataSource(
+                    [&ctx, fileURI, meshDataOffsets, surfaces=surfaceInfo[meshIndex], uvs=uvsInfos[meshIndex], texCoords]
+                    (std::vector<Vertex>& vertices, std::vector<uint32>& indices) {
+                        auto stream = ctx.fs.openReadStream(fileURI);
+                        loadMeshData([&](const MeshDataArray array, const DataInfo& info, void* destination) {
+                            const auto elementSize = MESH_DATA_ELEMENT_SIZE[array];
+                            stream.seekg(static_cast<std::streamoff>(meshDataOffsets[array] + info.first * elementSize));
+                            if (!stream.read(static_cast<char*>(destination), static_cast<std::streamsize>(info.count * elementSize))) {
+                                throw Exception("Assets pack ", fileURI, " : failed to re-fetch mesh data");
+                            }
+                        }, surfaces, uvs, texCoords, vertices, indices);
+                    });
+            }
             meshes[meshIndex] = mesh.id;
+            loadedMeshes[meshIndex] = &mesh;
         }
+        // Generated while loading, in parallel, the meshes being independent : the flush only uploads them
+        std::for_each(std::execution::par, loadedMeshes.begin(), loadedMeshes.end(), [&](Mesh* mesh) {
+            meshManager.generate(*mesh);
+        });
         materialManager.flush();
         meshManager.flush();
         callback(nodeHeaders, meshes, childrenIndexes);
@@ -342,11 +307,15 @@ namespace lysa {
         const vireo::Buffer& stagingBuffer,
         const vireo::CommandList& commandList,
         std::ifstream &stream,
+        const std::string& fileURI,
         const std::vector<ImageHeader>& imageHeaders,
         const std::vector<std::vector<MipLevelInfo>>&levelHeaders,
         const std::vector<TextureHeader>& textureHeaders) const {
         const auto& vireo = ctx.vireo;
+        auto& residencyManager = ctx.res.get<ResidencyManager>();
         std::vector<std::shared_ptr<vireo::Image>> images(header.texturesCount);
+        // Start of the images data bloc in the file
+        const auto imagesDataOffset = static_cast<uint64>(stream.tellg());
 
         // Create images upload buffer
         static constexpr size_t BLOCK_SIZE = 64 * 1024;
@@ -401,12 +370,149 @@ namespace lysa {
                     static_cast<vireo::AddressMode>(texture.samplerAddressModeU),
                     static_cast<vireo::AddressMode>(texture.samplerAddressModeV));
                 auto& lImage = ctx.res.get<ImageManager>().create(image, name);
+                residencyManager.track(ResidencyType::IMAGE, lImage.id, imageHeader.dataSize);
+                if (!fileURI.empty()) {
+                    residencyManager.setReloadCallback(ResidencyType::IMAGE, lImage.id,
+                        [&ctx, fileURI, imageHeader, levels=levelHeaders[texture.imageIndex], imagesDataOffset](const unique_id id) {
+                            reloadImage(ctx, fileURI, imagesDataOffset + imageHeader.dataOffset, imageHeader, levels, id);
+                        });
+                }
                 textures.push_back({lImage.id, samplerIndex});
             }
         }
         return images;
     }
 
+    void AssetsPack::loadMeshData(
+        const MeshDataReader& read,
+        const std::vector<SurfaceInfo>& surfacesInfo,
+        const std::vector<std::vector<DataInfo>>& uvsInfos,
+        const std::vector<int32>& surfacesTexCoords,
+        std::vector<Vertex>& meshVertices,
+        std::vector<uint32>& meshIndices) {
+        auto positions = std::vector<float3>{};
+        auto normals = std::vector<float3>{};
+        auto uvs = std::vector<float2>{};
+        auto tangents = std::vector<float4>{};
+        for (auto surfaceIndex = 0; surfaceIndex < surfacesInfo.size(); ++surfaceIndex) {
+            const auto& info = surfacesInfo[surfaceIndex];
+            const auto firstIndex = meshIndices.size();
+            const auto firstVertex = meshVertices.size();
+            // Load indices
+            meshIndices.resize(firstIndex + info.indices.count);
+            read(INDICES, info.indices, meshIndices.data() + firstIndex);
+            // Load positions
+            positions.resize(info.positions.count);
+            read(POSITIONS, info.positions, positions.data());
+            meshVertices.resize(firstVertex + info.positions.count);
+            for(auto i = 0; i < info.positions.count; ++i) {
+                meshVertices[firstVertex + i] = {
+                    .position = positions[i],
+                };
+            }
+            // Load normals
+            normals.resize(info.normals.count);
+            read(NORMALS, info.normals, normals.data());
+            for(auto i = 0; i < info.normals.count; ++i) {
+                meshVertices[firstVertex + i].normal = normals[i];
+            }
+            // Load tangents
+            tangents.resize(info.tangents.count);
+            read(TANGENTS, info.tangents, tangents.data());
+            for(auto i = 0; i < info.tangents.count; ++i) {
+                meshVertices[firstVertex + i].tangent = tangents[i];
+            }
+            // Load UVs
+            const auto texCoord = surfacesTexCoords[surfaceIndex];
+            if (texCoord != -1 && !uvsInfos[surfaceIndex].empty()) {
+                const auto& texCoordInfo = uvsInfos[surfaceIndex][texCoord];
+                uvs.resize(texCoordInfo.count);
+                read(UVS, texCoordInfo, uvs.data());
+                for(auto i = 0; i < texCoordInfo.count; i++) {
+                    meshVertices[firstVertex + i].uv = uvs[i];
+                }
+            }
+            // calculate missing tangents
+            if (info.tangents.count == 0) {
+                for (auto i = 0; i < meshIndices.size(); i += 3) {
+                    auto &vertex1  = meshVertices[meshIndices[i]];
+                    auto &vertex2  = meshVertices[meshIndices[i + 1]];
+                    auto &vertex3  = meshVertices[meshIndices[i + 2]];
+                    float3 edge1    = vertex2.position - vertex1.position;
+                    float3 edge2    = vertex3.position - vertex1.position;
+                    float2 deltaUV1 = vertex2.uv - vertex1.uv;
+                    float2 deltaUV2 = vertex3.uv - vertex1.uv;
+
+                    float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+                    float3  tangent{
+                        f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x),
+                        f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y),
+                        f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z),
+                    };
+                    vertex1.tangent = float4{tangent, 1.0};
+                    vertex2.tangent = float4{tangent, 1.0};
+                    vertex3.tangent = float4{tangent, 1.0};
+                }
+            }
+        }
+    }
+
+    void AssetsPack::reloadImage(
+        Context& ctx,
+        const std::string& fileURI,
+        const uint64 dataOffset,
+        const ImageHeader& imageHeader,
+        const std::vector<MipLevelInfo>& levelHeaders,
+        const unique_id image) {
+        auto stream = ctx.fs.openReadStream(fileURI);
+        stream.seekg(static_cast<std::streamoff>(dataOffset));
+        auto data = std::vector<char>(imageHeader.dataSize);
+        if (!stream.read(data.data(), static_cast<std::streamsize>(imageHeader.dataSize))) {
+            throw Exception("Assets pack ", fileURI, " : failed to reload image ", imageHeader.name);
+        }
+
+        auto& asyncQueue = ctx.asyncQueue;
+        const auto gpuImage = ctx.vireo->createImage(
+            static_cast<vireo::ImageFormat>(imageHeader.format),
+            imageHeader.width,
+            imageHeader.height,
+            imageHeader.mipLevels,
+            1,
+            imageHeader.name);
+        const auto command = asyncQueue.beginCommand(vireo::CommandType::TRANSFER);
+        const auto stagingBuffer = asyncQueue.createBuffer(
+            command,
+            vireo::BufferType::IMAGE_UPLOAD,
+            imageHeader.dataSize,
+            1);
+        stagingBuffer->map();
+        stagingBuffer->write(data.data(), data.size(), 0);
+        command.commandList->barrier(
+            gpuImage,
+            vireo::ResourceState::UNDEFINED,
+            vireo::ResourceState::COPY_DST,
+            0,
+            imageHeader.mipLevels);
+        auto sourceOffsets = std::vector<size_t>(imageHeader.mipLevels);
+        for (int mipLevel = 0; mipLevel < imageHeader.mipLevels; ++mipLevel) {
+            sourceOffsets[mipLevel] = levelHeaders[mipLevel].offset;
+        }
+        command.commandList->copy(*stagingBuffer, *gpuImage, sourceOffsets);
+        asyncQueue.endCommand(command);
+
+        const auto barriersCommand = asyncQueue.beginCommand(vireo::CommandType::GRAPHIC);
+        barriersCommand.commandList->barrier(
+            gpuImage,
+            vireo::ResourceState::COPY_DST,
+            vireo::ResourceState::SHADER_READ,
+            0,
+            imageHeader.mipLevels);
+        asyncQueue.endCommand(barriersCommand);
+
+        ctx.res.get<ImageManager>().restore(image, gpuImage);
+        ctx.res.get<ResidencyManager>().track(ResidencyType::IMAGE, image, imageHeader.dataSize);
+    }
+
     void AssetsPack::print(const Header& header) {
         std::printf("Version : %d\nImages count : %d\nTextures count : %d\nMaterials count : %d\nMeshes count : %d\nNodes count : %d\nAnimations count : %d\nHeaders size : %llu\n",
             header.version,
@@ -9,6 +9,7 @@ export module lysa.assets_pack;
 import vireo;
 import lysa.context;
 import lysa.math;
+import lysa.resources.mesh;
 import lysa.resources.texture;
 
 export namespace lysa {
@@ -278,7 +279,7 @@ export namespace lysa {
     private:
         Header header{};;
 
-        void loadScene(Context& ctx, std::ifstream& stream, const Callback& callback);
+        void loadScene(Context& ctx, std::ifstream& stream, const std::string& fileURI, const Callback& callback);
 
         std::vector<std::shared_ptr<vireo::Image>> loadImagesAndTextures(
             Context& ctx,
@@ -286,9 +287,55 @@ export namespace lysa {
             const vireo::Buffer& stagingBuffer,
             const vireo::CommandList& commandList,
             std::ifstream& stream,
+            const std::string& fileURI,
             const std::vector<ImageHeader>&,
             const std::vector<std::vector<MipLevelInfo>>&,
             const std::vector<TextureHeader>&) const;
+
+        /*
+         * Reload an image evicted from VRAM, used as the ResidencyManager reload callback
+         */
+        static void reloadImage(
+            Context& ctx,
+            const std::string& fileURI,
+            uint64 dataOffset,
+            const ImageHeader& imageHeader,
+            const std::vector<MipLevelInfo>& levelHeaders,
+            unique_id image);
+
+        /*
+         * Meshes data arrays, in file order
+         */
+        enum MeshDataArray : uint32 {
+            INDICES   = 0,
+            POSITIONS = 1,
+            NORMALS   = 2,
+            UVS       = 3,
+            TANGENTS  = 4,
+            MESH_DATA_ARRAYS_COUNT
+        };
+
+        static constexpr size_t MESH_DATA_ELEMENT_SIZE[MESH_DATA_ARRAYS_COUNT] {
+            sizeof(uint32), sizeof(float3), sizeof(float3), sizeof(float2), sizeof(float4)
+        };
+
+        /*
+         * Copies the elements described by a DataInfo of a meshes data array into a destination buffer
+         */
+        using MeshDataReader = std::function<void(MeshDataArray array, const DataInfo& info, void* destination)>;
+
+        /*
+         * Builds the vertices & indices of a mesh from the meshes data arrays, used for the loading
+         * and as the source of the meshes whose CPU data have been discarded
+         * @param surfacesTexCoords Index of the UVs array of each surface, -1 for no UVs
+         */
+        static void loadMeshData(
+            const MeshDataReader& read,
+            const std::vector<SurfaceInfo>& surfacesInfo,
+            const std::vector<std::vector<DataInfo>>& uvsInfos,
+            const std::vector<int32>& surfacesTexCoords,
+            std::vector<Vertex>& vertices,
+            std::vector<uint32>& indices);
     };
 
 }
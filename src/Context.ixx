@@ -35,6 +35,10 @@ export namespace  lysa {
         size_t vertices{surfaces * 1000};
         //! Maximum number of meshes indices in GPU memory
         size_t indices{vertices * 10};
+        //! Maximum number of meshes surfaces clusters in GPU memory
+        size_t clusters{indices / 300};
+        //! GPU memory budget in bytes for the meshes & images, unused resources are evicted when over budget. 0 to disable
+        size_t vramBudget{0};
     };
 
     /**
@@ -47,8 +51,10 @@ export namespace  lysa {
         double deltaTime{1.0/60.0};
         //! Number of simultaneous frames during rendering for ALL render targets and scenes
         uint32 framesInFlight{2};
-        //! Maximum number of shadow maps per scene
-        uint32 maxShadowMapsPerScene{20};
+        //! Maximum number of lights casting shadows per scene
+        uint32 maxShadowMapsPerScene{64};
+        //! Width and height of the shadow maps atlas of each scene frame, a power of two
+        uint32 shadowMapAtlasSize{4096};
         //! Enable shadowed colors for transparency objects
         // bool shadowTransparencyColorEnabled{true};
         //! Resource capacity configuration
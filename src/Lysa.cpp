@@ -13,13 +13,16 @@ namespace lysa {
     Lysa::Lysa(const ContextConfiguration& config) :
         ctx(config),
         fixedDeltaTime(config.deltaTime),
+        residencyManager(ctx, config.resourcesCapacity.vramBudget),
+        pipelineRegistry(ctx),
         imageManager(ctx, config.resourcesCapacity.images),
         materialManager(ctx, config.resourcesCapacity.material),
         meshManager(ctx,
                     config.resourcesCapacity.meshes,
                     config.resourcesCapacity.vertices,
                     config.resourcesCapacity.indices,
-                    config.resourcesCapacity.surfaces),
+                    config.resourcesCapacity.surfaces,
+                    config.resourcesCapacity.clusters),
         globalDescriptors(ctx)
     {
         ctx.globalDescriptorLayout = globalDescriptors.getDescriptorLayout();
@@ -32,6 +35,11 @@ namespace lysa {
         SceneFrameData::destroyDescriptorLayouts();
         Renderpass::destroyShaderModules();
         FrustumCulling::cleanup();
+        LightClustering::cleanup();
+        ShadowMapAtlas::cleanup();
+        OcclusionCulling::cleanup();
+        DepthPyramid::cleanup();
+        DrawCommandsCompaction::cleanup();
     }
 
     void Lysa::uploadData() {
@@ -45,6 +53,7 @@ namespace lysa {
 
     void Lysa::run() {
         while (!ctx.exit) {
+            residencyManager.update();
             uploadData();
             ctx.defer._process();
             ctx.threads._process();
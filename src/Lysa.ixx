@@ -31,11 +31,18 @@ export import lysa.renderers.deferred_renderer;
 export import lysa.renderers.forward_renderer;
 export import lysa.renderers.global_descriptor_set;
 export import lysa.renderers.graphic_pipeline_data;
+export import lysa.renderers.pipelines_array;
 export import lysa.renderers.renderer;
 export import lysa.renderers.scene_frame_data;
+export import lysa.renderers.scene_instances_data;
+export import lysa.renderers.shadow_map_atlas;
 export import lysa.renderers.vector_2d;
 export import lysa.renderers.vector_3d;
+export import lysa.renderers.pipelines.depth_pyramid;
+export import lysa.renderers.pipelines.draw_commands_compaction;
 export import lysa.renderers.pipelines.frustum_culling;
+export import lysa.renderers.pipelines.light_clustering;
+export import lysa.renderers.pipelines.occlusion_culling;
 export import lysa.renderers.renderpasses.bloom_pass;
 export import lysa.renderers.renderpasses.depth_prepass;
 export import lysa.renderers.renderpasses.display_attachment;
@@ -60,13 +67,17 @@ export import lysa.resources.manager;
 export import lysa.resources.material;
 export import lysa.resources.mesh;
 export import lysa.resources.mesh_instance;
+export import lysa.resources.pipeline_registry;
 export import lysa.resources.registry;
+export import lysa.resources.residency;
 export import lysa.resources.render_target;
 export import lysa.resources.render_view;
 export import lysa.resources.rendering_window;
 export import lysa.resources.samplers;
 export import lysa.resources.scene;
+export import lysa.resources.spatial_index;
 export import lysa.resources.texture;
+export import lysa.resources.transform_hierarchy;
 
 #ifdef LUA_BINDING
 export import lysa.lua;
@@ -118,6 +129,8 @@ export namespace  lysa {
         double currentTime{0.0};
         double accumulator{0.0};
 
+        ResidencyManager residencyManager;
+        PipelineRegistry pipelineRegistry;
         ImageManager imageManager;
         MaterialManager materialManager;
         MeshManager meshManager;
@@ -32,6 +32,13 @@ namespace lysa {
     }
 
     MemoryBlock MemoryArray::alloc(const size_t instanceCount) {
+        if (const auto bloc = tryAlloc(instanceCount)) {
+            return *bloc;
+        }
+        throw Exception{"Out of memory for array " + name};
+    }
+
+    std::optional<MemoryBlock> MemoryArray::tryAlloc(const size_t instanceCount) {
         auto lock = std::lock_guard{mutex};
         const auto size = instanceSize * instanceCount;
         for (MemoryBlock& bloc : freeBlocs) {
@@ -49,7 +56,13 @@ namespace lysa {
                 return result;
             }
         }
-        throw Exception{"Out of memory for array " + name};
+        return std::nullopt;
+    }
+
+    bool MemoryArray::canAlloc(const size_t instanceCount) {
+        auto lock = std::lock_guard{mutex};
+        const auto size = instanceSize * instanceCount;
+        return std::ranges::any_of(freeBlocs, [&](const MemoryBlock& bloc) { return bloc.size >= size; });
     }
 
     void MemoryArray::free(const MemoryBlock& bloc) {
@@ -68,47 +81,70 @@ namespace lysa {
         const size_t instanceCount,
         const size_t stagingInstanceCount,
         const vireo::BufferType bufferType,
-        const std::string& name) :
-        MemoryArray{vireo, instanceSize, instanceCount, bufferType, name},
-        stagingBuffer{vireo->createBuffer(vireo::BufferType::BUFFER_UPLOAD, instanceSize * stagingInstanceCount, 1, "Staging " + name)} {
+        const std::string& name,
+        const uint32 stagingBuffersCount) :
+        MemoryArray{vireo, instanceSize, instanceCount, bufferType, name} {
         assert([&]{ return bufferType == vireo::BufferType::VERTEX ||
             bufferType == vireo::BufferType::INDEX ||
             bufferType == vireo::BufferType::INDIRECT ||
             bufferType == vireo::BufferType::DEVICE_STORAGE ||
             bufferType == vireo::BufferType::READWRITE_STORAGE;}, "Invalid buffer type for device memory array");
-        stagingBuffer->map();
+        assert([&]{ return stagingBuffersCount > 0; }, "At least one staging buffer is needed");
+        stagingBuffers.resize(stagingBuffersCount);
+        for (auto& stagingBuffer : stagingBuffers) {
+            stagingBuffer = vireo->createBuffer(vireo::BufferType::BUFFER_UPLOAD, instanceSize * stagingInstanceCount, 1, "Staging " + name);
+            stagingBuffer->map();
+        }
     }
 
     void DeviceMemoryArray::write(const MemoryBlock& destination, const void* source) {
         assert([&]{ return destination.size != 0; }, "Write size must be > 0");
         auto lock = std::lock_guard{mutex};
-        stagingBuffer->write(source, destination.size, stagingBufferCurrentOffset);
-        pendingWrites.push_back({
-            stagingBufferCurrentOffset,
-            destination.offset,
-            destination.size,
-        });
+        stagingBuffers[currentStagingBuffer]->write(source, destination.size, stagingBufferCurrentOffset);
+        // Contiguous writes are merged into one copy region
+        if (!pendingWrites.empty() &&
+            pendingWrites.back().srcOffset + pendingWrites.back().size == stagingBufferCurrentOffset &&
+            pendingWrites.back().dstOffset + pendingWrites.back().size == destination.offset) {
+            pendingWrites.back().size += destination.size;
+        } else {
+            pendingWrites.push_back({
+                stagingBufferCurrentOffset,
+                destination.offset,
+                destination.size,
+            });
+        }
         stagingBufferCurrentOffset += destination.size;
     }
 
     void DeviceMemoryArray::flush(const vireo::CommandList& commandList) {
         auto lock = std::lock_guard{mutex};
         if (!pendingWrites.empty()) {
-            commandList.copy(stagingBuffer, buffer, pendingWrites);
+            if (shaderReadState) {
+                commandList.barrier(
+                   *buffer,
+                   vireo::ResourceState::SHADER_READ,
+                   vireo::ResourceState::COPY_DST);
+                shaderReadState = false;
+            }
+            commandList.copy(stagingBuffers[currentStagingBuffer], buffer, pendingWrites);
             pendingWrites.clear();
             stagingBufferCurrentOffset = 0;
+            // The next writes go to the next staging buffer, the current one is in use until the copy is done
+            currentStagingBuffer = (currentStagingBuffer + 1) % stagingBuffers.size();
         }
     }
 
-    void DeviceMemoryArray::postBarrier(const vireo::CommandList& commandList) const {
+    void DeviceMemoryArray::postBarrier(const vireo::CommandList& commandList) {
+        if (shaderReadState) { return; }
         commandList.barrier(
            *buffer,
            vireo::ResourceState::COPY_DST,
            vireo::ResourceState::SHADER_READ);
+        shaderReadState = true;
     }
 
     DeviceMemoryArray::~DeviceMemoryArray() {
-        stagingBuffer.reset();
+        stagingBuffers.clear();
     }
 
     HostVisibleMemoryArray::HostVisibleMemoryArray(
@@ -36,6 +36,19 @@ export namespace lysa {
          */
         MemoryBlock alloc(size_t instanceCount);
 
+        /**
+         * Allocate a new GPU memory block without throwing when the array is full
+         * @param instanceCount Number of resources instances stored in this memory block
+         * @return The memory block, or std::nullopt if no free block is large enough
+         */
+        std::optional<MemoryBlock> tryAlloc(size_t instanceCount);
+
+        /**
+         * Checks if a memory block can be allocated
+         * @param instanceCount Number of resources instances stored in this memory block
+         */
+        bool canAlloc(size_t instanceCount);
+
         /**
          * Free a previously allocated GPU memory block
          * @param bloc Allocated memory block
@@ -93,6 +106,8 @@ export namespace lysa {
          * @param instanceCount Maximum number of resources stored in the array
          * @param stagingInstanceCount Maximum number of temporary resources used for staging temporary data before transfer
          * @param name Name of the GPU buffer for GPU-side debug
+         * @param stagingBuffersCount Number of staging buffers used in turn by the flushes, set it to the number
+         * of frames in flight when the array is flushed once per frame and shared by the frames in flight
          */
         DeviceMemoryArray(
             const std::shared_ptr<vireo::Vireo>& vireo,
@@ -100,26 +115,30 @@ export namespace lysa {
             size_t instanceCount,
             size_t stagingInstanceCount,
             vireo::BufferType,
-            const std::string& name);
+            const std::string& name,
+            uint32 stagingBuffersCount = 1);
 
         void write(const MemoryBlock& destination, const void* source) override;
 
         /**
-         * Transfer pending writes from the staging buffer into the array
+         * Transfer pending writes from the staging buffer into the array.
+         * If the GPU buffer has been put in SHADER_READ state by postBarrier(), it is put back in COPY_DST state first.
          */
         void flush(const vireo::CommandList& commandList);
 
         /**
-         * Put the GPU buffer in SHADER_READ state
+         * Put the GPU buffer in SHADER_READ state, does nothing if nothing has been transferred since the last call
          */
-        void postBarrier(const vireo::CommandList& commandList) const;
+        void postBarrier(const vireo::CommandList& commandList);
 
         ~DeviceMemoryArray() override;
 
     private:
-        std::shared_ptr<vireo::Buffer> stagingBuffer;
+        std::vector<std::shared_ptr<vireo::Buffer>> stagingBuffers;
+        uint32 currentStagingBuffer{0};
         size_t stagingBufferCurrentOffset{0};
         std::vector<vireo::BufferCopyRegion> pendingWrites;
+        bool shaderReadState{false};
     };
 
     /**
@@ -884,7 +884,7 @@ end
         .beginClass<AABB>("AABB")
             .addProperty("min", &AABB::min)
             .addProperty("max", &AABB::max)
-            .addFunction("to_global", &AABB::toGlobal)
+            .addFunction("to_global", luabridge::constOverload<const float4x4&>(&AABB::toGlobal))
         .endClass()
 
         .beginClass<Vertex>("Vertex")
@@ -932,6 +932,8 @@ end
             .addProperty("mesh", &MeshInstance::getMesh)
             .addProperty("visible", &MeshInstance::isVisible, &MeshInstance::setVisible)
             .addProperty("cast_shadow", &MeshInstance::isCastShadows, &MeshInstance::setCastShadow)
+            .addProperty("min_screen_size_scale", &MeshInstance::getMinScreenSizeScale, &MeshInstance::setMinScreenSizeScale)
+            .addProperty("static", &MeshInstance::isStatic, &MeshInstance::setStatic)
             .addProperty("aabb", &MeshInstance::getAABB, &MeshInstance::setAABB)
             .addProperty("transform", &MeshInstance::getTransform, &MeshInstance::setTransform)
             .addFunction("get_surface_material", &MeshInstance::getSurfaceMaterial)
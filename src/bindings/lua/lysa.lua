@@ -762,6 +762,7 @@ return {
     ---@field aabb lysa.AABB
     ---@field visible boolean
     ---@field cast_shadow boolean
+    ---@field static boolean
     ---@field transform lysa.float4x4
     ---@field get_surface_material fun(self:lysa.Mesh, surfaceIndex:integer):lysa.Material|nil
     ---@field set_surface_material_override fun(self:lysa.Mesh, surfaceIndex:integer, id:integer):lysa.Material|nil
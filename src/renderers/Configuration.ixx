@@ -66,6 +66,26 @@ export namespace lysa {
         uint32             bloomBlurKernelSize{5};
         //! Bloom effect blur strength
         float              bloomBlurStrength{1.2f};
+        //! Enable the two-phase occlusion culling of the opaque models against a depth pyramid
+        bool               occlusionCullingEnabled{false};
+        //! Read back the culling counters for diagnostics, a few frames late
+        bool               cullingStatisticsEnabled{false};
+        //! Maximum projected error of the mesh detail levels, in fraction of the screen height, 0 to always draw the full meshes
+        float              lodThreshold{0.001f};
+        //! Relative error margin before switching back to a finer mesh detail level
+        float              lodHysteresis{0.25f};
+        //! Draw the opaque models from the nearest to the farthest, using the distances of a few frames before
+        bool               frontToBackSortingEnabled{true};
+        //! Minimum projected size of the models drawn by the camera, in fraction of the screen height, 0 to draw them all
+        float              minScreenSize{0.001f};
+        //! Minimum projected size of the models drawn in the shadow maps, in fraction of the shadow map height, 0 to draw them all
+        float              shadowMinScreenSize{0.004f};
+        //! Cache the depth of the static mesh instances in the shadow maps, only the dynamic ones are drawn each frame
+        bool               shadowStaticCacheEnabled{true};
+        //! The cascades of the directional lights after the first are rendered every N frames, one by one, 1 to render them all each frame
+        uint32             shadowCascadesUpdateInterval{2};
+        //! Render the six faces of the omni lights shadow maps in a single pass, culled once
+        bool               shadowCubeMapSinglePassEnabled{true};
 #ifdef DEFERRED_RENDERER
         //! Enable SSAO in the deferred renderer
         bool               ssaoEnabled{true};
@@ -7,6 +7,7 @@
 module lysa.renderers.graphic_pipeline_data;
 
 import vireo;
+import lysa.exception;
 import lysa.log;
 
 namespace lysa {
@@ -14,6 +15,7 @@ namespace lysa {
     void GraphicPipelineData::createDescriptorLayouts(const std::shared_ptr<vireo::Vireo>& vireo) {
         pipelineDescriptorLayout = vireo->createDescriptorLayout("Pipeline data");
         pipelineDescriptorLayout->add(BINDING_INSTANCES, vireo::DescriptorType::DEVICE_STORAGE);
+        pipelineDescriptorLayout->add(BINDING_INSTANCES_INDICES, vireo::DescriptorType::DEVICE_STORAGE);
         pipelineDescriptorLayout->build();
     }
 
@@ -24,10 +26,10 @@ namespace lysa {
     GraphicPipelineData::GraphicPipelineData(
         const Context& ctx,
         const uint32 pipelineId,
-        const DeviceMemoryArray& meshInstancesDataArray,
+        const uint32 index,
         const uint32 maxMeshSurfacePerPipeline) :
         pipelineId{pipelineId},
-        frustumCullingPipeline{ctx, true, meshInstancesDataArray, pipelineId},
+        index{index},
         materialManager(ctx.res.get<MaterialManager>()),
         vireo(ctx.vireo),
         instancesArray{
@@ -36,26 +38,55 @@ namespace lysa {
             maxMeshSurfacePerPipeline,
             maxMeshSurfacePerPipeline,
             vireo::BufferType::DEVICE_STORAGE,
-            "instance:" + std::to_string(pipelineId)},
-        drawCommands(maxMeshSurfacePerPipeline),
+            "instance:" + std::to_string(pipelineId),
+            ctx.config.framesInFlight},
+        maxDrawCommands{maxMeshSurfacePerPipeline},
         drawCommandsBuffer{ctx.vireo->createBuffer(
             vireo::BufferType::DEVICE_STORAGE,
             sizeof(DrawCommand) * maxMeshSurfacePerPipeline,
             1,
             "drawCommand:" + std::to_string(pipelineId))},
-        culledDrawCommandsCountBuffer{ctx.vireo->createBuffer(
-            vireo::BufferType::READWRITE_STORAGE,
-            sizeof(uint32),
+        drawGroupsBuffer{ctx.vireo->createBuffer(
+            vireo::BufferType::DEVICE_STORAGE,
+            sizeof(uint32) * maxMeshSurfacePerPipeline,
             1,
-            "culledDrawCommandsCount:" + std::to_string(pipelineId))},
+            "drawGroups:" + std::to_string(pipelineId))},
+        drawCommandsStagingBuffers(ctx.config.framesInFlight) {
+    }
+
+    GraphicPipelineFrameData::GraphicPipelineFrameData(
+        const Context& ctx,
+        const uint32 pipelineId,
+        const DeviceMemoryArray& meshInstancesDataArray,
+        const uint32 maxMeshSurfacePerPipeline) :
+        occlusionCullingPipeline{ctx, meshInstancesDataArray, pipelineId},
         culledDrawCommandsBuffer{ctx.vireo->createBuffer(
             vireo::BufferType::READWRITE_STORAGE,
-            sizeof(DrawCommand) * maxMeshSurfacePerPipeline,
+            sizeof(DrawCommand) * maxMeshSurfacePerPipeline * MESH_LODS_MAX,
             1,
-            "culledDrawCommands:" + std::to_string(pipelineId))}
-    {
-        descriptorSet = ctx.vireo->createDescriptorSet(pipelineDescriptorLayout, "Graphic : " + std::to_string(pipelineId));
-        descriptorSet->update(BINDING_INSTANCES, instancesArray.getBuffer());
+            "culledDrawCommands:" + std::to_string(pipelineId))},
+        disoccludedDrawCommandsBuffer{ctx.vireo->createBuffer(
+            vireo::BufferType::READWRITE_STORAGE,
+            sizeof(DrawCommand) * maxMeshSurfacePerPipeline * MESH_LODS_MAX,
+            1,
+            "disoccludedDrawCommands:" + std::to_string(pipelineId))},
+        culledCompaction{ctx, "culled:" + std::to_string(pipelineId)},
+        disoccludedCompaction{ctx, "disoccluded:" + std::to_string(pipelineId)},
+        compactedCulledDrawCommandsBuffer{ctx.vireo->createBuffer(
+            vireo::BufferType::READWRITE_STORAGE,
+            sizeof(DrawCommand) * maxMeshSurfacePerPipeline * MESH_LODS_MAX,
+            1,
+            "compactedCulledDrawCommands:" + std::to_string(pipelineId))},
+        compactedDisoccludedDrawCommandsBuffer{ctx.vireo->createBuffer(
+            vireo::BufferType::READWRITE_STORAGE,
+            sizeof(DrawCommand) * maxMeshSurfacePerPipeline * MESH_LODS_MAX,
+            1,
+            "compactedDisoccludedDrawCommands:" + std::to_string(pipelineId))},
+        drawCountsBuffer{ctx.vireo->createBuffer(
+            vireo::BufferType::READWRITE_STORAGE,
+            sizeof(uint32),
+            2,
+            "drawCounts:" + std::to_string(pipelineId))} {
     }
 
     void GraphicPipelineData::addInstance(
@@ -73,12 +104,17 @@ namespace lysa {
         const MemoryBlock& meshInstanceMemoryBlock) {
         const auto& mesh = meshInstance->getMesh();
         auto instancesData = std::vector<InstanceData>{};
+        auto& slots = instancesDrawCommands[meshInstance];
         for (uint32 i = 0; i < mesh.getSurfaces().size(); i++) {
             const auto& surface = mesh.getSurfaces()[i];
             const auto& material = materialManager[meshInstance->getSurfaceMaterial(i)];
             if (material.getPipelineId() == pipelineId) {
+                if (drawCommandsCount >= maxDrawCommands) {
+                    throw Exception("Too many draw commands for pipeline ", pipelineId);
+                }
                 const uint32 id = instanceMemoryBlock.instanceIndex + instancesData.size();
-                drawCommands[drawCommandsCount] = {
+                const auto groupIndex = getDrawGroup(mesh.getSurfacesIndex() + i, material.getIndex());
+                drawCommands.push_back({
                     .instanceIndex = id,
                     .command = {
                         .indexCount = surface.indexCount,
@@ -86,8 +122,25 @@ namespace lysa {
                         .firstIndex = mesh.getIndicesIndex() + surface.firstIndex,
                         .vertexOffset = static_cast<int32>(mesh.getVerticesIndex()),
                         .firstInstance = id,
-                    }
-                };
+                    },
+                    .meshInstanceIndex = meshInstanceMemoryBlock.instanceIndex,
+                    .groupIndex = groupIndex,
+                    .meshSurfaceIndex = mesh.getSurfacesIndex() + i,
+                    // The shader materials pipelines use the cull mode of any of their materials
+                    .backFacesCulled = material.getType() == Material::STANDARD &&
+                                       material.getCullMode() == vireo::CullMode::BACK ? 1u : 0u,
+                });
+                const auto clustersCount = static_cast<uint32>(surface.clusters.size());
+                drawCommandsClustersCounts.push_back(clustersCount);
+                if (clustersCount > 0) {
+                    clusteredDrawCommandsCount++;
+                    drawClustersCount += clustersCount;
+                }
+                drawGroupsSizes[groupIndex]++;
+                drawGroupsUpdated = true;
+                drawCommandsOwners.push_back({meshInstance, static_cast<uint32>(slots.size())});
+                slots.push_back(drawCommandsCount);
+                dirtyDrawCommands.push_back(drawCommandsCount);
                 instancesData.push_back(InstanceData {
                     .meshInstanceIndex = meshInstanceMemoryBlock.instanceIndex,
                     .meshSurfaceIndex = mesh.getSurfacesIndex() + i,
@@ -104,56 +157,158 @@ namespace lysa {
     }
 
     void GraphicPipelineData::removeInstance(const MeshInstance* meshInstance) {
-        if (instancesMemoryBlocks.contains(meshInstance)) {
-            instancesToRemove.insert(meshInstance);
+        const auto it = instancesMemoryBlocks.find(meshInstance);
+        if (it == instancesMemoryBlocks.end()) { return; }
+        instancesArray.free(it->second);
+        instancesMemoryBlocks.erase(it);
+        const auto slotsIt = instancesDrawCommands.find(meshInstance);
+        if (slotsIt == instancesDrawCommands.end()) { return; }
+        // Remove the highest slots first so a slot moved by a swap is never one of the removed slots
+        auto slots = std::move(slotsIt->second);
+        instancesDrawCommands.erase(slotsIt);
+        std::ranges::sort(slots, std::greater{});
+        for (const auto slot : slots) {
+            const auto groupIndex = drawCommands[slot].groupIndex;
+            if (--drawGroupsSizes[groupIndex] == 0) {
+                drawGroupsIndices.erase(drawGroupsKeys[groupIndex]);
+                freeDrawGroups.push_back(groupIndex);
+            }
+            drawGroupsUpdated = true;
+            if (const auto clustersCount = drawCommandsClustersCounts[slot]; clustersCount > 0) {
+                clusteredDrawCommandsCount--;
+                drawClustersCount -= clustersCount;
+            }
+            const auto last = drawCommandsCount - 1;
+            if (slot != last) {
+                drawCommands[slot] = drawCommands[last];
+                drawCommandsOwners[slot] = drawCommandsOwners[last];
+                drawCommandsClustersCounts[slot] = drawCommandsClustersCounts[last];
+                const auto& [owner, ownerSlot] = drawCommandsOwners[slot];
+                instancesDrawCommands[owner][ownerSlot] = slot;
+                dirtyDrawCommands.push_back(slot);
+            }
+            drawCommands.pop_back();
+            drawCommandsOwners.pop_back();
+            drawCommandsClustersCounts.pop_back();
+            drawCommandsCount--;
         }
+        instancesUpdated = true;
     }
 
-    void GraphicPipelineData::updateData(
-        const vireo::CommandList& commandList,
-        std::unordered_set<std::shared_ptr<vireo::Buffer>>& drawCommandsStagingBufferRecycleBin,
-        const std::unordered_map<const MeshInstance*, MemoryBlock>& meshInstancesDataMemoryBlocks) {
-        if (!instancesToRemove.empty()) {
-            for (const auto* meshInstance : instancesToRemove) {
-                instancesToRemove.insert(meshInstance);
-                instancesArray.free(instancesMemoryBlocks.at(meshInstance));
-                instancesMemoryBlocks.erase(meshInstance);
-                drawCommandsCount = 0;
-            }
-            instancesToRemove.clear();
-            for (const auto& instance : std::views::keys(instancesMemoryBlocks)) {
-                addInstance(
-                    instance,
-                    instancesMemoryBlocks.at(instance),
-                    meshInstancesDataMemoryBlocks.at(instance));
-            }
+    uint32 GraphicPipelineData::getDrawGroup(const uint32 meshSurfaceIndex, const uint32 materialIndex) {
+        const auto key = std::pair{meshSurfaceIndex, materialIndex};
+        const auto it = drawGroupsIndices.find(key);
+        if (it != drawGroupsIndices.end()) {
+            return it->second;
+        }
+        drawGroupsUpdated = true;
+        auto groupIndex = drawGroupsCount;
+        if (freeDrawGroups.empty()) {
+            drawGroupsCount++;
+            drawGroupsSizes.push_back(0);
+            drawGroupsKeys.push_back(key);
+        } else {
+            groupIndex = freeDrawGroups.back();
+            freeDrawGroups.pop_back();
+            drawGroupsKeys[groupIndex] = key;
         }
+        drawGroupsIndices[key] = groupIndex;
+        return groupIndex;
+    }
+
+    void GraphicPipelineData::updateData(const vireo::CommandList& commandList) {
         if (instancesUpdated) {
             instancesArray.flush(commandList);
             instancesArray.postBarrier(commandList);
-            if (drawCommandsStagingBufferCount < drawCommandsCount) {
-                if (drawCommandsStagingBuffer) {
-                    drawCommandsStagingBufferRecycleBin.insert(drawCommandsStagingBuffer);
+
+            // Coalesce the modified slots still in use into contiguous ranges
+            std::ranges::sort(dirtyDrawCommands);
+            const auto [first, last] = std::ranges::unique(dirtyDrawCommands);
+            dirtyDrawCommands.erase(first, last);
+            std::erase_if(dirtyDrawCommands, [&](const uint32 slot) { return slot >= drawCommandsCount; });
+
+            // The staging buffer of this upload was last used framesInFlight uploads ago and is free again
+            auto& staging = drawCommandsStagingBuffers[currentDrawCommandsStagingBuffer];
+            if (!dirtyDrawCommands.empty() || drawGroupsUpdated) {
+                currentDrawCommandsStagingBuffer = (currentDrawCommandsStagingBuffer + 1) % drawCommandsStagingBuffers.size();
+            }
+
+            if (drawGroupsUpdated) {
+                // Position of the instances of each group in its instances indices range
+                drawGroups.resize(drawGroupsCount);
+                auto position = uint32{0};
+                for (auto i = 0; i < drawGroupsCount; i++) {
+                    drawGroups[i] = position;
+                    position += drawGroupsSizes[i];
                 }
-                drawCommandsStagingBuffer = vireo->createBuffer(
-                    vireo::BufferType::BUFFER_UPLOAD,
-                    sizeof(DrawCommand) * drawCommandsCount);
-                drawCommandsStagingBufferCount = drawCommandsCount;
-                drawCommandsStagingBuffer->map();
+                if (!staging.groupsBuffer) {
+                    staging.groupsBuffer = vireo->createBuffer(
+                        vireo::BufferType::BUFFER_UPLOAD,
+                        sizeof(uint32) * maxDrawCommands);
+                    staging.groupsBuffer->map();
+                }
+                staging.groupsBuffer->write(drawGroups.data(), sizeof(uint32) * drawGroupsCount);
+                if (drawGroupsCount > 0) {
+                    commandList.barrier(
+                        *drawGroupsBuffer,
+                        drawGroupsUploaded ? vireo::ResourceState::COMPUTE_READ : vireo::ResourceState::COPY_DST,
+                        vireo::ResourceState::COPY_DST);
+                    commandList.copy(staging.groupsBuffer, drawGroupsBuffer, {{0, 0, sizeof(uint32) * drawGroupsCount}});
+                    commandList.barrier(
+                        *drawGroupsBuffer,
+                        vireo::ResourceState::COPY_DST,
+                        vireo::ResourceState::COMPUTE_READ);
+                    drawGroupsUploaded = true;
+                    drawCommandsVersion++;
+                }
+                drawGroupsUpdated = false;
             }
 
-            drawCommandsStagingBuffer->write(drawCommands.data(),
-                sizeof(DrawCommand) * drawCommandsCount);
-            commandList.copy(drawCommandsStagingBuffer, drawCommandsBuffer, sizeof(DrawCommand) * drawCommandsCount);
+            if (!dirtyDrawCommands.empty()) {
+                if (staging.count < dirtyDrawCommands.size()) {
+                    staging.count = std::max(
+                        static_cast<uint32>(dirtyDrawCommands.size()),
+                        std::min(std::max(staging.count * 2, 64u), maxDrawCommands));
+                    staging.buffer = vireo->createBuffer(
+                        vireo::BufferType::BUFFER_UPLOAD,
+                        sizeof(DrawCommand) * staging.count);
+                    staging.buffer->map();
+                }
+
+                auto regions = std::vector<vireo::BufferCopyRegion>{};
+                auto stagingOffset = size_t{0};
+                for (auto i = 0; i < dirtyDrawCommands.size();) {
+                    const auto rangeStart = dirtyDrawCommands[i];
+                    auto rangeEnd = rangeStart + 1;
+                    while (++i < dirtyDrawCommands.size() && dirtyDrawCommands[i] == rangeEnd) {
+                        rangeEnd++;
+                    }
+                    const auto size = sizeof(DrawCommand) * (rangeEnd - rangeStart);
+                    staging.buffer->write(&drawCommands[rangeStart], size, stagingOffset);
+                    regions.push_back({
+                        stagingOffset,
+                        sizeof(DrawCommand) * rangeStart,
+                        size,
+                    });
+                    stagingOffset += size;
+                }
+                dirtyDrawCommands.clear();
+                // The buffer is shared with the previous frames, wait for their culling passes
+                if (drawCommandsUploaded) {
+                    commandList.barrier(
+                        *drawCommandsBuffer,
+                        vireo::ResourceState::INDIRECT_DRAW,
+                        vireo::ResourceState::COPY_DST);
+                }
+                commandList.copy(staging.buffer, drawCommandsBuffer, regions);
+                commandList.barrier(
+                    *drawCommandsBuffer,
+                    vireo::ResourceState::COPY_DST,
+                    vireo::ResourceState::INDIRECT_DRAW);
+                drawCommandsUploaded = true;
+                drawCommandsVersion++;
+            }
             instancesUpdated = false;
-            commandList.barrier(
-                *drawCommandsBuffer,
-                vireo::ResourceState::COPY_DST,
-                vireo::ResourceState::INDIRECT_DRAW);
-            commandList.barrier(
-                *culledDrawCommandsBuffer,
-                vireo::ResourceState::COPY_DST,
-                vireo::ResourceState::INDIRECT_DRAW);
         }
     }
 
@@ -16,7 +16,8 @@ import lysa.resources.material;
 import lysa.resources.mesh;
 import lysa.resources.mesh_instance;
 import lysa.renderers.configuration;
-import lysa.renderers.pipelines.frustum_culling;
+import lysa.renderers.pipelines.draw_commands_compaction;
+import lysa.renderers.pipelines.occlusion_culling;
 
 export namespace lysa {
 
@@ -41,6 +42,10 @@ export namespace lysa {
         uint32      bloomEnabled{0};
         /** event.Toggle for SSAO post-process (1 enabled, 0 disabled). */
         uint32      ssaoEnabled{0};
+        /** event.Scale of the logarithm of the view depth giving the light cluster depth slice. */
+        float       lightsClustersSliceScale{0.0f};
+        /** event.Bias added to the scaled logarithm of the view depth giving the light cluster depth slice. */
+        float       lightsClustersSliceBias{0.0f};
     };
 
     /**
@@ -83,17 +88,32 @@ export namespace lysa {
         uint32 instanceIndex;
         /** event.Standard indexed indirect draw command parameters. */
         vireo::DrawIndexedIndirectCommand command;
+        /** event.Index of the MeshInstance in the global instances array, used by the culling. */
+        uint32 meshInstanceIndex;
+        /** event.Index of the draw group of the draw command in its pipeline, used by the culling. */
+        uint32 groupIndex;
+        /** event.Index of the MeshSurface in the global surfaces array, used by the detail level selection. */
+        uint32 meshSurfaceIndex;
+        /** event.1 if the pipeline culls the back faces of the surface, enabling the back-face culling of its clusters. */
+        uint32 backFacesCulled;
     };
 
     /**
-     * event.Per-pipeline data for instances, draw command arrays and culling.
+     * event.Per-pipeline data for instances and draw command arrays.
+     *
+     * Stores instance data and the draw commands of a pipeline. The data is
+     * shared by all the frames in flight and updated with the modifications only,
+     * staged in one staging buffer per frame in flight.
      *
-     * Stores instance data, staging/copy buffers and the compute pipeline
-     * used to perform frustum culling and produce culled indirect draws.
+     * The draw commands of a same mesh surface and material form a draw group. The culling
+     * outputs one instanced indirect draw per group, with the list of the visible instances
+     * of the group in an instances indices buffer read by the vertex shaders.
      */
     struct GraphicPipelineData {
         /** event.Descriptor binding for per-instance buffer used by pipelines. */
         static constexpr vireo::DescriptorIndex BINDING_INSTANCES{0};
+        /** event.Descriptor binding for the instances indices of the instanced draws. */
+        static constexpr vireo::DescriptorIndex BINDING_INSTANCES_INDICES{1};
         /** event.Shared descriptor layout for pipeline-local resources. */
         inline static std::shared_ptr<vireo::DescriptorLayout> pipelineDescriptorLayout{nullptr};
         /**
@@ -106,10 +126,8 @@ export namespace lysa {
 
         /** event.Identifier of the material/pipeline family. */
         pipeline_id pipelineId;
-        /** event.Descriptor set bound when drawing with this pipeline. */
-        std::shared_ptr<vireo::DescriptorSet> descriptorSet;
-        /** event.Compute pipeline used to cull draw commands against the frustum. */
-        FrustumCulling frustumCullingPipeline;
+        /** event.Dense index of the pipeline data in its scene, the same pipeline id being used by the opaque, transparent and shader material pipelines. */
+        uint32 index;
         /** event.Reference to the material manager. */
         MaterialManager& materialManager;
         /** event.Reference to Vireo. */
@@ -117,41 +135,86 @@ export namespace lysa {
 
         /** event.Flag tracking if the instances set has been updated. */
         bool instancesUpdated{false};
-        /** event.Set of mesh instances scheduled for removal. */
-        std::unordered_set<const MeshInstance*> instancesToRemove;
         /** event.Device memory array that stores InstanceData blocks. */
         DeviceMemoryArray instancesArray;
         /** event.Mapping of mesh instance to its memory block within instancesArray. */
         std::unordered_map<const MeshInstance*, MemoryBlock> instancesMemoryBlocks;
 
+        /** event.Maximum number of draw commands, size of the GPU draw commands buffers. */
+        const uint32 maxDrawCommands;
         /** event.Number of indirect draw commands before culling. */
         uint32 drawCommandsCount{0};
-        /** event.CPU-side list of draw commands to upload. */
+        /** event.CPU-side list of draw commands to upload, densely packed. */
         std::vector<DrawCommand> drawCommands;
+        /** event.Slots in drawCommands of the draw commands of each mesh instance. */
+        std::unordered_map<const MeshInstance*, std::vector<uint32>> instancesDrawCommands;
+        /** event.Owner of each draw command slot, and position of the slot in the owner's list. */
+        std::vector<std::pair<const MeshInstance*, uint32>> drawCommandsOwners;
+        /** event.Slots modified since the last upload. */
+        std::vector<uint32> dirtyDrawCommands;
+        /** event.Number of clusters of the surface of each draw command slot. */
+        std::vector<uint32> drawCommandsClustersCounts;
+        /** event.Number of draw commands whose surface is split in clusters. */
+        uint32 clusteredDrawCommandsCount{0};
+        /** event.Total number of clusters of the draw commands, the maximum number of cluster draws. */
+        uint32 drawClustersCount{0};
         /** event.GPU buffer storing indirect draw commands. */
         std::shared_ptr<vireo::Buffer> drawCommandsBuffer;
-        /** event.GPU buffer storing the count of culled draw commands. */
-        std::shared_ptr<vireo::Buffer> culledDrawCommandsCountBuffer;
-        /** event.GPU buffer storing culled indirect draw commands. */
-        std::shared_ptr<vireo::Buffer> culledDrawCommandsBuffer;
+        /** event.Flag set once drawCommandsBuffer has been uploaded and is in INDIRECT_DRAW state. */
+        bool drawCommandsUploaded{false};
+        /** event.Incremented each time drawCommandsBuffer or drawGroupsBuffer is modified. */
+        uint32 drawCommandsVersion{0};
 
-        /** event.Staging buffer used to copy draw commands to the GPU. */
-        std::shared_ptr<vireo::Buffer> drawCommandsStagingBuffer;
-        /** event.Number of draw commands stored in the current staging buffer. */
-        uint32 drawCommandsStagingBufferCount{0};
+        /** event.Number of draw groups, including the free ones. */
+        uint32 drawGroupsCount{0};
+        /** event.Number of draw commands of each draw group. */
+        std::vector<uint32> drawGroupsSizes;
+        /** event.Position of the first draw command of each draw group once sorted by group, uploaded. */
+        std::vector<uint32> drawGroups;
+        /** event.Draw group of each (mesh surface, material) pair. */
+        std::map<std::pair<uint32, uint32>, uint32> drawGroupsIndices;
+        /** event.(mesh surface, material) pair of each draw group. */
+        std::vector<std::pair<uint32, uint32>> drawGroupsKeys;
+        /** event.Draw groups without draw commands, reused first. */
+        std::vector<uint32> freeDrawGroups;
+        /** event.Flag set if a draw group size changed since the last upload. */
+        bool drawGroupsUpdated{false};
+        /** event.GPU buffer storing drawGroups. */
+        std::shared_ptr<vireo::Buffer> drawGroupsBuffer;
+        /** event.Flag set once drawGroupsBuffer has been uploaded and is in COMPUTE_READ state. */
+        bool drawGroupsUploaded{false};
+        /**
+         * event.Visibility of each draw command slot the previous frame, written by the occlusion culling.
+         * Created on first use, in the COMPUTE_WRITE state between two frames.
+         */
+        std::shared_ptr<vireo::Buffer> visibilityBuffer;
+
+        /** event.Staging buffer used to copy the modified draw commands to the GPU. */
+        struct DrawCommandsStagingBuffer {
+            /** event.Upload buffer, mapped. */
+            std::shared_ptr<vireo::Buffer> buffer;
+            /** event.Capacity in draw commands of the buffer, doubled when too small. */
+            uint32 count{0};
+            /** event.Upload buffer of the draw groups, mapped, created on first use. */
+            std::shared_ptr<vireo::Buffer> groupsBuffer;
+        };
+        /** event.Staging buffers used in turn by the uploads, one per frame in flight. */
+        std::vector<DrawCommandsStagingBuffer> drawCommandsStagingBuffers;
+        /** event.Staging buffer used by the next upload. */
+        uint32 currentDrawCommandsStagingBuffer{0};
 
         /**
          * event.Create a pipeline data object for a specific material/pipeline ID.
          * 
          * @param ctx Reference to the rendering context.
          * @param pipelineId Identifier of the pipeline.
-         * @param meshInstancesDataArray Array storing per-mesh-instance data.
+         * @param index Dense index of the pipeline data in its scene.
          * @param maxMeshSurfacePerPipeline Maximum number of mesh surfaces supported by this pipeline.
          */
         GraphicPipelineData(
             const Context& ctx,
             uint32 pipelineId,
-            const DeviceMemoryArray& meshInstancesDataArray,
+            uint32 index,
             uint32 maxMeshSurfacePerPipeline);
 
         /**
@@ -165,6 +228,7 @@ export namespace lysa {
 
         /**
          * event.Removes a previously registered mesh instance.
+         * The draw commands of the instance are replaced by the last ones (swap-remove).
          * @param meshInstance Pointer to the mesh instance to remove.
          */
         void removeInstance(
@@ -182,16 +246,64 @@ export namespace lysa {
             const MemoryBlock& meshInstanceMemoryBlock);
 
         /**
-         * event.Uploads/refreshes GPU buffers and prepares culled draw arrays.
-         * 
+         * event.Returns the draw group of a (mesh surface, material) pair, created if needed.
+         * @param meshSurfaceIndex Index of the mesh surface within the global surfaces array.
+         * @param materialIndex Index of the material.
+         */
+        uint32 getDrawGroup(uint32 meshSurfaceIndex, uint32 materialIndex);
+
+        /**
+         * event.Uploads the modified draw commands and instances to the GPU buffers.
+         * Must be called at most once per frame, by the frame that records the copies.
+         *
          * @param commandList Command buffer for GPU operations.
-         * @param drawCommandsStagingBufferRecycleBin Set for recycling staging buffers.
-         * @param meshInstancesDataMemoryBlocks Map of memory blocks for mesh instance data.
          */
-        void updateData(
-            const vireo::CommandList& commandList,
-            std::unordered_set<std::shared_ptr<vireo::Buffer>>& drawCommandsStagingBufferRecycleBin,
-            const std::unordered_map<const MeshInstance*, MemoryBlock>& meshInstancesDataMemoryBlocks);
+        void updateData(const vireo::CommandList& commandList);
+    };
+
+    /**
+     * event.Per-frame transient occlusion culling data of a pipeline.
+     *
+     * Stores the compute pipeline used to perform the occlusion culling for the
+     * camera and the culled indirect draws produced for one frame in flight.
+     * The other pipelines and points of view are culled by the FrustumCulling of the scene.
+     */
+    struct GraphicPipelineFrameData {
+        /** event.Compute pipeline used to cull draw commands against the frustum and the depth pyramid. */
+        OcclusionCulling occlusionCullingPipeline;
+        /** event.GPU buffer storing the culled instanced draw command of each draw group and detail level. */
+        std::shared_ptr<vireo::Buffer> culledDrawCommandsBuffer;
+        /** event.GPU buffer storing the instanced draw command of each draw group and detail level made visible by the occlusion culling second phase. */
+        std::shared_ptr<vireo::Buffer> disoccludedDrawCommandsBuffer;
+        /** event.Compute pipeline compacting the culled draw commands with instances, after each phase. */
+        DrawCommandsCompaction culledCompaction;
+        /** event.Compute pipeline compacting the disoccluded draw commands with instances, after the second phase. */
+        DrawCommandsCompaction disoccludedCompaction;
+        /** event.GPU buffer storing the culled draw commands with instances, drawn with an indirect count. */
+        std::shared_ptr<vireo::Buffer> compactedCulledDrawCommandsBuffer;
+        /** event.GPU buffer storing the disoccluded draw commands with instances, drawn with an indirect count. */
+        std::shared_ptr<vireo::Buffer> compactedDisoccludedDrawCommandsBuffer;
+        /** event.GPU buffer storing the number of compacted culled then disoccluded draw commands. */
+        std::shared_ptr<vireo::Buffer> drawCountsBuffer;
+
+        /** event.Position of the number of compacted culled draw commands in drawCountsBuffer. */
+        static constexpr uint32 DRAW_COUNT_CULLED{0};
+        /** event.Position of the number of compacted disoccluded draw commands in drawCountsBuffer. */
+        static constexpr uint32 DRAW_COUNT_DISOCCLUDED{1};
+
+        /**
+         * event.Create the occlusion culling data of a pipeline for one frame in flight.
+         *
+         * @param ctx Reference to the rendering context.
+         * @param pipelineId Identifier of the pipeline.
+         * @param meshInstancesDataArray Array storing per-mesh-instance data.
+         * @param maxMeshSurfacePerPipeline Maximum number of mesh surfaces supported by this pipeline.
+         */
+        GraphicPipelineFrameData(
+            const Context& ctx,
+            uint32 pipelineId,
+            const DeviceMemoryArray& meshInstancesDataArray,
+            uint32 maxMeshSurfacePerPipeline);
     };
 
 }
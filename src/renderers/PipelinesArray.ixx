@@ -0,0 +1,121 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.renderers.pipelines_array;
+
+import lysa.types;
+
+export namespace lysa {
+
+    /**
+     * Flat array of per-pipeline values indexed by a dense identifier, a pipeline id or the index of
+     * a GraphicPipelineData in its scene.
+     *
+     * The array grows to the largest identifier stored and is never shrunk, the identifiers being
+     * interned or allocated densely. The values are iterated in the order of their identifiers, giving
+     * the same order from a frame to another, as (identifier, value) pairs.
+     */
+    template <typename T>
+    class PipelinesArray {
+    public:
+        /**
+         * Iterator over the stored values, skipping the empty slots.
+         */
+        class Iterator {
+        public:
+            Iterator(const PipelinesArray& array, const uint32 id) : array{&array}, id{id} { skipEmpty(); }
+
+            std::pair<uint32, const T&> operator*() const { return { id, array->values[id] }; }
+
+            Iterator& operator++() {
+                id++;
+                skipEmpty();
+                return *this;
+            }
+
+            bool operator==(const Iterator& other) const { return id == other.id; }
+
+        private:
+            const PipelinesArray* array;
+            uint32 id;
+
+            void skipEmpty() {
+                while (id < array->values.size() && !array->stored[id]) { id++; }
+            }
+        };
+
+        /**
+         * Checks if a value is stored for an identifier.
+         */
+        bool contains(const uint32 id) const { return id < stored.size() && stored[id]; }
+
+        /**
+         * Returns the value of an identifier, which must be stored.
+         */
+        const T& at(const uint32 id) const { return values.at(id); }
+
+        /**
+         * Returns the value of an identifier, which must be stored.
+         */
+        T& at(const uint32 id) { return values.at(id); }
+
+        /**
+         * Stores the value of an identifier, replacing the previous one.
+         * @return The stored value
+         */
+        T& emplace(const uint32 id, T value) {
+            if (id >= values.size()) {
+                values.resize(id + 1);
+                stored.resize(id + 1, false);
+            }
+            if (!stored[id]) {
+                stored[id] = true;
+                count++;
+            }
+            values[id] = std::move(value);
+            return values[id];
+        }
+
+        /**
+         * Removes the value of an identifier, if any.
+         */
+        void erase(const uint32 id) {
+            if (!contains(id)) { return; }
+            values[id] = T{};
+            stored[id] = false;
+            count--;
+        }
+
+        /**
+         * Removes all the values, keeping the capacity.
+         */
+        void clear() {
+            for (auto& value : values) { value = T{}; }
+            stored.assign(stored.size(), false);
+            count = 0;
+        }
+
+        /**
+         * Returns the number of stored values.
+         */
+        auto size() const { return count; }
+
+        /**
+         * Checks if no value is stored.
+         */
+        auto empty() const { return count == 0; }
+
+        auto begin() const { return Iterator{*this, 0}; }
+
+        auto end() const { return Iterator{*this, static_cast<uint32>(values.size())}; }
+
+    private:
+        std::vector<T> values;
+        std::vector<bool> stored;
+        uint32 count{0};
+    };
+
+}
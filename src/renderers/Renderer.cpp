@@ -73,6 +73,9 @@ namespace lysa {
         if (config.bloomEnabled) {
             bloomPass = std::make_unique<BloomPass>(ctx, config);
         }
+        if (config.occlusionCullingEnabled) {
+            depthPyramid = std::make_unique<DepthPyramid>(ctx);
+        }
         framesData.resize(ctx.config.framesInFlight);
     }
 
@@ -116,7 +119,22 @@ namespace lysa {
         }
         commandList.setViewport(viewport);
         commandList.setScissors(scissors);
-        depthPrePass.render(commandList, scene, framesData[frameIndex].depthAttachment, frameIndex);
+        const auto& depthAttachment = framesData[frameIndex].depthAttachment;
+        depthPrePass.render(commandList, scene, depthAttachment, frameIndex);
+        if (depthPyramid) {
+            depthPyramid->build(
+                commandList,
+                depthAttachment,
+                withStencil ?
+                    vireo::ResourceState::RENDER_TARGET_DEPTH_STENCIL :
+                    vireo::ResourceState::RENDER_TARGET_DEPTH,
+                frameIndex);
+            scene.computeOcclusion(
+                commandList,
+                depthPyramid->getImages(frameIndex),
+                depthPyramid->getLevelsCount());
+            depthPrePass.renderDisoccluded(commandList, scene, depthAttachment, frameIndex);
+        }
     }
 
     void Renderer::render(
@@ -184,6 +202,9 @@ namespace lysa {
                 depthStage);
         }
         depthPrePass.resize(extent, commandList);
+        if (depthPyramid) {
+            depthPyramid->resize(extent);
+        }
         shaderMaterialPass.resize(extent, commandList);
         transparencyPass.resize(extent, commandList);
         if (bloomPass) {
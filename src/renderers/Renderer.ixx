@@ -13,6 +13,7 @@ import lysa.math;
 import lysa.renderers.configuration;
 import lysa.renderers.graphic_pipeline_data;
 import lysa.renderers.scene_frame_data;
+import lysa.renderers.pipelines.depth_pyramid;
 import lysa.renderers.renderpasses.bloom_pass;
 import lysa.renderers.renderpasses.depth_prepass;
 import lysa.renderers.renderpasses.fxaa_pass;
@@ -80,7 +81,11 @@ export namespace lysa {
         /** Performs per-frame housekeeping (e.g., pass-local data updates). */
         virtual void update(uint32 frameIndex);
 
-        /** Pre-render stage: uploads, layout transitions, depth pre pass and shadow maps. */
+        /**
+         * Pre-render stage: uploads, layout transitions, depth pre pass and shadow maps.
+         * With the occlusion culling enabled, also builds the depth pyramid, runs the second
+         * culling phase and completes the depth pre pass with the newly visible models.
+         */
         void prepare(
             vireo::CommandList& commandList,
             const SceneFrameData& scene,
@@ -146,6 +151,8 @@ export namespace lysa {
         std::vector<FrameData> framesData;
         // Depth-only pre-pass used by both forward and deferred renderers
         DepthPrepass depthPrePass;
+        // Hierarchical depth built after the depth pre-pass, for the occlusion culling
+        std::unique_ptr<DepthPyramid> depthPyramid;
 
         Renderer(
             const Context& ctx,
@@ -10,6 +10,7 @@ import lysa.exception;
 import lysa.log;
 import lysa.math;
 import lysa.resources.image;
+import lysa.resources.mesh;
 import lysa.renderers.renderpasses.shadow_map_pass;
 
 namespace lysa {
@@ -18,15 +19,16 @@ namespace lysa {
         sceneDescriptorLayout = ctx.vireo->createDescriptorLayout("Scene");
         sceneDescriptorLayout->add(BINDING_SCENE, vireo::DescriptorType::UNIFORM);
         sceneDescriptorLayout->add(BINDING_MODELS, vireo::DescriptorType::DEVICE_STORAGE);
-        sceneDescriptorLayout->add(BINDING_LIGHTS, vireo::DescriptorType::UNIFORM);
-        sceneDescriptorLayout->add(BINDING_SHADOW_MAPS, vireo::DescriptorType::SAMPLED_IMAGE,
-            ctx.config.maxShadowMapsPerScene * 6);
+        sceneDescriptorLayout->add(BINDING_LIGHTS, vireo::DescriptorType::DEVICE_STORAGE);
+        sceneDescriptorLayout->add(BINDING_CLUSTERS_LIGHTS_COUNTS, vireo::DescriptorType::DEVICE_STORAGE);
+        sceneDescriptorLayout->add(BINDING_CLUSTERS_LIGHTS, vireo::DescriptorType::DEVICE_STORAGE);
+        sceneDescriptorLayout->add(BINDING_SHADOW_MAPS, vireo::DescriptorType::SAMPLED_IMAGE);
         sceneDescriptorLayout->build();
 
 #ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
         sceneDescriptorLayoutOptional1 = ctx.vireo->createDescriptorLayout("Scene opt1");
         sceneDescriptorLayoutOptional1->add(BINDING_SHADOW_MAP_TRANSPARENCY_COLOR,
-            vireo::DescriptorType::SAMPLED_IMAGE, ctx.config.maxShadowMapsPerScene * 6);
+            vireo::DescriptorType::SAMPLED_IMAGE);
         sceneDescriptorLayoutOptional1->build();
 #endif
 
@@ -43,86 +45,259 @@ namespace lysa {
 
     SceneFrameData::SceneFrameData(
         const Context& ctx,
+        SceneInstancesData& instancesData,
         const uint32 maxLights,
-        const uint32 maxMeshInstancesPerScene,
         const uint32 maxMeshSurfacePerPipeline) :
         ctx(ctx),
+        instancesData(instancesData),
         lightsBuffer{ctx.vireo->createBuffer(
-            vireo::BufferType::UNIFORM,
+            vireo::BufferType::DEVICE_STORAGE,
             sizeof(LightData),
-            1,
+            LIGHTS_INITIAL_CAPACITY,
             "lights")},
-        meshInstancesDataArray{ctx.vireo,
-            sizeof(MeshInstanceData),
-            maxMeshInstancesPerScene,
-            maxMeshInstancesPerScene,
-            vireo::BufferType::DEVICE_STORAGE,
-            "meshInstancesData"},
+        lightsStagingBuffer{ctx.vireo->createBuffer(
+            vireo::BufferType::BUFFER_UPLOAD,
+            sizeof(LightData),
+            LIGHTS_INITIAL_CAPACITY,
+            "lights staging")},
+        lightClustering{ctx},
         sceneUniformBuffer{ctx.vireo->createBuffer(
             vireo::BufferType::UNIFORM,
             sizeof(SceneData), 1,
             "sceneUniform")},
+        shadowMapAtlas{ctx, ctx.config.shadowMapAtlasSize},
+        frustumCulling{ctx, instancesData.getMeshInstancesDataArray()},
         maxMeshSurfacePerPipeline(maxMeshSurfacePerPipeline),
-        maxLights(maxLights),
-        materialManager(ctx.res.get<MaterialManager>()) {
-        const auto blankImage = ctx.res.get<ImageManager>().getBlankImage();
-
-        shadowMaps.resize(ctx.config.maxShadowMapsPerScene * 6);
-        for (int i = 0; i < shadowMaps.size(); i++) {
-            shadowMaps[i] = blankImage;
-        }
+        maxLights(maxLights) {
         descriptorSet = ctx.vireo->createDescriptorSet(sceneDescriptorLayout, "Scene");
         descriptorSet->update(BINDING_SCENE, sceneUniformBuffer);
-        descriptorSet->update(BINDING_MODELS, meshInstancesDataArray.getBuffer());
+        descriptorSet->update(BINDING_MODELS, instancesData.getMeshInstancesDataArray().getBuffer());
         descriptorSet->update(BINDING_LIGHTS, lightsBuffer);
-        descriptorSet->update(BINDING_SHADOW_MAPS, shadowMaps);
+        descriptorSet->update(BINDING_CLUSTERS_LIGHTS_COUNTS, lightClustering.getClustersLightsCountsBuffer());
+        descriptorSet->update(BINDING_CLUSTERS_LIGHTS, lightClustering.getClustersLightsBuffer());
+        descriptorSet->update(BINDING_SHADOW_MAPS, shadowMapAtlas.getShadowMaps()->getImage());
 
 #ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
-        shadowTransparencyColorMaps.resize(ctx.config.maxShadowMapsPerScene * 6);
-        for (int i = 0; i < shadowMaps.size(); i++) {
-            shadowMaps[i] = blankImage;
-            shadowTransparencyColorMaps[i] = blankImage;
-        }
         descriptorSetOpt1 = ctx.vireo->createDescriptorSet(sceneDescriptorLayoutOptional1, "Scene Opt1");
-        descriptorSetOpt1->update(BINDING_SHADOW_MAP_TRANSPARENCY_COLOR, shadowTransparencyColorMaps);
+        descriptorSetOpt1->update(BINDING_SHADOW_MAP_TRANSPARENCY_COLOR, shadowMapAtlas.getTransparencyColorMaps()->getImage());
 #endif
 
         sceneUniformBuffer->map();
-        lightsBuffer->map();
+        lightsStagingBuffer->map();
     }
 
-    void SceneFrameData::compute(vireo::CommandList& commandList, const Camera& camera) const {
-        compute(camera, commandList, opaquePipelinesData);
-        compute(camera, commandList, shaderMaterialPipelinesData);
-        compute(camera, commandList, transparentPipelinesData);
+    void SceneFrameData::compute(vireo::CommandList& commandList, const Camera& camera) {
+        auto cullingPipelines = std::vector<CullingPipeline>{};
+        addCullingPipelines(cullingPipelines, instancesData.getOpaquePipelinesData(), frontToBackSortingEnabled);
+        addCullingPipelines(cullingPipelines, instancesData.getShaderMaterialPipelinesData(), false);
+        addCullingPipelines(cullingPipelines, instancesData.getTransparentPipelinesData(), false);
+        cullingViews[0] = {
+            .transform = camera.transform,
+            .projection = camera.projection,
+            .minScreenSize = cullingMinScreenSize,
+        };
+        frustumCulling.dispatch(commandList, cullingViews, cullingPipelines, cullingLodSettings, cullingStatisticsEnabled);
+        updatePipelinesDescriptorSets(cullingPipelines);
+        touchVisibleResources(cullingPipelines);
+        lightClustering.dispatch(commandList, camera, lightsBuffer, static_cast<uint32>(lights.size()));
+
+        for (const auto& [pipelineId, pipelineData] : instancesData.getOpaquePipelinesData()) {
+            if (!pipelinesFrameData.contains(pipelineData->index)) { continue; }
+            const auto& frameData = pipelinesFrameData.at(pipelineData->index);
+            frameData->occlusionCullingPipeline.dispatchFirstPhase(
+                commandList,
+                pipelineData->drawCommandsCount,
+                pipelineData->drawGroupsCount,
+                camera.transform,
+                camera.projection,
+                cullingMinScreenSize,
+                *pipelineData->drawGroupsBuffer,
+                *pipelineData->drawCommandsBuffer,
+                *frameData->culledDrawCommandsBuffer,
+                *instancesIndicesBuffer,
+                frustumCulling.getInstancesIndicesFirst(*pipelineData, false),
+                frustumCulling.getLodStride(),
+                *frustumCulling.getLodsBuffer(),
+                frustumCulling.getLodsFirst(*pipelineData),
+                *frustumCulling.getGroupsOrderBuffer(),
+                frustumCulling.getGroupsOrderFirst(*pipelineData),
+                *pipelineData->visibilityBuffer);
+            compactOcclusionCulling(commandList, *pipelineData, *frameData, false);
+        }
     }
 
-    void SceneFrameData::compute(
-        const Camera& camera,
-        vireo::CommandList& commandList,
-        const std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>>& pipelinesData) const {
+    void SceneFrameData::updatePipelinesDescriptorSets(const std::vector<CullingPipeline>& cullingPipelines) {
+        // The instances indices buffer is recreated when the culling outputs grow
+        const auto rebind = instancesIndicesBuffer != frustumCulling.getInstancesIndicesBuffer();
+        instancesIndicesBuffer = frustumCulling.getInstancesIndicesBuffer();
+        for (const auto& cullingPipeline : cullingPipelines) {
+            const auto* pipelineData = cullingPipeline.pipelineData;
+            if (!pipelinesDescriptorSets.contains(pipelineData->index)) {
+                const auto& pipelineDescriptorSet = pipelinesDescriptorSets.emplace(
+                    pipelineData->index,
+                    ctx.vireo->createDescriptorSet(
+                        GraphicPipelineData::pipelineDescriptorLayout,
+                        "Graphic : " + std::to_string(pipelineData->pipelineId)));
+                pipelineDescriptorSet->update(GraphicPipelineData::BINDING_INSTANCES, pipelineData->instancesArray.getBuffer());
+            } else if (!rebind) {
+                continue;
+            }
+            pipelinesDescriptorSets.at(pipelineData->index)->update(GraphicPipelineData::BINDING_INSTANCES_INDICES, instancesIndicesBuffer);
+        }
+    }
+
+    void SceneFrameData::touchVisibleResources(const std::vector<CullingPipeline>& cullingPipelines) const {
+        // The draw commands of a group share the same mesh surface and material, one instance per group is enough
+        auto touchedGroups = std::vector<bool>{};
+        for (const auto& cullingPipeline : cullingPipelines) {
+            const auto& pipelineData = *cullingPipeline.pipelineData;
+            const auto* groupsDepths = frustumCulling.getGroupsDepths(pipelineData);
+            if (!groupsDepths) { continue; }
+            touchedGroups.assign(groupsDepths->size(), false);
+            for (auto slot = 0u; slot < pipelineData.drawCommandsCount; slot++) {
+                const auto group = pipelineData.drawCommands[slot].groupIndex;
+                if (group >= groupsDepths->size() || (*groupsDepths)[group] == 0 || touchedGroups[group]) {
+                    continue;
+                }
+                touchedGroups[group] = true;
+                instancesData.touchResources(pipelineData.drawCommandsOwners[slot].first);
+            }
+        }
+    }
+
+    void SceneFrameData::addCullingPipelines(
+        std::vector<CullingPipeline>& cullingPipelines,
+        const PipelinesArray<std::unique_ptr<GraphicPipelineData>>& pipelinesData,
+        const bool frontToBack) const {
         for (const auto& [pipelineId, pipelineData] : pipelinesData) {
-            pipelineData->frustumCullingPipeline.dispatch(
+            // The occlusion culling already culls these pipelines for the camera
+            cullingPipelines.push_back({
+                .pipelineData = pipelineData.get(),
+                .firstView = !pipelinesFrameData.contains(pipelineData->index),
+                .frontToBack = frontToBack,
+            });
+        }
+    }
+
+    void SceneFrameData::computeOcclusion(
+        vireo::CommandList& commandList,
+        const std::vector<std::shared_ptr<vireo::Image>>& depthPyramid,
+        const uint32 levelsCount) const {
+        for (const auto& [pipelineId, pipelineData] : instancesData.getOpaquePipelinesData()) {
+            if (!pipelinesFrameData.contains(pipelineData->index)) { continue; }
+            const auto& frameData = pipelinesFrameData.at(pipelineData->index);
+            frameData->occlusionCullingPipeline.dispatchSecondPhase(
                 commandList,
                 pipelineData->drawCommandsCount,
-                camera.transform,
-                camera.projection,
-                *pipelineData->instancesArray.getBuffer(),
+                pipelineData->drawGroupsCount,
+                *pipelineData->drawGroupsBuffer,
                 *pipelineData->drawCommandsBuffer,
-                *pipelineData->culledDrawCommandsBuffer,
-                *pipelineData->culledDrawCommandsCountBuffer);
+                *frameData->culledDrawCommandsBuffer,
+                *frameData->disoccludedDrawCommandsBuffer,
+                *instancesIndicesBuffer,
+                frustumCulling.getInstancesIndicesFirst(*pipelineData, true),
+                *frustumCulling.getLodsBuffer(),
+                *frustumCulling.getGroupsOrderBuffer(),
+                *pipelineData->visibilityBuffer,
+                depthPyramid,
+                levelsCount,
+                cullingStatisticsEnabled);
+            compactOcclusionCulling(commandList, *pipelineData, *frameData, true);
+        }
+    }
+
+    void SceneFrameData::compactOcclusionCulling(
+        vireo::CommandList& commandList,
+        const GraphicPipelineData& pipelineData,
+        GraphicPipelineFrameData& frameData,
+        const bool withDisoccluded) {
+        // The second phase appends to the culled draw commands : compacted again after each phase
+        const auto count = pipelineData.drawGroupsCount * MESH_LODS_MAX;
+        if (count == 0) { return; }
+        frameData.culledCompaction.dispatch(
+            commandList,
+            {{ .inputFirst = 0, .outputFirst = 0, .count = count, .countIndex = GraphicPipelineFrameData::DRAW_COUNT_CULLED }},
+            frameData.culledDrawCommandsBuffer,
+            frameData.compactedCulledDrawCommandsBuffer,
+            frameData.drawCountsBuffer);
+        if (withDisoccluded) {
+            frameData.disoccludedCompaction.dispatch(
+                commandList,
+                {{ .inputFirst = 0, .outputFirst = 0, .count = count, .countIndex = GraphicPipelineFrameData::DRAW_COUNT_DISOCCLUDED }},
+                frameData.disoccludedDrawCommandsBuffer,
+                frameData.compactedDisoccludedDrawCommandsBuffer,
+                frameData.drawCountsBuffer);
+        }
+    }
+
+    OcclusionCullingStatistics SceneFrameData::getOcclusionCullingStatistics() const {
+        auto statistics = OcclusionCullingStatistics{};
+        for (const auto& [index, frameData] : pipelinesFrameData) {
+            const auto pipelineStatistics = frameData->occlusionCullingPipeline.getStatistics();
+            statistics.frustumCulledCount += pipelineStatistics.frustumCulledCount;
+            statistics.occlusionCulledCount += pipelineStatistics.occlusionCulledCount;
+        }
+        return statistics;
+    }
+
+    ShadowMapCacheStatistics SceneFrameData::getShadowMapCacheStatistics() const {
+        auto statistics = ShadowMapCacheStatistics{};
+        for (const auto& renderpass : std::views::values(shadowMapRenderers)) {
+            const auto& shadowMapStatistics =
+                std::static_pointer_cast<ShadowMapPass>(renderpass)->getStaticCacheStatistics();
+            statistics.hitsCount += shadowMapStatistics.hitsCount;
+            statistics.missesCount += shadowMapStatistics.missesCount;
         }
-        for (const auto& renderer : std::views::values(shadowMapRenderers)) {
-            const auto& shadowMapRenderer = std::static_pointer_cast<ShadowMapPass>(renderer);
-            shadowMapRenderer->compute(commandList, pipelinesData);
+        return statistics;
+    }
+
+    void SceneFrameData::invalidateShadowMapsStaticCache(const std::vector<AABB>& aabbs) {
+        for (const auto& renderpass : std::views::values(shadowMapRenderers)) {
+            std::static_pointer_cast<ShadowMapPass>(renderpass)->invalidateStaticCache(aabbs);
         }
     }
 
-    void SceneFrameData::updatePipelinesData(
+    void SceneFrameData::updatePipelinesFrameData(
         const vireo::CommandList& commandList,
-        const std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>>& pipelinesData) {
+        const PipelinesArray<std::unique_ptr<GraphicPipelineData>>& pipelinesData,
+        const bool withOcclusionCulling) {
+        if (!withOcclusionCulling) {
+            // The previous submission of this frame in flight is completed
+            pipelinesFrameData.clear();
+            return;
+        }
         for (const auto& [pipelineId, pipelineData] : pipelinesData) {
-            pipelineData->updateData(commandList, drawCommandsStagingBufferRecycleBin, meshInstancesDataMemoryBlocks);
+            if (!pipelinesFrameData.contains(pipelineData->index)) {
+                const auto& frameData = pipelinesFrameData.emplace(pipelineData->index, std::make_unique<GraphicPipelineFrameData>(
+                    ctx, pipelineId, instancesData.getMeshInstancesDataArray(), maxMeshSurfacePerPipeline));
+                commandList.barrier(
+                    *frameData->culledDrawCommandsBuffer,
+                    vireo::ResourceState::COPY_DST,
+                    vireo::ResourceState::INDIRECT_DRAW);
+                commandList.barrier(
+                    *frameData->disoccludedDrawCommandsBuffer,
+                    vireo::ResourceState::COPY_DST,
+                    vireo::ResourceState::INDIRECT_DRAW);
+                for (const auto& buffer : {
+                    frameData->compactedCulledDrawCommandsBuffer,
+                    frameData->compactedDisoccludedDrawCommandsBuffer,
+                    frameData->drawCountsBuffer }) {
+                    commandList.barrier(*buffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::INDIRECT_DRAW);
+                }
+            }
+            // Shared by the frames in flight, the content is not cleared : a wrong visibility only
+            // moves a draw command from one phase to the other for one frame
+            if (!pipelineData->visibilityBuffer) {
+                pipelineData->visibilityBuffer = ctx.vireo->createBuffer(
+                    vireo::BufferType::READWRITE_STORAGE,
+                    sizeof(uint32),
+                    pipelineData->maxDrawCommands,
+                    "visibility:" + std::to_string(pipelineId));
+                commandList.barrier(
+                    *pipelineData->visibilityBuffer,
+                    vireo::ResourceState::COPY_DST,
+                    vireo::ResourceState::COMPUTE_WRITE);
+            }
         }
     }
 
@@ -134,7 +309,17 @@ namespace lysa {
         if (!removedLights.empty()) {
             for (const auto& light : removedLights) {
                 disableLightShadowCasting(light);
-                lights.erase(light);
+                // The last light takes the slot of the removed one, the other lights keep theirs
+                const auto slot = lightsSlots.at(light);
+                const auto* last = lights.back();
+                lights[slot] = last;
+                lightsSlots[last] = slot;
+                lights.pop_back();
+                lightsSlots.erase(light);
+                dirtyLights.erase(static_cast<uint32>(lights.size()));
+                if (slot < lights.size()) {
+                    dirtyLights.insert(slot);
+                }
             }
             removedLights.clear();
         }
@@ -145,26 +330,119 @@ namespace lysa {
                 disableLightShadowCasting(light);
             }
         }
-        if (shadowMapsUpdated) {
-            descriptorSet->update(BINDING_SHADOW_MAPS, shadowMaps);
-#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
-                descriptorSetOpt1->update(BINDING_SHADOW_MAP_TRANSPARENCY_COLOR, shadowTransparencyColorMaps);
-#endif
-            shadowMapsUpdated = false;
-        }
+        shadowMapAtlas.update(commandList, config.shadowStaticCacheEnabled);
+        allocateShadowMaps(camera);
+        // The camera point of view is set by compute()
+        cullingViews.resize(1);
+        shadowMapViews.clear();
+        shadowMapStaticViews.clear();
+        // The most important lights first : the lights whose culling views do not fit in the
+        // FRUSTUM_CULLING_MAX_VIEWS of the culling dispatch do not cast shadows this frame
+        auto shadowCasters = std::vector<std::pair<ShadowMapPass*, float>>{};
         for (const auto [light, renderpass] : shadowMapRenderers) {
             if (light->visible && light->castShadows) {
-                const auto shadowMapRenderer = std::dynamic_pointer_cast<ShadowMapPass>(renderpass);
-                shadowMapRenderer->setCurrentCamera(camera);
-                shadowMapRenderer->updatePipelines(pipelineIds);
-                shadowMapRenderer->update(frameIndex);
+                const auto shadowMapRenderer = static_cast<ShadowMapPass*>(renderpass.get());
+                shadowCasters.push_back({shadowMapRenderer, shadowMapRenderer->getImportance(camera)});
+            }
+        }
+        std::ranges::stable_sort(shadowCasters, std::greater{}, &std::pair<ShadowMapPass*, float>::second);
+        for (const auto shadowMapRenderer : std::views::keys(shadowCasters)) {
+            shadowMapRenderer->setCurrentCamera(camera);
+            shadowMapRenderer->setStaticCacheEnabled(config.shadowStaticCacheEnabled);
+            shadowMapRenderer->setCascadesUpdateInterval(config.shadowCascadesUpdateInterval);
+            shadowMapRenderer->setCurrentFrame(instancesData.getFramesCount());
+            shadowMapRenderer->setSinglePassEnabled(config.shadowCubeMapSinglePassEnabled);
+            // Worst case, all the static caches being rendered again
+            const auto viewsCount = shadowMapRenderer->getCullingViewsCount() *
+                (shadowMapRenderer->isStaticCacheEnabled() ? 2 : 1);
+            if (cullingViews.size() + viewsCount > FRUSTUM_CULLING_MAX_VIEWS) {
+                shadowMapRenderer->skipUpdate();
+                continue;
+            }
+            shadowMapRenderer->update(frameIndex);
+            shadowMapViews[shadowMapRenderer] = static_cast<uint32>(cullingViews.size());
+            for (auto i = 0u; i < shadowMapRenderer->getCullingViewsCount(); i++) {
+                cullingViews.push_back(shadowMapRenderer->getCullingView(i));
+                cullingViews.back().minScreenSize = config.shadowMinScreenSize;
+            }
+            if (!shadowMapRenderer->isStaticCacheEnabled()) { continue; }
+            // The static shadow casters are culled only for the shadow maps rendering their cache
+            for (auto i = 0u; i < shadowMapRenderer->getCullingViewsCount(); i++) {
+                if (shadowMapRenderer->isStaticCacheRendered(i)) {
+                    shadowMapStaticViews[{shadowMapRenderer, i}] = static_cast<uint32>(cullingViews.size());
+                    cullingViews.push_back(shadowMapRenderer->getCullingView(i, true));
+                    cullingViews.back().minScreenSize = config.shadowMinScreenSize;
+                }
             }
         }
 
-        if (!drawCommandsStagingBufferRecycleBin.empty()) {
-            drawCommandsStagingBufferRecycleBin.clear();
+        instancesData.update(commandList);
+        uploadedInstancesCount = instancesData.getUploadedInstancesCount();
+        occlusionCullingEnabled = config.occlusionCullingEnabled;
+        cullingStatisticsEnabled = config.cullingStatisticsEnabled;
+        cullingLodSettings = {
+            .threshold = config.lodThreshold,
+            .hysteresis = config.lodHysteresis,
+        };
+        cullingMinScreenSize = config.minScreenSize;
+        frontToBackSortingEnabled = config.frontToBackSortingEnabled;
+        updatePipelinesFrameData(commandList, instancesData.getOpaquePipelinesData(), occlusionCullingEnabled);
+
+        if (lights.size() > maxLights) {
+            throw Exception("Too many lights");
+        }
+        if (lights.size() > lightsCapacity) {
+            // Doubled to amortize the reallocations, before any use of the buffer is recorded for this frame
+            lightsCapacity = std::min(std::max(lightsCapacity * 2, static_cast<uint32>(lights.size())), maxLights);
+            lightsBuffer = ctx.vireo->createBuffer(
+                vireo::BufferType::DEVICE_STORAGE,
+                sizeof(LightData), lightsCapacity,
+                "Scene Lights");
+            lightsStagingBuffer = ctx.vireo->createBuffer(
+                vireo::BufferType::BUFFER_UPLOAD,
+                sizeof(LightData), lightsCapacity,
+                "Scene Lights staging");
+            lightsStagingBuffer->map();
+            lightsBufferCreated = true;
+            descriptorSet->update(BINDING_LIGHTS, lightsBuffer);
+            for (auto slot = 0u; slot < lights.size(); slot++) {
+                dirtyLights.insert(slot);
+            }
+        }
+        // The lights are compared with their last upload : the modified lights, including the light
+        // spaces of the shadow casting lights following the camera, are uploaded without updateLight()
+        uploadedLights.resize(lights.size());
+        auto regions = std::vector<vireo::BufferCopyRegion>{};
+        for (auto slot = 0u; slot < lights.size(); slot++) {
+            const auto lightData = getLightData(lights[slot]);
+            if (!dirtyLights.contains(slot) &&
+                std::memcmp(&lightData, &uploadedLights[slot], sizeof(LightData)) == 0) {
+                continue;
+            }
+            uploadedLights[slot] = lightData;
+            const auto offset = slot * sizeof(LightData);
+            lightsStagingBuffer->write(&lightData, sizeof(LightData), offset);
+            // Contiguous slots are merged into one copy region
+            if (!regions.empty() && regions.back().srcOffset + regions.back().size == offset) {
+                regions.back().size += sizeof(LightData);
+            } else {
+                regions.push_back({offset, offset, sizeof(LightData)});
+            }
+        }
+        dirtyLights.clear();
+        if (!regions.empty()) {
+            if (!lightsBufferCreated) {
+                commandList.barrier(*lightsBuffer, vireo::ResourceState::SHADER_READ, vireo::ResourceState::COPY_DST);
+            }
+            commandList.copy(lightsStagingBuffer, lightsBuffer, regions);
+        }
+        if (!regions.empty() || lightsBufferCreated) {
+            commandList.barrier(*lightsBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::SHADER_READ);
         }
+        lightsBufferCreated = false;
 
+        // The light clusters are computed by compute() with the same camera
+        const auto slices = LightClustering::getSliceScaleBias(camera);
         const auto sceneUniform = SceneData {
             .cameraPosition = camera.transform[3].xyz,
             .projection = camera.projection,
@@ -174,305 +452,258 @@ namespace lysa {
             .lightsCount = static_cast<uint32>(lights.size()),
             .bloomEnabled = config.bloomEnabled ? 1u : 0u,
             .ssaoEnabled = config.ssaoEnabled ? 1u : 0u,
+            .lightsClustersSliceScale = slices.x,
+            .lightsClustersSliceBias = slices.y,
         };
         sceneUniformBuffer->write(&sceneUniform);
-
-        if (meshInstancesDataUpdated) {
-            meshInstancesDataArray.flush(commandList);
-            meshInstancesDataArray.postBarrier(commandList);
-            meshInstancesDataUpdated = false;
-        }
-
-        updatePipelinesData(commandList, opaquePipelinesData);
-        updatePipelinesData(commandList, shaderMaterialPipelinesData);
-        updatePipelinesData(commandList, transparentPipelinesData);
-
-        if (!lights.empty()) {
-            if (lights.size() > lightsBufferCount) {
-                if (lightsBufferCount >= maxLights) {
-                    throw Exception("Too many lights");
-                }
-                lightsBufferCount = lights.size();
-                lightsBuffer = ctx.vireo->createBuffer(
-                    vireo::BufferType::UNIFORM,
-                    sizeof(LightData) * lightsBufferCount, 1,
-                    "Scene Lights");
-                lightsBuffer->map();
-                descriptorSet->update(BINDING_LIGHTS, lightsBuffer);
-            }
-            auto lightIndex = 0;
-            auto lightsArray = std::vector<LightData>(lightsBufferCount);
-            for (const auto& light : lights) {
-                if (light->visible) {
-                    lightsArray[lightIndex] = light->getData();
-                    if (shadowMapRenderers.contains(light)) {
-                        const auto& shadowMapRenderer = std::static_pointer_cast<ShadowMapPass>(shadowMapRenderers[light]);
-                        lightsArray[lightIndex].mapIndex = shadowMapIndex[light];
-                        switch (light->type) {
-                            case LightType::LIGHT_DIRECTIONAL: {
-                                for (int cascadeIndex = 0; cascadeIndex < lightsArray[lightIndex].cascadesCount ; cascadeIndex++) {
-                                    lightsArray[lightIndex].lightSpace[cascadeIndex] =
-                                        shadowMapRenderer->getLightSpace(cascadeIndex);
-                                    lightsArray[lightIndex].cascadeSplitDepth[cascadeIndex] =
-                                        shadowMapRenderer->getCascadeSplitDepth(cascadeIndex);
-                                }
-                                break;
-                            }
-                            case LightType::LIGHT_SPOT: {
-                                lightsArray[lightIndex].lightSpace[0] = shadowMapRenderer->getLightSpace(0);
-                                break;
-                            }
-                            case LightType::LIGHT_OMNI: {
-                                break;
-                            }
-                            default:;
-                        }
-                    }
-                    lightIndex++;
-                }
-            }
-            lightsBuffer->write(lightsArray.data(), lightsArray.size() * sizeof(LightData));
-        }
     }
 
     void SceneFrameData::addLight(const Light* light) {
-        lights.insert(light);
+        if (lightsSlots.contains(light)) {
+            // Added again before the removal was processed
+            if (removedLights.erase(light) > 0) {
+                updateLight(light);
+            }
+            return;
+        }
+        const auto slot = static_cast<uint32>(lights.size());
+        lights.push_back(light);
+        lightsSlots[light] = slot;
+        dirtyLights.insert(slot);
         if (light->castShadows) {
             enableLightShadowCasting(light);
         }
     }
 
     void SceneFrameData::removeLight(const Light* light) {
-        if (lights.contains(light)) {
+        if (lightsSlots.contains(light)) {
             removedLights.insert(light);
         }
     }
 
-    void SceneFrameData::addInstance(const MeshInstance* meshInstance) {
-        const auto& mesh = meshInstance->getMesh();
-        assert([&]{ return !meshInstancesDataMemoryBlocks.contains(meshInstance);}, "Mesh instance already in the scene");
-        assert([&]{return !mesh.getMaterials().empty(); }, "Models without materials are not supported");
-        assert([&]{return mesh.isUploaded(); }, "Mesh instance is not in VRAM");
-
-        const auto meshInstanceData = meshInstance->getData();
-        meshInstancesDataMemoryBlocks[meshInstance] = meshInstancesDataArray.alloc(1);
-        meshInstancesDataArray.write(meshInstancesDataMemoryBlocks[meshInstance], &meshInstanceData);
-        meshInstancesDataUpdated = true;
-
-        auto haveTransparentMaterial{false};
-        auto haveShaderMaterial{false};
-        auto nodePipelineIds = std::set<uint32>{};
-        for (int i = 0; i < mesh.getSurfaces().size(); i++) {
-            const auto& material = materialManager[meshInstance->getSurfaceMaterial(i)];
-            haveTransparentMaterial = material.getTransparency() != Transparency::DISABLED;
-            haveShaderMaterial = material.getType() == Material::SHADER;
-            const auto id = material.getPipelineId();
-            nodePipelineIds.insert(id);
-            if (!pipelineIds.contains(id)) {
-                pipelineIds[id].push_back(material.id);
-                materialsUpdated = true;
-            }
-        }
-
-        for (const auto& pipelineId : nodePipelineIds) {
-            if (haveShaderMaterial) {
-                addInstance(pipelineId, meshInstance, shaderMaterialPipelinesData);
-            } else if (haveTransparentMaterial) {
-                addInstance(pipelineId, meshInstance, transparentPipelinesData);
-            } else {
-                addInstance(pipelineId, meshInstance, opaquePipelinesData);
-            }
+    void SceneFrameData::updateLight(const Light* light) {
+        if (const auto it = lightsSlots.find(light); it != lightsSlots.end()) {
+            dirtyLights.insert(it->second);
         }
     }
 
-    void SceneFrameData::updateInstance(const MeshInstance* meshInstance) {
-        assert([&]{ return meshInstancesDataMemoryBlocks.contains(meshInstance); },
-"MeshInstance does not belong to the scene");
-        const auto meshInstanceData = meshInstance->getData();
-        meshInstancesDataArray.write(meshInstancesDataMemoryBlocks[meshInstance], &meshInstanceData);
-        meshInstancesDataUpdated = true;
-    }
-
-    void SceneFrameData::addInstance(
-        pipeline_id pipelineId,
-        const MeshInstance*& meshInstance,
-        std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>>& pipelinesData) {
-        if (!pipelinesData.contains(pipelineId)) {
-            pipelinesData[pipelineId] = std::make_unique<GraphicPipelineData>(
-                ctx, pipelineId, meshInstancesDataArray, maxMeshSurfacePerPipeline);
+    LightData SceneFrameData::getLightData(const Light* light) const {
+        auto lightData = light->getData();
+        if (!light->visible) {
+            lightData.type = static_cast<int32>(LightType::LIGHT_UNKNOWN);
+            return lightData;
         }
-        pipelinesData[pipelineId]->addInstance(meshInstance, meshInstancesDataMemoryBlocks);
-    }
-
-    void SceneFrameData::removeInstance(const MeshInstance* meshInstance) {
-        assert([&]{ return meshInstancesDataMemoryBlocks.contains(meshInstance); },
-            "MeshInstance does not belong to the scene");
-        for (const auto& pipelineId : std::views::keys(pipelineIds)) {
-            if (shaderMaterialPipelinesData.contains(pipelineId)) {
-                shaderMaterialPipelinesData[pipelineId]->removeInstance(meshInstance);
+        if (shadowMapRenderers.contains(light)) {
+            const auto& shadowMapRenderer = std::static_pointer_cast<ShadowMapPass>(shadowMapRenderers.at(light));
+            // Without shadow maps, or without culling views this frame
+            if (shadowMapRenderer->getShadowMapSize() == 0 || !shadowMapViews.contains(shadowMapRenderer.get())) {
+                return lightData;
             }
-            if (transparentPipelinesData.contains(pipelineId)) {
-                transparentPipelinesData[pipelineId]->removeInstance(meshInstance);
+            lightData.castShadows = 1;
+            for (int i = 0; i < shadowMapRenderer->getShadowMapCount(); i++) {
+                lightData.shadowMapCoordinates[i] = shadowMapAtlas.getCoordinates(shadowMapRenderer->getShadowMapArea(i));
             }
-            if (opaquePipelinesData.contains(pipelineId)) {
-                opaquePipelinesData[pipelineId]->removeInstance(meshInstance);
+            switch (light->type) {
+                case LightType::LIGHT_DIRECTIONAL: {
+                    for (int cascadeIndex = 0; cascadeIndex < lightData.cascadesCount ; cascadeIndex++) {
+                        lightData.lightSpace[cascadeIndex] =
+                            shadowMapRenderer->getLightSpace(cascadeIndex);
+                        lightData.cascadeSplitDepth[cascadeIndex] =
+                            shadowMapRenderer->getCascadeSplitDepth(cascadeIndex);
+                    }
+                    break;
+                }
+                case LightType::LIGHT_SPOT: {
+                    lightData.lightSpace[0] = shadowMapRenderer->getLightSpace(0);
+                    break;
+                }
+                case LightType::LIGHT_OMNI: {
+                    break;
+                }
+                default:;
             }
         }
-        meshInstancesDataArray.free(meshInstancesDataMemoryBlocks.at(meshInstance));
-        meshInstancesDataMemoryBlocks.erase(meshInstance);
-        meshInstancesDataUpdated = true;
+        return lightData;
     }
 
     void SceneFrameData::drawOpaquesModels(
         vireo::CommandList& commandList,
-        const std::unordered_map<uint32, std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const {
-        if (opaquePipelinesData.empty()) { return; }
-        drawModels(commandList, pipelines, opaquePipelinesData);
+        const PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const {
+        if (instancesData.getOpaquePipelinesData().empty()) { return; }
+        drawModels(commandList, pipelines, instancesData.getOpaquePipelinesData());
+    }
+
+    void SceneFrameData::drawDisoccludedOpaquesModels(
+        vireo::CommandList& commandList,
+        const PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const {
+        if (!occlusionCullingEnabled || instancesData.getOpaquePipelinesData().empty()) { return; }
+        drawModels(commandList, pipelines, instancesData.getOpaquePipelinesData(), true);
     }
 
     void SceneFrameData::drawTransparentModels(
         vireo::CommandList& commandList,
-        const std::unordered_map<uint32, std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const {
-        if (transparentPipelinesData.empty()) { return; }
-        drawModels(commandList, pipelines, transparentPipelinesData);
+        const PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const {
+        if (instancesData.getTransparentPipelinesData().empty()) { return; }
+        drawModels(commandList, pipelines, instancesData.getTransparentPipelinesData());
     }
 
     void SceneFrameData::drawShaderMaterialModels(
         vireo::CommandList& commandList,
-        const std::unordered_map<uint32, std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const {
-        if (shaderMaterialPipelinesData.empty()) { return; }
-        drawModels(commandList, pipelines, shaderMaterialPipelinesData);
+        const PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const {
+        if (instancesData.getShaderMaterialPipelinesData().empty()) { return; }
+        drawModels(commandList, pipelines, instancesData.getShaderMaterialPipelinesData());
     }
 
 
     void SceneFrameData::drawModels(
         vireo::CommandList& commandList,
         const uint32 set,
-        const std::map<pipeline_id, std::shared_ptr<vireo::Buffer>>& culledDrawCommandsBuffers,
-        const std::map<pipeline_id, std::shared_ptr<vireo::Buffer>>& culledDrawCommandsCountBuffers,
-        const std::map<pipeline_id, std::shared_ptr<FrustumCulling>>& frustumCullingPipelines) const {
-        for (const auto& [pipelineId, pipelineData] : opaquePipelinesData) {
-            if (pipelineData->drawCommandsCount == 0 ||
-                frustumCullingPipelines.at(pipelineId)->getDrawCommandsCount() == 0) { continue; }
-            commandList.bindDescriptor(pipelineData->descriptorSet, set);
-            // commandList.drawIndexedIndirect(
-                // pipelineData->drawCommandsBuffer,
-                // 0,
-                // pipelineData->drawCommandsCount,
-                // sizeof(DrawCommand),
-                // sizeof(uint32));
-            commandList.drawIndexedIndirectCount(
-                culledDrawCommandsBuffers.at(pipelineId),
-                0,
-                culledDrawCommandsCountBuffers.at(pipelineId),
-                0,
-                pipelineData->drawCommandsCount,
-                sizeof(DrawCommand),
-                sizeof(uint32));
-        }
-        for (const auto& [pipelineId, pipelineData] : shaderMaterialPipelinesData) {
-            if (pipelineData->drawCommandsCount == 0 ||
-                frustumCullingPipelines.at(pipelineId)->getDrawCommandsCount() == 0) { continue; }
-            commandList.bindDescriptor(pipelineData->descriptorSet, set);
-            commandList.drawIndexedIndirectCount(
-                culledDrawCommandsBuffers.at(pipelineId),
-                0,
-                culledDrawCommandsCountBuffers.at(pipelineId),
-                0,
-                pipelineData->drawCommandsCount,
-                sizeof(DrawCommand),
-                sizeof(uint32));
-        }
-        for (const auto& [pipelineId, pipelineData] : transparentPipelinesData) {
-            if (pipelineData->drawCommandsCount == 0 ||
-                frustumCullingPipelines.at(pipelineId)->getDrawCommandsCount() == 0) { continue; }
-            commandList.bindDescriptor(pipelineData->descriptorSet, set);
-            commandList.drawIndexedIndirectCount(
-                culledDrawCommandsBuffers.at(pipelineId),
-                0,
-                culledDrawCommandsCountBuffers.at(pipelineId),
-                0,
-                pipelineData->drawCommandsCount,
-                sizeof(DrawCommand),
-                sizeof(uint32));
+        const Renderpass& shadowMapRenderer,
+        const uint32 shadowMapIndex,
+        const bool staticCasters) const {
+        auto viewIndex = 0u;
+        if (staticCasters) {
+            const auto it = shadowMapStaticViews.find({&shadowMapRenderer, shadowMapIndex});
+            if (it == shadowMapStaticViews.end()) { return; }
+            viewIndex = it->second;
+        } else {
+            const auto it = shadowMapViews.find(&shadowMapRenderer);
+            if (it == shadowMapViews.end()) { return; }
+            viewIndex = it->second + shadowMapIndex;
+        }
+        for (const auto* pipelinesData : {
+            &instancesData.getOpaquePipelinesData(),
+            &instancesData.getShaderMaterialPipelinesData(),
+            &instancesData.getTransparentPipelinesData() }) {
+            for (const auto& [pipelineId, pipelineData] : *pipelinesData) {
+                const auto range = frustumCulling.getRange(viewIndex, *pipelineData);
+                if (pipelineData->drawCommandsCount == 0 || range.drawCount == 0) { continue; }
+                commandList.bindDescriptor(pipelinesDescriptorSets.at(pipelineData->index), set);
+                commandList.drawIndexedIndirectCount(
+                    frustumCulling.getCompactedOutputBuffer(),
+                    range.offset,
+                    frustumCulling.getDrawCountsBuffer(),
+                    range.countOffset,
+                    range.drawCount,
+                    sizeof(DrawCommand),
+                    sizeof(uint32));
+            }
         }
     }
 
     void SceneFrameData::drawModels(
         vireo::CommandList& commandList,
-        const std::unordered_map<uint32, std::shared_ptr<vireo::GraphicPipeline>>& pipelines,
-        const std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>>& pipelinesData) const {
+        const PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>>& pipelines,
+        const PipelinesArray<std::unique_ptr<GraphicPipelineData>>& pipelinesData,
+        const bool disoccluded) const {
+        // The pipelines in the order of their ids, the draw groups of the opaque ones being sorted by the culling
         for (const auto& [pipelineId, pipelineData] : pipelinesData) {
-            if (pipelineData->drawCommandsCount == 0 ||
-                pipelineData->frustumCullingPipeline.getDrawCommandsCount() == 0) { continue; }
+            if (pipelineData->drawCommandsCount == 0) { continue; }
+            const auto* frameData = pipelinesFrameData.contains(pipelineData->index) ?
+                pipelinesFrameData.at(pipelineData->index).get() : nullptr;
+            if (disoccluded && !frameData) { continue; }
+            const auto range = frustumCulling.getRange(0, *pipelineData);
+            const auto clusters = frustumCulling.getClustersRange(*pipelineData);
+            if (!frameData && range.drawCount == 0 && clusters.maxDrawCount == 0) { continue; }
             const auto& pipeline = pipelines.at(pipelineId);
             commandList.bindPipeline(pipeline);
             commandList.bindDescriptors({
                 ctx.globalDescriptorSet,
                 ctx.samplers.getDescriptorSet(),
                 descriptorSet,
-                pipelineData->descriptorSet,
+                pipelinesDescriptorSets.at(pipelineData->index),
 #ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
                 descriptorSetOpt1,
 #endif
             });
 
-            commandList.drawIndexedIndirectCount(
-                pipelineData->culledDrawCommandsBuffer,
-                0,
-                pipelineData->culledDrawCommandsCountBuffer,
-                0,
-                pipelineData->drawCommandsCount,
-                sizeof(DrawCommand),
-                sizeof(uint32));
+            // One instanced draw per draw group and detail level with instances, compacted by the culling
+            if (frameData) {
+                commandList.drawIndexedIndirectCount(
+                    disoccluded ? frameData->compactedDisoccludedDrawCommandsBuffer : frameData->compactedCulledDrawCommandsBuffer,
+                    0,
+                    frameData->drawCountsBuffer,
+                    sizeof(uint32) * (disoccluded ?
+                        GraphicPipelineFrameData::DRAW_COUNT_DISOCCLUDED :
+                        GraphicPipelineFrameData::DRAW_COUNT_CULLED),
+                    pipelineData->drawGroupsCount * MESH_LODS_MAX,
+                    sizeof(DrawCommand),
+                    sizeof(uint32));
+            } else {
+                if (range.drawCount > 0) {
+                    commandList.drawIndexedIndirectCount(
+                        frustumCulling.getCompactedOutputBuffer(),
+                        range.offset,
+                        frustumCulling.getDrawCountsBuffer(),
+                        range.countOffset,
+                        range.drawCount,
+                        sizeof(DrawCommand),
+                        sizeof(uint32));
+                }
+                // One draw per visible cluster of the surfaces split in clusters
+                if (clusters.maxDrawCount > 0) {
+                    commandList.drawIndexedIndirectCount(
+                        frustumCulling.getClustersOutputBuffer(),
+                        clusters.offset,
+                        frustumCulling.getClustersCountsBuffer(),
+                        clusters.countOffset,
+                        clusters.maxDrawCount,
+                        sizeof(DrawCommand),
+                        sizeof(uint32));
+                }
+            }
         }
     }
 
     void SceneFrameData::enableLightShadowCasting(const Light* light) {
         if (light->castShadows && !shadowMapRenderers.contains(light) && (shadowMapRenderers.size() < ctx.config.maxShadowMapsPerScene)) {
-            const auto shadowMapRenderer = std::make_shared<ShadowMapPass>(
-                ctx,
-                light,
-                meshInstancesDataArray,
-                maxMeshSurfacePerPipeline);
+            // The shadow maps are allocated in the atlas by allocateShadowMaps()
+            const auto shadowMapRenderer = std::make_shared<ShadowMapPass>(ctx, light, shadowMapAtlas);
             // Log::info("enableLightShadowCasting for #", std::to_string(light->id));
             materialsUpdated = true; // force update pipelines
             shadowMapRenderers[light] = shadowMapRenderer;
-            const auto blankImage = ctx.res.get<ImageManager>().getBlankImage();
-            for (uint32 index = 0; index < shadowMaps.size(); index += 6) {
-                if (shadowMaps[index] == blankImage) {
-                    shadowMapIndex[light] = index;
-                    for (int i = 0; i < shadowMapRenderer->getShadowMapCount(); i++) {
-                        shadowMaps[index + i] = shadowMapRenderer->getShadowMap(i)->getImage();
-#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
-                        shadowTransparencyColorMaps[index + i] = shadowMapRenderer->getTransparencyColorMap(i)->getImage();
-#endif
-                    }
-                    shadowMapsUpdated = true;
-                    return;
-                }
-            }
-            throw Exception("Out of memory for shadow map");
+            updateLight(light);
         }
     }
 
     void SceneFrameData::disableLightShadowCasting(const Light* light) {
         if (shadowMapRenderers.contains(light)) {
             // Log::info("disableLightShadowCasting for #", std::to_string(light->id));
-            const auto& shadowMapRenderer = std::static_pointer_cast<ShadowMapPass>(shadowMapRenderers.at(light));
-            const auto index = shadowMapIndex[light];
-            const auto& blankImage = ctx.res.get<ImageManager>().getBlankImage();
-            for (int i = 0; i < shadowMapRenderer->getShadowMapCount(); i++) {
-                shadowMaps[index + i] = blankImage;
-#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
-                shadowTransparencyColorMaps[index + i] = blankImage;
-#endif
-            }
-            shadowMapsUpdated = true;
-            shadowMapIndex.erase(light);
+            // The shadow maps are freed in the atlas by the render pass
             shadowMapRenderers.erase(light);
+            updateLight(light);
         }
     }
 
+    void SceneFrameData::allocateShadowMaps(const Camera& camera) {
+        struct Request {
+            ShadowMapPass* renderer;
+            float importance;
+            uint32 size;
+        };
+        auto requests = std::vector<Request>{};
+        for (const auto [light, renderpass] : shadowMapRenderers) {
+            const auto shadowMapRenderer = static_cast<ShadowMapPass*>(renderpass.get());
+            if (!light->visible) { continue; }
+            const auto importance = shadowMapRenderer->getImportance(camera);
+            const auto size = shadowMapRenderer->getRequestedShadowMapSize(importance);
+            if (size < shadowMapRenderer->getShadowMapSize()) {
+                // The shrinks first, freeing space for the others
+                shadowMapRenderer->allocateShadowMaps(size);
+            } else if (size > shadowMapRenderer->getShadowMapSize()) {
+                requests.push_back({shadowMapRenderer, importance, size});
+            }
+        }
+        // The most important lights first, a light is given a smaller size than requested if the atlas is full
+        std::ranges::stable_sort(requests, std::greater{}, &Request::importance);
+        for (const auto& request : requests) {
+            const auto minSize = std::max(
+                request.renderer->getShadowMapSize() * 2,
+                ShadowMapAtlas::MIN_SHADOW_MAP_SIZE);
+            for (auto size = request.size; size >= minSize; size /= 2) {
+                if (request.renderer->allocateShadowMaps(size)) { break; }
+            }
+        }
+    }
 
-}
\ No newline at end of file
+}
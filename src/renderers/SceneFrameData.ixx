@@ -7,6 +7,7 @@
 export module lysa.renderers.scene_frame_data;
 
 import vireo;
+import lysa.aabb;
 import lysa.context;
 import lysa.math;
 import lysa.memory;
@@ -18,16 +19,33 @@ import lysa.resources.manager;
 import lysa.resources.mesh_instance;
 import lysa.renderers.configuration;
 import lysa.renderers.graphic_pipeline_data;
+import lysa.renderers.pipelines_array;
 import lysa.renderers.pipelines.frustum_culling;
+import lysa.renderers.pipelines.light_clustering;
+import lysa.renderers.pipelines.occlusion_culling;
+import lysa.renderers.scene_instances_data;
+import lysa.renderers.shadow_map_atlas;
 import lysa.renderers.renderpasses.renderpass;
 
 export namespace lysa {
 
+    /**
+     * Number of shadow maps (cascades or cube faces) drawn with or without the cached depth of the static shadow casters
+     */
+    struct ShadowMapCacheStatistics {
+        /** Shadow maps whose static shadow casters were copied from the cache */
+        uint32 hitsCount{0};
+        /** Shadow maps whose static shadow casters were rendered again in the cache */
+        uint32 missesCount{0};
+    };
+
     /**
      * Manages per-frame scene data for rendering.
      *
      * SceneFrameData handles the storage and update of scene-wide information,
-     * including cameras, lights, environment settings, and mesh instance data.
+     * including cameras, lights and environment settings. The mesh instances are
+     * stored in a SceneInstancesData shared by all the frames in flight, only the
+     * transient culling results are owned by each frame.
      * It also manages descriptor sets and buffers required for rendering.
      */
     class SceneFrameData {
@@ -38,12 +56,16 @@ export namespace lysa {
         static constexpr vireo::DescriptorIndex BINDING_MODELS{1};
         /** Descriptor binding for lights buffer. */
         static constexpr vireo::DescriptorIndex BINDING_LIGHTS{2};
-        /** Descriptor binding for shadow maps array. */
-        static constexpr vireo::DescriptorIndex BINDING_SHADOW_MAPS{3};
+        /** Descriptor binding for the number of lights of each light cluster. */
+        static constexpr vireo::DescriptorIndex BINDING_CLUSTERS_LIGHTS_COUNTS{3};
+        /** Descriptor binding for the lights indices of each light cluster. */
+        static constexpr vireo::DescriptorIndex BINDING_CLUSTERS_LIGHTS{4};
+        /** Descriptor binding for the shadow maps atlas. */
+        static constexpr vireo::DescriptorIndex BINDING_SHADOW_MAPS{5};
         /** Shared descriptor layout for the main scene set. */
         inline static std::shared_ptr<vireo::DescriptorLayout> sceneDescriptorLayout{nullptr};
 
-        /** Optional descriptor binding: transparency color for shadow maps. */
+        /** Optional descriptor binding: transparency color atlas for shadow maps. */
         static constexpr vireo::DescriptorIndex BINDING_SHADOW_MAP_TRANSPARENCY_COLOR{0};
 #ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
         /** Optional descriptor layout (set used when transparency color is needed). */
@@ -75,14 +97,14 @@ export namespace lysa {
          * Constructs a new SceneFrameData object.
          * 
          * @param ctx Reference to the global context.
+         * @param instancesData Mesh instances store shared by the frames in flight.
          * @param maxLights Maximum number of lights supported.
-         * @param maxMeshInstancesPerScene Maximum number of mesh instances per scene.
          * @param maxMeshSurfacePerPipeline Maximum number of mesh surfaces per pipeline.
          */
         SceneFrameData(
             const Context& ctx,
+            SceneInstancesData& instancesData,
             uint32 maxLights,
-            uint32 maxMeshInstancesPerScene,
             uint32 maxMeshSurfacePerPipeline);
 
         /**
@@ -96,7 +118,8 @@ export namespace lysa {
         /**
          * Updates CPU/GPU scene state.
          * 
-         * Synchronizes uniforms, lights, instances, and descriptors for the current frame.
+         * Synchronizes uniforms, lights, and descriptors for the current frame and
+         * copies the pending modifications of the shared mesh instances store.
          * 
          * @param commandList Command buffer for GPU operations.
          * @param camera The current camera.
@@ -108,30 +131,59 @@ export namespace lysa {
         /**
          * Executes compute workloads.
          * 
-         * Performs operations such as frustum culling.
+         * Culls the draw commands of all the pipelines for the camera and the
+         * shadow maps in a single dispatch, assigns the lights to the light
+         * clusters of the camera, then executes the first phase of the
+         * occlusion culling of the opaque models.
          * 
          * @param commandList Command buffer for GPU operations.
          * @param camera The current camera.
          */
-        void compute(vireo::CommandList& commandList, const Camera& camera) const;
+        void compute(vireo::CommandList& commandList, const Camera& camera);
+
+        /**
+         * Executes the second phase of the occlusion culling of the opaque models.
+         *
+         * Must be called after the first phase draw commands have been rendered in the
+         * depth buffer and the depth pyramid built from it.
+         *
+         * @param commandList Command buffer for GPU operations.
+         * @param depthPyramid Levels of the depth pyramid.
+         * @param levelsCount Number of levels used in depthPyramid.
+         */
+        void computeOcclusion(
+            vireo::CommandList& commandList,
+            const std::vector<std::shared_ptr<vireo::Image>>& depthPyramid,
+            uint32 levelsCount) const;
+
+        /**
+         * Returns the occlusion culling counters of the opaque models, as computed the last time
+         * this frame in flight was rendered with RendererConfiguration::cullingStatisticsEnabled.
+         */
+        OcclusionCullingStatistics getOcclusionCullingStatistics() const;
 
         /**
-         * Adds a mesh instance to the scene.
-         * @param meshInstance Pointer to the mesh instance to add.
+         * Returns the frustum culling counters of all the models, as computed the last time
+         * this frame in flight was rendered with RendererConfiguration::cullingStatisticsEnabled.
          */
-        void addInstance(const MeshInstance* meshInstance);
+        const auto& getFrustumCullingStatistics() const { return frustumCulling.getStatistics(); }
 
         /**
-         * Updates an existing mesh instance in the scene.
-         * @param meshInstance Pointer to the mesh instance to update.
+         * Returns the number of mesh instances, added or updated, uploaded by the last update() of this frame in flight.
          */
-        void updateInstance(const MeshInstance* meshInstance);
+        auto getUploadedInstancesCount() const { return uploadedInstancesCount; }
 
         /**
-         * Removes a mesh instance from the scene.
-         * @param meshInstance Pointer to the mesh instance to remove.
+         * Returns the static cache counters of all the shadow maps, as computed the last time
+         * this frame in flight was rendered.
          */
-        void removeInstance(const MeshInstance* meshInstance);
+        ShadowMapCacheStatistics getShadowMapCacheStatistics() const;
+
+        /**
+         * Invalidates the cached depth of the static shadow casters in the shadow maps intersecting some boxes.
+         * @param aabbs World AABB of the modified static shadow casters, before and after their modification.
+         */
+        void invalidateShadowMapsStaticCache(const std::vector<AABB>& aabbs);
 
         /**
          * Adds a light to the scene.
@@ -145,65 +197,84 @@ export namespace lysa {
          */
         void removeLight(const Light* light);
 
+        /**
+         * Forces the upload of the parameters of a light by the next update().
+         * The modified lights are detected by update(), comparing their parameters with the uploaded ones.
+         * @param light Pointer to the light to update.
+         */
+        void updateLight(const Light* light);
+
         /**
          * Issues draw calls for opaque models.
          * @param commandList Command buffer to record into.
-         * @param pipelines   Map of material/pipeline identifiers to pipelines.
+         * @param pipelines   Pipelines indexed by material/pipeline identifier.
          */
         void drawOpaquesModels(
            vireo::CommandList& commandList,
-           const std::unordered_map<uint32, std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const;
+           const PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const;
+
+        /**
+         * Issues draw calls for the opaque models made visible by the second phase of the occlusion culling.
+         * @param commandList Command buffer to record into.
+         * @param pipelines   Pipelines indexed by material/pipeline identifier.
+         */
+        void drawDisoccludedOpaquesModels(
+           vireo::CommandList& commandList,
+           const PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const;
 
         /**
          * Issues draw calls for transparent models.
          * @param commandList Command buffer to record into.
-         * @param pipelines   Map of material/pipeline identifiers to pipelines.
+         * @param pipelines   Pipelines indexed by material/pipeline identifier.
          */
         void drawTransparentModels(
            vireo::CommandList& commandList,
-           const std::unordered_map<uint32, std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const;
+           const PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const;
 
         /**
          * Issues draw calls for models driven by shader materials/special passes.
          * @param commandList Command buffer to record into.
-         * @param pipelines   Map of material/pipeline identifiers to pipelines.
+         * @param pipelines   Pipelines indexed by material/pipeline identifier.
          */
         void drawShaderMaterialModels(
            vireo::CommandList& commandList,
-           const std::unordered_map<uint32, std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const;
+           const PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>>& pipelines) const;
 
         /**
-         * Issues multi-draw indirect calls for models.
+         * Issues multi-draw indirect calls for the models casting shadows in a shadow map.
          * 
          * @param commandList Command buffer to record into.
          * @param set Descriptor set index.
-         * @param culledDrawCommandsBuffers Map of buffers containing indirect draw commands.
-         * @param culledDrawCommandsCountBuffers Map of buffers containing indirect draw counts.
-         * @param frustumCullingPipelines Map of frustum culling pipelines.
+         * @param shadowMapRenderer Shadow map render pass of a light of the scene.
+         * @param shadowMapIndex Index of the culling view in the render pass, one per shadow map or one for a single pass cube map.
+         * @param staticCasters true to draw the static shadow casters rendered in the cache of the shadow map.
          */
         void drawModels(
            vireo::CommandList& commandList,
            uint32 set,
-           const std::map<pipeline_id, std::shared_ptr<vireo::Buffer>>& culledDrawCommandsBuffers,
-           const std::map<pipeline_id, std::shared_ptr<vireo::Buffer>>& culledDrawCommandsCountBuffers,
-           const std::map<pipeline_id, std::shared_ptr<FrustumCulling>>& frustumCullingPipelines) const;
+           const Renderpass& shadowMapRenderer,
+           uint32 shadowMapIndex,
+           bool staticCasters = false) const;
 
         /**
          * Returns the mapping of pipeline identifiers to their materials.
          * @return A reference to the pipeline to materials map.
          */
-        const auto& getPipelineIds() const { return pipelineIds; }
+        const auto& getPipelineIds() const { return instancesData.getPipelineIds(); }
 
         /**
          * Checks if materials have been updated.
          * @return True if materials were updated and pipelines/descriptors must be refreshed.
          */
-        auto isMaterialsUpdated() const { return materialsUpdated; }
+        auto isMaterialsUpdated() const { return materialsUpdated || instancesData.isMaterialsUpdated(); }
 
         /**
          * Resets the materials updated flag.
          */
-        void resetMaterialsUpdated() { materialsUpdated = false; }
+        void resetMaterialsUpdated() {
+            materialsUpdated = false;
+            instancesData.resetMaterialsUpdated();
+        }
 
         /**
          * Returns the main descriptor set.
@@ -232,8 +303,10 @@ export namespace lysa {
     private:
         /*Reference to the engine context. */
         const Context& ctx;
-        /* Reference to the material manager. */
-        MaterialManager& materialManager;
+        /* Mesh instances store shared by the frames in flight. */
+        SceneInstancesData& instancesData;
+        /* Number of mesh instances uploaded by the last update(). */
+        uint32 uploadedInstancesCount{0};
         /* Maximum number of supported lights. */
         const uint32 maxLights;
         /* Maximum number of mesh surfaces per pipeline. */
@@ -248,72 +321,99 @@ export namespace lysa {
         std::shared_ptr<vireo::Buffer> sceneUniformBuffer;
         /* Current environment settings. */
         Environment environment;
+        /* Atlas of the shadow maps of all the lights, declared before the render passes using its areas. */
+        ShadowMapAtlas shadowMapAtlas;
         /* Map of lights to their shadow-map render passes. */
         std::map<const Light*, std::shared_ptr<Renderpass>> shadowMapRenderers;
-        /* Array of shadow map images. */
-        std::vector<std::shared_ptr<vireo::Image>> shadowMaps;
-#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
-        /* Array of transparency-color shadow maps. */
-        std::vector<std::shared_ptr<vireo::Image>> shadowTransparencyColorMaps;
-#endif
-        /* Associates each light with a shadow map index. */
-        std::map<const Light*, uint32> shadowMapIndex;
         /* Lights scheduled for removal. */
         std::unordered_set<const Light*> removedLights;
-        /* Flag set if shadow maps have changed. */
-        bool shadowMapsUpdated{false};
-
-        /* Device array for per-mesh-instance data. */
-        DeviceMemoryArray meshInstancesDataArray;
-        /* Memory blocks in meshInstancesDataArray per mesh instance. */
-        std::unordered_map<const MeshInstance*, MemoryBlock> meshInstancesDataMemoryBlocks{};
-        /* Flag set if mesh instance data changed. */
-        bool meshInstancesDataUpdated{false};
-
-        /* Mapping of pipeline id to its materials. */
-        std::unordered_map<pipeline_id, std::vector<unique_id>> pipelineIds;
-        /* Flag set when the materials list changes. */
+
+        /* Flag set when the pipelines must be refreshed for a new shadow map renderer. */
         bool materialsUpdated{false};
 
-        /* List of active lights. */
-        std::unordered_set<const Light*> lights;
+        /* Initial number of light slots in lightsBuffer. */
+        static constexpr uint32 LIGHTS_INITIAL_CAPACITY{16};
+        /* Active lights in the order of their slots in lightsBuffer, a removed light is replaced by the last one. */
+        std::vector<const Light*> lights;
+        /* Slot of each active light in lights and lightsBuffer. */
+        std::unordered_map<const Light*, uint32> lightsSlots;
+        /* Slots of lightsBuffer to upload by the next update() even if their parameters did not change. */
+        std::set<uint32> dirtyLights;
+        /* Parameters of the lights as last uploaded in each slot of lightsBuffer. */
+        std::vector<LightData> uploadedLights;
         /* GPU buffer for packed light parameters. */
         std::shared_ptr<vireo::Buffer> lightsBuffer;
-        /* Number of allocated light slots in lightsBuffer. */
-        uint32 lightsBufferCount{1};
-
-        /* Recycle bin for indirect draw commands staging buffers. */
-        std::unordered_set<std::shared_ptr<vireo::Buffer>> drawCommandsStagingBufferRecycleBin;
+        /* Staging buffer with the layout of lightsBuffer, the dirty slots are copied by contiguous ranges. */
+        std::shared_ptr<vireo::Buffer> lightsStagingBuffer;
+        /* Number of allocated light slots in lightsBuffer, doubled when full. */
+        uint32 lightsCapacity{LIGHTS_INITIAL_CAPACITY};
+        /* Flag set until lightsBuffer leaves the COPY_DST state it is created in. */
+        bool lightsBufferCreated{true};
+        /* Assignment of the visible lights to the light clusters of the camera. */
+        LightClustering lightClustering;
+
+        /* Frustum culling of all the pipelines for the camera and the shadow maps. */
+        FrustumCulling frustumCulling;
+        /* Points of view of this frame : the camera first, then the shadow maps. */
+        std::vector<CullingView> cullingViews = std::vector<CullingView>(1);
+        /* Index of the first point of view of each shadow map renderer in cullingViews. */
+        std::unordered_map<const Renderpass*, uint32> shadowMapViews;
+        /* Index in cullingViews of the static shadow casters of the shadow maps whose cache is rendered this frame. */
+        std::map<std::pair<const Renderpass*, uint32>, uint32> shadowMapStaticViews;
+        /* Descriptor set of each pipeline data for this frame, with the instances indices of the culling, indexed by GraphicPipelineData::index. */
+        PipelinesArray<std::shared_ptr<vireo::DescriptorSet>> pipelinesDescriptorSets;
+        /* Instances indices buffer of the culling bound in pipelinesDescriptorSets. */
+        std::shared_ptr<vireo::Buffer> instancesIndicesBuffer;
+        /* Occlusion culled draw commands of each opaque pipeline data for this frame, indexed by GraphicPipelineData::index. */
+        PipelinesArray<std::unique_ptr<GraphicPipelineFrameData>> pipelinesFrameData;
+        /* Flag set if the opaque models are culled with the two-phase occlusion culling. */
+        bool occlusionCullingEnabled{false};
+        /* Flag set if the culling counters are read back for diagnostics. */
+        bool cullingStatisticsEnabled{false};
+        /* Selection of the mesh detail levels by the culling. */
+        CullingLodSettings cullingLodSettings{};
+        /* Minimum projected size of the mesh instances culled for the camera. */
+        float cullingMinScreenSize{0.0f};
+        /* Flag set if the draw groups of the opaque models are drawn front to back. */
+        bool frontToBackSortingEnabled{false};
+
+        void updatePipelinesFrameData(
+            const vireo::CommandList& commandList,
+            const PipelinesArray<std::unique_ptr<GraphicPipelineData>>& pipelinesData,
+            bool withOcclusionCulling);
 
-        /* Opaque pipelines data. */
-        std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>> opaquePipelinesData;
-        /* Shader material pipelines data. */
-        std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>> shaderMaterialPipelinesData;
-        /* Transparent pipelines data. */
-        std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>> transparentPipelinesData;
+        void updatePipelinesDescriptorSets(const std::vector<CullingPipeline>& cullingPipelines);
 
-        void updatePipelinesData(
-            const vireo::CommandList& commandList,
-            const std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>>& pipelinesData);
+        /* Marks the resources of the draw groups seen by the camera as used, for the residency. */
+        void touchVisibleResources(const std::vector<CullingPipeline>& cullingPipelines) const;
 
-        void compute(
-            const Camera& camera,
+        /* Compacts the culled, and after the second phase the disoccluded, draw commands of an occlusion culling. */
+        static void compactOcclusionCulling(
             vireo::CommandList& commandList,
-            const std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>>& pipelinesData) const;
+            const GraphicPipelineData& pipelineData,
+            GraphicPipelineFrameData& frameData,
+            bool withDisoccluded);
 
-        void addInstance(
-            pipeline_id pipelineId,
-            const MeshInstance*& meshInstance,
-            std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>>& pipelinesData);
+        void addCullingPipelines(
+            std::vector<CullingPipeline>& cullingPipelines,
+            const PipelinesArray<std::unique_ptr<GraphicPipelineData>>& pipelinesData,
+            bool frontToBack) const;
 
         void drawModels(
             vireo::CommandList& commandList,
-            const std::unordered_map<uint32, std::shared_ptr<vireo::GraphicPipeline>>& pipelines,
-            const std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>>& pipelinesData) const;
+            const PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>>& pipelines,
+            const PipelinesArray<std::unique_ptr<GraphicPipelineData>>& pipelinesData,
+            bool disoccluded = false) const;
+
+        /* Parameters of a light in lightsBuffer, an invisible light keeps its slot with an unknown type. */
+        LightData getLightData(const Light* light) const;
 
         void enableLightShadowCasting(const Light* light);
 
         void disableLightShadowCasting(const Light* light);
+
+        /* Reallocates the shadow maps in the atlas with the resolutions requested by the importance of the lights. */
+        void allocateShadowMaps(const Camera& camera);
     };
 
 }
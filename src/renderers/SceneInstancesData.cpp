@@ -0,0 +1,162 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+module lysa.renderers.scene_instances_data;
+
+import lysa.exception;
+import lysa.log;
+
+namespace lysa {
+
+    SceneInstancesData::SceneInstancesData(
+        const Context& ctx,
+        const uint32 maxMeshInstancesPerScene,
+        const uint32 maxMeshSurfacePerPipeline) :
+        ctx(ctx),
+        materialManager(ctx.res.get<MaterialManager>()),
+        residencyManager(ctx.res.get<ResidencyManager>()),
+        maxMeshSurfacePerPipeline(maxMeshSurfacePerPipeline),
+        meshInstancesDataArray{ctx.vireo,
+            sizeof(MeshInstanceData),
+            maxMeshInstancesPerScene,
+            maxMeshInstancesPerScene,
+            vireo::BufferType::DEVICE_STORAGE,
+            "meshInstancesData",
+            ctx.config.framesInFlight} {
+    }
+
+    void SceneInstancesData::update(const vireo::CommandList& commandList) {
+        framesCount += 1;
+        uploadedInstancesCount = writtenInstancesCount;
+        writtenInstancesCount = 0;
+        if (meshInstancesDataUpdated) {
+            meshInstancesDataArray.flush(commandList);
+            meshInstancesDataArray.postBarrier(commandList);
+            meshInstancesDataUpdated = false;
+        }
+        for (const auto* pipelinesData : { &opaquePipelinesData, &shaderMaterialPipelinesData, &transparentPipelinesData }) {
+            for (const auto& [pipelineId, pipelineData] : *pipelinesData) {
+                pipelineData->updateData(commandList);
+            }
+        }
+    }
+
+    void SceneInstancesData::forEachResource(
+        const MeshInstance* meshInstance,
+        const std::function<void(ResidencyType, unique_id)>& callback) const {
+        const auto& mesh = meshInstance->getMesh();
+        callback(ResidencyType::MESH, mesh.id);
+        for (int i = 0; i < mesh.getSurfaces().size(); i++) {
+            const auto& material = materialManager[meshInstance->getSurfaceMaterial(i)];
+            if (material.getType() == Material::STANDARD) {
+                for (const auto image : static_cast<const StandardMaterial&>(material).getImages()) {
+                    callback(ResidencyType::IMAGE, image);
+                }
+            }
+        }
+    }
+
+    void SceneInstancesData::touchResources(const MeshInstance* meshInstance) const {
+        forEachResource(meshInstance, [&](const ResidencyType type, const unique_id id) {
+            residencyManager.touch(type, id);
+        });
+    }
+
+    void SceneInstancesData::addInstance(const MeshInstance* meshInstance) {
+        const auto& mesh = meshInstance->getMesh();
+        assert([&]{ return !meshInstancesDataMemoryBlocks.contains(meshInstance);}, "Mesh instance already in the scene");
+        assert([&]{return !mesh.getMaterials().empty(); }, "Models without materials are not supported");
+        // Reference the mesh & images, restoring them in VRAM if they have been evicted
+        forEachResource(meshInstance, [&](const ResidencyType type, const unique_id id) {
+            residencyManager.acquire(type, id);
+        });
+        assert([&]{return mesh.isUploaded(); }, "Mesh instance is not in VRAM");
+
+        const auto meshInstanceData = meshInstance->getData();
+        meshInstancesDataMemoryBlocks[meshInstance] = meshInstancesDataArray.alloc(1);
+        meshInstancesDataArray.write(meshInstancesDataMemoryBlocks[meshInstance], &meshInstanceData);
+        meshInstancesDataUpdated = true;
+        writtenInstancesCount += 1;
+
+        auto haveTransparentMaterial{false};
+        auto haveShaderMaterial{false};
+        auto nodePipelineIds = std::set<uint32>{};
+        for (int i = 0; i < mesh.getSurfaces().size(); i++) {
+            const auto& material = materialManager[meshInstance->getSurfaceMaterial(i)];
+            haveTransparentMaterial = material.getTransparency() != Transparency::DISABLED;
+            haveShaderMaterial = material.getType() == Material::SHADER;
+            const auto id = material.getPipelineId();
+            nodePipelineIds.insert(id);
+            if (!pipelineIds.contains(id)) {
+                pipelineIds[id].push_back(material.id);
+                materialsUpdated = true;
+            }
+        }
+
+        for (const auto& pipelineId : nodePipelineIds) {
+            if (haveShaderMaterial) {
+                addInstance(pipelineId, meshInstance, shaderMaterialPipelinesData);
+            } else if (haveTransparentMaterial) {
+                addInstance(pipelineId, meshInstance, transparentPipelinesData);
+            } else {
+                addInstance(pipelineId, meshInstance, opaquePipelinesData);
+            }
+        }
+    }
+
+    void SceneInstancesData::updateInstances(std::vector<const MeshInstance*>& meshInstances) {
+        if (meshInstances.empty()) { return; }
+        std::ranges::sort(meshInstances, {}, [&](const MeshInstance* meshInstance) {
+            return meshInstancesDataMemoryBlocks.at(meshInstance).offset;
+        });
+        auto data = std::vector<MeshInstanceData>{};
+        for (auto i = 0; i < meshInstances.size();) {
+            // Gather the instances stored in consecutive blocks and write them at once
+            const auto& first = meshInstancesDataMemoryBlocks.at(meshInstances[i]);
+            data.clear();
+            data.push_back(meshInstances[i]->getData());
+            while (++i < meshInstances.size() &&
+                   meshInstancesDataMemoryBlocks.at(meshInstances[i]).offset == first.offset + data.size() * sizeof(MeshInstanceData)) {
+                data.push_back(meshInstances[i]->getData());
+            }
+            meshInstancesDataArray.write(
+                {first.instanceIndex, first.offset, data.size() * sizeof(MeshInstanceData)},
+                data.data());
+        }
+        meshInstancesDataUpdated = true;
+        writtenInstancesCount += static_cast<uint32>(meshInstances.size());
+    }
+
+    void SceneInstancesData::addInstance(
+        pipeline_id pipelineId,
+        const MeshInstance*& meshInstance,
+        PipelinesArray<std::unique_ptr<GraphicPipelineData>>& pipelinesData) {
+        if (!pipelinesData.contains(pipelineId)) {
+            pipelinesData.emplace(pipelineId, std::make_unique<GraphicPipelineData>(
+                ctx, pipelineId, pipelinesDataCount++, maxMeshSurfacePerPipeline));
+        }
+        pipelinesData.at(pipelineId)->addInstance(meshInstance, meshInstancesDataMemoryBlocks);
+    }
+
+    void SceneInstancesData::removeInstance(const MeshInstance* meshInstance) {
+        assert([&]{ return meshInstancesDataMemoryBlocks.contains(meshInstance); },
+            "MeshInstance does not belong to the scene");
+        for (const auto& pipelineId : std::views::keys(pipelineIds)) {
+            for (auto* pipelinesData : { &shaderMaterialPipelinesData, &transparentPipelinesData, &opaquePipelinesData }) {
+                if (pipelinesData->contains(pipelineId)) {
+                    pipelinesData->at(pipelineId)->removeInstance(meshInstance);
+                }
+            }
+        }
+        meshInstancesDataArray.free(meshInstancesDataMemoryBlocks.at(meshInstance));
+        meshInstancesDataMemoryBlocks.erase(meshInstance);
+        meshInstancesDataUpdated = true;
+        forEachResource(meshInstance, [&](const ResidencyType type, const unique_id id) {
+            residencyManager.release(type, id);
+        });
+    }
+
+}
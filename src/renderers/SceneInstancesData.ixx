@@ -0,0 +1,179 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.renderers.scene_instances_data;
+
+import vireo;
+import lysa.context;
+import lysa.memory;
+import lysa.resources.material;
+import lysa.resources.manager;
+import lysa.resources.mesh_instance;
+import lysa.resources.residency;
+import lysa.renderers.graphic_pipeline_data;
+import lysa.renderers.pipelines_array;
+
+export namespace lysa {
+
+    /**
+     * Persistent GPU store of the mesh instances of a scene, shared by all the frames in flight.
+     *
+     * The mesh instances data, the per-pipeline instances and the draw commands are
+     * written once when the scene changes. The modifications are staged in one
+     * staging buffer per frame in flight (a delta ring) and copied into the device
+     * buffers by the update command list of the next frame. Only the transient data,
+     * culled draw commands and counters, is owned by each SceneFrameData.
+     */
+    class SceneInstancesData {
+    public:
+        /**
+         * Constructs the instances store of a scene.
+         *
+         * @param ctx Reference to the global context.
+         * @param maxMeshInstancesPerScene Maximum number of mesh instances per scene.
+         * @param maxMeshSurfacePerPipeline Maximum number of mesh surfaces per pipeline.
+         */
+        SceneInstancesData(
+            const Context& ctx,
+            uint32 maxMeshInstancesPerScene,
+            uint32 maxMeshSurfacePerPipeline);
+
+        /**
+         * Copies the modifications made since the last call into the device buffers.
+         * Must be called once per frame, in the update command list of the frame.
+         *
+         * @param commandList Command buffer for GPU operations.
+         */
+        void update(const vireo::CommandList& commandList);
+
+        /**
+         * Returns the number of mesh instances, added or updated, copied into the device buffers by the last update().
+         */
+        auto getUploadedInstancesCount() const { return uploadedInstancesCount; }
+
+        /**
+         * Returns the number of update() calls, the frames of the scene counted across all the frames in flight.
+         */
+        auto getFramesCount() const { return framesCount; }
+
+        /**
+         * Adds a mesh instance.
+         * @param meshInstance Pointer to the mesh instance to add.
+         */
+        void addInstance(const MeshInstance* meshInstance);
+
+        /**
+         * Updates a batch of existing mesh instances, contiguous instances are written as one range.
+         * @param meshInstances Mesh instances to update.
+         */
+        void updateInstances(std::vector<const MeshInstance*>& meshInstances);
+
+        /**
+         * Removes a mesh instance.
+         * @param meshInstance Pointer to the mesh instance to remove.
+         */
+        void removeInstance(const MeshInstance* meshInstance);
+
+        /**
+         * Checks if a mesh instance has been added.
+         * @param meshInstance Pointer to the mesh instance.
+         */
+        bool haveInstance(const MeshInstance* meshInstance) const {
+            return meshInstancesDataMemoryBlocks.contains(meshInstance);
+        }
+
+        /**
+         * Marks the mesh and the images of a mesh instance as seen during the current frame.
+         * @param meshInstance Mesh instance kept by the frustum culling.
+         */
+        void touchResources(const MeshInstance* meshInstance) const;
+
+        /**
+         * Returns the device array of the per-mesh-instance data.
+         */
+        const auto& getMeshInstancesDataArray() const { return meshInstancesDataArray; }
+
+        /**
+         * Returns the opaque pipelines data, indexed by pipeline id.
+         */
+        const auto& getOpaquePipelinesData() const { return opaquePipelinesData; }
+
+        /**
+         * Returns the shader material pipelines data, indexed by pipeline id.
+         */
+        const auto& getShaderMaterialPipelinesData() const { return shaderMaterialPipelinesData; }
+
+        /**
+         * Returns the transparent pipelines data, indexed by pipeline id.
+         */
+        const auto& getTransparentPipelinesData() const { return transparentPipelinesData; }
+
+        /**
+         * Returns the mapping of pipeline identifiers to their materials.
+         */
+        const auto& getPipelineIds() const { return pipelineIds; }
+
+        /**
+         * Checks if new pipelines have been added since the last resetMaterialsUpdated().
+         */
+        auto isMaterialsUpdated() const { return materialsUpdated; }
+
+        /**
+         * Resets the materials updated flag.
+         */
+        void resetMaterialsUpdated() { materialsUpdated = false; }
+
+        SceneInstancesData(SceneInstancesData&) = delete;
+        SceneInstancesData& operator=(SceneInstancesData&) = delete;
+
+    private:
+        /* Reference to the engine context. */
+        const Context& ctx;
+        /* Reference to the material manager. */
+        MaterialManager& materialManager;
+        /* GPU memory budget manager, references the resources used by the scene. */
+        ResidencyManager& residencyManager;
+        /* Maximum number of mesh surfaces per pipeline. */
+        const uint32 maxMeshSurfacePerPipeline;
+
+        /* Device array for per-mesh-instance data. */
+        DeviceMemoryArray meshInstancesDataArray;
+        /* Memory blocks in meshInstancesDataArray per mesh instance. */
+        std::unordered_map<const MeshInstance*, MemoryBlock> meshInstancesDataMemoryBlocks{};
+        /* Flag set if mesh instance data changed. */
+        bool meshInstancesDataUpdated{false};
+        /* Number of mesh instances written since the last update(). */
+        uint32 writtenInstancesCount{0};
+        /* Number of mesh instances copied by the last update(). */
+        uint32 uploadedInstancesCount{0};
+        /* Number of update() calls. */
+        uint64 framesCount{0};
+
+        /* Mapping of pipeline id to its materials. */
+        std::unordered_map<pipeline_id, std::vector<unique_id>> pipelineIds;
+        /* Flag set when the materials list changes. */
+        bool materialsUpdated{false};
+
+        /* Opaque pipelines data. */
+        PipelinesArray<std::unique_ptr<GraphicPipelineData>> opaquePipelinesData;
+        /* Shader material pipelines data. */
+        PipelinesArray<std::unique_ptr<GraphicPipelineData>> shaderMaterialPipelinesData;
+        /* Transparent pipelines data. */
+        PipelinesArray<std::unique_ptr<GraphicPipelineData>> transparentPipelinesData;
+        /* Number of pipelines data created, the index of the next one. */
+        uint32 pipelinesDataCount{0};
+
+        void addInstance(
+            pipeline_id pipelineId,
+            const MeshInstance*& meshInstance,
+            PipelinesArray<std::unique_ptr<GraphicPipelineData>>& pipelinesData);
+
+        void forEachResource(
+            const MeshInstance* meshInstance,
+            const std::function<void(ResidencyType, unique_id)>& callback) const;
+    };
+
+}
@@ -0,0 +1,129 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+module lysa.renderers.shadow_map_atlas;
+
+import lysa.virtual_fs;
+
+namespace lysa {
+
+    std::shared_ptr<vireo::DescriptorLayout> ShadowMapAtlas::copyDescriptorLayout;
+    std::shared_ptr<vireo::GraphicPipeline> ShadowMapAtlas::clearPipeline;
+    std::shared_ptr<vireo::GraphicPipeline> ShadowMapAtlas::copyPipeline;
+
+    ShadowMapAtlas::ShadowMapAtlas(const Context& ctx, const uint32 size) :
+        ctx{ctx},
+        packer{size, MIN_SHADOW_MAP_SIZE} {
+        const auto& vireo = *ctx.vireo;
+        shadowMaps = vireo.createRenderTarget(
+            vireo::ImageFormat::D32_SFLOAT,
+            packer.getSize(),
+            packer.getSize(),
+            vireo::RenderTargetType::DEPTH,
+            { .depthStencil = { .depth = 1.0f, .stencil = 0 } },
+            1,
+            vireo::MSAA::NONE,
+            DEBUG_NAME);
+#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
+        transparencyColorMaps = vireo.createRenderTarget(
+            vireo::ImageFormat::R8G8B8A8_SNORM, // Packed RGB + alpha
+            packer.getSize(),
+            packer.getSize(),
+            vireo::RenderTargetType::COLOR,
+            { .color = {0.0f, 0.0f, 0.0f, 1.0f} },
+            1,
+            vireo::MSAA::NONE,
+            DEBUG_NAME + "/transparencyColor");
+#endif
+
+        if (clearPipeline == nullptr) {
+            copyDescriptorLayout = vireo.createDescriptorLayout(DEBUG_NAME);
+            copyDescriptorLayout->add(BINDING_STATIC_SHADOW_MAPS, vireo::DescriptorType::SAMPLED_IMAGE);
+            copyDescriptorLayout->build();
+
+            // Both write the depth of all the fragments of the viewport, whatever the depth in the atlas
+            auto pipelineConfig = vireo::GraphicPipelineConfiguration {
+#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
+                .colorRenderFormats = { vireo::ImageFormat::R8G8B8A8_SNORM },
+                .colorBlendDesc = {{}},
+#endif
+                .depthStencilImageFormat = vireo::ImageFormat::D32_SFLOAT,
+                .depthTestEnable = true,
+                .depthWriteEnable = true,
+            };
+            pipelineConfig.depthCompareOp = vireo::CompareOp::ALWAYS;
+            pipelineConfig.vertexShader = loadShader(VERTEX_SHADER);
+            pipelineConfig.resources = vireo.createPipelineResources({}, {}, DEBUG_NAME + "/clear");
+            pipelineConfig.fragmentShader = loadShader(CLEAR_FRAGMENT_SHADER);
+            clearPipeline = vireo.createGraphicPipeline(pipelineConfig, DEBUG_NAME + "/clear");
+
+            // The static shadow casters are not cached with the transparency color
+            pipelineConfig.colorRenderFormats.clear();
+            pipelineConfig.colorBlendDesc.clear();
+            pipelineConfig.resources = vireo.createPipelineResources({ copyDescriptorLayout }, {}, DEBUG_NAME + "/copy");
+            pipelineConfig.fragmentShader = loadShader(COPY_FRAGMENT_SHADER);
+            copyPipeline = vireo.createGraphicPipeline(pipelineConfig, DEBUG_NAME + "/copy");
+        }
+    }
+
+    void ShadowMapAtlas::cleanup() {
+        clearPipeline.reset();
+        copyPipeline.reset();
+        copyDescriptorLayout.reset();
+    }
+
+    std::shared_ptr<vireo::ShaderModule> ShadowMapAtlas::loadShader(const std::string& name) const {
+        auto tempBuffer = std::vector<char>{};
+        ctx.fs.loadShader(name, tempBuffer);
+        return ctx.vireo->createShaderModule(tempBuffer, name);
+    }
+
+    float4 ShadowMapAtlas::getCoordinates(const AtlasPacker::Area& area) const {
+        const auto size = static_cast<float>(packer.getSize());
+        return float4{
+            static_cast<float>(area.x) / size,
+            static_cast<float>(area.y) / size,
+            static_cast<float>(area.size) / size,
+            static_cast<float>(area.size) / size};
+    }
+
+    void ShadowMapAtlas::update(const vireo::CommandList& commandList, const bool staticCacheEnabled) {
+        if (shadowMapsCreated) {
+            commandList.barrier(shadowMaps, vireo::ResourceState::UNDEFINED, vireo::ResourceState::SHADER_READ);
+#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
+            commandList.barrier(transparencyColorMaps, vireo::ResourceState::UNDEFINED, vireo::ResourceState::SHADER_READ);
+#endif
+            shadowMapsCreated = false;
+        }
+        if (staticCacheEnabled && staticShadowMaps == nullptr) {
+            const auto& vireo = *ctx.vireo;
+            staticShadowMaps = vireo.createRenderTarget(
+                vireo::ImageFormat::D32_SFLOAT,
+                packer.getSize(),
+                packer.getSize(),
+                vireo::RenderTargetType::DEPTH,
+                { .depthStencil = { .depth = 1.0f, .stencil = 0 } },
+                1,
+                vireo::MSAA::NONE,
+                DEBUG_NAME + "/static");
+            copyDescriptorSet = vireo.createDescriptorSet(copyDescriptorLayout, DEBUG_NAME + "/copy");
+            copyDescriptorSet->update(BINDING_STATIC_SHADOW_MAPS, staticShadowMaps->getImage());
+            commandList.barrier(staticShadowMaps, vireo::ResourceState::UNDEFINED, vireo::ResourceState::SHADER_READ);
+        }
+    }
+
+    void ShadowMapAtlas::clear(vireo::CommandList& commandList) const {
+        commandList.bindPipeline(clearPipeline);
+        commandList.draw(3);
+    }
+
+    void ShadowMapAtlas::copyStatic(vireo::CommandList& commandList) const {
+        commandList.bindPipeline(copyPipeline);
+        commandList.bindDescriptors({ copyDescriptorSet });
+        commandList.draw(3);
+    }
+
+}
@@ -0,0 +1,134 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.renderers.shadow_map_atlas;
+
+import vireo;
+import lysa.atlas_packer;
+import lysa.context;
+import lysa.math;
+
+export namespace lysa {
+
+    /**
+     * Depth atlas of all the shadow maps of a scene frame.
+     *
+     * Each shadow map (cascade, cube face or spot light) is an area of the atlas allocated by an
+     * AtlasPacker, rendered with the viewport of its area and sampled through its texture
+     * coordinates rectangle. The memory of the shadow maps is bounded by the size of the atlas,
+     * whatever the number of lights casting shadows. A second atlas with the same areas holds the
+     * cached depth of the static shadow casters.
+     */
+    class ShadowMapAtlas {
+    public:
+        /**
+         * Size of the smallest shadow maps
+         */
+        static constexpr uint32 MIN_SHADOW_MAP_SIZE{128};
+
+        /**
+         * Creates the atlas
+         * @param ctx The engine context
+         * @param size Width and height of the atlas, a power of two
+         */
+        ShadowMapAtlas(const Context& ctx, uint32 size);
+
+        /**
+         * Allocates the area of a shadow map
+         * @param size Width and height of the shadow map, rounded up to a power of two
+         * @return The area, empty if the atlas is full
+         */
+        AtlasPacker::Area allocate(const uint32 size) { return packer.allocate(size); }
+
+        /**
+         * Frees the area of a shadow map
+         */
+        void free(const AtlasPacker::Area& area) { packer.free(area); }
+
+        /**
+         * Returns the texture coordinates of an area : xy top-left corner, zw size
+         */
+        float4 getCoordinates(const AtlasPacker::Area& area) const;
+
+        /**
+         * Creates the static shadow casters atlas on its first use and moves the new
+         * atlases in the SHADER_READ state
+         */
+        void update(const vireo::CommandList& commandList, bool staticCacheEnabled);
+
+        /**
+         * Clears the shadow map of the current viewport to the far plane. Must be recorded in a
+         * rendering of the shadow maps atlas or of the static shadow casters atlas.
+         */
+        void clear(vireo::CommandList& commandList) const;
+
+        /**
+         * Copies the static shadow casters of the current viewport in the shadow maps atlas. Must
+         * be recorded in a rendering of the shadow maps atlas.
+         */
+        void copyStatic(vireo::CommandList& commandList) const;
+
+        /**
+         * Returns the depth of all the shadow maps
+         */
+        const auto& getShadowMaps() const { return shadowMaps; }
+
+        /**
+         * Returns the depth of the static shadow casters, nullptr before the first use of the cache
+         */
+        const auto& getStaticShadowMaps() const { return staticShadowMaps; }
+
+#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
+        /**
+         * Returns the transparency color of all the shadow maps
+         */
+        const auto& getTransparencyColorMaps() const { return transparencyColorMaps; }
+#endif
+
+        /**
+         * Returns the width and height of the atlas
+         */
+        auto getSize() const { return packer.getSize(); }
+
+        /**
+         * Returns the number of texels used by the shadow maps
+         */
+        auto getUsedArea() const { return packer.getUsedArea(); }
+
+        static void cleanup();
+
+        ShadowMapAtlas(ShadowMapAtlas&) = delete;
+        ShadowMapAtlas& operator=(ShadowMapAtlas&) = delete;
+
+    private:
+        static constexpr vireo::DescriptorIndex BINDING_STATIC_SHADOW_MAPS{0};
+
+        const std::string DEBUG_NAME{"ShadowMapAtlas"};
+        const std::string VERTEX_SHADER{"quad.vert"};
+        const std::string CLEAR_FRAGMENT_SHADER{"shadowmap_clear.frag"};
+        const std::string COPY_FRAGMENT_SHADER{"shadowmap_copy.frag"};
+
+        const Context& ctx;
+        AtlasPacker packer;
+        std::shared_ptr<vireo::RenderTarget> shadowMaps;
+        std::shared_ptr<vireo::RenderTarget> staticShadowMaps;
+#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
+        std::shared_ptr<vireo::RenderTarget> transparencyColorMaps;
+#endif
+        // Reads staticShadowMaps for the copies
+        std::shared_ptr<vireo::DescriptorSet> copyDescriptorSet;
+        // The atlases are in the UNDEFINED state until the first update()
+        bool shadowMapsCreated{true};
+        bool staticShadowMapsCreated{false};
+
+        static std::shared_ptr<vireo::DescriptorLayout> copyDescriptorLayout;
+        static std::shared_ptr<vireo::GraphicPipeline> clearPipeline;
+        static std::shared_ptr<vireo::GraphicPipeline> copyPipeline;
+
+        std::shared_ptr<vireo::ShaderModule> loadShader(const std::string& name) const;
+    };
+
+}
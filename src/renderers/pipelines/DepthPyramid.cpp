@@ -0,0 +1,115 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+module lysa.renderers.pipelines.depth_pyramid;
+
+import lysa.virtual_fs;
+
+namespace lysa {
+
+    std::shared_ptr<vireo::DescriptorLayout> DepthPyramid::descriptorLayout;
+    std::shared_ptr<vireo::Pipeline> DepthPyramid::pipeline;
+
+    DepthPyramid::DepthPyramid(const Context& ctx) :
+        ctx{ctx} {
+        const auto& vireo = *ctx.vireo;
+        if (descriptorLayout == nullptr) {
+            descriptorLayout = vireo.createDescriptorLayout(DEBUG_NAME);
+            descriptorLayout->add(BINDING_GLOBAL, vireo::DescriptorType::UNIFORM);
+            descriptorLayout->add(BINDING_INPUT, vireo::DescriptorType::SAMPLED_IMAGE);
+            descriptorLayout->add(BINDING_OUTPUT, vireo::DescriptorType::READWRITE_IMAGE);
+            descriptorLayout->build();
+            const auto pipelineResources = vireo.createPipelineResources(
+                { descriptorLayout },
+                {},
+                DEBUG_NAME);
+            auto tempBuffer = std::vector<char>{};
+            ctx.fs.loadShader(SHADER, tempBuffer);
+            const auto shaderModule = vireo.createShaderModule(tempBuffer, SHADER);
+            pipeline = vireo.createComputePipeline(pipelineResources, shaderModule, SHADER);
+        }
+        framesData.resize(ctx.config.framesInFlight);
+    }
+
+    void DepthPyramid::cleanup() {
+        pipeline.reset();
+        descriptorLayout.reset();
+    }
+
+    void DepthPyramid::resize(const vireo::Extent& extent) {
+        const auto& vireo = *ctx.vireo;
+        levelsSizes.clear();
+        auto width = std::max(1u, extent.width / 2);
+        auto height = std::max(1u, extent.height / 2);
+        while (levelsSizes.size() < DEPTH_PYRAMID_MAX_LEVELS) {
+            levelsSizes.push_back({width, height});
+            if (width == 1 && height == 1) { break; }
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+        }
+        levelsCount = static_cast<uint32>(levelsSizes.size());
+        for (auto& frame : framesData) {
+            frame.images.clear();
+            frame.levels.clear();
+            for (auto level = 0; level < levelsCount; level++) {
+                const auto name = DEBUG_NAME + ":" + std::to_string(level);
+                frame.images.push_back(vireo.createReadWriteImage(
+                    vireo::ImageFormat::R32_SFLOAT,
+                    levelsSizes[level].width,
+                    levelsSizes[level].height,
+                    1,
+                    1,
+                    name));
+                auto data = Level{
+                    .globalBuffer = vireo.createBuffer(vireo::BufferType::UNIFORM, sizeof(Global), 1, name + "/global"),
+                    .descriptorSet = vireo.createDescriptorSet(descriptorLayout, name),
+                };
+                const auto global = Global{
+                    .inputSize = level == 0 ?
+                        uint2{extent.width, extent.height} :
+                        uint2{levelsSizes[level - 1].width, levelsSizes[level - 1].height},
+                    .outputSize = uint2{levelsSizes[level].width, levelsSizes[level].height},
+                };
+                data.globalBuffer->map();
+                data.globalBuffer->write(&global);
+                data.globalBuffer->unmap();
+                data.descriptorSet->update(BINDING_GLOBAL, data.globalBuffer);
+                if (level > 0) {
+                    data.descriptorSet->update(BINDING_INPUT, frame.images[level - 1]);
+                }
+                data.descriptorSet->update(BINDING_OUTPUT, frame.images[level]);
+                frame.levels.push_back(data);
+            }
+            // The culling shaders use a fixed size array of levels
+            while (frame.images.size() < DEPTH_PYRAMID_MAX_LEVELS) {
+                frame.images.push_back(frame.images.back());
+            }
+        }
+    }
+
+    void DepthPyramid::build(
+        vireo::CommandList& commandList,
+        const std::shared_ptr<vireo::RenderTarget>& depthAttachment,
+        const vireo::ResourceState depthState,
+        const uint32 frameIndex) {
+        const auto& frame = framesData[frameIndex];
+        // The depth attachment is recreated by the renderer on resize
+        frame.levels[0].descriptorSet->update(BINDING_INPUT, depthAttachment->getImage());
+        commandList.barrier(depthAttachment, depthState, vireo::ResourceState::SHADER_READ);
+        commandList.bindPipeline(pipeline);
+        for (auto level = 0; level < levelsCount; level++) {
+            const auto& image = frame.images[level];
+            const auto& size = levelsSizes[level];
+            commandList.barrier(image, vireo::ResourceState::UNDEFINED, vireo::ResourceState::DISPATCH_TARGET);
+            commandList.bindDescriptors({ frame.levels[level].descriptorSet });
+            commandList.dispatch((size.width + 7) / 8, (size.height + 7) / 8, 1);
+            // Read by the next level and by the culling shaders
+            commandList.barrier(image, vireo::ResourceState::DISPATCH_TARGET, vireo::ResourceState::SHADER_READ);
+        }
+        commandList.barrier(depthAttachment, vireo::ResourceState::SHADER_READ, depthState);
+    }
+
+}
@@ -0,0 +1,96 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.renderers.pipelines.depth_pyramid;
+
+import vireo;
+import lysa.context;
+import lysa.math;
+
+export namespace lysa {
+
+    /**
+     * Maximum number of levels of a depth pyramid
+     */
+    constexpr uint32 DEPTH_PYRAMID_MAX_LEVELS{16};
+
+    /**
+     * Hierarchical depth buffer (Hi-Z) built from a depth attachment.
+     *
+     * Each level stores the farthest depth of the texels of the previous level it covers,
+     * the first level being half the size of the depth attachment. The levels are separate
+     * images, one per frame in flight, left in the SHADER_READ state after build().
+     */
+    class DepthPyramid {
+    public:
+        DepthPyramid(const Context& ctx);
+
+        /**
+         * Recreates the levels for a new depth attachment size
+         */
+        void resize(const vireo::Extent& extent);
+
+        /**
+         * Builds the pyramid from the depth attachment of the frame
+         * @param commandList Command list to record the compute dispatches into
+         * @param depthAttachment Depth attachment, in the depthState state
+         * @param depthState Current state of the depth attachment, restored at the end
+         * @param frameIndex Index of the current frame
+         */
+        void build(
+            vireo::CommandList& commandList,
+            const std::shared_ptr<vireo::RenderTarget>& depthAttachment,
+            vireo::ResourceState depthState,
+            uint32 frameIndex);
+
+        /**
+         * Returns the DEPTH_PYRAMID_MAX_LEVELS images of the pyramid of a frame, the unused levels
+         * reference the last level
+         */
+        const auto& getImages(const uint32 frameIndex) const { return framesData[frameIndex].images; }
+
+        /**
+         * Returns the number of levels
+         */
+        auto getLevelsCount() const { return levelsCount; }
+
+        static void cleanup();
+
+        DepthPyramid(DepthPyramid&) = delete;
+        DepthPyramid& operator=(DepthPyramid&) = delete;
+
+    private:
+        static constexpr vireo::DescriptorIndex BINDING_GLOBAL{0};
+        static constexpr vireo::DescriptorIndex BINDING_INPUT{1};
+        static constexpr vireo::DescriptorIndex BINDING_OUTPUT{2};
+
+        const std::string DEBUG_NAME{"DepthPyramid"};
+        const std::string SHADER{"depth_pyramid.comp"};
+
+        struct Global {
+            uint2 inputSize;
+            uint2 outputSize;
+        };
+
+        struct Level {
+            std::shared_ptr<vireo::Buffer>        globalBuffer;
+            std::shared_ptr<vireo::DescriptorSet> descriptorSet;
+        };
+
+        struct FrameData {
+            std::vector<std::shared_ptr<vireo::Image>> images;
+            std::vector<Level> levels;
+        };
+
+        const Context& ctx;
+        uint32 levelsCount{0};
+        std::vector<vireo::Extent> levelsSizes;
+        std::vector<FrameData> framesData;
+
+        static std::shared_ptr<vireo::DescriptorLayout> descriptorLayout;
+        static std::shared_ptr<vireo::Pipeline> pipeline;
+    };
+}
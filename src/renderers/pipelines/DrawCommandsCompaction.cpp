@@ -0,0 +1,106 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+module lysa.renderers.pipelines.draw_commands_compaction;
+
+import lysa.virtual_fs;
+
+namespace lysa {
+
+    std::shared_ptr<vireo::DescriptorLayout> DrawCommandsCompaction::descriptorLayout;
+    std::shared_ptr<vireo::Pipeline> DrawCommandsCompaction::pipeline;
+
+    DrawCommandsCompaction::DrawCommandsCompaction(const Context& ctx, const std::string& name) :
+        ctx{ctx},
+        name{DEBUG_NAME + ":" + name} {
+        const auto& vireo = *ctx.vireo;
+        if (descriptorLayout == nullptr) {
+            descriptorLayout = vireo.createDescriptorLayout(DEBUG_NAME);
+            descriptorLayout->add(BINDING_GLOBAL, vireo::DescriptorType::UNIFORM);
+            descriptorLayout->add(BINDING_RANGES, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_INPUT, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_OUTPUT, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_COUNTS, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->build();
+            const auto pipelineResources = vireo.createPipelineResources(
+                { descriptorLayout },
+                {},
+                DEBUG_NAME);
+            auto tempBuffer = std::vector<char>{};
+            ctx.fs.loadShader(SHADER, tempBuffer);
+            const auto shaderModule = vireo.createShaderModule(tempBuffer, SHADER);
+            pipeline = vireo.createComputePipeline(pipelineResources, shaderModule, SHADER);
+        }
+        globalBuffer = vireo.createBuffer(vireo::BufferType::UNIFORM, sizeof(Global), 1, this->name + "/global");
+        globalBuffer->map();
+        descriptorSet = vireo.createDescriptorSet(descriptorLayout, this->name);
+        descriptorSet->update(BINDING_GLOBAL, globalBuffer);
+    }
+
+    void DrawCommandsCompaction::cleanup() {
+        pipeline.reset();
+        descriptorLayout.reset();
+    }
+
+    void DrawCommandsCompaction::dispatch(
+        vireo::CommandList& commandList,
+        const std::vector<DrawCommandsRange>& ranges,
+        const std::shared_ptr<vireo::Buffer>& input,
+        const std::shared_ptr<vireo::Buffer>& output,
+        const std::shared_ptr<vireo::Buffer>& counts) {
+        if (ranges.empty()) { return; }
+        const auto rangesCount = static_cast<uint32>(ranges.size());
+        if (ranges != uploadedRanges) {
+            if (rangesCount > rangesCapacity) {
+                rangesCapacity = std::max(rangesCount, rangesCapacity * 2);
+                rangesBuffer = ctx.vireo->createBuffer(
+                    vireo::BufferType::DEVICE_STORAGE,
+                    sizeof(DrawCommandsRange), rangesCapacity,
+                    name + "/ranges");
+                rangesStagingBuffer = ctx.vireo->createBuffer(
+                    vireo::BufferType::BUFFER_UPLOAD,
+                    sizeof(DrawCommandsRange), rangesCapacity,
+                    name + "/rangesStaging");
+                rangesStagingBuffer->map();
+                commandList.barrier(*rangesBuffer, vireo::ResourceState::UNDEFINED, vireo::ResourceState::COMPUTE_READ);
+                descriptorSet->update(BINDING_RANGES, rangesBuffer);
+            }
+            rangesStagingBuffer->write(ranges.data(), ranges.size() * sizeof(DrawCommandsRange));
+            commandList.barrier(*rangesBuffer, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::COPY_DST);
+            commandList.copy(rangesStagingBuffer, rangesBuffer, {{0, 0, ranges.size() * sizeof(DrawCommandsRange)}});
+            commandList.barrier(*rangesBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_READ);
+            const auto global = Global{ .rangesCount = rangesCount };
+            globalBuffer->write(&global);
+            uploadedRanges = ranges;
+        }
+        if (input != boundInput) {
+            descriptorSet->update(BINDING_INPUT, input);
+            boundInput = input;
+        }
+        if (output != boundOutput) {
+            descriptorSet->update(BINDING_OUTPUT, output);
+            boundOutput = output;
+        }
+        if (counts != boundCounts) {
+            descriptorSet->update(BINDING_COUNTS, counts);
+            boundCounts = counts;
+        }
+
+        commandList.barrier(*input, vireo::ResourceState::INDIRECT_DRAW, vireo::ResourceState::COMPUTE_READ);
+        commandList.barrier(*output, vireo::ResourceState::INDIRECT_DRAW, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.barrier(*counts, vireo::ResourceState::INDIRECT_DRAW, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.bindPipeline(pipeline);
+        commandList.bindDescriptors({ descriptorSet });
+        commandList.dispatch(
+            std::min(rangesCount, MAX_DISPATCH_GROUPS),
+            (rangesCount + MAX_DISPATCH_GROUPS - 1) / MAX_DISPATCH_GROUPS,
+            1);
+        commandList.barrier(*counts, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::INDIRECT_DRAW);
+        commandList.barrier(*output, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::INDIRECT_DRAW);
+        commandList.barrier(*input, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::INDIRECT_DRAW);
+    }
+
+}
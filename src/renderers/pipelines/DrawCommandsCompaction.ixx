@@ -0,0 +1,100 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.renderers.pipelines.draw_commands_compaction;
+
+import vireo;
+import lysa.context;
+import lysa.math;
+
+export namespace lysa {
+
+    /**
+     * Range of draw commands compacted together
+     */
+    struct DrawCommandsRange {
+        /** Position of the first draw command in the input buffer */
+        uint32 inputFirst;
+        /** Position of the first compacted draw command in the output buffer */
+        uint32 outputFirst;
+        /** Number of draw commands of the range */
+        uint32 count;
+        /** Position of the number of compacted draw commands in the counts buffer */
+        uint32 countIndex;
+
+        bool operator==(const DrawCommandsRange&) const = default;
+    };
+
+    /**
+     * Compaction of the instanced draw commands produced by the culling.
+     *
+     * The culling outputs one instanced draw command per draw group and detail level, most of them
+     * without instances. Each range of draw commands is compacted by one workgroup : the draw commands
+     * with instances are copied, in the same order, at the start of the range of the output buffer and
+     * their number is written in the counts buffer for the draws with an indirect count. Keeping the
+     * order preserves the front to back sorting of the draw groups.
+     */
+    class DrawCommandsCompaction {
+    public:
+        DrawCommandsCompaction(const Context& ctx, const std::string& name);
+
+        /**
+         * Records the compaction of ranges of draw commands. The ranges are uploaded again only when
+         * they change, and must not change between two dispatches of the same command list.
+         * @param ranges Ranges to compact, the output ranges must not overlap
+         * @param input Draw commands, in the INDIRECT_DRAW state
+         * @param output Compacted draw commands, in the INDIRECT_DRAW state
+         * @param counts Number of compacted draw commands of each range, in the INDIRECT_DRAW state
+         */
+        void dispatch(
+            vireo::CommandList& commandList,
+            const std::vector<DrawCommandsRange>& ranges,
+            const std::shared_ptr<vireo::Buffer>& input,
+            const std::shared_ptr<vireo::Buffer>& output,
+            const std::shared_ptr<vireo::Buffer>& counts);
+
+        static void cleanup();
+
+        virtual ~DrawCommandsCompaction() = default;
+        DrawCommandsCompaction(DrawCommandsCompaction&) = delete;
+        DrawCommandsCompaction& operator=(DrawCommandsCompaction&) = delete;
+
+    private:
+        static constexpr vireo::DescriptorIndex BINDING_GLOBAL{0};
+        static constexpr vireo::DescriptorIndex BINDING_RANGES{1};
+        static constexpr vireo::DescriptorIndex BINDING_INPUT{2};
+        static constexpr vireo::DescriptorIndex BINDING_OUTPUT{3};
+        static constexpr vireo::DescriptorIndex BINDING_COUNTS{4};
+
+        // Maximum number of workgroups in a dimension of a dispatch
+        static constexpr uint32 MAX_DISPATCH_GROUPS{65535};
+
+        const std::string DEBUG_NAME{"DrawCommandsCompaction"};
+        const std::string SHADER{"draw_commands_compaction.comp"};
+
+        struct Global {
+            uint32 rangesCount;
+            uint32 padding[3];
+        };
+
+        const Context& ctx;
+        const std::string name;
+        std::shared_ptr<vireo::DescriptorSet> descriptorSet;
+        std::shared_ptr<vireo::Buffer> globalBuffer;
+        // Ranges of the last upload, the ranges buffer being in the COMPUTE_READ state
+        std::vector<DrawCommandsRange> uploadedRanges;
+        uint32 rangesCapacity{0};
+        std::shared_ptr<vireo::Buffer> rangesBuffer;
+        std::shared_ptr<vireo::Buffer> rangesStagingBuffer;
+        // Buffers bound to the descriptor set, only updated when they change
+        std::shared_ptr<vireo::Buffer> boundInput;
+        std::shared_ptr<vireo::Buffer> boundOutput;
+        std::shared_ptr<vireo::Buffer> boundCounts;
+
+        static std::shared_ptr<vireo::DescriptorLayout> descriptorLayout;
+        static std::shared_ptr<vireo::Pipeline> pipeline;
+    };
+}
@@ -6,133 +6,633 @@
 */
 module lysa.renderers.pipelines.frustum_culling;
 
-import lysa.log;
+import lysa.exception;
+import lysa.resources.mesh;
 import lysa.virtual_fs;
 
 namespace lysa {
 
     std::shared_ptr<vireo::DescriptorLayout> FrustumCulling::descriptorLayout;
-    std::unordered_map<std::string, std::shared_ptr<vireo::ShaderModule>> FrustumCulling::shaderModules{};
-    std::unordered_map<std::string, std::shared_ptr<vireo::Pipeline>> FrustumCulling::pipelines{};
+    std::shared_ptr<vireo::Pipeline> FrustumCulling::pipeline;
+    std::shared_ptr<vireo::Pipeline> FrustumCulling::clearPipeline;
+    std::shared_ptr<vireo::Pipeline> FrustumCulling::rangesPipeline;
+    std::shared_ptr<vireo::Pipeline> FrustumCulling::instancesPipeline;
+    std::shared_ptr<vireo::Pipeline> FrustumCulling::clustersPipeline;
 
     FrustumCulling::FrustumCulling(
         const Context& ctx,
-        const bool isForScene,
-        const DeviceMemoryArray& meshInstancesArray,
-        pipeline_id pipelineId) {
+        const DeviceMemoryArray& meshInstancesArray) :
+        ctx{ctx},
+        compaction{ctx, DEBUG_NAME} {
         const auto& vireo = *ctx.vireo;
-        auto debugName = DEBUG_NAME + ":" + std::to_string(pipelineId);
-        globalBuffer = vireo.createBuffer(vireo::BufferType::UNIFORM, sizeof(Utils), 1, debugName + "/global");
+        globalBuffer = vireo.createBuffer(vireo::BufferType::UNIFORM, sizeof(Global), 1, DEBUG_NAME + "/global");
         globalBuffer->map();
-        commandClearCounterBuffer = vireo.createBuffer(vireo::BufferType::BUFFER_UPLOAD, sizeof(uint32), 1, debugName + "/commandClearCounter");
-        constexpr auto clearValue = 0;
-        commandClearCounterBuffer->map();
-        commandClearCounterBuffer->write(&clearValue);
-        commandClearCounterBuffer->unmap();
-
-        downloadCounterBuffer = vireo.createBuffer(vireo::BufferType::BUFFER_DOWNLOAD, sizeof(uint32), 1, debugName + "/downloadCounter");
-        downloadCounterBuffer->map();
+        viewsBuffer = vireo.createBuffer(vireo::BufferType::UNIFORM, sizeof(View), FRUSTUM_CULLING_MAX_VIEWS, DEBUG_NAME + "/views");
+        viewsBuffer->map();
 
         if (descriptorLayout == nullptr) {
             descriptorLayout = vireo.createDescriptorLayout(DEBUG_NAME);
             descriptorLayout->add(BINDING_GLOBAL, vireo::DescriptorType::UNIFORM);
             descriptorLayout->add(BINDING_MESHINSTANCES, vireo::DescriptorType::DEVICE_STORAGE);
-            descriptorLayout->add(BINDING_INSTANCES, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_VIEWS, vireo::DescriptorType::UNIFORM);
+            descriptorLayout->add(BINDING_PIPELINES, vireo::DescriptorType::DEVICE_STORAGE);
             descriptorLayout->add(BINDING_INPUT, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_GROUPS, vireo::DescriptorType::DEVICE_STORAGE);
             descriptorLayout->add(BINDING_OUTPUT, vireo::DescriptorType::READWRITE_STORAGE);
-            descriptorLayout->add(BINDING_COUNTER, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_INSTANCES_INDICES, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_COUNTERS, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_MESHSURFACES, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_LODS, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_MESHCLUSTERS, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_CANDIDATES, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_CLUSTERS_OUTPUT, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_CLUSTERS_COUNTS, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_GROUPS_DEPTHS, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_GROUPS_ORDER, vireo::DescriptorType::DEVICE_STORAGE);
             descriptorLayout->build();
-        }
-
-        descriptorSet = vireo.createDescriptorSet(descriptorLayout, debugName);
-        descriptorSet->update(BINDING_GLOBAL, globalBuffer);
-        descriptorSet->update(BINDING_MESHINSTANCES, meshInstancesArray.getBuffer());
-
-        auto& shaderName = isForScene ? SHADER_SCENE : SHADER_SHADOWMAP;
-        if (!shaderModules.contains(shaderName)) {
             const auto pipelineResources = vireo.createPipelineResources(
                 { descriptorLayout },
                 {},
                 DEBUG_NAME);
             auto tempBuffer = std::vector<char>{};
-            ctx.fs.loadShader(shaderName, tempBuffer);
-            shaderModules[shaderName] = vireo.createShaderModule(tempBuffer, shaderName);
-            pipelines[shaderName] = vireo.createComputePipeline(pipelineResources, shaderModules[shaderName], shaderName);
+            ctx.fs.loadShader(SHADER, tempBuffer);
+            const auto shaderModule = vireo.createShaderModule(tempBuffer, SHADER);
+            pipeline = vireo.createComputePipeline(pipelineResources, shaderModule, SHADER);
+            tempBuffer.clear();
+            ctx.fs.loadShader(CLEAR_SHADER, tempBuffer);
+            const auto clearShaderModule = vireo.createShaderModule(tempBuffer, CLEAR_SHADER);
+            clearPipeline = vireo.createComputePipeline(pipelineResources, clearShaderModule, CLEAR_SHADER);
+            tempBuffer.clear();
+            ctx.fs.loadShader(RANGES_SHADER, tempBuffer);
+            const auto rangesShaderModule = vireo.createShaderModule(tempBuffer, RANGES_SHADER);
+            rangesPipeline = vireo.createComputePipeline(pipelineResources, rangesShaderModule, RANGES_SHADER);
+            tempBuffer.clear();
+            ctx.fs.loadShader(INSTANCES_SHADER, tempBuffer);
+            const auto instancesShaderModule = vireo.createShaderModule(tempBuffer, INSTANCES_SHADER);
+            instancesPipeline = vireo.createComputePipeline(pipelineResources, instancesShaderModule, INSTANCES_SHADER);
+            tempBuffer.clear();
+            ctx.fs.loadShader(CLUSTERS_SHADER, tempBuffer);
+            const auto clustersShaderModule = vireo.createShaderModule(tempBuffer, CLUSTERS_SHADER);
+            clustersPipeline = vireo.createComputePipeline(pipelineResources, clustersShaderModule, CLUSTERS_SHADER);
         }
-        pipeline = pipelines[shaderName];
+
+        descriptorSet = vireo.createDescriptorSet(descriptorLayout, DEBUG_NAME);
+        descriptorSet->update(BINDING_GLOBAL, globalBuffer);
+        descriptorSet->update(BINDING_MESHINSTANCES, meshInstancesArray.getBuffer());
+        descriptorSet->update(BINDING_VIEWS, viewsBuffer);
+        descriptorSet->update(BINDING_MESHSURFACES, ctx.res.get<MeshManager>().getMeshSurfaceBuffer());
+        descriptorSet->update(BINDING_MESHCLUSTERS, ctx.res.get<MeshManager>().getMeshClusterBuffer());
     }
 
     void FrustumCulling::cleanup() {
-        pipelines.clear();
-        shaderModules.clear();
+        clustersPipeline.reset();
+        instancesPipeline.reset();
+        rangesPipeline.reset();
+        clearPipeline.reset();
+        pipeline.reset();
         descriptorLayout.reset();
     }
 
+    void FrustumCulling::reserve(const vireo::CommandList& commandList) {
+        const auto& vireo = *ctx.vireo;
+        const auto pipelinesCount = static_cast<uint32>(pipelinesTable.size());
+        if (pipelinesCount > pipelinesCapacity) {
+            pipelinesCapacity = std::max(pipelinesCount, pipelinesCapacity * 2);
+            pipelinesBuffer = vireo.createBuffer(
+                vireo::BufferType::DEVICE_STORAGE,
+                sizeof(Pipeline), pipelinesCapacity,
+                DEBUG_NAME + "/pipelines");
+            pipelinesStagingBuffer = vireo.createBuffer(
+                vireo::BufferType::BUFFER_UPLOAD,
+                sizeof(Pipeline), pipelinesCapacity,
+                DEBUG_NAME + "/pipelinesStaging");
+            pipelinesStagingBuffer->map();
+            commandList.barrier(*pipelinesBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_READ);
+            descriptorSet->update(BINDING_PIPELINES, pipelinesBuffer);
+        }
+        if (drawCommandsCount > inputCapacity) {
+            inputCapacity = std::max(drawCommandsCount, inputCapacity * 2);
+            inputBuffer = vireo.createBuffer(
+                vireo::BufferType::DEVICE_STORAGE,
+                sizeof(DrawCommand), inputCapacity,
+                DEBUG_NAME + "/input");
+            commandList.barrier(*inputBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_READ);
+            // Everything must be gathered again in the new buffer
+            gathered.clear();
+            descriptorSet->update(BINDING_INPUT, inputBuffer);
+        }
+        // Always created, read by the occlusion culling even without draw commands
+        const auto lodsCount = std::max(drawCommandsCount, 1u);
+        if (lodsCount > lodsCapacity) {
+            lodsCapacity = std::max(lodsCount, lodsCapacity * 2);
+            lodsBuffer = vireo.createBuffer(
+                vireo::BufferType::READWRITE_STORAGE,
+                sizeof(uint32), lodsCapacity,
+                DEBUG_NAME + "/lods");
+            // Not cleared, the previous levels are clamped to the valid ones by the shader
+            commandList.barrier(*lodsBuffer, vireo::ResourceState::UNDEFINED, vireo::ResourceState::COMPUTE_READ);
+            descriptorSet->update(BINDING_LODS, lodsBuffer);
+        }
+        if (drawGroupsCount > groupsCapacity) {
+            groupsCapacity = std::max(drawGroupsCount, groupsCapacity * 2);
+            groupsBuffer = vireo.createBuffer(
+                vireo::BufferType::DEVICE_STORAGE,
+                sizeof(uint32), groupsCapacity,
+                DEBUG_NAME + "/groups");
+            commandList.barrier(*groupsBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_READ);
+            gathered.clear();
+            descriptorSet->update(BINDING_GROUPS, groupsBuffer);
+        }
+        // Always created, read by the occlusion culling even without draw groups
+        const auto groupsOrderCount = std::max(drawGroupsCount, 1u);
+        if (groupsOrderCount > groupsOrderCapacity) {
+            groupsOrderCapacity = std::max(groupsOrderCount, groupsOrderCapacity * 2);
+            groupsDepthsBuffer = vireo.createBuffer(
+                vireo::BufferType::READWRITE_STORAGE,
+                sizeof(uint32), groupsOrderCapacity,
+                DEBUG_NAME + "/groupsDepths");
+            commandList.barrier(*groupsDepthsBuffer, vireo::ResourceState::UNDEFINED, vireo::ResourceState::COPY_SRC);
+            const auto zeros = std::vector<uint32>(groupsOrderCapacity, 0);
+            commandClearGroupsDepthsBuffer = vireo.createBuffer(
+                vireo::BufferType::BUFFER_UPLOAD,
+                sizeof(uint32), groupsOrderCapacity,
+                DEBUG_NAME + "/commandClearGroupsDepths");
+            commandClearGroupsDepthsBuffer->map();
+            commandClearGroupsDepthsBuffer->write(zeros.data(), zeros.size() * sizeof(uint32));
+            commandClearGroupsDepthsBuffer->unmap();
+            downloadGroupsDepthsBuffer = vireo.createBuffer(
+                vireo::BufferType::BUFFER_DOWNLOAD,
+                sizeof(uint32), groupsOrderCapacity,
+                DEBUG_NAME + "/downloadGroupsDepths");
+            downloadGroupsDepthsBuffer->map();
+            groupsOrderBuffer = vireo.createBuffer(
+                vireo::BufferType::DEVICE_STORAGE,
+                sizeof(uint32), groupsOrderCapacity,
+                DEBUG_NAME + "/groupsOrder");
+            groupsOrderStagingBuffer = vireo.createBuffer(
+                vireo::BufferType::BUFFER_UPLOAD,
+                sizeof(uint32), groupsOrderCapacity,
+                DEBUG_NAME + "/groupsOrderStaging");
+            groupsOrderStagingBuffer->map();
+            commandList.barrier(*groupsOrderBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_READ);
+            descriptorSet->update(BINDING_GROUPS_DEPTHS, groupsDepthsBuffer);
+            descriptorSet->update(BINDING_GROUPS_ORDER, groupsOrderBuffer);
+        }
+        const auto outputCount = viewsCount * drawGroupsCount * MESH_LODS_MAX;
+        if (outputCount > outputCapacity) {
+            outputCapacity = std::max(outputCount, outputCapacity * 2);
+            outputBuffer = vireo.createBuffer(
+                vireo::BufferType::READWRITE_STORAGE,
+                sizeof(DrawCommand), outputCapacity,
+                DEBUG_NAME + "/output");
+            commandList.barrier(*outputBuffer, vireo::ResourceState::UNDEFINED, vireo::ResourceState::INDIRECT_DRAW);
+            descriptorSet->update(BINDING_OUTPUT, outputBuffer);
+            compactedOutputBuffer = vireo.createBuffer(
+                vireo::BufferType::READWRITE_STORAGE,
+                sizeof(DrawCommand), outputCapacity,
+                DEBUG_NAME + "/compactedOutput");
+            commandList.barrier(*compactedOutputBuffer, vireo::ResourceState::UNDEFINED, vireo::ResourceState::INDIRECT_DRAW);
+        }
+        const auto drawCountsCount = std::max(viewsCount * pipelinesCount, 1u);
+        if (drawCountsCount > drawCountsCapacity) {
+            drawCountsCapacity = std::max(drawCountsCount, drawCountsCapacity * 2);
+            drawCountsBuffer = vireo.createBuffer(
+                vireo::BufferType::READWRITE_STORAGE,
+                sizeof(uint32), drawCountsCapacity,
+                DEBUG_NAME + "/drawCounts");
+            commandList.barrier(*drawCountsBuffer, vireo::ResourceState::UNDEFINED, vireo::ResourceState::INDIRECT_DRAW);
+        }
+        // One instance index per draw command kept by a view at most, then the ranges of the pipelines culled
+        // for the first view by another pass and one instance index per draw command for its cluster draws
+        const auto instancesIndicesCount = std::max(clustersInstancesFirst + drawCommandsCount, 1u);
+        if (instancesIndicesCount > instancesIndicesCapacity) {
+            instancesIndicesCapacity = std::max(instancesIndicesCount, instancesIndicesCapacity * 2);
+            instancesIndicesBuffer = vireo.createBuffer(
+                vireo::BufferType::READWRITE_STORAGE,
+                sizeof(uint32), instancesIndicesCapacity,
+                DEBUG_NAME + "/instancesIndices");
+            commandList.barrier(*instancesIndicesBuffer, vireo::ResourceState::UNDEFINED, vireo::ResourceState::SHADER_READ);
+            descriptorSet->update(BINDING_INSTANCES_INDICES, instancesIndicesBuffer);
+        }
+        const auto candidatesCount = 1 + 2 * clusteredDrawCommandsCount;
+        if (candidatesCount > candidatesCapacity) {
+            candidatesCapacity = std::max(candidatesCount, candidatesCapacity * 2);
+            candidatesBuffer = vireo.createBuffer(
+                vireo::BufferType::READWRITE_STORAGE,
+                sizeof(uint32), candidatesCapacity,
+                DEBUG_NAME + "/candidates");
+            commandList.barrier(*candidatesBuffer, vireo::ResourceState::UNDEFINED, vireo::ResourceState::COMPUTE_READ);
+            descriptorSet->update(BINDING_CANDIDATES, candidatesBuffer);
+        }
+        const auto clustersOutputCount = std::max(drawClustersCount, 1u);
+        if (clustersOutputCount > clustersOutputCapacity) {
+            clustersOutputCapacity = std::max(clustersOutputCount, clustersOutputCapacity * 2);
+            clustersOutputBuffer = vireo.createBuffer(
+                vireo::BufferType::READWRITE_STORAGE,
+                sizeof(DrawCommand), clustersOutputCapacity,
+                DEBUG_NAME + "/clustersOutput");
+            commandList.barrier(*clustersOutputBuffer, vireo::ResourceState::UNDEFINED, vireo::ResourceState::INDIRECT_DRAW);
+            descriptorSet->update(BINDING_CLUSTERS_OUTPUT, clustersOutputBuffer);
+        }
+        const auto clustersCountsCount = std::max(pipelinesCount, 1u);
+        if (clustersCountsCount > clustersCountsCapacity) {
+            clustersCountsCapacity = std::max(clustersCountsCount, clustersCountsCapacity * 2);
+            clustersCountsBuffer = vireo.createBuffer(
+                vireo::BufferType::READWRITE_STORAGE,
+                sizeof(uint32), clustersCountsCapacity,
+                DEBUG_NAME + "/clustersCounts");
+            commandList.barrier(*clustersCountsBuffer, vireo::ResourceState::UNDEFINED, vireo::ResourceState::INDIRECT_DRAW);
+            descriptorSet->update(BINDING_CLUSTERS_COUNTS, clustersCountsBuffer);
+        }
+        // Kept draw commands of each (view, pipeline) pair, then small features of each view
+        const auto countersCount = viewsCount * (pipelinesCount + 1);
+        if (countersCount > countersCapacity) {
+            countersCapacity = std::max(countersCount, countersCapacity * 2);
+            countersBuffer = vireo.createBuffer(
+                vireo::BufferType::READWRITE_STORAGE,
+                sizeof(uint32), countersCapacity,
+                DEBUG_NAME + "/counters");
+            commandList.barrier(*countersBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COPY_SRC);
+            const auto zeros = std::vector<uint32>(countersCapacity, 0);
+            commandClearCountersBuffer = vireo.createBuffer(
+                vireo::BufferType::BUFFER_UPLOAD,
+                sizeof(uint32), countersCapacity,
+                DEBUG_NAME + "/commandClearCounters");
+            commandClearCountersBuffer->map();
+            commandClearCountersBuffer->write(zeros.data(), zeros.size() * sizeof(uint32));
+            commandClearCountersBuffer->unmap();
+            downloadCountersBuffer = vireo.createBuffer(
+                vireo::BufferType::BUFFER_DOWNLOAD,
+                sizeof(uint32), countersCapacity,
+                DEBUG_NAME + "/downloadCounters");
+            downloadCountersBuffer->map();
+            descriptorSet->update(BINDING_COUNTERS, countersBuffer);
+        }
+    }
+
     void FrustumCulling::dispatch(
         vireo::CommandList& commandList,
-        const uint32 drawCommandsCount,
-        const float4x4& view,
-        const float4x4& projection,
-        const vireo::Buffer& instances,
-        const vireo::Buffer& input,
-        const vireo::Buffer& output,
-        const vireo::Buffer& counter) {
-        commandList.barrier(
-            counter,
-            vireo::ResourceState::INDIRECT_DRAW,
-            vireo::ResourceState::COPY_DST);
-        commandList.copy(*commandClearCounterBuffer, counter);
-        commandList.barrier(
-            counter,
-            vireo::ResourceState::COPY_DST,
-            vireo::ResourceState::COMPUTE_WRITE);
-        if (drawCommandsCount == 0) { return; }
-
-        auto global = Utils{
+        const std::vector<CullingView>& views,
+        const std::vector<CullingPipeline>& pipelines,
+        const CullingLodSettings& lodSettings,
+        const bool withStatistics) {
+        if (views.size() > FRUSTUM_CULLING_MAX_VIEWS) {
+            throw Exception("Too many culling views");
+        }
+        // Before the download buffers are reused or recreated
+        readStatistics();
+        readGroupsDepths();
+
+        // Prefix sums of the draw commands, draw groups and clusters counts : position of each pipeline
+        // in the input buffers, in each view range of the output buffers and in the clusters output buffer
+        viewsCount = static_cast<uint32>(views.size());
+        drawCommandsCount = 0;
+        drawGroupsCount = 0;
+        clusteredDrawCommandsCount = 0;
+        drawClustersCount = 0;
+        auto otherPassPipelines = false;
+        pipelinesTable.clear();
+        pipelinesIndices.clear();
+        for (const auto& [pipelineData, firstView, frontToBack] : pipelines) {
+            pipelinesIndices.emplace(pipelineData->index, static_cast<uint32>(pipelinesTable.size()));
+            pipelinesTable.push_back({
+                .first = drawCommandsCount,
+                .count = pipelineData->drawCommandsCount,
+                .firstGroup = drawGroupsCount,
+                .groupsCount = pipelineData->drawGroupsCount,
+                .firstView = firstView ? 1u : 0u,
+                .firstCluster = drawClustersCount,
+                // The clusters are only culled for the first view
+                .clustersCount = firstView ? pipelineData->drawClustersCount : 0,
+            });
+            drawCommandsCount += pipelineData->drawCommandsCount;
+            drawGroupsCount += pipelineData->drawGroupsCount;
+            if (firstView) {
+                clusteredDrawCommandsCount += pipelineData->clusteredDrawCommandsCount;
+            }
+            drawClustersCount += pipelinesTable.back().clustersCount;
+            otherPassPipelines |= !firstView;
+        }
+        // The pipelines culled by another pass get one range per detail level, occluded then disoccluded
+        otherPassInstancesFirst = viewsCount * drawCommandsCount;
+        clustersInstancesFirst = otherPassInstancesFirst + (otherPassPipelines ? 2 * MESH_LODS_MAX * drawCommandsCount : 0);
+        // Always creates the instances indices buffer, bound by the pipelines even without draw commands
+        reserve(commandList);
+        if (drawCommandsCount == 0 || viewsCount == 0) {
+            statistics = {};
+            return;
+        }
+
+        // Gather the draw commands and draw groups of the pipelines modified or moved since the last dispatch
+        auto inputState = vireo::ResourceState::COMPUTE_READ;
+        for (const auto& [pipelineData, firstView, frontToBack] : pipelines) {
+            const auto& table = pipelinesTable[pipelinesIndices.at(pipelineData->index)];
+            if (table.count == 0) { continue; }
+            if (gathered.contains(pipelineData->index)) {
+                const auto& previous = gathered.at(pipelineData->index);
+                if (previous.first == table.first &&
+                    previous.count == table.count &&
+                    previous.firstGroup == table.firstGroup &&
+                    previous.groupsCount == table.groupsCount &&
+                    previous.version == pipelineData->drawCommandsVersion) { continue; }
+            }
+            if (inputState != vireo::ResourceState::COPY_DST) {
+                commandList.barrier(*inputBuffer, inputState, vireo::ResourceState::COPY_DST);
+                commandList.barrier(*groupsBuffer, inputState, vireo::ResourceState::COPY_DST);
+                inputState = vireo::ResourceState::COPY_DST;
+            }
+            commandList.barrier(
+                *pipelineData->drawCommandsBuffer,
+                vireo::ResourceState::INDIRECT_DRAW,
+                vireo::ResourceState::COPY_SRC);
+            commandList.copy(pipelineData->drawCommandsBuffer, inputBuffer, {{
+                0,
+                sizeof(DrawCommand) * table.first,
+                sizeof(DrawCommand) * table.count,
+            }});
+            commandList.barrier(
+                *pipelineData->drawCommandsBuffer,
+                vireo::ResourceState::COPY_SRC,
+                vireo::ResourceState::INDIRECT_DRAW);
+            commandList.barrier(
+                *pipelineData->drawGroupsBuffer,
+                vireo::ResourceState::COMPUTE_READ,
+                vireo::ResourceState::COPY_SRC);
+            commandList.copy(pipelineData->drawGroupsBuffer, groupsBuffer, {{
+                0,
+                sizeof(uint32) * table.firstGroup,
+                sizeof(uint32) * table.groupsCount,
+            }});
+            commandList.barrier(
+                *pipelineData->drawGroupsBuffer,
+                vireo::ResourceState::COPY_SRC,
+                vireo::ResourceState::COMPUTE_READ);
+            gathered.emplace(pipelineData->index, {
+                table.first,
+                table.count,
+                table.firstGroup,
+                table.groupsCount,
+                pipelineData->drawCommandsVersion,
+            });
+        }
+        if (inputState != vireo::ResourceState::COMPUTE_READ) {
+            commandList.barrier(*inputBuffer, inputState, vireo::ResourceState::COMPUTE_READ);
+            commandList.barrier(*groupsBuffer, inputState, vireo::ResourceState::COMPUTE_READ);
+        }
+
+        pipelinesStagingBuffer->write(pipelinesTable.data(), pipelinesTable.size() * sizeof(Pipeline));
+        commandList.barrier(*pipelinesBuffer, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::COPY_DST);
+        commandList.copy(pipelinesStagingBuffer, pipelinesBuffer, {{0, 0, pipelinesTable.size() * sizeof(Pipeline)}});
+        commandList.barrier(*pipelinesBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_READ);
+
+        updateGroupsOrder(pipelines);
+        groupsOrderStagingBuffer->write(groupsOrder.data(), groupsOrder.size() * sizeof(uint32));
+        commandList.barrier(*groupsOrderBuffer, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::COPY_DST);
+        commandList.copy(groupsOrderStagingBuffer, groupsOrderBuffer, {{0, 0, groupsOrder.size() * sizeof(uint32)}});
+        commandList.barrier(*groupsOrderBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_READ);
+
+        // Projected error of a level : error * scale * projection[1][1] / (2 * distance) for a perspective
+        // projection, error * scale * projection[1][1] / 2 for an orthographic one
+        const auto& firstView = views[0];
+        const auto global = Global {
             .drawCommandsCount = drawCommandsCount,
-            .viewMatrix = inverse(view),
+            .viewsCount = viewsCount,
+            .pipelinesCount = static_cast<uint32>(pipelinesTable.size()),
+            .drawGroupsCount = drawGroupsCount,
+            .lodOrigin = float4{
+                firstView.transform[3].xyz,
+                lodSettings.threshold > 0.0f ? firstView.projection[1][1] / (2.0f * lodSettings.threshold) : 0.0f},
+            .lodHysteresis = lodSettings.hysteresis,
+            .lodPerspective = firstView.projection[3][3] == 0.0f ? 1u : 0u,
+            .clustersInstancesFirst = clustersInstancesFirst,
         };
-        Frustum::extractPlanes(global.planes, mul(global.viewMatrix, projection));
         globalBuffer->write(&global);
+        auto viewsData = std::vector<View>(views.size());
+        for (auto i = 0; i < views.size(); i++) {
+            Frustum::extractPlanes(viewsData[i].planes, mul(inverse(views[i].transform), views[i].projection));
+            viewsData[i].origin = float4{views[i].transform[3].xyz, views[i].projection[1][1]};
+            viewsData[i].minScreenSize = views[i].minScreenSize;
+            viewsData[i].perspective = views[i].projection[3][3] == 0.0f ? 1u : 0u;
+            viewsData[i].shadowCasters = views[i].shadowCasters ? 1u : 0u;
+            viewsData[i].mobility = static_cast<uint32>(views[i].mobility);
+            viewsData[i].cubeMap = views[i].cubeMap ? 1u : 0u;
+            if (views[i].cubeMap) {
+                // The small features are discarded with the 90 degrees perspective of the faces
+                viewsData[i].origin.w = 1.0f;
+                viewsData[i].perspective = 1;
+            }
+        }
+        viewsBuffer->write(viewsData.data(), viewsData.size() * sizeof(View));
+
+        commandList.barrier(*countersBuffer, vireo::ResourceState::COPY_SRC, vireo::ResourceState::COPY_DST);
+        commandList.copy(commandClearCountersBuffer, countersBuffer, {{0, 0, viewsCount * (pipelinesTable.size() + 1) * sizeof(uint32)}});
+        commandList.barrier(*countersBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_WRITE);
+
+        commandList.barrier(*outputBuffer, vireo::ResourceState::INDIRECT_DRAW, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.barrier(*instancesIndicesBuffer, vireo::ResourceState::SHADER_READ, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.barrier(*lodsBuffer, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::COMPUTE_WRITE);
+
+        // The cleared counters are zeros too
+        commandList.barrier(*candidatesBuffer, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::COPY_DST);
+        commandList.copy(commandClearCountersBuffer, candidatesBuffer, {{0, 0, sizeof(uint32)}});
+        commandList.barrier(*candidatesBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.barrier(*clustersCountsBuffer, vireo::ResourceState::INDIRECT_DRAW, vireo::ResourceState::COPY_DST);
+        commandList.copy(commandClearCountersBuffer, clustersCountsBuffer, {{0, 0, pipelinesTable.size() * sizeof(uint32)}});
+        commandList.barrier(*clustersCountsBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.barrier(*clustersOutputBuffer, vireo::ResourceState::INDIRECT_DRAW, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.barrier(*groupsDepthsBuffer, vireo::ResourceState::COPY_SRC, vireo::ResourceState::COPY_DST);
+        commandList.copy(commandClearGroupsDepthsBuffer, groupsDepthsBuffer, {{0, 0, drawGroupsCount * sizeof(uint32)}});
+        commandList.barrier(*groupsDepthsBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_WRITE);
+
+        // The output draws are written by each of the following passes
+        const auto outputBarrier = [&] {
+            commandList.barrier(*outputBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::COMPUTE_READ);
+            commandList.barrier(*outputBuffer, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::COMPUTE_WRITE);
+        };
+
+        // Only the instances counts of the draws are reset
+        const auto outputGroups = (viewsCount * drawGroupsCount * MESH_LODS_MAX + 63) / 64;
+        commandList.bindPipeline(clearPipeline);
+        commandList.bindDescriptors({ descriptorSet });
+        commandList.dispatch(
+            std::min(outputGroups, MAX_DISPATCH_GROUPS),
+            (outputGroups + MAX_DISPATCH_GROUPS - 1) / MAX_DISPATCH_GROUPS,
+            1);
+        outputBarrier();
 
-        descriptorSet->update(BINDING_INSTANCES, instances);
-        descriptorSet->update(BINDING_INPUT, input);
-        descriptorSet->update(BINDING_OUTPUT, output, counter);
-        descriptorSet->update(BINDING_COUNTER, counter);
-
-        commandList.barrier(
-            input,
-            vireo::ResourceState::INDIRECT_DRAW,
-            vireo::ResourceState::COMPUTE_READ);
-        commandList.barrier(
-            output,
-            vireo::ResourceState::INDIRECT_DRAW,
-            vireo::ResourceState::COMPUTE_WRITE);
+        // Counts the kept draw commands of each draw and each (view, pipeline) pair
         commandList.bindPipeline(pipeline);
         commandList.bindDescriptors({ descriptorSet });
         commandList.dispatch((drawCommandsCount + 63) / 64, 1, 1);
-        commandList.barrier(
-            output,
-            vireo::ResourceState::COMPUTE_WRITE,
-            vireo::ResourceState::INDIRECT_DRAW);
-        commandList.barrier(
-            input,
-            vireo::ResourceState::COMPUTE_READ,
-            vireo::ResourceState::INDIRECT_DRAW);
-
-        commandList.barrier(
-            counter,
-            vireo::ResourceState::COMPUTE_WRITE,
-            vireo::ResourceState::COPY_SRC);
-        commandList.copy(counter, *downloadCounterBuffer);
-        commandList.barrier(
-            counter,
-            vireo::ResourceState::COPY_SRC,
-            vireo::ResourceState::INDIRECT_DRAW);
+        outputBarrier();
+        commandList.barrier(*countersBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::COMPUTE_READ);
+        commandList.barrier(*lodsBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::COMPUTE_READ);
+
+        // First instance of each draw from the prefix sums of the counts, one workgroup per (view, pipeline) pair
+        const auto rangesCount = viewsCount * static_cast<uint32>(pipelinesTable.size());
+        commandList.bindPipeline(rangesPipeline);
+        commandList.bindDescriptors({ descriptorSet });
+        commandList.dispatch(
+            std::min(rangesCount, MAX_DISPATCH_GROUPS),
+            (rangesCount + MAX_DISPATCH_GROUPS - 1) / MAX_DISPATCH_GROUPS,
+            1);
+        outputBarrier();
+
+        // Same culling with the selected levels, writing the instances indices
+        commandList.bindPipeline(instancesPipeline);
+        commandList.bindDescriptors({ descriptorSet });
+        commandList.dispatch((drawCommandsCount + 63) / 64, 1, 1);
+
+        commandList.barrier(*candidatesBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::COMPUTE_READ);
+        if (clusteredDrawCommandsCount > 0) {
+            // One workgroup per candidate, its instances indices are after the ones of the other passes
+            commandList.bindPipeline(clustersPipeline);
+            commandList.bindDescriptors({ descriptorSet });
+            commandList.dispatch(
+                std::min(clusteredDrawCommandsCount, MAX_DISPATCH_GROUPS),
+                (clusteredDrawCommandsCount + MAX_DISPATCH_GROUPS - 1) / MAX_DISPATCH_GROUPS,
+                1);
+        }
+        commandList.barrier(*clustersCountsBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::INDIRECT_DRAW);
+        commandList.barrier(*clustersOutputBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::INDIRECT_DRAW);
+        commandList.barrier(*instancesIndicesBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::SHADER_READ);
+        commandList.barrier(*outputBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::INDIRECT_DRAW);
+
+        // Most of the instanced draws have no instances : one compacted range per (view, pipeline) pair,
+        // at the same position in the compacted output, drawn with the counts
+        compactionRanges.clear();
+        for (auto view = 0u; view < viewsCount; view++) {
+            for (auto i = 0u; i < pipelinesTable.size(); i++) {
+                const auto first = (view * drawGroupsCount + pipelinesTable[i].firstGroup) * MESH_LODS_MAX;
+                compactionRanges.push_back({
+                    .inputFirst = first,
+                    .outputFirst = first,
+                    .count = pipelinesTable[i].groupsCount * MESH_LODS_MAX,
+                    .countIndex = static_cast<uint32>(view * pipelinesTable.size() + i),
+                });
+            }
+        }
+        compaction.dispatch(commandList, compactionRanges, outputBuffer, compactedOutputBuffer, drawCountsBuffer);
+
+        commandList.barrier(*countersBuffer, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::COPY_SRC);
+        if (withStatistics) {
+            commandList.copy(countersBuffer, downloadCountersBuffer, {{0, 0, viewsCount * (pipelinesTable.size() + 1) * sizeof(uint32)}});
+            statisticsPending = true;
+            statisticsViewsCount = viewsCount;
+            statisticsPipelinesTable = pipelinesTable;
+        }
+        commandList.barrier(*groupsDepthsBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::COPY_SRC);
+        // Read back for all the pipelines : the sorted ones order their groups with the distances,
+        // and the groups visible from the first view feed the residency of their resources
+        groupsDepthsPipelines.clear();
+        for (const auto& cullingPipeline : pipelines) {
+            groupsDepthsPipelines.push_back(cullingPipeline.pipelineData);
+        }
+        if (drawGroupsCount > 0) {
+            commandList.copy(groupsDepthsBuffer, downloadGroupsDepthsBuffer, {{0, 0, drawGroupsCount * sizeof(uint32)}});
+            groupsDepthsPending = true;
+            groupsDepthsPipelinesTable = pipelinesTable;
+        }
+    }
+
+    void FrustumCulling::readGroupsDepths() {
+        if (!groupsDepthsPending) { return; }
+        groupsDepthsPending = false;
+        const auto* keys = static_cast<uint32*>(downloadGroupsDepthsBuffer->getMappedAddress());
+        groupsDepths.clear();
+        for (auto i = 0; i < groupsDepthsPipelines.size(); i++) {
+            const auto& table = groupsDepthsPipelinesTable[i];
+            groupsDepths.emplace(groupsDepthsPipelines[i]->index, std::vector<uint32>(
+                keys + table.firstGroup,
+                keys + table.firstGroup + table.groupsCount));
+        }
+    }
+
+    const std::vector<uint32>* FrustumCulling::getGroupsDepths(const GraphicPipelineData& pipelineData) const {
+        return groupsDepths.contains(pipelineData.index) ? &groupsDepths.at(pipelineData.index) : nullptr;
+    }
+
+    void FrustumCulling::updateGroupsOrder(const std::vector<CullingPipeline>& pipelines) {
+        groupsOrder.resize(drawGroupsCount);
+        auto sorted = std::vector<uint32>{};
+        for (const auto& [pipelineData, firstView, frontToBack] : pipelines) {
+            const auto& table = pipelinesTable[pipelinesIndices.at(pipelineData->index)];
+            sorted.resize(table.groupsCount);
+            std::iota(sorted.begin(), sorted.end(), 0);
+            if (frontToBack && groupsDepths.contains(pipelineData->index)) {
+                // The groups without visible instances and the ones created since the read are the last
+                const auto& keys = groupsDepths.at(pipelineData->index);
+                std::ranges::stable_sort(sorted, std::greater{}, [&](const uint32 group) {
+                    return group < keys.size() ? keys[group] : 0u;
+                });
+            }
+            for (auto rank = 0u; rank < sorted.size(); rank++) {
+                groupsOrder[table.firstGroup + sorted[rank]] = rank;
+            }
+        }
+    }
+
+    void FrustumCulling::readStatistics() {
+        if (!statisticsPending) { return; }
+        statisticsPending = false;
+        const auto* counters = static_cast<uint32*>(downloadCountersBuffer->getMappedAddress());
+        const auto pipelinesCount = statisticsPipelinesTable.size();
+        statistics = {};
+        for (auto i = 0; i < pipelinesCount; i++) {
+            statistics.drawCommandsCount += statisticsPipelinesTable[i].count;
+            statistics.firstViewCount += counters[i];
+        }
+        for (auto i = pipelinesCount; i < statisticsViewsCount * pipelinesCount; i++) {
+            statistics.otherViewsCount += counters[i];
+        }
+        statistics.viewsCounts.resize(statisticsViewsCount);
+        statistics.viewsSmallFeaturesCounts.resize(statisticsViewsCount);
+        for (auto view = 0; view < statisticsViewsCount; view++) {
+            for (auto i = 0; i < pipelinesCount; i++) {
+                statistics.viewsCounts[view] += counters[view * pipelinesCount + i];
+            }
+            statistics.viewsSmallFeaturesCounts[view] = counters[statisticsViewsCount * pipelinesCount + view];
+        }
+    }
+
+    FrustumCulling::Range FrustumCulling::getRange(
+        const uint32 viewIndex,
+        const GraphicPipelineData& pipelineData) const {
+        if (!pipelinesIndices.contains(pipelineData.index) || viewIndex >= viewsCount || drawCommandsCount == 0) { return {}; }
+        const auto pipelineIndex = pipelinesIndices.at(pipelineData.index);
+        const auto& table = pipelinesTable[pipelineIndex];
+        if (viewIndex == 0 && table.firstView == 0) { return {}; }
+        return {
+            .offset = sizeof(DrawCommand) * (viewIndex * drawGroupsCount + table.firstGroup) * MESH_LODS_MAX,
+            .countOffset = sizeof(uint32) * (viewIndex * pipelinesTable.size() + pipelineIndex),
+            .drawCount = table.groupsCount * MESH_LODS_MAX,
+        };
+    }
+
+    FrustumCulling::ClustersRange FrustumCulling::getClustersRange(const GraphicPipelineData& pipelineData) const {
+        if (!pipelinesIndices.contains(pipelineData.index) || viewsCount == 0 || drawCommandsCount == 0) { return {}; }
+        const auto pipelineIndex = pipelinesIndices.at(pipelineData.index);
+        const auto& table = pipelinesTable[pipelineIndex];
+        return {
+            .offset = sizeof(DrawCommand) * table.firstCluster,
+            .countOffset = sizeof(uint32) * pipelineIndex,
+            .maxDrawCount = table.clustersCount,
+        };
+    }
+
+    uint32 FrustumCulling::getInstancesIndicesFirst(
+        const GraphicPipelineData& pipelineData,
+        const bool disoccluded) const {
+        const auto& table = pipelinesTable[pipelinesIndices.at(pipelineData.index)];
+        return otherPassInstancesFirst + (disoccluded ? MESH_LODS_MAX * drawCommandsCount : 0) + table.first;
+    }
+
+    uint32 FrustumCulling::getLodsFirst(const GraphicPipelineData& pipelineData) const {
+        return pipelinesTable[pipelinesIndices.at(pipelineData.index)].first;
     }
 
-    uint32 FrustumCulling::getDrawCommandsCount() const {
-        return *static_cast<uint32*>(downloadCounterBuffer->getMappedAddress());
+    uint32 FrustumCulling::getGroupsOrderFirst(const GraphicPipelineData& pipelineData) const {
+        return pipelinesTable[pipelinesIndices.at(pipelineData.index)].firstGroup;
     }
 
-}
\ No newline at end of file
+}
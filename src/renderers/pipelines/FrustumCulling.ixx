@@ -9,30 +9,253 @@ export module lysa.renderers.pipelines.frustum_culling;
 import vireo;
 import lysa.context;
 import lysa.frustum;
-import lysa.utils;
 import lysa.math;
 import lysa.memory;
+import lysa.renderers.graphic_pipeline_data;
+import lysa.renderers.pipelines_array;
+import lysa.renderers.pipelines.draw_commands_compaction;
 
 export namespace lysa {
+
+    /**
+     * Maximum number of points of view culled by one dispatch
+     */
+    constexpr uint32 FRUSTUM_CULLING_MAX_VIEWS{128};
+
+    /**
+     * Mesh instances kept by a point of view, depending on MeshInstance::isStatic()
+     */
+    enum class CullingMobility : uint32 {
+        /** Static and dynamic mesh instances */
+        ALL     = 0,
+        /** Static mesh instances only, drawn with their finest detail level */
+        STATIC  = 1,
+        /** Dynamic mesh instances only */
+        DYNAMIC = 2,
+    };
+
+    /**
+     * Point of view the draw commands are culled for
+     */
+    struct CullingView {
+        /** World transform of the point of view (inverse of the view matrix) */
+        float4x4 transform;
+        /** Projection matrix */
+        float4x4 projection;
+        /** Only keeps the mesh instances casting shadows */
+        bool shadowCasters{false};
+        /** Only keeps the static or the dynamic mesh instances */
+        CullingMobility mobility{CullingMobility::ALL};
+        /** Discards the mesh instances projected under this fraction of the viewport height, 0 to keep them */
+        float minScreenSize{0.0f};
+        /**
+         * Cube map centered on transform[3], the projection bounding its range : the faces each mesh instance
+         * is seen from are packed in its instance index, and each instance is drawn once per face
+         */
+        bool cubeMap{false};
+    };
+
+    /**
+     * Pipeline whose draw commands are culled
+     */
+    struct CullingPipeline {
+        /** Draw commands of the pipeline */
+        const GraphicPipelineData* pipelineData;
+        /** false if the draw commands are culled for the first view by another pass */
+        bool firstView{true};
+        /** Orders the draw groups from the nearest to the farthest of the first view */
+        bool frontToBack{false};
+    };
+
+    /**
+     * Selection of the detail levels of the mesh surfaces
+     */
+    struct CullingLodSettings {
+        /** Maximum projected error of a detail level, in fraction of the viewport height, 0 to always draw the full surfaces */
+        float threshold{0.0f};
+        /** Relative margin on the error before going back to a finer level, avoiding the flickering at the thresholds */
+        float hysteresis{0.0f};
+    };
+
+    /**
+     * Number of draw commands kept by the frustum culling
+     */
+    struct FrustumCullingStatistics {
+        /** Draw commands tested */
+        uint32 drawCommandsCount{0};
+        /** Draw commands kept for the first view, the camera */
+        uint32 firstViewCount{0};
+        /** Draw commands kept for all the other views */
+        uint32 otherViewsCount{0};
+        /** Draw commands kept for each view */
+        std::vector<uint32> viewsCounts;
+        /** Draw commands in the frustum of each view but discarded for their projected size */
+        std::vector<uint32> viewsSmallFeaturesCounts;
+    };
+
+    /**
+     * Frustum culling of the draw commands of all the pipelines of a scene, for all the points
+     * of view of a frame (camera, shadow map cascades and cube faces), in a single dispatch.
+     *
+     * The draw commands and the draw groups of the pipelines are gathered in input buffers, a pipeline
+     * being copied again only when its draw commands have been modified. Each (view, pipeline) pair owns
+     * a range of the output buffer with one instanced indirect draw per draw group of the pipeline,
+     * the ranges being the prefix sum of the draw groups counts of the pipelines. The culling runs in
+     * two passes : the first one counts the visible draw commands of each draw and of each (view, pipeline)
+     * pair, a prefix sum of these counts gives each draw its range of the instances indices buffer, sized
+     * by the draw commands actually kept, and the second pass writes the indices, read by the vertex
+     * shaders with the first instance of the draw and the instance ID. Only the instances counts of the
+     * draws are reset before the dispatch. The draws of each range with instances are then compacted at
+     * the start of the range of a second output buffer, and drawn with an indirect count.
+     *
+     * Each draw group has one instanced draw per detail level of its surface. The level of a draw command
+     * is selected from the projected error of the levels for the first view and is used for all the
+     * views, the shadows matching the geometry seen by the camera. The last selected levels are kept
+     * for the hysteresis and for the pass culling the first view instead.
+     *
+     * A view can also discard the mesh instances whose bounding sphere is projected under a fraction of
+     * its viewport height (small-feature culling), the shadow maps usually using a larger fraction than
+     * the camera. The fraction is scaled by each mesh instance.
+     *
+     * The draw groups of a pipeline are drawn in the order of the groups order buffer. For the pipelines
+     * sorted front to back, this order comes from the distance to the first view of the nearest visible
+     * instance of each group, read back from a previous dispatch of the same frame in flight so the CPU
+     * never waits for the GPU. The other pipelines keep the order of their groups. The distances are
+     * read back for all the pipelines, the groups with a visible instance giving the resources seen
+     * by the camera for the residency of the meshes and images.
+     *
+     * For the first view, the draw commands at the finest level of a surface split in clusters are not
+     * drawn with their group : a second dispatch, one workgroup per such draw command, culls each cluster
+     * against the frustum and with its normal cone, then appends one non-instanced indexed draw per
+     * visible cluster to the clusters output range of the pipeline, drawn with an indirect count.
+     */
     class FrustumCulling {
     public:
+        /**
+         * Output of a pipeline for a view
+         */
+        struct Range {
+            /** Offset in bytes of the instanced draw commands in the compacted output buffer */
+            size_t offset{0};
+            /** Offset in bytes of the number of instanced draw commands in the draw counts buffer */
+            size_t countOffset{0};
+            /** Maximum number of instanced draw commands, 0 if the pipeline has not been culled for the view */
+            uint32 drawCount{0};
+        };
+
         FrustumCulling(
             const Context& ctx,
-            bool isForScene,
-            const DeviceMemoryArray& meshInstancesArray,
-            pipeline_id pipelineId);
+            const DeviceMemoryArray& meshInstancesArray);
 
+        /**
+         * Records the gathering of the modified draw commands and the culling dispatch
+         * @param commandList Command list to record into
+         * @param views Points of view, at most FRUSTUM_CULLING_MAX_VIEWS
+         * @param pipelines Pipelines to cull
+         * @param lodSettings Selection of the detail levels
+         * @param withStatistics Copy the counters for getStatistics()
+         */
         void dispatch(
             vireo::CommandList& commandList,
-            uint32 drawCommandsCount,
-            const float4x4& view,
-            const float4x4& projection,
-            const vireo::Buffer& instances,
-            const vireo::Buffer& input,
-            const vireo::Buffer& output,
-            const vireo::Buffer& counter);
+            const std::vector<CullingView>& views,
+            const std::vector<CullingPipeline>& pipelines,
+            const CullingLodSettings& lodSettings,
+            bool withStatistics);
+
+        /**
+         * Output of the visible clusters of a pipeline for the first view
+         */
+        struct ClustersRange {
+            /** Offset in bytes of the cluster draw commands in the clusters output buffer */
+            size_t offset{0};
+            /** Offset in bytes of the number of cluster draw commands in the clusters counts buffer */
+            size_t countOffset{0};
+            /** Maximum number of cluster draw commands, 0 if the pipeline has no clusters for the first view */
+            uint32 maxDrawCount{0};
+        };
+
+        /**
+         * Returns the output range of a pipeline for a view, as culled by the last dispatch()
+         */
+        Range getRange(uint32 viewIndex, const GraphicPipelineData& pipelineData) const;
+
+        /**
+         * Returns the clusters output range of a pipeline for the first view, as culled by the last dispatch()
+         */
+        ClustersRange getClustersRange(const GraphicPipelineData& pipelineData) const;
+
+        /**
+         * Returns the position in the instances indices buffer of the instances of the finest level
+         * of a pipeline not culled by the last dispatch() for the first view, for the pass culling it instead.
+         * The next levels follow every getLodStride() indices.
+         * @param pipelineData Pipeline with CullingPipeline::firstView set to false
+         * @param disoccluded Returns a second range, after the ranges of all the views
+         */
+        uint32 getInstancesIndicesFirst(const GraphicPipelineData& pipelineData, bool disoccluded) const;
+
+        /**
+         * Returns the distance between the instances indices of two detail levels
+         */
+        auto getLodStride() const { return drawCommandsCount; }
+
+        /**
+         * Returns the position in the detail levels buffer of the levels of the draw commands of a pipeline
+         */
+        uint32 getLodsFirst(const GraphicPipelineData& pipelineData) const;
+
+        /**
+         * Returns the detail level selected by the last dispatch() for each draw command, in the COMPUTE_READ state
+         */
+        auto getLodsBuffer() const { return lodsBuffer; }
+
+        /**
+         * Returns the culled instanced draw commands with instances of all the ranges, compacted at the
+         * start of each range, in the INDIRECT_DRAW state
+         */
+        auto getCompactedOutputBuffer() const { return compactedOutputBuffer; }
 
-        uint32 getDrawCommandsCount() const;
+        /**
+         * Returns the number of compacted instanced draw commands of each range, in the INDIRECT_DRAW state
+         */
+        auto getDrawCountsBuffer() const { return drawCountsBuffer; }
+
+        /**
+         * Returns the position of each draw group in the output range of its pipeline, in the COMPUTE_READ state
+         */
+        auto getGroupsOrderBuffer() const { return groupsOrderBuffer; }
+
+        /**
+         * Returns the distance keys of the draw groups of a pipeline read back from a previous dispatch of
+         * this frame in flight, 0 for the groups without instance visible from the first view, nullptr if
+         * the pipeline has not been read back yet. The groups created since the read are not in the keys.
+         */
+        const std::vector<uint32>* getGroupsDepths(const GraphicPipelineData& pipelineData) const;
+
+        /**
+         * Returns the position in the groups order buffer of the draw groups of a pipeline
+         */
+        uint32 getGroupsOrderFirst(const GraphicPipelineData& pipelineData) const;
+
+        /**
+         * Returns the cluster draw commands of all the pipelines, in the INDIRECT_DRAW state
+         */
+        auto getClustersOutputBuffer() const { return clustersOutputBuffer; }
+
+        /**
+         * Returns the number of cluster draw commands of each pipeline, in the INDIRECT_DRAW state
+         */
+        auto getClustersCountsBuffer() const { return clustersCountsBuffer; }
+
+        /**
+         * Returns the instances indices of the instanced draw commands, in the SHADER_READ state
+         */
+        auto getInstancesIndicesBuffer() const { return instancesIndicesBuffer; }
+
+        /**
+         * Returns the counters of the last dispatch recorded with statistics whose submission was
+         * completed when dispatch() was called again, the draws never wait for them.
+         */
+        const auto& getStatistics() const { return statistics; }
 
         static void cleanup();
 
@@ -43,29 +266,169 @@ export namespace lysa {
     private:
         static constexpr vireo::DescriptorIndex BINDING_GLOBAL{0};
         static constexpr vireo::DescriptorIndex BINDING_MESHINSTANCES{1};
-        static constexpr vireo::DescriptorIndex BINDING_INSTANCES{2};
-        static constexpr vireo::DescriptorIndex BINDING_INPUT{3};
-        static constexpr vireo::DescriptorIndex BINDING_OUTPUT{4};
-        static constexpr vireo::DescriptorIndex BINDING_COUNTER{5};
+        static constexpr vireo::DescriptorIndex BINDING_VIEWS{2};
+        static constexpr vireo::DescriptorIndex BINDING_PIPELINES{3};
+        static constexpr vireo::DescriptorIndex BINDING_INPUT{4};
+        static constexpr vireo::DescriptorIndex BINDING_GROUPS{5};
+        static constexpr vireo::DescriptorIndex BINDING_OUTPUT{6};
+        static constexpr vireo::DescriptorIndex BINDING_INSTANCES_INDICES{7};
+        static constexpr vireo::DescriptorIndex BINDING_COUNTERS{8};
+        static constexpr vireo::DescriptorIndex BINDING_MESHSURFACES{9};
+        static constexpr vireo::DescriptorIndex BINDING_LODS{10};
+        static constexpr vireo::DescriptorIndex BINDING_MESHCLUSTERS{11};
+        static constexpr vireo::DescriptorIndex BINDING_CANDIDATES{12};
+        static constexpr vireo::DescriptorIndex BINDING_CLUSTERS_OUTPUT{13};
+        static constexpr vireo::DescriptorIndex BINDING_CLUSTERS_COUNTS{14};
+        static constexpr vireo::DescriptorIndex BINDING_GROUPS_DEPTHS{15};
+        static constexpr vireo::DescriptorIndex BINDING_GROUPS_ORDER{16};
+
+        // Maximum number of workgroups in a dimension of a dispatch
+        static constexpr uint32 MAX_DISPATCH_GROUPS{65535};
 
         const std::string DEBUG_NAME{"FrustumCulling"};
-        const std::string SHADER_SCENE{"frustum_culling.comp"};
-        const std::string SHADER_SHADOWMAP{"frustum_culling_shadowmap.comp"};
+        const std::string SHADER{"frustum_culling.comp"};
+        const std::string CLEAR_SHADER{"frustum_culling_clear.comp"};
+        const std::string RANGES_SHADER{"frustum_culling_ranges.comp"};
+        const std::string INSTANCES_SHADER{"frustum_culling_instances.comp"};
+        const std::string CLUSTERS_SHADER{"cluster_culling.comp"};
 
-        struct Utils {
+        struct Global {
             uint32 drawCommandsCount;
+            uint32 viewsCount;
+            uint32 pipelinesCount;
+            uint32 drawGroupsCount;
+            // xyz : position of the first view, w : scale of the errors, 0 to disable the detail levels
+            float4 lodOrigin;
+            float  lodHysteresis;
+            uint32 lodPerspective;
+            uint32 clustersInstancesFirst;
+            uint32 padding;
+        };
+
+        struct View {
             Frustum::Plane planes[6];
-            float4x4 viewMatrix;
+            // xyz : position, w : projection[1][1]
+            float4 origin;
+            float  minScreenSize;
+            uint32 perspective;
+            uint32 shadowCasters;
+            uint32 mobility;
+            uint32 cubeMap;
+            uint32 padding[3];
+        };
+
+        struct Pipeline {
+            uint32 first;
+            uint32 count;
+            uint32 firstGroup;
+            uint32 groupsCount;
+            uint32 firstView;
+            uint32 firstCluster;
+            uint32 clustersCount;
+            uint32 padding;
+        };
+
+        // Position of the draw commands and draw groups of a pipeline in the input buffers
+        struct Gathered {
+            uint32 first;
+            uint32 count;
+            uint32 firstGroup;
+            uint32 groupsCount;
+            uint32 version;
         };
 
-        std::shared_ptr<vireo::DescriptorSet>    descriptorSet;
-        std::shared_ptr<vireo::Buffer>           globalBuffer;
-        std::shared_ptr<vireo::Buffer>           commandClearCounterBuffer;
-        std::shared_ptr<vireo::Buffer>           downloadCounterBuffer;
-        std::shared_ptr<vireo::Pipeline>         pipeline;
+        const Context& ctx;
+        std::shared_ptr<vireo::DescriptorSet> descriptorSet;
+        std::shared_ptr<vireo::Buffer> globalBuffer;
+        std::shared_ptr<vireo::Buffer> viewsBuffer;
+
+        // Layout of the last dispatch
+        uint32 viewsCount{0};
+        uint32 drawCommandsCount{0};
+        uint32 drawGroupsCount{0};
+        uint32 clusteredDrawCommandsCount{0};
+        uint32 drawClustersCount{0};
+        // Position in the instances indices buffer of the ranges of the pipelines culled for the first view by
+        // another pass, after the ranges of all the views, and of the instance indices of the cluster draws
+        uint32 otherPassInstancesFirst{0};
+        uint32 clustersInstancesFirst{0};
+        std::vector<Pipeline> pipelinesTable;
+        // Indexed by GraphicPipelineData::index
+        PipelinesArray<uint32> pipelinesIndices;
+        PipelinesArray<Gathered> gathered;
+        std::vector<uint32> groupsOrder;
+        std::vector<DrawCommandsRange> compactionRanges;
+
+        // Buffers grown on demand. Between two dispatches the pipelines, input, groups, lods and candidates
+        // buffers are in the COMPUTE_READ state, the output, compacted output, draw counts, clusters output
+        // and clusters counts buffers in the INDIRECT_DRAW state, the instances indices buffer in the SHADER_READ state and the counters
+        // buffer in the COPY_SRC state
+        uint32 pipelinesCapacity{0};
+        std::shared_ptr<vireo::Buffer> pipelinesBuffer;
+        std::shared_ptr<vireo::Buffer> pipelinesStagingBuffer;
+        uint32 inputCapacity{0};
+        std::shared_ptr<vireo::Buffer> inputBuffer;
+        uint32 lodsCapacity{0};
+        std::shared_ptr<vireo::Buffer> lodsBuffer;
+        uint32 groupsCapacity{0};
+        std::shared_ptr<vireo::Buffer> groupsBuffer;
+        uint32 outputCapacity{0};
+        std::shared_ptr<vireo::Buffer> outputBuffer;
+        std::shared_ptr<vireo::Buffer> compactedOutputBuffer;
+        uint32 drawCountsCapacity{0};
+        std::shared_ptr<vireo::Buffer> drawCountsBuffer;
+        DrawCommandsCompaction compaction;
+        uint32 instancesIndicesCapacity{0};
+        std::shared_ptr<vireo::Buffer> instancesIndicesBuffer;
+        // Number of draw commands to cluster-cull followed by (draw command, pipeline) pairs
+        uint32 candidatesCapacity{0};
+        std::shared_ptr<vireo::Buffer> candidatesBuffer;
+        uint32 clustersOutputCapacity{0};
+        std::shared_ptr<vireo::Buffer> clustersOutputBuffer;
+        uint32 clustersCountsCapacity{0};
+        std::shared_ptr<vireo::Buffer> clustersCountsBuffer;
+        // Nearest distance keys of the groups in the COPY_SRC state, position of the groups in their pipeline range
+        uint32 groupsOrderCapacity{0};
+        std::shared_ptr<vireo::Buffer> groupsDepthsBuffer;
+        std::shared_ptr<vireo::Buffer> commandClearGroupsDepthsBuffer;
+        std::shared_ptr<vireo::Buffer> downloadGroupsDepthsBuffer;
+        std::shared_ptr<vireo::Buffer> groupsOrderBuffer;
+        std::shared_ptr<vireo::Buffer> groupsOrderStagingBuffer;
+        uint32 countersCapacity{0};
+        std::shared_ptr<vireo::Buffer> countersBuffer;
+        std::shared_ptr<vireo::Buffer> commandClearCountersBuffer;
+        std::shared_ptr<vireo::Buffer> downloadCountersBuffer;
+
+        // Layout of the dispatch whose counters are copied in downloadCountersBuffer
+        bool statisticsPending{false};
+        uint32 statisticsViewsCount{0};
+        std::vector<Pipeline> statisticsPipelinesTable;
+        FrustumCullingStatistics statistics{};
+
+        // Layout of the dispatch whose groups distances are copied in downloadGroupsDepthsBuffer, and the
+        // distance keys of the groups of the pipelines read from it, the larger the nearer
+        bool groupsDepthsPending{false};
+        std::vector<Pipeline> groupsDepthsPipelinesTable;
+        std::vector<const GraphicPipelineData*> groupsDepthsPipelines;
+        PipelinesArray<std::vector<uint32>> groupsDepths;
 
         static std::shared_ptr<vireo::DescriptorLayout> descriptorLayout;
-        static std::unordered_map<std::string, std::shared_ptr<vireo::ShaderModule>> shaderModules;
-        static std::unordered_map<std::string, std::shared_ptr<vireo::Pipeline>> pipelines;
+        static std::shared_ptr<vireo::Pipeline> pipeline;
+        static std::shared_ptr<vireo::Pipeline> clearPipeline;
+        static std::shared_ptr<vireo::Pipeline> rangesPipeline;
+        static std::shared_ptr<vireo::Pipeline> instancesPipeline;
+        static std::shared_ptr<vireo::Pipeline> clustersPipeline;
+
+        // Recreates the buffers too small for the current layout
+        void reserve(const vireo::CommandList& commandList);
+
+        // Reads the counters copied by the previous dispatch of this frame in flight
+        void readStatistics();
+
+        // Reads the groups distances copied by the previous dispatch of this frame in flight
+        void readGroupsDepths();
+
+        // Position of the groups in the range of their pipeline, sorted by distance for the sorted pipelines
+        void updateGroupsOrder(const std::vector<CullingPipeline>& pipelines);
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,205 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+module lysa.renderers.pipelines.light_clustering;
+
+import lysa.log;
+import lysa.virtual_fs;
+
+namespace lysa {
+
+    std::shared_ptr<vireo::DescriptorLayout> LightClustering::descriptorLayout;
+    std::shared_ptr<vireo::Pipeline> LightClustering::pipeline;
+
+    LightClustering::LightClustering(const Context& ctx) :
+        ctx{ctx} {
+        const auto& vireo = *ctx.vireo;
+        globalBuffer = vireo.createBuffer(vireo::BufferType::UNIFORM, sizeof(Global), 1, DEBUG_NAME + "/global");
+        globalBuffer->map();
+        clustersLightsCountsBuffer = vireo.createBuffer(
+            vireo::BufferType::READWRITE_STORAGE,
+            sizeof(uint32),
+            LIGHTS_CLUSTERS_COUNT,
+            DEBUG_NAME + "/clustersLightsCounts");
+        clustersLightsBuffer = vireo.createBuffer(
+            vireo::BufferType::READWRITE_STORAGE,
+            sizeof(uint32),
+            LIGHTS_CLUSTERS_COUNT * LIGHTS_CLUSTER_MAX_LIGHTS,
+            DEBUG_NAME + "/clustersLights");
+
+        constexpr uint32 zero{0};
+        commandClearOverflowBuffer = vireo.createBuffer(vireo::BufferType::BUFFER_UPLOAD, sizeof(uint32), 1, DEBUG_NAME + "/commandClearOverflow");
+        commandClearOverflowBuffer->map();
+        commandClearOverflowBuffer->write(&zero);
+        commandClearOverflowBuffer->unmap();
+        overflowBuffer = vireo.createBuffer(vireo::BufferType::READWRITE_STORAGE, sizeof(uint32), 1, DEBUG_NAME + "/overflow");
+        downloadOverflowBuffer = vireo.createBuffer(vireo::BufferType::BUFFER_DOWNLOAD, sizeof(uint32), 1, DEBUG_NAME + "/downloadOverflow");
+        downloadOverflowBuffer->map();
+
+        if (descriptorLayout == nullptr) {
+            descriptorLayout = vireo.createDescriptorLayout(DEBUG_NAME);
+            descriptorLayout->add(BINDING_GLOBAL, vireo::DescriptorType::UNIFORM);
+            descriptorLayout->add(BINDING_LIGHTS, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_CLUSTERS_LIGHTS_COUNTS, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_CLUSTERS_LIGHTS, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_OVERFLOW, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->build();
+            const auto pipelineResources = vireo.createPipelineResources(
+                { descriptorLayout },
+                {},
+                DEBUG_NAME);
+            auto tempBuffer = std::vector<char>{};
+            ctx.fs.loadShader(SHADER, tempBuffer);
+            const auto shaderModule = vireo.createShaderModule(tempBuffer, SHADER);
+            pipeline = vireo.createComputePipeline(pipelineResources, shaderModule, SHADER);
+        }
+
+        descriptorSet = vireo.createDescriptorSet(descriptorLayout, DEBUG_NAME);
+        descriptorSet->update(BINDING_GLOBAL, globalBuffer);
+        descriptorSet->update(BINDING_CLUSTERS_LIGHTS_COUNTS, clustersLightsCountsBuffer);
+        descriptorSet->update(BINDING_CLUSTERS_LIGHTS, clustersLightsBuffer);
+        descriptorSet->update(BINDING_OVERFLOW, overflowBuffer);
+    }
+
+    void LightClustering::cleanup() {
+        pipeline.reset();
+        descriptorLayout.reset();
+    }
+
+    float2 LightClustering::getSliceScaleBias(const Camera& camera) {
+        // The slices are computed with log(-z), the near plane of an orthographic camera can be <= 0
+        const auto near = std::max(camera.near, 1e-3f);
+        const auto far = std::max(camera.far, near * 2.0f);
+        const auto scale = static_cast<float>(LIGHTS_CLUSTERS_Z) / std::log(far / near);
+        return float2{scale, -std::log(near) * scale};
+    }
+
+    LightClusters LightClustering::assignLights(const Camera& camera, const std::span<const LightData> lights) {
+        const auto slices = getSliceScaleBias(camera);
+        const auto inverseProjection = inverse(camera.projection);
+        const auto view = inverse(camera.transform);
+        const auto perspective = camera.projection[3][3] == 0.0f;
+        // View space point at a depth on the ray of a point in normalized device coordinates
+        const auto viewPoint = [&](const float2& ndc, const float depth) {
+            const auto unprojected = mul(float4{ndc, 0.5f, 1.0f}, inverseProjection);
+            const float3 point = (unprojected / unprojected.w).xyz;
+            if (perspective) {
+                return point * (depth / -static_cast<float>(point.z));
+            }
+            return float3{point.xy, -depth};
+        };
+
+        // View space bounding spheres of the lights, w < 0 for the directional lights
+        auto spheres = std::vector<float4>(lights.size());
+        for (auto i = 0u; i < lights.size(); i++) {
+            const auto& light = lights[i];
+            spheres[i] = light.type == static_cast<int32>(LightType::LIGHT_DIRECTIONAL) ?
+                float4{0.0f, 0.0f, 0.0f, -1.0f} :
+                float4{mul(float4{light.position.xyz, 1.0f}, view).xyz, light.range};
+        }
+
+        auto clusters = LightClusters{
+            .lightsCounts = std::vector<uint32>(LIGHTS_CLUSTERS_COUNT, 0),
+            .lights = std::vector<uint32>(LIGHTS_CLUSTERS_COUNT * LIGHTS_CLUSTER_MAX_LIGHTS, 0),
+        };
+        for (auto id = 0u; id < LIGHTS_CLUSTERS_COUNT; id++) {
+            const auto tileX = id % LIGHTS_CLUSTERS_X;
+            const auto tileY = (id / LIGHTS_CLUSTERS_X) % LIGHTS_CLUSTERS_Y;
+            const auto slice = id / (LIGHTS_CLUSTERS_X * LIGHTS_CLUSTERS_Y);
+
+            // View space bounding box of the cluster
+            const auto dims = float2{static_cast<float>(LIGHTS_CLUSTERS_X), static_cast<float>(LIGHTS_CLUSTERS_Y)};
+            const auto ndcMin = float2{static_cast<float>(tileX), static_cast<float>(tileY)} / dims * 2.0f - 1.0f;
+            const auto ndcMax = float2{static_cast<float>(tileX + 1), static_cast<float>(tileY + 1)} / dims * 2.0f - 1.0f;
+            const auto nearDepth = std::exp((static_cast<float>(slice) - slices.y) / slices.x);
+            const auto farDepth = std::exp((static_cast<float>(slice + 1) - slices.y) / slices.x);
+            auto aabbMin = float3{1e30f};
+            auto aabbMax = float3{-1e30f};
+            for (auto corner = 0u; corner < 8; corner++) {
+                const auto ndc = float2{
+                    (corner & 1) != 0 ? ndcMax.x : ndcMin.x,
+                    (corner & 2) != 0 ? ndcMax.y : ndcMin.y};
+                const auto point = viewPoint(ndc, (corner & 4) != 0 ? farDepth : nearDepth);
+                aabbMin = min(aabbMin, point);
+                aabbMax = max(aabbMax, point);
+            }
+
+            auto& count = clusters.lightsCounts[id];
+            for (auto i = 0u; i < lights.size(); i++) {
+                if (lights[i].type < static_cast<int32>(LightType::LIGHT_DIRECTIONAL) ||
+                    lights[i].type > static_cast<int32>(LightType::LIGHT_SPOT)) {
+                    continue;
+                }
+                const auto& sphere = spheres[i];
+                // Distance from the center of the light to the nearest point of the cluster
+                const auto delta = max(max(aabbMin - sphere.xyz, sphere.xyz - aabbMax), float3{0.0f});
+                const auto radius = static_cast<float>(sphere.w);
+                if (radius < 0.0f || static_cast<float>(dot(delta, delta)) <= radius * radius) {
+                    if (count == LIGHTS_CLUSTER_MAX_LIGHTS) {
+                        clusters.overflowCount++;
+                        break;
+                    }
+                    clusters.lights[id * LIGHTS_CLUSTER_MAX_LIGHTS + count] = i;
+                    count++;
+                }
+            }
+        }
+        return clusters;
+    }
+
+    void LightClustering::dispatch(
+        vireo::CommandList& commandList,
+        const Camera& camera,
+        const std::shared_ptr<vireo::Buffer>& lights,
+        const uint32 lightsCount) {
+        if (boundLights != lights) {
+            boundLights = lights;
+            descriptorSet->update(BINDING_LIGHTS, lights);
+        }
+        const auto slices = getSliceScaleBias(camera);
+        const auto global = Global{
+            .inverseProjection = inverse(camera.projection),
+            .view = inverse(camera.transform),
+            .sliceScale = slices.x,
+            .sliceBias = slices.y,
+            .lightsCount = lightsCount,
+            .perspective = camera.projection[3][3] == 0.0f ? 1u : 0u,
+        };
+        globalBuffer->write(&global);
+
+        // The previous submission of this frame in flight is completed
+        if (overflowPending) {
+            const auto count = *static_cast<uint32*>(downloadOverflowBuffer->getMappedAddress());
+            if (count > 0 && overflowCount == 0) {
+                Log::warning(count, " light clusters are affected by more than ",
+                    LIGHTS_CLUSTER_MAX_LIGHTS, " lights, some lights are ignored");
+            }
+            overflowCount = count;
+            overflowPending = false;
+        }
+        commandList.barrier(
+            *overflowBuffer,
+            firstDispatch ? vireo::ResourceState::UNDEFINED : vireo::ResourceState::COPY_SRC,
+            vireo::ResourceState::COPY_DST);
+        commandList.copy(*commandClearOverflowBuffer, *overflowBuffer, {{0, 0, sizeof(uint32)}});
+        commandList.barrier(*overflowBuffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_WRITE);
+
+        const auto from = firstDispatch ? vireo::ResourceState::UNDEFINED : vireo::ResourceState::SHADER_READ;
+        firstDispatch = false;
+        commandList.barrier(*clustersLightsCountsBuffer, from, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.barrier(*clustersLightsBuffer, from, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.bindPipeline(pipeline);
+        commandList.bindDescriptors({ descriptorSet });
+        commandList.dispatch((LIGHTS_CLUSTERS_COUNT + 63) / 64, 1, 1);
+        // Read by the lighting shaders
+        commandList.barrier(*clustersLightsCountsBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::SHADER_READ);
+        commandList.barrier(*clustersLightsBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::SHADER_READ);
+        commandList.barrier(*overflowBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::COPY_SRC);
+        commandList.copy(*overflowBuffer, *downloadOverflowBuffer);
+        overflowPending = true;
+    }
+
+}
@@ -0,0 +1,152 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.renderers.pipelines.light_clustering;
+
+import vireo;
+import lysa.context;
+import lysa.math;
+import lysa.resources.camera;
+import lysa.resources.light;
+
+export namespace lysa {
+
+    /**
+     * Number of screen tiles of the light clusters on the X axis
+     */
+    constexpr uint32 LIGHTS_CLUSTERS_X{16};
+
+    /**
+     * Number of screen tiles of the light clusters on the Y axis
+     */
+    constexpr uint32 LIGHTS_CLUSTERS_Y{9};
+
+    /**
+     * Number of depth slices of the light clusters
+     */
+    constexpr uint32 LIGHTS_CLUSTERS_Z{24};
+
+    /**
+     * Number of light clusters
+     */
+    constexpr uint32 LIGHTS_CLUSTERS_COUNT{LIGHTS_CLUSTERS_X * LIGHTS_CLUSTERS_Y * LIGHTS_CLUSTERS_Z};
+
+    /**
+     * Maximum number of lights affecting a light cluster, the others are ignored
+     */
+    constexpr uint32 LIGHTS_CLUSTER_MAX_LIGHTS{256};
+
+    /**
+     * Lights of the light clusters of a camera, computed on the CPU
+     */
+    struct LightClusters {
+        /** Number of lights of each cluster */
+        std::vector<uint32> lightsCounts;
+        /** Indices of the lights of each cluster, LIGHTS_CLUSTER_MAX_LIGHTS per cluster */
+        std::vector<uint32> lights;
+        /** Number of clusters affected by more than LIGHTS_CLUSTER_MAX_LIGHTS lights */
+        uint32 overflowCount{0};
+    };
+
+    /**
+     * Assigns the lights of a scene to the clusters of the camera frustum.
+     *
+     * The frustum is split in LIGHTS_CLUSTERS_X * LIGHTS_CLUSTERS_Y screen tiles and LIGHTS_CLUSTERS_Z
+     * depth slices, exponentially distributed between the near and far planes of the camera. Each
+     * cluster lists the omni and spot lights whose range intersects its bounding box and all the
+     * directional lights, so the lighting shaders only evaluate the lights of the cluster of a
+     * fragment. The outputs are left in the SHADER_READ state after dispatch().
+     *
+     * A cluster keeps the first LIGHTS_CLUSTER_MAX_LIGHTS lights affecting it. The clusters missing
+     * lights are counted and read back, a warning being logged when some appear.
+     */
+    class LightClustering {
+    public:
+        LightClustering(const Context& ctx);
+
+        /**
+         * Records the assignment of the lights to the clusters
+         * @param lights Lights of the scene, in the SHADER_READ state
+         * @param lightsCount Number of lights used in lights
+         */
+        void dispatch(
+            vireo::CommandList& commandList,
+            const Camera& camera,
+            const std::shared_ptr<vireo::Buffer>& lights,
+            uint32 lightsCount);
+
+        /**
+         * Returns the number of lights of each cluster
+         */
+        const auto& getClustersLightsCountsBuffer() const { return clustersLightsCountsBuffer; }
+
+        /**
+         * Returns the indices of the lights of each cluster, LIGHTS_CLUSTER_MAX_LIGHTS per cluster
+         */
+        const auto& getClustersLightsBuffer() const { return clustersLightsBuffer; }
+
+        /**
+         * Returns the number of clusters affected by more than LIGHTS_CLUSTER_MAX_LIGHTS lights, counted
+         * by the last dispatch() whose submission was completed when dispatch() was called again
+         */
+        auto getOverflowCount() const { return overflowCount; }
+
+        /**
+         * Assigns the lights to the clusters on the CPU, as dispatch() does on the GPU
+         * @param lights Lights of the scene, as written in the lights buffer
+         */
+        static LightClusters assignLights(const Camera& camera, std::span<const LightData> lights);
+
+        /**
+         * Returns the scale and the bias giving the depth slice of a view space depth z
+         * with log(-z) * scale + bias
+         */
+        static float2 getSliceScaleBias(const Camera& camera);
+
+        static void cleanup();
+
+        LightClustering(LightClustering&) = delete;
+        LightClustering& operator=(LightClustering&) = delete;
+
+    private:
+        static constexpr vireo::DescriptorIndex BINDING_GLOBAL{0};
+        static constexpr vireo::DescriptorIndex BINDING_LIGHTS{1};
+        static constexpr vireo::DescriptorIndex BINDING_CLUSTERS_LIGHTS_COUNTS{2};
+        static constexpr vireo::DescriptorIndex BINDING_CLUSTERS_LIGHTS{3};
+        static constexpr vireo::DescriptorIndex BINDING_OVERFLOW{4};
+
+        const std::string DEBUG_NAME{"LightClustering"};
+        const std::string SHADER{"light_clustering.comp"};
+
+        struct Global {
+            float4x4 inverseProjection;
+            float4x4 view;
+            float    sliceScale;
+            float    sliceBias;
+            uint32   lightsCount;
+            uint32   perspective;
+        };
+
+        const Context& ctx;
+        std::shared_ptr<vireo::Buffer>        globalBuffer;
+        std::shared_ptr<vireo::Buffer>        clustersLightsCountsBuffer;
+        std::shared_ptr<vireo::Buffer>        clustersLightsBuffer;
+        std::shared_ptr<vireo::DescriptorSet> descriptorSet;
+        // Lights buffer bound in descriptorSet, recreated by the scene when the lights count grows
+        std::shared_ptr<vireo::Buffer>        boundLights;
+        // The outputs are in the UNDEFINED state until the first dispatch
+        bool                                  firstDispatch{true};
+        // Number of overflowed clusters, in the COPY_SRC state between two dispatches
+        std::shared_ptr<vireo::Buffer>        overflowBuffer;
+        std::shared_ptr<vireo::Buffer>        commandClearOverflowBuffer;
+        std::shared_ptr<vireo::Buffer>        downloadOverflowBuffer;
+        bool                                  overflowPending{false};
+        uint32                                overflowCount{0};
+
+        static std::shared_ptr<vireo::DescriptorLayout> descriptorLayout;
+        static std::shared_ptr<vireo::Pipeline> pipeline;
+    };
+}
@@ -0,0 +1,240 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+module lysa.renderers.pipelines.occlusion_culling;
+
+import lysa.virtual_fs;
+import lysa.resources.image;
+import lysa.resources.mesh;
+import lysa.renderers.graphic_pipeline_data;
+
+namespace lysa {
+
+    std::shared_ptr<vireo::DescriptorLayout> OcclusionCulling::descriptorLayout;
+    std::shared_ptr<vireo::Pipeline> OcclusionCulling::pipeline;
+
+    OcclusionCulling::OcclusionCulling(
+        const Context& ctx,
+        const DeviceMemoryArray& meshInstancesArray,
+        const pipeline_id pipelineId) :
+        ctx{ctx} {
+        const auto& vireo = *ctx.vireo;
+        const auto debugName = DEBUG_NAME + ":" + std::to_string(pipelineId);
+
+        constexpr uint32 zeros[2]{0, 0};
+        commandClearStatisticsBuffer = vireo.createBuffer(vireo::BufferType::BUFFER_UPLOAD, sizeof(zeros), 1, debugName + "/commandClearStatistics");
+        commandClearStatisticsBuffer->map();
+        commandClearStatisticsBuffer->write(zeros);
+        commandClearStatisticsBuffer->unmap();
+
+        statisticsBuffer = vireo.createBuffer(vireo::BufferType::READWRITE_STORAGE, sizeof(uint32), 2, debugName + "/statistics");
+        downloadStatisticsBuffer = vireo.createBuffer(vireo::BufferType::BUFFER_DOWNLOAD, sizeof(uint32), 2, debugName + "/downloadStatistics");
+        downloadStatisticsBuffer->map();
+
+        if (descriptorLayout == nullptr) {
+            descriptorLayout = vireo.createDescriptorLayout(DEBUG_NAME);
+            descriptorLayout->add(BINDING_GLOBAL, vireo::DescriptorType::UNIFORM);
+            descriptorLayout->add(BINDING_MESHINSTANCES, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_GROUPS, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_INPUT, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_OUTPUT, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_DISOCCLUDED_OUTPUT, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_VISIBILITY, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_STATISTICS, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_INSTANCES_INDICES, vireo::DescriptorType::READWRITE_STORAGE);
+            descriptorLayout->add(BINDING_DEPTH_PYRAMID, vireo::DescriptorType::SAMPLED_IMAGE, DEPTH_PYRAMID_MAX_LEVELS);
+            descriptorLayout->add(BINDING_MESHSURFACES, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_LODS, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->add(BINDING_GROUPS_ORDER, vireo::DescriptorType::DEVICE_STORAGE);
+            descriptorLayout->build();
+            const auto pipelineResources = vireo.createPipelineResources(
+                { descriptorLayout },
+                {},
+                DEBUG_NAME);
+            auto tempBuffer = std::vector<char>{};
+            ctx.fs.loadShader(SHADER, tempBuffer);
+            const auto shaderModule = vireo.createShaderModule(tempBuffer, SHADER);
+            pipeline = vireo.createComputePipeline(pipelineResources, shaderModule, SHADER);
+        }
+
+        // The first phase does not read the depth pyramid, it is bound to a blank image array
+        const auto blankImage = ctx.res.get<ImageManager>().getBlankImage();
+        for (auto* phase : { &firstPhase, &secondPhase }) {
+            const auto name = debugName + (phase == &firstPhase ? "/first" : "/second");
+            phase->globalBuffer = vireo.createBuffer(vireo::BufferType::UNIFORM, sizeof(Global), 1, name + "/global");
+            phase->globalBuffer->map();
+            phase->descriptorSet = vireo.createDescriptorSet(descriptorLayout, name);
+            phase->descriptorSet->update(BINDING_GLOBAL, phase->globalBuffer);
+            phase->descriptorSet->update(BINDING_MESHINSTANCES, meshInstancesArray.getBuffer());
+            phase->descriptorSet->update(BINDING_STATISTICS, statisticsBuffer);
+            phase->descriptorSet->update(BINDING_MESHSURFACES, ctx.res.get<MeshManager>().getMeshSurfaceBuffer());
+            phase->descriptorSet->update(BINDING_DEPTH_PYRAMID,
+                std::vector<std::shared_ptr<vireo::Image>>(DEPTH_PYRAMID_MAX_LEVELS, blankImage));
+        }
+    }
+
+    void OcclusionCulling::cleanup() {
+        pipeline.reset();
+        descriptorLayout.reset();
+    }
+
+    void OcclusionCulling::clear(
+        vireo::CommandList& commandList,
+        const vireo::Buffer& zeros,
+        const vireo::Buffer& buffer,
+        const size_t size,
+        const vireo::ResourceState from) {
+        commandList.barrier(buffer, from, vireo::ResourceState::COPY_DST);
+        commandList.copy(zeros, buffer, {{0, 0, size}});
+        commandList.barrier(buffer, vireo::ResourceState::COPY_DST, vireo::ResourceState::COMPUTE_WRITE);
+    }
+
+    void OcclusionCulling::dispatchFirstPhase(
+        vireo::CommandList& commandList,
+        const uint32 drawCommandsCount,
+        const uint32 drawGroupsCount,
+        const float4x4& view,
+        const float4x4& projection,
+        const float minScreenSize,
+        const vireo::Buffer& groups,
+        const vireo::Buffer& input,
+        const vireo::Buffer& output,
+        const vireo::Buffer& instancesIndices,
+        const uint32 instancesFirst,
+        const uint32 lodStride,
+        const vireo::Buffer& lods,
+        const uint32 lodsFirst,
+        const vireo::Buffer& groupsOrder,
+        const uint32 groupsOrderFirst,
+        const vireo::Buffer& visibility) {
+        // The previous submission of this frame in flight is completed
+        if (statisticsPending) {
+            const auto* counters = static_cast<uint32*>(downloadStatisticsBuffer->getMappedAddress());
+            statistics = {
+                .frustumCulledCount = counters[0],
+                .occlusionCulledCount = counters[1],
+            };
+            statisticsPending = false;
+        }
+        clear(commandList, *commandClearStatisticsBuffer, *statisticsBuffer, 2 * sizeof(uint32), vireo::ResourceState::COPY_SRC);
+        if (drawCommandsCount == 0) {
+            return;
+        }
+        const auto outputCount = drawGroupsCount * MESH_LODS_MAX;
+        if (outputCount > commandClearOutputCapacity) {
+            // Only the instances counts must be reset, the other fields are written with the first instance
+            commandClearOutputCapacity = std::max(outputCount, commandClearOutputCapacity * 2);
+            const auto zeros = std::vector<DrawCommand>(commandClearOutputCapacity, DrawCommand{});
+            commandClearOutputBuffer = ctx.vireo->createBuffer(
+                vireo::BufferType::BUFFER_UPLOAD,
+                sizeof(DrawCommand), commandClearOutputCapacity,
+                DEBUG_NAME + "/commandClearOutput");
+            commandClearOutputBuffer->map();
+            commandClearOutputBuffer->write(zeros.data(), zeros.size() * sizeof(DrawCommand));
+            commandClearOutputBuffer->unmap();
+        }
+        clear(commandList, *commandClearOutputBuffer, output, outputCount * sizeof(DrawCommand), vireo::ResourceState::INDIRECT_DRAW);
+
+        global = Global{
+            .drawCommandsCount = drawCommandsCount,
+            .phase = PHASE_FIRST,
+            .drawGroupsCount = drawGroupsCount,
+            .instancesFirst = instancesFirst,
+            .lodStride = lodStride,
+            .lodsFirst = lodsFirst,
+            .view = inverse(view),
+            .projection = projection,
+            .origin = float4{view[3].xyz, projection[1][1]},
+            .minScreenSize = minScreenSize,
+            .perspective = projection[3][3] == 0.0f ? 1u : 0u,
+            .groupsOrderFirst = groupsOrderFirst,
+        };
+        Frustum::extractPlanes(global.planes, mul(global.view, projection));
+        firstPhase.globalBuffer->write(&global);
+
+        const auto& descriptorSet = firstPhase.descriptorSet;
+        descriptorSet->update(BINDING_GROUPS, groups);
+        descriptorSet->update(BINDING_INPUT, input);
+        descriptorSet->update(BINDING_OUTPUT, output);
+        descriptorSet->update(BINDING_DISOCCLUDED_OUTPUT, output);
+        descriptorSet->update(BINDING_VISIBILITY, visibility);
+        descriptorSet->update(BINDING_INSTANCES_INDICES, instancesIndices);
+        descriptorSet->update(BINDING_LODS, lods);
+        descriptorSet->update(BINDING_GROUPS_ORDER, groupsOrder);
+
+        // The visibility was written by the second phase of the previous frame
+        commandList.barrier(visibility, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::COMPUTE_READ);
+        commandList.barrier(input, vireo::ResourceState::INDIRECT_DRAW, vireo::ResourceState::COMPUTE_READ);
+        commandList.barrier(instancesIndices, vireo::ResourceState::SHADER_READ, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.bindPipeline(pipeline);
+        commandList.bindDescriptors({ descriptorSet });
+        commandList.dispatch((drawCommandsCount + 63) / 64, 1, 1);
+        commandList.barrier(instancesIndices, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::SHADER_READ);
+        commandList.barrier(output, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::INDIRECT_DRAW);
+        commandList.barrier(input, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::INDIRECT_DRAW);
+        commandList.barrier(visibility, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::COMPUTE_WRITE);
+    }
+
+    void OcclusionCulling::dispatchSecondPhase(
+        vireo::CommandList& commandList,
+        const uint32 drawCommandsCount,
+        const uint32 drawGroupsCount,
+        const vireo::Buffer& groups,
+        const vireo::Buffer& input,
+        const vireo::Buffer& output,
+        const vireo::Buffer& disoccludedOutput,
+        const vireo::Buffer& instancesIndices,
+        const uint32 disoccludedInstancesFirst,
+        const vireo::Buffer& lods,
+        const vireo::Buffer& groupsOrder,
+        const vireo::Buffer& visibility,
+        const std::vector<std::shared_ptr<vireo::Image>>& depthPyramid,
+        const uint32 levelsCount,
+        const bool withStatistics) {
+        if (drawCommandsCount == 0) {
+            commandList.barrier(*statisticsBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::COPY_SRC);
+            statistics = {};
+            return;
+        }
+        clear(commandList, *commandClearOutputBuffer, disoccludedOutput, drawGroupsCount * MESH_LODS_MAX * sizeof(DrawCommand), vireo::ResourceState::INDIRECT_DRAW);
+
+        // Same frustum and matrices as the first phase
+        global.phase = PHASE_SECOND;
+        global.levelsCount = levelsCount;
+        global.disoccludedInstancesFirst = disoccludedInstancesFirst;
+        secondPhase.globalBuffer->write(&global);
+
+        const auto& descriptorSet = secondPhase.descriptorSet;
+        descriptorSet->update(BINDING_GROUPS, groups);
+        descriptorSet->update(BINDING_INPUT, input);
+        // The output instances counts are not reset : the newly visible instances are appended after the first phase ones
+        descriptorSet->update(BINDING_OUTPUT, output);
+        descriptorSet->update(BINDING_DISOCCLUDED_OUTPUT, disoccludedOutput);
+        descriptorSet->update(BINDING_VISIBILITY, visibility);
+        descriptorSet->update(BINDING_INSTANCES_INDICES, instancesIndices);
+        descriptorSet->update(BINDING_DEPTH_PYRAMID, depthPyramid);
+        descriptorSet->update(BINDING_LODS, lods);
+        descriptorSet->update(BINDING_GROUPS_ORDER, groupsOrder);
+
+        commandList.barrier(input, vireo::ResourceState::INDIRECT_DRAW, vireo::ResourceState::COMPUTE_READ);
+        commandList.barrier(output, vireo::ResourceState::INDIRECT_DRAW, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.barrier(instancesIndices, vireo::ResourceState::SHADER_READ, vireo::ResourceState::COMPUTE_WRITE);
+        commandList.bindPipeline(pipeline);
+        commandList.bindDescriptors({ descriptorSet });
+        commandList.dispatch((drawCommandsCount + 63) / 64, 1, 1);
+        commandList.barrier(instancesIndices, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::SHADER_READ);
+        commandList.barrier(disoccludedOutput, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::INDIRECT_DRAW);
+        commandList.barrier(output, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::INDIRECT_DRAW);
+        commandList.barrier(input, vireo::ResourceState::COMPUTE_READ, vireo::ResourceState::INDIRECT_DRAW);
+
+        commandList.barrier(*statisticsBuffer, vireo::ResourceState::COMPUTE_WRITE, vireo::ResourceState::COPY_SRC);
+        if (withStatistics) {
+            commandList.copy(*statisticsBuffer, *downloadStatisticsBuffer);
+            statisticsPending = true;
+        }
+    }
+
+}
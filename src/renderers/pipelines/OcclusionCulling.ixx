@@ -0,0 +1,186 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.renderers.pipelines.occlusion_culling;
+
+import vireo;
+import lysa.context;
+import lysa.frustum;
+import lysa.math;
+import lysa.memory;
+import lysa.renderers.pipelines.depth_pyramid;
+
+export namespace lysa {
+
+    /**
+     * Number of draw commands culled by the second phase of the occlusion culling
+     */
+    struct OcclusionCullingStatistics {
+        /** Draw commands outside the frustum, too small on screen or of an invisible mesh instance */
+        uint32 frustumCulledCount{0};
+        /** Draw commands hidden by the depth pyramid */
+        uint32 occlusionCulledCount{0};
+    };
+
+    /**
+     * Two-phase frustum and occlusion culling of the draw commands of a pipeline.
+     *
+     * The first phase outputs the draw commands in the frustum that were visible the previous frame.
+     * Once they are rendered in the depth buffer and a depth pyramid is built, the second phase tests
+     * all the draw commands against the frustum and the pyramid, updates the visibility of each draw
+     * command for the next frame and appends the newly visible ones to the same output and to a
+     * "disoccluded" output, used to complete the depth buffer.
+     *
+     * The outputs contain one instanced draw command per draw group and detail level of the pipeline,
+     * the visible instances of each group being listed in a range of an instances indices buffer. The
+     * detail levels of the draw commands are the ones selected by the FrustumCulling of the scene.
+     */
+    class OcclusionCulling {
+    public:
+        OcclusionCulling(
+            const Context& ctx,
+            const DeviceMemoryArray& meshInstancesArray,
+            pipeline_id pipelineId);
+
+        /**
+         * Records the first phase, resets the instances counts of the output
+         * @param drawGroupsCount Number of draw groups, the outputs have MESH_LODS_MAX instanced draw commands per group
+         * @param minScreenSize Discards the mesh instances projected under this fraction of the viewport height
+         * @param groups Position of the first draw command of each draw group
+         * @param instancesIndices Instances indices of the outputs, in the SHADER_READ state
+         * @param instancesFirst Start of the range of the output finest level in instancesIndices
+         * @param lodStride Distance between the ranges of two detail levels in instancesIndices
+         * @param lods Detail level of each draw command, in the COMPUTE_READ state
+         * @param lodsFirst Position of the first draw command in lods
+         * @param groupsOrder Position of each draw group in the outputs, in the COMPUTE_READ state
+         * @param groupsOrderFirst Position of the first draw group in groupsOrder
+         */
+        void dispatchFirstPhase(
+            vireo::CommandList& commandList,
+            uint32 drawCommandsCount,
+            uint32 drawGroupsCount,
+            const float4x4& view,
+            const float4x4& projection,
+            float minScreenSize,
+            const vireo::Buffer& groups,
+            const vireo::Buffer& input,
+            const vireo::Buffer& output,
+            const vireo::Buffer& instancesIndices,
+            uint32 instancesFirst,
+            uint32 lodStride,
+            const vireo::Buffer& lods,
+            uint32 lodsFirst,
+            const vireo::Buffer& groupsOrder,
+            uint32 groupsOrderFirst,
+            const vireo::Buffer& visibility);
+
+        /**
+         * Records the second phase, must be called after dispatchFirstPhase() with the same buffers
+         * @param disoccludedInstancesFirst Start of the range of the disoccluded output finest level in instancesIndices
+         * @param depthPyramid Levels of the depth pyramid, in the SHADER_READ state
+         * @param levelsCount Number of levels used in depthPyramid
+         * @param withStatistics Copy the culling counters for getStatistics()
+         */
+        void dispatchSecondPhase(
+            vireo::CommandList& commandList,
+            uint32 drawCommandsCount,
+            uint32 drawGroupsCount,
+            const vireo::Buffer& groups,
+            const vireo::Buffer& input,
+            const vireo::Buffer& output,
+            const vireo::Buffer& disoccludedOutput,
+            const vireo::Buffer& instancesIndices,
+            uint32 disoccludedInstancesFirst,
+            const vireo::Buffer& lods,
+            const vireo::Buffer& groupsOrder,
+            const vireo::Buffer& visibility,
+            const std::vector<std::shared_ptr<vireo::Image>>& depthPyramid,
+            uint32 levelsCount,
+            bool withStatistics);
+
+        /**
+         * Returns the culling counters of the last second phase recorded with statistics whose
+         * submission was completed when dispatchFirstPhase() was called again.
+         */
+        const auto& getStatistics() const { return statistics; }
+
+        static void cleanup();
+
+        virtual ~OcclusionCulling() = default;
+        OcclusionCulling(OcclusionCulling&) = delete;
+        OcclusionCulling& operator=(OcclusionCulling&) = delete;
+
+    private:
+        static constexpr vireo::DescriptorIndex BINDING_GLOBAL{0};
+        static constexpr vireo::DescriptorIndex BINDING_MESHINSTANCES{1};
+        static constexpr vireo::DescriptorIndex BINDING_GROUPS{2};
+        static constexpr vireo::DescriptorIndex BINDING_INPUT{3};
+        static constexpr vireo::DescriptorIndex BINDING_OUTPUT{4};
+        static constexpr vireo::DescriptorIndex BINDING_DISOCCLUDED_OUTPUT{5};
+        static constexpr vireo::DescriptorIndex BINDING_VISIBILITY{6};
+        static constexpr vireo::DescriptorIndex BINDING_STATISTICS{7};
+        static constexpr vireo::DescriptorIndex BINDING_INSTANCES_INDICES{8};
+        static constexpr vireo::DescriptorIndex BINDING_DEPTH_PYRAMID{9};
+        static constexpr vireo::DescriptorIndex BINDING_MESHSURFACES{10};
+        static constexpr vireo::DescriptorIndex BINDING_LODS{11};
+        static constexpr vireo::DescriptorIndex BINDING_GROUPS_ORDER{12};
+
+        static constexpr uint32 PHASE_FIRST{0};
+        static constexpr uint32 PHASE_SECOND{1};
+
+        const std::string DEBUG_NAME{"OcclusionCulling"};
+        const std::string SHADER{"occlusion_culling.comp"};
+
+        struct Global {
+            uint32 drawCommandsCount;
+            uint32 phase;
+            uint32 levelsCount;
+            uint32 drawGroupsCount;
+            uint32 instancesFirst;
+            uint32 disoccludedInstancesFirst;
+            uint32 lodStride;
+            uint32 lodsFirst;
+            Frustum::Plane planes[6];
+            float4x4 view;
+            float4x4 projection;
+            // xyz : position, w : projection[1][1]
+            float4 origin;
+            float  minScreenSize;
+            uint32 perspective;
+            uint32 groupsOrderFirst;
+            uint32 padding;
+        };
+
+        struct Phase {
+            std::shared_ptr<vireo::DescriptorSet> descriptorSet;
+            std::shared_ptr<vireo::Buffer>        globalBuffer;
+        };
+
+        const Context& ctx;
+        // Each phase has its own uniform buffer, both are read by the same submission
+        Phase firstPhase;
+        Phase secondPhase;
+        Global global{};
+        std::shared_ptr<vireo::Buffer>           statisticsBuffer;
+        std::shared_ptr<vireo::Buffer>           commandClearOutputBuffer;
+        uint32                                   commandClearOutputCapacity{0};
+        std::shared_ptr<vireo::Buffer>           commandClearStatisticsBuffer;
+        std::shared_ptr<vireo::Buffer>           downloadStatisticsBuffer;
+        bool                                     statisticsPending{false};
+        OcclusionCullingStatistics               statistics{};
+
+        static std::shared_ptr<vireo::DescriptorLayout> descriptorLayout;
+        static std::shared_ptr<vireo::Pipeline> pipeline;
+
+        // Zeroes the start of a buffer in the from state, leaves it in the COMPUTE_WRITE state
+        static void clear(
+            vireo::CommandList& commandList,
+            const vireo::Buffer& zeros,
+            const vireo::Buffer& buffer,
+            size_t size,
+            vireo::ResourceState from);
+    };
+}
@@ -29,6 +29,7 @@ namespace lysa {
         },
             SceneFrameData::instanceIndexConstantDesc, name);
         renderingConfig.stencilTestEnable = pipelineConfig.stencilTestEnable;
+        disoccludedRenderingConfig.stencilTestEnable = pipelineConfig.stencilTestEnable;
         framesData.resize(ctx.config.framesInFlight);
     }
 
@@ -40,7 +41,7 @@ namespace lysa {
                 pipelineConfig.vertexShader = loadShader(VERTEX_SHADER);
                 pipelineConfig.vertexInputLayout = ctx.vireo->createVertexLayout(sizeof(VertexData), VertexData::vertexAttributes);
                 pipelineConfig.msaa = config.msaa;
-                pipelines[pipelineId] = ctx.vireo->createGraphicPipeline(pipelineConfig, name + ":" + std::to_string(pipelineId));
+                pipelines.emplace(pipelineId, ctx.vireo->createGraphicPipeline(pipelineConfig, name + ":" + std::to_string(pipelineId)));
             }
         }
     }
@@ -61,6 +62,22 @@ namespace lysa {
         commandList.endRendering();
     }
 
+    void DepthPrepass::renderDisoccluded(
+        vireo::CommandList& commandList,
+        const SceneFrameData& scene,
+        const std::shared_ptr<vireo::RenderTarget>& depthAttachment,
+        const uint32 frameIndex) {
+        const auto& frame = framesData[frameIndex];
+        disoccludedRenderingConfig.depthStencilRenderTarget = depthAttachment;
+        disoccludedRenderingConfig.multisampledDepthStencilRenderTarget = frame.multisampledDepthAttachment;
+        commandList.beginRendering(disoccludedRenderingConfig);
+        if (pipelineConfig.stencilTestEnable) {
+            commandList.setStencilReference(1);
+        }
+        scene.drawDisoccludedOpaquesModels(commandList, pipelines);
+        commandList.endRendering();
+    }
+
     void DepthPrepass::resize(const vireo::Extent& extent, const std::shared_ptr<vireo::CommandList>& commandList) {
         if (config.msaa != vireo::MSAA::NONE) {
             for (auto& frame : framesData) {
@@ -9,6 +9,7 @@ export module lysa.renderers.renderpasses.depth_prepass;
 import vireo;
 import lysa.context;
 import lysa.renderers.configuration;
+import lysa.renderers.pipelines_array;
 import lysa.renderers.renderpasses.renderpass;
 import lysa.renderers.scene_frame_data;
 import lysa.resources.material;
@@ -59,6 +60,20 @@ export namespace lysa {
             const std::shared_ptr<vireo::RenderTarget>& depthAttachment,
             uint32 frameIndex);
 
+        /**
+         * Completes the depth pre-pass with the opaque models made visible by the
+         * second phase of the occlusion culling, without clearing the depth attachment
+         * @param commandList The command list to record rendering commands into
+         * @param scene The scene frame data
+         * @param depthAttachment The target depth attachment
+         * @param frameIndex Index of the current frame
+         */
+        void renderDisoccluded(
+            vireo::CommandList& commandList,
+            const SceneFrameData& scene,
+            const std::shared_ptr<vireo::RenderTarget>& depthAttachment,
+            uint32 frameIndex);
+
         /**
          * Resizes the render pass resources
          * @param extent The new extent
@@ -88,12 +103,17 @@ export namespace lysa {
             .clearDepthStencil = true,
         };
 
+        vireo::RenderingConfiguration disoccludedRenderingConfig {
+            .depthTestEnable = pipelineConfig.depthTestEnable,
+            .clearDepthStencil = false,
+        };
+
         struct FrameData {
             std::shared_ptr<vireo::RenderTarget> multisampledDepthAttachment;
         };
 
         const MaterialManager& materialManager;
         std::vector<FrameData> framesData;
-        std::unordered_map<pipeline_id, std::shared_ptr<vireo::GraphicPipeline>> pipelines;
+        PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>> pipelines;
     };
 }
\ No newline at end of file
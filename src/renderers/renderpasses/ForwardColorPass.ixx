@@ -10,6 +10,7 @@ import vireo;
 import lysa.context;
 import lysa.types;
 import lysa.renderers.configuration;
+import lysa.renderers.pipelines_array;
 import lysa.renderers.scene_frame_data;
 import lysa.renderers.renderpasses.renderpass;
 import lysa.resources.material;
@@ -94,7 +95,7 @@ export namespace lysa {
 
         const MaterialManager& materialManager;
         std::vector<FrameData> framesData;
-        std::unordered_map<pipeline_id, std::shared_ptr<vireo::GraphicPipeline>> pipelines;
+        PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>> pipelines;
 
     };
 }
\ No newline at end of file
@@ -49,7 +49,7 @@ namespace lysa {
                 pipelineConfig.cullMode = material.getCullMode();
                 pipelineConfig.vertexShader = loadShader(VERTEX_SHADER);
                 pipelineConfig.fragmentShader = loadShader(FRAGMENT_SHADER);
-                pipelines[pipelineId] = ctx.vireo->createGraphicPipeline(pipelineConfig, name);
+                pipelines.emplace(pipelineId, ctx.vireo->createGraphicPipeline(pipelineConfig, name));
             }
         }
     }
@@ -9,6 +9,7 @@ export module lysa.renderers.renderpasses.gbuffer_pass;
 import vireo;
 import lysa.context;
 import lysa.renderers.configuration;
+import lysa.renderers.pipelines_array;
 import lysa.renderers.scene_frame_data;
 import lysa.renderers.renderpasses.renderpass;
 import lysa.resources.material;
@@ -152,6 +153,6 @@ export namespace lysa {
 
         std::vector<FrameData> framesData;
         const MaterialManager& materialManager;
-        std::unordered_map<pipeline_id, std::shared_ptr<vireo::GraphicPipeline>> pipelines;
+        PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>> pipelines;
     };
 }
\ No newline at end of file
@@ -55,7 +55,7 @@ namespace lysa {
                 pipelineConfig.cullMode = material.getCullMode();
                 pipelineConfig.vertexShader = loadShader(vertShaderName);
                 pipelineConfig.fragmentShader = loadShader(fragShaderName);
-                pipelines[pipelineId] = ctx.vireo->createGraphicPipeline(pipelineConfig, name);
+                pipelines.emplace(pipelineId, ctx.vireo->createGraphicPipeline(pipelineConfig, name));
             }
         }
     }
@@ -9,6 +9,7 @@ export module lysa.renderers.renderpasses.shader_material_pass;
 import vireo;
 import lysa.context;
 import lysa.renderers.configuration;
+import lysa.renderers.pipelines_array;
 import lysa.renderers.scene_frame_data;
 import lysa.renderers.renderpasses.renderpass;
 import lysa.resources.material;
@@ -69,7 +70,7 @@ export namespace lysa {
         };
 
         const MaterialManager& materialManager;
-        std::unordered_map<pipeline_id, std::shared_ptr<vireo::GraphicPipeline>> pipelines;
+        PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>> pipelines;
 
     };
 }
\ No newline at end of file
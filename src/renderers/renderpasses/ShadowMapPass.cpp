@@ -7,25 +7,40 @@
 module lysa.renderers.renderpasses.shadow_map_pass;
 
 import lysa.exception;
+import lysa.frustum;
 import lysa.log;
 
 namespace lysa {
 
+    // Returns false if the box is entirely behind one of the planes
+    static bool isInFrustum(const Frustum::Plane planes[6], const AABB& aabb) {
+        for (auto i = 0; i < 6; i++) {
+            const float3 normal = planes[i].data.xyz;
+            // Farthest corner along the plane normal
+            const float3 positive = select(normal >= float3(0.0f), aabb.max, aabb.min);
+            if (dot(normal, positive) + planes[i].data.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     ShadowMapPass::ShadowMapPass(
         const Context& ctx,
         const Light* light,
-        const DeviceMemoryArray& meshInstancesDataArray,
-        const size_t maxMeshSurfacePerPipeline) :
+        ShadowMapAtlas& atlas) :
         Renderpass{ctx, {}, "ShadowMapPass"},
         light{light},
-        meshInstancesDataArray{meshInstancesDataArray},
-        maxMeshSurfacePerPipeline(maxMeshSurfacePerPipeline),
         isCascaded{light->type == LightType::LIGHT_DIRECTIONAL},
-        isCubeMap{light->type == LightType::LIGHT_OMNI} {
+        isCubeMap{light->type == LightType::LIGHT_OMNI},
+        atlas{atlas} {
         const auto& vireo = *ctx.vireo;
 
         descriptorLayout = vireo.createDescriptorLayout();
         descriptorLayout->add(BINDING_GLOBAL, vireo::DescriptorType::UNIFORM);
+        if (isCubeMap) {
+            descriptorLayout->add(BINDING_CUBE_MAP_FACES, vireo::DescriptorType::UNIFORM);
+        }
         descriptorLayout->build();
 
         pipelineConfig.resources = ctx.vireo->createPipelineResources({
@@ -45,6 +60,13 @@ namespace lysa {
             pipelineConfig.fragmentShader = loadShader(FRAGMENT_SHADER);
         }
         pipeline = vireo.createGraphicPipeline(pipelineConfig, name);
+        if (isCubeMap) {
+            auto singlePassPipelineConfig = pipelineConfig;
+            singlePassPipelineConfig.vertexShader = loadShader(VERTEX_SHADER_CUBEMAP);
+            singlePassPipeline = vireo.createGraphicPipeline(singlePassPipelineConfig, name + "/singlePass");
+            cubeMapFacesBuffer = vireo.createBuffer(vireo::BufferType::UNIFORM, sizeof(CubeMapFaces));
+            cubeMapFacesBuffer->map();
+        }
 
         if (isCascaded) {
             subpassesCount = light->shadowMapCascadesCount;
@@ -61,66 +83,124 @@ namespace lysa {
             data.globalUniformBuffer->map();
             data.descriptorSet = vireo.createDescriptorSet(descriptorLayout);
             data.descriptorSet->update(BINDING_GLOBAL, data.globalUniformBuffer);
-            int size = light->shadowMapSize;
-            if (isCascaded) {
-                size = std::max(512, size >> i);
+            if (isCubeMap) {
+                data.descriptorSet->update(BINDING_CUBE_MAP_FACES, cubeMapFacesBuffer);
             }
-            data.shadowMap = vireo.createRenderTarget(
-                pipelineConfig.depthStencilImageFormat,
-                size,
-                size,
-                vireo::RenderTargetType::DEPTH,
-                renderingConfig.depthStencilClearValue);
-#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
-            data.transparencyColorMap = vireo.createRenderTarget(
-                pipelineConfig.colorRenderFormats[0],
-                size,
-                size,
-                vireo::RenderTargetType::COLOR,
-                renderingConfig.colorRenderTargets[0].clearValue);
-#endif
         }
     }
 
-    void ShadowMapPass::updatePipelines(const std::unordered_map<pipeline_id, std::vector<unique_id>>& pipelineIds) {
-        for (const auto& pipelineId: std::views::keys(pipelineIds)) {
-            for (auto& data : subpassData) {
-                if (!data.frustumCullingPipelines.contains(pipelineId)) {
-                    // INFO("ShadowMapPass::updatePipelines for light ", std::to_string(light->getName()));
-                    data.frustumCullingPipelines[pipelineId] =
-                        std::make_shared<FrustumCulling>(ctx, false, meshInstancesDataArray, pipelineId);
-                    data.culledDrawCommandsCountBuffers[pipelineId] = ctx.vireo->createBuffer(
-                      vireo::BufferType::READWRITE_STORAGE,
-                      sizeof(uint32));
-                    data.culledDrawCommandsBuffers[pipelineId] = ctx.vireo->createBuffer(
-                      vireo::BufferType::READWRITE_STORAGE,
-                      sizeof(DrawCommand) * maxMeshSurfacePerPipeline);
+    ShadowMapPass::~ShadowMapPass() {
+        for (const auto& data : subpassData) {
+            atlas.free(data.area);
+        }
+    }
+
+    CullingView ShadowMapPass::getCullingView(const uint32 index, const bool staticCasters) const {
+        auto view = CullingView {
+            .transform = subpassData[index].inverseViewMatrix,
+            .projection = subpassData[index].projection,
+            .shadowCasters = true,
+            .mobility = staticCasters ? CullingMobility::STATIC :
+                        staticCacheEnabled ? CullingMobility::DYNAMIC :
+                        CullingMobility::ALL,
+        };
+        if (isSinglePass()) {
+            // Box bounding the range of the light, the faces are selected by the culling
+            const auto& lightPosition = subpassData[0].globalUniform.lightPosition;
+            const auto range = lightPosition.w;
+            view.transform = float4x4::identity();
+            view.transform[3] = float4(lightPosition.xyz, 1.0f);
+            view.projection = orthographic(-range, range, range, -range, -range, range);
+            view.cubeMap = true;
+        }
+        return view;
+    }
+
+    float ShadowMapPass::getImportance(const Camera& camera) const {
+        if (light->type == LightType::LIGHT_DIRECTIONAL) { return 1.0f; }
+        const auto distance = length(light->getPosition() - camera.transform[3].xyz);
+        if (distance <= light->range) { return 1.0f; }
+        // Projected height of the range sphere, relative to the screen height
+        if (camera.projection[3][3] == 0.0f) {
+            return std::min(1.0f, light->range * camera.projection[1][1] / distance);
+        }
+        return std::min(1.0f, light->range * std::abs(camera.projection[1][1]));
+    }
+
+    uint32 ShadowMapPass::getRequestedShadowMapSize(const float importance) const {
+        const auto maxSize = std::max(std::bit_ceil(light->shadowMapSize), ShadowMapAtlas::MIN_SHADOW_MAP_SIZE);
+        const auto target = static_cast<float>(maxSize) * std::clamp(importance, 0.0f, 1.0f);
+        // Hysteresis : the current size is kept until the target is well below it
+        if (shadowMapSize != 0 &&
+            target <= static_cast<float>(shadowMapSize) &&
+            target >= static_cast<float>(shadowMapSize) * 0.375f) {
+            return shadowMapSize;
+        }
+        const auto size = std::bit_ceil(static_cast<uint32>(std::ceil(target)));
+        return std::clamp(size, ShadowMapAtlas::MIN_SHADOW_MAP_SIZE, maxSize);
+    }
+
+    bool ShadowMapPass::allocateShadowMaps(const uint32 size) {
+        if (size == shadowMapSize) { return true; }
+        // The cascades are smaller with the distance to the camera
+        const auto getSize = [&](const uint32 s, const int index) {
+            return isCascaded ? std::max(s >> index, std::min(s, 512u)) : s;
+        };
+        for (auto& data : subpassData) {
+            atlas.free(data.area);
+            data.area = {};
+        }
+        if (size != 0) {
+            for (auto i = 0; i < subpassesCount; i++) {
+                subpassData[i].area = atlas.allocate(getSize(size, i));
+                if (subpassData[i].area.size == 0) {
+                    // Atlas full : restores the previous sizes, the freed quadrants being still free
+                    for (auto& data : subpassData) {
+                        atlas.free(data.area);
+                        data.area = {};
+                    }
+                    for (auto j = 0; shadowMapSize != 0 && j < subpassesCount; j++) {
+                        subpassData[j].area = atlas.allocate(getSize(shadowMapSize, j));
+                        if (subpassData[j].area.size == 0) {
+                            allocateShadowMaps(0);
+                        }
+                    }
+                    // The restored areas can be at other positions in the atlas, with an undefined content
+                    invalidateShadowMaps();
+                    return false;
                 }
             }
         }
+        shadowMapSize = size;
+        // The content of the new areas is undefined
+        invalidateShadowMaps();
+        return true;
     }
 
-    void ShadowMapPass::compute(
-        vireo::CommandList& commandList,
-        const std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>>& pipelinesData) const {
-        if (!light->visible || !light->castShadows) { return; }
-        for (const auto& [pipelineId, pipelineData] : pipelinesData) {
-            for (const auto& data : subpassData) {
-                data.frustumCullingPipelines.at(pipelineId)->dispatch(
-                    commandList,
-                    pipelineData->drawCommandsCount,
-                    data.inverseViewMatrix,
-                    data.projection,
-                    *pipelineData->instancesArray.getBuffer(),
-                    *pipelineData->drawCommandsBuffer,
-                    *data.culledDrawCommandsBuffers.at(pipelineId),
-                    *data.culledDrawCommandsCountBuffers.at(pipelineId));
-            }
+    void ShadowMapPass::invalidateShadowMaps() {
+        for (auto& data : subpassData) {
+            data.staticCacheValid = false;
         }
+        allCascadesUpdated = true;
+    }
+
+    void ShadowMapPass::setViewport(vireo::CommandList& commandList, const AtlasPacker::Area& area) const {
+        auto viewport = vireo::Viewport{static_cast<float>(area.size), static_cast<float>(area.size)};
+        viewport.x = static_cast<float>(area.x);
+        viewport.y = static_cast<float>(area.y);
+        commandList.setViewport(viewport);
+        auto scissors = vireo::Rect{area.size, area.size};
+        scissors.x = static_cast<int32>(area.x);
+        scissors.y = static_cast<int32>(area.y);
+        commandList.setScissors(scissors);
     }
 
     void ShadowMapPass::update(const uint32) {
-        if (!light->visible || !light->castShadows) { return; }
+        if (!light->visible || !light->castShadows || shadowMapSize == 0) { return; }
+        // Rendered every frame, the far cascades being scheduled below
+        for (auto& data : subpassData) {
+            data.updated = true;
+        }
         static constexpr auto aspectRatio{1};
         switch (light->type) {
             case LightType::LIGHT_DIRECTIONAL: {
@@ -134,6 +214,34 @@ namespace lysa {
                 const auto range = maxZ - minZ;
                 const auto ratio = maxZ / minZ;
 
+                // The splits and the light space basis of all the cascades change together
+                if (any(lastLightDirection != lightDirection) || lastCameraNear != nearClip || lastCameraFar != farClip) {
+                    lastLightDirection = lightDirection;
+                    lastCameraNear = nearClip;
+                    lastCameraFar = farClip;
+                    allCascadesUpdated = true;
+                }
+                // Frames of the scene since the previous update of this pass, one per frame in flight
+                const auto framesStep = currentFrame > lastFrame ? currentFrame - lastFrame : 1;
+                lastFrame = currentFrame;
+                for (auto i = 1; i < subpassesCount && cascadesUpdateInterval > 1; i++) {
+                    // The far cascades are interleaved, each one rendered every cascadesUpdateInterval frames
+                    // of the scene, whatever the number of frames in flight
+                    auto& data = subpassData[i];
+                    if (allCascadesUpdated) {
+                        data.nextUpdateFrame = currentFrame + cascadesUpdateInterval - (i - 1) % cascadesUpdateInterval;
+                    } else if (currentFrame >= data.nextUpdateFrame) {
+                        data.nextUpdateFrame = currentFrame + cascadesUpdateInterval;
+                    } else {
+                        data.updated = false;
+                    }
+                }
+                allCascadesUpdated = false;
+
+                // Light space basis, independent of the camera position so the cascades can be snapped to its texels
+                const auto lightViewMatrix = look_at(FLOAT3ZERO, lightDirection, AXIS_UP);
+                const auto inverseLightViewMatrix = inverse(lightViewMatrix);
+
                 // Calculate split depths based on view camera frustum
                 // Based on the method presented in https://developer.nvidia.com/gpugems/GPUGems3/gpugems3_ch10.html
                 for (auto i = 0; i < subpassesCount; i++) {
@@ -149,6 +257,11 @@ namespace lysa {
                 const auto invCam = inverse(mul(inverse(currentCamera->transform), currentCamera->projection));
                 for (auto cascadeIndex = 0; cascadeIndex < subpassesCount; cascadeIndex++) {
                     const auto splitDist = cascadeSplits[cascadeIndex];
+                    if (!subpassData[cascadeIndex].updated) {
+                        // Keeps the light space the shadow map in the atlas was rendered with
+                        lastSplitDist = splitDist;
+                        continue;
+                    }
 
                     // Camera frustum corners in NDC space
                     float3 frustumCorners[] = {
@@ -176,16 +289,32 @@ namespace lysa {
                     }
                     frustumCenter /= 8.0f;
 
-                    // Radius of the cascade split
+                    // Radius of the cascade split, the bounding sphere does not change with the camera rotation
                     auto radius = 0.0f;
                     for (auto j = 0; j < 8; j++) {
                         const float distance = length(frustumCorners[j] - frustumCenter);
                         radius = std::max(radius, distance);
                     }
+                    // A cascade rendered every few frames is used until its next rendering : its radius is enlarged
+                    // by the distance its split moved since its previous rendering, at the same speed, up to twice
+                    // the radius after a teleport
+                    auto& data = subpassData[cascadeIndex];
+                    if (cascadeIndex > 0 && cascadesUpdateInterval > 1 && data.renderedFrame && currentFrame > *data.renderedFrame) {
+                        const auto speed = length(frustumCenter - data.renderedCenter) /
+                            static_cast<float>(currentFrame - *data.renderedFrame);
+                        const auto maxAge = data.nextUpdateFrame - currentFrame + framesStep - 1;
+                        radius += std::min(speed * static_cast<float>(maxAge), radius);
+                    }
+                    data.renderedFrame = currentFrame;
+                    data.renderedCenter = frustumCenter;
                     radius = std::ceil(radius * 16.0f) / 16.0f ;
 
-                    // Snap the frustum center to the nearest texel grid
-                    const auto shadowMapResolution = static_cast<float>(subpassData[cascadeIndex].shadowMap->getImage()->getWidth());
+                    // Snap the frustum center to the texel grid of the light space basis
+                    const auto shadowMapResolution = static_cast<float>(subpassData[cascadeIndex].area.size);
+                    const auto texelSize = 2.0f * radius / shadowMapResolution;
+                    const auto lightSpaceCenter = mul(float4(frustumCenter, 1.0f), lightViewMatrix);
+                    const auto snappedCenter = float4(round(lightSpaceCenter.xyz / texelSize) * texelSize, 1.0f);
+                    frustumCenter = mul(snappedCenter, inverseLightViewMatrix).xyz;
 
                     // Split the bounding box
                     const auto maxExtents = float3(radius);
@@ -195,22 +324,11 @@ namespace lysa {
                     // View & projection matrices
                     const auto eye = frustumCenter - lightDirection * radius;
                     const auto viewMatrix = look_at(eye, frustumCenter, AXIS_UP);
-                    auto lightProjection = orthographic(
+                    const auto lightProjection = orthographic(
                         minExtents.x, maxExtents.x,
                         maxExtents.y, minExtents.y,
                         -depth, depth);
 
-                    const auto shadowMatrix = mul(viewMatrix, lightProjection);
-                    float4 shadowOrigin = mul(float4(0, 0, 0, 1), shadowMatrix);
-                    shadowOrigin *= (shadowMapResolution * 0.5f);
-
-                    const auto roundedOrigin = round(shadowOrigin);
-                    auto roundOffset = roundedOrigin - shadowOrigin;
-                    roundOffset = roundOffset * 2.0f / shadowMapResolution;
-                    roundOffset.z = 0.0f;
-                    roundOffset.w = 0.0f;
-                    lightProjection[3] += roundOffset;
-
                     subpassData[cascadeIndex].inverseViewMatrix = inverse(viewMatrix);
                     subpassData[cascadeIndex].projection = lightProjection;
                     subpassData[cascadeIndex].globalUniform.lightSpace = mul(viewMatrix, lightProjection);
@@ -263,6 +381,26 @@ namespace lysa {
                     }
                     lastLightPosition = lightPosition;
                 }
+                if (isSinglePass()) {
+                    // Written each frame since the areas can be reallocated
+                    const auto atlasSize = static_cast<float>(atlas.getSize());
+                    auto cubeMapFaces = CubeMapFaces{};
+                    for (int i = 0; i < 6; i++) {
+                        const auto& area = subpassData[i].area;
+                        const auto x = static_cast<float>(area.x);
+                        const auto y = static_cast<float>(area.y);
+                        const auto size = static_cast<float>(area.size);
+                        cubeMapFaces.lightSpace[i] = subpassData[i].globalUniform.lightSpace;
+                        // The top of the clip space is the first row of the area
+                        cubeMapFaces.clipTransform[i] = float4{
+                            size / atlasSize,
+                            size / atlasSize,
+                            (2.0f * x + size) / atlasSize - 1.0f,
+                            1.0f - (2.0f * y + size) / atlasSize};
+                        cubeMapFaces.area[i] = float4{x, y, x + size, y + size};
+                    }
+                    cubeMapFacesBuffer->write(&cubeMapFaces);
+                }
                 break;
             }
             case LightType::LIGHT_SPOT: {
@@ -285,71 +423,179 @@ namespace lysa {
             }
             default:;
         }
+        // Decided here since the culling views of the static shadow casters depend on it
+        const auto isStaticCacheMissed = [&](const SubpassData& data) {
+            return staticCacheEnabled && data.updated &&
+                (!data.staticCacheValid || !isSameStaticView(data.globalUniform, data.staticGlobalUniform));
+        };
+        // The static shadow casters of the six faces are drawn together in a single pass
+        const auto allStaticCachesMissed = isSinglePass() && std::ranges::any_of(subpassData, isStaticCacheMissed);
+        for (auto& data : subpassData) {
+            data.staticCacheRendered = allStaticCachesMissed || isStaticCacheMissed(data);
+            if (data.staticCacheRendered) {
+                data.staticGlobalUniform = data.globalUniform;
+                data.staticCacheValid = true;
+            }
+        }
+    }
+
+    void ShadowMapPass::skipUpdate() {
+        for (auto& data : subpassData) {
+            data.updated = false;
+            data.staticCacheRendered = false;
+        }
+    }
+
+    void ShadowMapPass::setCascadesUpdateInterval(const uint32 interval) {
+        if (interval != cascadesUpdateInterval) {
+            cascadesUpdateInterval = interval;
+            allCascadesUpdated = true;
+        }
+    }
+
+    void ShadowMapPass::setSinglePassEnabled(const bool enabled) {
+        if (isCubeMap && enabled != singlePassEnabled) {
+            singlePassEnabled = enabled;
+            // Forces the rendering of the static shadow casters for the new culling views
+            for (auto& data : subpassData) {
+                data.staticCacheValid = false;
+            }
+        }
+    }
+
+    void ShadowMapPass::setStaticCacheEnabled(const bool enabled) {
+#ifndef SHADOW_TRANSPARENCY_COLOR_ENABLED
+        // The transparency color maps are not cached
+        if (enabled != staticCacheEnabled) {
+            staticCacheEnabled = enabled;
+            for (auto& data : subpassData) {
+                data.staticCacheValid = false;
+            }
+        }
+#endif
+    }
+
+    void ShadowMapPass::invalidateStaticCache(const std::vector<AABB>& aabbs) {
+        for (auto& data : subpassData) {
+            if (!data.staticCacheValid) { continue; }
+            Frustum::Plane planes[6];
+            Frustum::extractPlanes(planes, data.staticGlobalUniform.lightSpace);
+            data.staticCacheValid = std::ranges::none_of(aabbs, [&](const AABB& aabb) {
+                return isInFrustum(planes, aabb);
+            });
+        }
+    }
+
+    bool ShadowMapPass::isSameStaticView(const GlobalUniform& a, const GlobalUniform& b) {
+        for (auto i = 0; i < 4; i++) {
+            if (any(a.lightSpace[i] != b.lightSpace[i])) { return false; }
+        }
+        return all(a.lightPosition == b.lightPosition) &&
+               a.transparencyScissor == b.transparencyScissor &&
+               a.transparencyColorScissor == b.transparencyColorScissor;
+    }
+
+    void ShadowMapPass::drawShadowCasters(
+        vireo::CommandList& commandList,
+        const SceneFrameData& scene,
+        const uint32 index,
+        const bool staticCasters) const {
+        // The areas are cleared, or initialized with the static shadow casters, before the drawing
+        const auto clearArea = [&](const AtlasPacker::Area& area) {
+            setViewport(commandList, area);
+            if (staticCacheEnabled && !staticCasters) {
+                atlas.copyStatic(commandList);
+            } else {
+                atlas.clear(commandList);
+            }
+        };
+        if (isSinglePass()) {
+            for (const auto& data : subpassData) {
+                clearArea(data.area);
+            }
+            // The vertex shader moves the faces in their areas of the atlas
+            setViewport(commandList, {0, 0, atlas.getSize()});
+            commandList.bindPipeline(singlePassPipeline);
+        } else {
+            clearArea(subpassData[index].area);
+            commandList.bindPipeline(pipeline);
+        }
+        commandList.bindDescriptor(ctx.globalDescriptorSet, SET_RESOURCES);
+        commandList.bindDescriptor(scene.getDescriptorSet(), SET_SCENE);
+        commandList.bindDescriptor(subpassData[index].descriptorSet, SET_PASS);
+        commandList.bindDescriptor(ctx.samplers.getDescriptorSet(), SET_SAMPLERS);
+        scene.drawModels(commandList, SET_PIPELINE, *this, index, staticCasters);
     }
 
     void ShadowMapPass::render(
         vireo::CommandList& commandList,
         const SceneFrameData& scene) {
-        if (!light->visible || !light->castShadows) { return; }
+        statistics = {};
+        if (!light->visible || !light->castShadows || shadowMapSize == 0) { return; }
 
-        for (const auto& data : subpassData) {
-            commandList.setViewport({
-                static_cast<float>(data.shadowMap->getImage()->getWidth()),
-                static_cast<float>(data.shadowMap->getImage()->getHeight())
-            });
-            commandList.setScissors({
-                data.shadowMap->getImage()->getWidth(),
-                data.shadowMap->getImage()->getHeight()
-            });
-            if (firstPass) {
-                commandList.barrier(
-                  data.shadowMap,
-                  vireo::ResourceState::UNDEFINED,
-                  vireo::ResourceState::SHADER_READ);
-#ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
+        // One culling view for the six faces in a single pass
+        const auto viewsCount = getCullingViewsCount();
+        const auto facesCount = isSinglePass() ? subpassesCount : 1;
+        if (staticCacheEnabled) {
+            const auto staticShadowMaps = atlas.getStaticShadowMaps();
+            auto rendered = false;
+            for (auto index = 0u; index < viewsCount; index++) {
+                if (!subpassData[index].updated) { continue; }
+                if (!subpassData[index].staticCacheRendered) {
+                    statistics.hitsCount += facesCount;
+                    continue;
+                }
+                if (!rendered) {
+                    commandList.barrier(
+                        staticShadowMaps,
+                        vireo::ResourceState::SHADER_READ,
+                        vireo::ResourceState::RENDER_TARGET_DEPTH);
+                    staticRenderingConfig.depthStencilRenderTarget = staticShadowMaps;
+                    commandList.beginRendering(staticRenderingConfig);
+                    rendered = true;
+                }
+                drawShadowCasters(commandList, scene, index, true);
+                statistics.missesCount += facesCount;
+            }
+            if (rendered) {
+                commandList.endRendering();
                 commandList.barrier(
-                  data.transparencyColorMap,
-                  vireo::ResourceState::UNDEFINED,
-                  vireo::ResourceState::SHADER_READ);
-#endif
+                    staticShadowMaps,
+                    vireo::ResourceState::RENDER_TARGET_DEPTH,
+                    vireo::ResourceState::SHADER_READ);
             }
-            commandList.barrier(
-                data.shadowMap,
-                vireo::ResourceState::SHADER_READ,
-                vireo::ResourceState::RENDER_TARGET_DEPTH);
+        }
+
+        const auto shadowMaps = atlas.getShadowMaps();
+        commandList.barrier(
+            shadowMaps,
+            vireo::ResourceState::SHADER_READ,
+            vireo::ResourceState::RENDER_TARGET_DEPTH);
 #ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
-            commandList.barrier(
-                data.transparencyColorMap,
-                vireo::ResourceState::SHADER_READ,
-                vireo::ResourceState::RENDER_TARGET_COLOR);
-            renderingConfig.colorRenderTargets[0].renderTarget = data.transparencyColorMap;
+        const auto transparencyColorMaps = atlas.getTransparencyColorMaps();
+        commandList.barrier(
+            transparencyColorMaps,
+            vireo::ResourceState::SHADER_READ,
+            vireo::ResourceState::RENDER_TARGET_COLOR);
+        renderingConfig.colorRenderTargets[0].renderTarget = transparencyColorMaps;
 #endif
-            renderingConfig.depthStencilRenderTarget = data.shadowMap;
-            commandList.beginRendering(renderingConfig);
-            commandList.bindPipeline(pipeline);
-            commandList.bindDescriptor(ctx.globalDescriptorSet, SET_RESOURCES);
-            commandList.bindDescriptor(scene.getDescriptorSet(), SET_SCENE);
-            commandList.bindDescriptor(data.descriptorSet, SET_PASS);
-            commandList.bindDescriptor(ctx.samplers.getDescriptorSet(), SET_SAMPLERS);
-            scene.drawModels(
-                commandList,
-                SET_PIPELINE,
-                data.culledDrawCommandsBuffers,
-                data.culledDrawCommandsCountBuffers,
-                data.frustumCullingPipelines);
-            commandList.endRendering();
-            commandList.barrier(
-                data.shadowMap,
-                vireo::ResourceState::RENDER_TARGET_DEPTH,
-                vireo::ResourceState::SHADER_READ);
+        renderingConfig.depthStencilRenderTarget = shadowMaps;
+        commandList.beginRendering(renderingConfig);
+        for (auto index = 0u; index < viewsCount; index++) {
+            if (!subpassData[index].updated) { continue; }
+            drawShadowCasters(commandList, scene, index, false);
+        }
+        commandList.endRendering();
+        commandList.barrier(
+            shadowMaps,
+            vireo::ResourceState::RENDER_TARGET_DEPTH,
+            vireo::ResourceState::SHADER_READ);
 #ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
-            commandList.barrier(
-                data.transparencyColorMap,
-                vireo::ResourceState::RENDER_TARGET_COLOR,
-                vireo::ResourceState::SHADER_READ);
+        commandList.barrier(
+            transparencyColorMaps,
+            vireo::ResourceState::RENDER_TARGET_COLOR,
+            vireo::ResourceState::SHADER_READ);
 #endif
-        }
-        firstPass = false;
     }
 
-}
\ No newline at end of file
+}
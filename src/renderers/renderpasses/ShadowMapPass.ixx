@@ -9,21 +9,44 @@ module;
 export module lysa.renderers.renderpasses.shadow_map_pass;
 
 import vireo;
+import lysa.aabb;
+import lysa.atlas_packer;
 import lysa.context;
 import lysa.math;
-import lysa.memory;
 import lysa.resources.camera;
 import lysa.resources.light;
 import lysa.renderers.configuration;
 import lysa.renderers.graphic_pipeline_data;
 import lysa.renderers.scene_frame_data;
+import lysa.renderers.shadow_map_atlas;
 import lysa.renderers.pipelines.frustum_culling;
 import lysa.renderers.renderpasses.renderpass;
 
 export namespace lysa {
 
     /**
-     * Render pass for generating shadow maps
+     * Render pass for generating shadow maps.
+     *
+     * The shadow maps are areas of the shadow map atlas of the scene frame, allocated with
+     * allocateShadowMaps(). A light without areas does not cast shadows.
+     *
+     * When the static cache is enabled, the depth of the static shadow casters of each shadow map
+     * is rendered in the static shadow casters atlas, copied in the shadow map each frame before drawing
+     * the dynamic shadow casters. The cache of a shadow map is rendered again only when its light
+     * space changes or when a static shadow caster in its volume is modified.
+     *
+     * The first cascade of a directional light is rendered each frame, the others every
+     * cascades update interval frames of the scene, interleaved so that one far cascade is rendered
+     * per frame. A cascade not rendered keeps its light space and its content in the atlas, its
+     * bounding sphere being enlarged when rendered to cover the moves of the camera until the next
+     * rendering. The cascades are bounding spheres of the camera frustum splits, snapped to the
+     * texels of the light space, so a cascade does not move until the camera moves by a texel.
+     *
+     * The six faces of an omni light are rendered in a single pass when enabled : they are culled
+     * with a single cube map culling view giving the faces each mesh instance is seen from, and each
+     * instance is drawn once per face with one indirect draw per pipeline, the vertex shader moving
+     * it in the area of its face in the atlas and clipping it to this area with clip distances.
+     * Otherwise each face is culled and drawn separately.
      */
     class ShadowMapPass : public Renderpass {
     public:
@@ -31,29 +54,43 @@ export namespace lysa {
          * Constructs a ShadowMapPass
          * @param ctx The engine context
          * @param light Pointer to the light source for which shadows are generated
-         * @param meshInstancesDataArray Array of mesh instance data in device memory
-         * @param maxMeshSurfacePerPipeline Maximum number of mesh surfaces per pipeline
+         * @param atlas Atlas of the shadow maps of the scene frame
          */
         ShadowMapPass(
             const Context& ctx,
             const Light* light,
-            const DeviceMemoryArray& meshInstancesDataArray,
-            size_t maxMeshSurfacePerPipeline);
+            ShadowMapAtlas& atlas);
 
         /**
-         * Computes frustum culling for shadow map generation
-         * @param commandList The command list to record compute commands into
-         * @param pipelinesData Map of pipeline data for mesh rendering
+         * Frees the areas of the shadow maps in the atlas
          */
-        void compute(
-            vireo::CommandList& commandList,
-            const std::unordered_map<uint32, std::unique_ptr<GraphicPipelineData>>& pipelinesData) const;
+        ~ShadowMapPass() override;
+
+        /**
+         * Returns the screen-space importance of the light for a camera : the fraction of the
+         * screen height covered by its range, 1 for a directional light or a camera in its range
+         */
+        float getImportance(const Camera& camera) const;
+
+        /**
+         * Returns the size of the shadow maps for an importance of the light, a power of two between
+         * ShadowMapAtlas::MIN_SHADOW_MAP_SIZE and Light::shadowMapSize. The current size is kept while
+         * it is not too large for the importance, to avoid reallocating the shadow maps every frame.
+         */
+        uint32 getRequestedShadowMapSize(float importance) const;
+
+        /**
+         * Reallocates the areas of the shadow maps in the atlas, the cascades after the first are
+         * smaller. Keeps the current sizes if the atlas is full, the areas being allocated again.
+         * @param size Size of the shadow maps, 0 to free them
+         * @return false if the atlas is full
+         */
+        bool allocateShadowMaps(uint32 size);
 
         /**
-         * Updates the graphics pipelines based on active pipeline IDs
-         * @param pipelineIds Map of pipeline IDs to unique object IDs
+         * Returns the size of the shadow maps, 0 if they are not allocated in the atlas
          */
-        void updatePipelines(const std::unordered_map<pipeline_id, std::vector<unique_id>>& pipelineIds);
+        auto getShadowMapSize() const { return shadowMapSize; }
 
         /**
          * Sets the current camera for cascaded shadow maps calculation
@@ -63,12 +100,76 @@ export namespace lysa {
             currentCamera = const_cast<Camera*>(&camera);
         }
 
+        /**
+         * Enables the cache of the static shadow casters, always disabled with SHADOW_TRANSPARENCY_COLOR_ENABLED
+         */
+        void setStaticCacheEnabled(bool enabled);
+
+        /**
+         * Returns true if the static shadow casters are cached and drawn separately
+         */
+        auto isStaticCacheEnabled() const { return staticCacheEnabled; }
+
+        /**
+         * Sets the number of frames between two renderings of the cascades after the first one
+         * @param interval Interval in frames, 1 to render all the cascades each frame
+         */
+        void setCascadesUpdateInterval(uint32 interval);
+
+        /**
+         * Sets the number of the frame being rendered, counted by the scene across all the frames in flight.
+         * The cascades are scheduled with it, each frame in flight having its own shadow map passes.
+         * @param frame Frame number of the scene
+         */
+        void setCurrentFrame(const uint64 frame) {
+            currentFrame = frame;
+        }
+
+        /**
+         * Enables the rendering of the six faces of an omni light in a single pass
+         */
+        void setSinglePassEnabled(bool enabled);
+
+        /**
+         * Returns true if the six faces of the cube map are rendered in a single pass
+         */
+        auto isSinglePass() const { return isCubeMap && singlePassEnabled; }
+
+        /**
+         * Returns true if a shadow map is rendered by the next render(), as decided by the last update()
+         */
+        auto isShadowMapUpdated(const uint32 index) const { return subpassData[index].updated; }
+
+        /**
+         * Returns true if the static shadow casters of a shadow map are rendered again in its cache
+         * by the next render(), as decided by the last update()
+         * @param index Index of the shadow map
+         */
+        auto isStaticCacheRendered(const uint32 index) const { return subpassData[index].staticCacheRendered; }
+
+        /**
+         * Invalidates the cached shadow maps whose volume intersects the modified static shadow casters
+         * @param aabbs World AABB of the static shadow casters, before and after their modification
+         */
+        void invalidateStaticCache(const std::vector<AABB>& aabbs);
+
+        /**
+         * Returns the static cache counters of the shadow maps of the last render()
+         */
+        const auto& getStaticCacheStatistics() const { return statistics; }
+
         /**
          * Updates the shadow map pass state for the current frame
          * @param frameIndex Index of the current frame
          */
         void update(uint32 frameIndex) override;
 
+        /**
+         * Replaces update() for a frame whose shadow maps are not rendered nor used by the lighting,
+         * render() then draws nothing and the shadow maps keep their content
+         */
+        void skipUpdate();
+
         /**
          * Renders the shadow maps
          * @param commandList The command list to record rendering commands into
@@ -85,21 +186,25 @@ export namespace lysa {
         auto getShadowMapCount() const { return subpassesCount; }
 
         /**
-         * Gets a shadow map render target
-         * @param index Index of the shadow map
-         * @return A shared pointer to the shadow map render target
+         * Gets the number of culling views : one per shadow map, one for all the faces in a single pass
          */
-        auto getShadowMap(const uint32 index) const {
-            return subpassData[index].shadowMap;
-        }
+        auto getCullingViewsCount() const { return isSinglePass() ? 1u : subpassesCount; }
+
+        /**
+         * Gets the point of view of a shadow map, culled with the other points of view of the scene
+         * @param index Index of the culling view
+         * @param staticCasters true for the static shadow casters rendered in the cache
+         * @return The culling view, keeping only the shadow casters drawn in the shadow map or in its cache
+         */
+        CullingView getCullingView(uint32 index, bool staticCasters = false) const;
 
         /**
-         * Gets a transparency color map render target
+         * Gets the area of a shadow map in the atlas
          * @param index Index of the shadow map
-         * @return A shared pointer to the transparency color map render target
+         * @return The area, empty if the shadow maps are not allocated
          */
-        auto getTransparencyColorMap(const uint32 index) const {
-            return subpassData[index].transparencyColorMap;
+        const auto& getShadowMapArea(const uint32 index) const {
+            return subpassData[index].area;
         }
 
         /**
@@ -124,6 +229,7 @@ export namespace lysa {
         const std::string VERTEX_SHADER{"shadowmap.vert"};
         const std::string FRAGMENT_SHADER{"shadowmap.frag"};
         const std::string FRAGMENT_SHADER_CUBEMAP{"shadowmap_cubemap.frag"};
+        const std::string VERTEX_SHADER_CUBEMAP{"shadowmap_cubemap.vert"};
 
         static constexpr uint32 SET_RESOURCES{0};
         static constexpr uint32 SET_SCENE{1};
@@ -131,6 +237,7 @@ export namespace lysa {
         static constexpr uint32 SET_PASS{3};
         static constexpr uint32 SET_SAMPLERS{4};
         static constexpr vireo::DescriptorIndex BINDING_GLOBAL{0};
+        static constexpr vireo::DescriptorIndex BINDING_CUBE_MAP_FACES{1};
 
         struct GlobalUniform {
             float4x4 lightSpace;
@@ -140,17 +247,35 @@ export namespace lysa {
             float    splitDepth;
         };
 
+        struct CubeMapFaces {
+            float4x4 lightSpace[6];
+            // Clip space of each face to the clip space of the atlas : XY scale, ZW offset
+            float4   clipTransform[6];
+            // Area of each face in the atlas, in pixels : XY top-left corner, ZW bottom-right corner
+            float4   area[6];
+        };
+
         struct SubpassData {
             float4x4 inverseViewMatrix;
             float4x4 projection;
             GlobalUniform globalUniform;
-            std::shared_ptr<vireo::RenderTarget> shadowMap;
-            std::shared_ptr<vireo::RenderTarget> transparencyColorMap;
+            // Area of the shadow map in the shadow maps atlas and in the static shadow casters atlas
+            AtlasPacker::Area area;
             std::shared_ptr<vireo::Buffer> globalUniformBuffer;
             std::shared_ptr<vireo::DescriptorSet> descriptorSet;
-            std::map<pipeline_id, std::shared_ptr<FrustumCulling>> frustumCullingPipelines;
-            std::map<pipeline_id, std::shared_ptr<vireo::Buffer>> culledDrawCommandsBuffers;
-            std::map<pipeline_id, std::shared_ptr<vireo::Buffer>> culledDrawCommandsCountBuffers;
+            // Parameters the static shadow casters of the area are rendered with
+            GlobalUniform staticGlobalUniform;
+            // false when the static shadow casters must be rendered by the next frame
+            bool staticCacheValid{false};
+            // true if the static shadow casters are rendered by the current frame
+            bool staticCacheRendered{false};
+            // true if the shadow map is rendered by the current frame
+            bool updated{true};
+            // Frame of the scene the cascade must be rendered again by
+            uint64 nextUpdateFrame{0};
+            // Frame of the scene of the last rendering of the cascade and the center of its split, in world space
+            std::optional<uint64> renderedFrame;
+            float3 renderedCenter{0.0f};
         };
 
         const bool isCubeMap;
@@ -158,7 +283,23 @@ export namespace lysa {
         uint32 subpassesCount;
         Camera* currentCamera{nullptr};
         float3 lastLightPosition{-10000.0f};
+        // Parameters all the cascades depend on, all the cascades are rendered when they change
+        float3 lastLightDirection{0.0f};
+        float lastCameraNear{0.0f};
+        float lastCameraFar{0.0f};
+        uint32 cascadesUpdateInterval{1};
+        // Frame of the scene being rendered and the one of the previous update()
+        uint64 currentFrame{0};
+        uint64 lastFrame{0};
+        bool allCascadesUpdated{true};
         std::vector<SubpassData> subpassData;
+        ShadowMapAtlas& atlas;
+        uint32 shadowMapSize{0};
+        bool staticCacheEnabled{false};
+        bool singlePassEnabled{false};
+        ShadowMapCacheStatistics statistics;
+        // Faces of the cube map rendered in a single pass
+        std::shared_ptr<vireo::Buffer> cubeMapFacesBuffer;
 
         const std::vector<vireo::VertexAttributeDesc> vertexAttributes {
             {"POSITION", vireo::AttributeFormat::R32G32B32A32_FLOAT, offsetof(VertexData, position)},
@@ -178,26 +319,45 @@ export namespace lysa {
             .depthBiasSlopeFactor = 1.75f,
         };
 
+        // The other shadow maps of the atlas are kept, each area is cleared by a draw
         vireo::RenderingConfiguration renderingConfig {
 #ifdef SHADOW_TRANSPARENCY_COLOR_ENABLED
             .colorRenderTargets = {
                 {
-                    .clear = true,
-                    .clearValue{ .color = {0.0f, 0.0f, 0.0f, 1.0f} }
+                    .clear = false,
                 }},
 #endif
             .depthTestEnable = pipelineConfig.depthTestEnable,
-            .clearDepthStencil = true,
+            .clearDepthStencil = false,
             .discardDepthStencilAfterRender = false,
         };
 
-        bool firstPass{true};
-
-        const size_t maxMeshSurfacePerPipeline;
-        const DeviceMemoryArray& meshInstancesDataArray;
+        vireo::RenderingConfiguration staticRenderingConfig {
+            .depthTestEnable = pipelineConfig.depthTestEnable,
+            .clearDepthStencil = false,
+            .discardDepthStencilAfterRender = false,
+        };
 
         const Light* light;
         std::shared_ptr<vireo::GraphicPipeline> pipeline;
+        // Renders the six faces of the cube map in a single pass
+        std::shared_ptr<vireo::GraphicPipeline> singlePassPipeline;
         std::shared_ptr<vireo::DescriptorLayout> descriptorLayout;
+
+        // Renders all the shadow maps and their static caches again, their areas being new
+        void invalidateShadowMaps();
+
+        // Sets the viewport and the scissors to the area of a shadow map
+        void setViewport(vireo::CommandList& commandList, const AtlasPacker::Area& area) const;
+
+        // Draws the shadow casters of a culling view, clearing or copying the static shadow casters first
+        void drawShadowCasters(
+            vireo::CommandList& commandList,
+            const SceneFrameData& scene,
+            uint32 index,
+            bool staticCasters) const;
+
+        // Returns true if the static shadow casters rendered with a and b are the same
+        static bool isSameStaticView(const GlobalUniform& a, const GlobalUniform& b);
     };
 }
\ No newline at end of file
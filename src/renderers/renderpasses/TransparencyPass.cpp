@@ -61,7 +61,7 @@ namespace lysa {
                 oitPipelineConfig.cullMode = material.getCullMode();
                 oitPipelineConfig.vertexShader = loadShader(VERTEX_SHADER_OIT);
                 oitPipelineConfig.fragmentShader = loadShader(fragShaderName);
-                oitPipelines[pipelineId] = ctx.vireo->createGraphicPipeline(oitPipelineConfig, "Transparency OIT");
+                oitPipelines.emplace(pipelineId, ctx.vireo->createGraphicPipeline(oitPipelineConfig, "Transparency OIT"));
             }
         }
     }
@@ -10,6 +10,7 @@ import vireo;
 import lysa.context;
 import lysa.resources.material;
 import lysa.renderers.configuration;
+import lysa.renderers.pipelines_array;
 import lysa.renderers.scene_frame_data;
 import lysa.renderers.renderpasses.renderpass;
 
@@ -151,6 +152,6 @@ export namespace lysa {
         std::vector<FrameData> framesData;
         std::shared_ptr<vireo::Pipeline> compositePipeline;
         std::shared_ptr<vireo::DescriptorLayout> compositeDescriptorLayout;
-        std::unordered_map<pipeline_id, std::shared_ptr<vireo::GraphicPipeline>> oitPipelines;
+        PipelinesArray<std::shared_ptr<vireo::GraphicPipeline>> oitPipelines;
     };
 }
\ No newline at end of file
@@ -20,7 +20,8 @@ namespace lysa {
     }
 
     ImageManager::ImageManager(Context& ctx, const size_t capacity) :
-        ResourcesManager(ctx, capacity, "ImageManager"),
+        ResourcesManager(ctx, capacity, "ImageManager", capacity),
+        residencyManager(ctx.res.get<ResidencyManager>()),
         blankImage(ctx.vireo->createImage(
             vireo::ImageFormat::R8G8B8A8_SRGB,
             1, 1,1, 1,
@@ -31,6 +32,12 @@ namespace lysa {
             "Blank CubeMap")),
         images(capacity, blankImage) {
         ctx.res.enroll(*this);
+        // Images can only be restored by the reload callback of their loader
+        residencyManager.setHandler(ResidencyType::IMAGE, {
+            .evict = [this](const unique_id id) { evict(id); },
+            .restore = [](unique_id) { return false; },
+            .isRestorable = [](unique_id) { return false; },
+        });
         auto blank = std::vector<uint8>(4, 0);
         std::vector<void*> cubeFaces(6);
         for (int i = 0; i < 6; i++) {
@@ -72,12 +79,32 @@ namespace lysa {
         const std::string& name) {
         if (isFull()) throw Exception("ImageManager : no more free slots");
         auto& result = ResourcesManager::create(image, name);
-        result.index = result.id;
+        result.index = handle_index(result.id);
         images[result.index] = image;
         updated = true;
+        residencyManager.track(ResidencyType::IMAGE, result.id, image->getImageSize());
         return result;
     }
 
+    void ImageManager::restore(const unique_id id, const std::shared_ptr<vireo::Image>& image) {
+        auto& result = (*this)[id];
+        {
+            auto lock = std::lock_guard(mutex);
+            result.image = image;
+            images[result.index] = image;
+            updated = true;
+        }
+        residencyManager.track(ResidencyType::IMAGE, id, image->getImageSize());
+    }
+
+    void ImageManager::evict(const unique_id id) {
+        auto& image = (*this)[id];
+        auto lock = std::lock_guard(mutex);
+        images[image.index] = blankImage;
+        image.image.reset();
+        updated = true;
+    }
+
     Image& ImageManager::create(
         const void* data,
         const uint32 width, const uint32 height,
@@ -160,8 +187,9 @@ namespace lysa {
 
     bool ImageManager::destroy(const unique_id id) {
         if (ResourcesManager::destroy(id)) {
-            images[id] = blankImage;
+            images[handle_index(id)] = blankImage;
             updated = true;
+            residencyManager.untrack(ResidencyType::IMAGE, id);
             return true;
         }
         return false;
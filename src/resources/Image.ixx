@@ -12,6 +12,7 @@ import lysa.context;
 import lysa.math;
 import lysa.resources;
 import lysa.resources.manager;
+import lysa.resources.residency;
 
 export namespace lysa {
 
@@ -38,10 +39,15 @@ export namespace lysa {
         float2 getSize() const { return float2{getWidth(), getHeight()}; }
 
         /**
-         * Returns the GPU image
+         * Returns the GPU image, nullptr if the image has been evicted from VRAM
          */
         auto getImage() const { return image; }
 
+        /**
+         * Returns true if the GPU image is in VRAM
+         */
+        bool isResident() const { return image != nullptr; }
+
         /**
          * Returns the index of the image in the global GPU memory array of images
          */
@@ -126,6 +132,14 @@ export namespace lysa {
         /** Return the global GPU image array */
         auto getImages() const { return images; }
 
+        /**
+         * Replaces the GPU image of an image evicted by the ResidencyManager.
+         * Called by the reload callbacks registered by the loaders.
+         * @param id Evicted image
+         * @param image Reloaded GPU image
+         */
+        void restore(unique_id id, const std::shared_ptr<vireo::Image>& image);
+
         bool destroy(unique_id id) override;
 
         bool destroy(const Image& image) override { return destroy(image.id); }
@@ -135,6 +149,8 @@ export namespace lysa {
         void _resetUpdateFlag() { updated = false; }
 
     private:
+        /** GPU memory budget manager */
+        ResidencyManager& residencyManager;
         /** Flag indicating that one or more textures changed and need syncing. */
         bool updated{false};
         /** Default 2D image used when a texture is missing. */
@@ -145,6 +161,8 @@ export namespace lysa {
         std::mutex mutex;
         /** List of GPU images managed by this container. */
         std::vector<std::shared_ptr<vireo::Image>> images;
+
+        void evict(unique_id id);
     };
 
 }
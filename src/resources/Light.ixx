@@ -34,10 +34,11 @@ export namespace lysa {
         float4 direction{0.0f};
         float4 color{1.0f, 1.0f, 1.0f, 1.0f}; // RGB + Intensity;
         // shadow map params
-        int32 mapIndex{-1};
+        uint32 castShadows{0}; // 1 if the shadow maps are allocated in the atlas
         uint32 cascadesCount{0};
         float4 cascadeSplitDepth{0.0f};
         float4x4 lightSpace[6];
+        float4 shadowMapCoordinates[6]; // Area of each shadow map in the atlas, XY: top-left corner, ZW: size
     };
 
     /**
@@ -5,9 +5,9 @@
  * https://opensource.org/licenses/MIT
 */
 module lysa.resources.material;
-#include <xxhash.h>
 
 import lysa.log;
+import lysa.resources.pipeline_registry;
 
 namespace lysa {
 
@@ -19,63 +19,72 @@ namespace lysa {
         ctx.res.get<MaterialManager>().upload(*this);
     }
 
+    void Material::upload(const size_t offset, const size_t size) const {
+        ctx.res.get<MaterialManager>().upload(*this, offset, size);
+    }
+
+    void Material::updatePipelineId() {
+        pipelineId = ctx.res.get<PipelineRegistry>().intern(getPipelineKey());
+    }
+
+    void Material::setCullMode(const vireo::CullMode mode) {
+        if (cullMode == mode) { return; }
+        cullMode = mode;
+        updatePipelineId();
+    }
+
+    void Material::setTransparency(const Transparency transparencyMode) {
+        if (transparency == transparencyMode) { return; }
+        transparency = transparencyMode;
+        updatePipelineId();
+        upload(offsetof(MaterialData, flags), sizeof(MaterialData::flags));
+    }
+
+    void Material::setAlphaScissor(const float scissor) {
+        alphaScissor = scissor;
+        upload(offsetof(MaterialData, alphaScissor), sizeof(MaterialData::alphaScissor));
+    }
+
+    TextureInfoData StandardMaterial::getTextureInfoData(const TextureInfo& textureInfo) const {
+        if (textureInfo.texture.image == INVALID_ID) { return {}; }
+        const auto index = imageManager[textureInfo.texture.image].getIndex();
+        assert([&]{ return index < TEXTURE_NONE && textureInfo.texture.samplerIndex <= 0xffff; },
+            "StandardMaterial : texture or sampler index does not fit in 16 bits");
+        // The shaders read the matrix column-major : the rows of the 2x3 transform are the CPU columns
+        const auto& t = textureInfo.transform;
+        return {
+            .index = (textureInfo.texture.samplerIndex << 16) | index,
+            .transform0 = { t[0][0], t[1][0], t[2][0] },
+            .transform1 = { t[0][1], t[1][1], t[2][1] },
+        };
+    }
+
     MaterialData StandardMaterial::getMaterialData() const {
-        auto data = MaterialData {
+        return {
             .albedoColor = albedoColor,
-            .pipelineId = getPipelineId(),
-            .transparency = static_cast<int>(getTransparency()),
+            .emissiveFactor = float4{emissiveFactor, emissiveStrength},
+            .flags = static_cast<uint32>(getTransparency()) & MATERIAL_FLAG_TRANSPARENCY_MASK,
             .alphaScissor = getAlphaScissor(),
             .normalScale = normalScale,
             .metallicFactor = metallicFactor,
             .roughnessFactor = roughnessFactor,
-            .emissiveFactor = float4{emissiveFactor, emissiveStrength}
+            .diffuseTexture = getTextureInfoData(diffuseTexture),
+            .normalTexture = getTextureInfoData(normalTexture),
+            .metallicTexture = getTextureInfoData(metallicTexture),
+            .roughnessTexture = getTextureInfoData(roughnessTexture),
+            .emissiveTexture = getTextureInfoData(emissiveTexture),
         };
-        if (diffuseTexture.texture.image != INVALID_ID) {
-            data.diffuseTexture = {
-                .index = static_cast<int32>(imageManager[diffuseTexture.texture.image].getIndex()),
-                .samplerIndex = diffuseTexture.texture.samplerIndex,
-                .transform = float4x4{diffuseTexture.transform},
-            };
-        }
-        if (normalTexture.texture.image != INVALID_ID) {
-            data.normalTexture = {
-                .index = static_cast<int32>(imageManager[normalTexture.texture.image].getIndex()),
-                .samplerIndex = normalTexture.texture.samplerIndex,
-                .transform = float4x4{normalTexture.transform},
-            };
-        }
-        if (metallicTexture.texture.image != INVALID_ID) {
-            data.metallicTexture = {
-                .index = static_cast<int32>(imageManager[metallicTexture.texture.image].getIndex()),
-                .samplerIndex = metallicTexture.texture.samplerIndex,
-                .transform = float4x4{metallicTexture.transform},
-            };
-        }
-        if (roughnessTexture.texture.image != INVALID_ID) {
-            data.roughnessTexture = {
-                .index = static_cast<int32>(imageManager[roughnessTexture.texture.image].getIndex()),
-                .samplerIndex = roughnessTexture.texture.samplerIndex,
-                .transform = float4x4{roughnessTexture.transform},
-            };
-        }
-        if (emissiveTexture.texture.image != INVALID_ID) {
-            data.emissiveTexture = {
-                .index = static_cast<int32>(imageManager[emissiveTexture.texture.image].getIndex()),
-                .samplerIndex = emissiveTexture.texture.samplerIndex,
-                .transform = float4x4{emissiveTexture.transform},
-            };
-        }
-        return data;
     }
 
     StandardMaterial::StandardMaterial(Context& ctx):
         Material(ctx, STANDARD),
         imageManager(ctx.res.get<ImageManager>()) {
+        updatePipelineId();
     }
 
     void StandardMaterial::setAlbedoColor(const float4 &color) {
         albedoColor = color;
-        upload();
+        upload(offsetof(MaterialData, albedoColor), sizeof(MaterialData::albedoColor));
     }
 
     StandardMaterial::~StandardMaterial() {
@@ -101,7 +110,7 @@ namespace lysa {
         if (texture.texture.image != INVALID_ID) {
             imageManager.use(texture.texture.image);
         }
-        upload();
+        upload(offsetof(MaterialData, diffuseTexture), sizeof(TextureInfoData));
     }
 
     void StandardMaterial::setNormalTexture(const TextureInfo &texture) {
@@ -109,7 +118,7 @@ namespace lysa {
         if (texture.texture.image != INVALID_ID) {
             imageManager.use(texture.texture.image);
         }
-        upload();
+        upload(offsetof(MaterialData, normalTexture), sizeof(TextureInfoData));
     }
 
     void StandardMaterial::setMetallicTexture(const TextureInfo &texture) {
@@ -118,7 +127,8 @@ namespace lysa {
             imageManager.use(texture.texture.image);
         }
         if (metallicFactor == -1.0f) { metallicFactor = 0.0f; }
-        upload();
+        upload(offsetof(MaterialData, metallicFactor), sizeof(MaterialData::metallicFactor));
+        upload(offsetof(MaterialData, metallicTexture), sizeof(TextureInfoData));
     }
 
     void StandardMaterial::setRoughnessTexture(const TextureInfo &texture) {
@@ -127,7 +137,8 @@ namespace lysa {
             imageManager.use(texture.texture.image);
         }
         if (roughnessFactor == -1.0f) { roughnessFactor = 0.0f; }
-        upload();
+        upload(offsetof(MaterialData, roughnessFactor), sizeof(MaterialData::roughnessFactor));
+        upload(offsetof(MaterialData, roughnessTexture), sizeof(TextureInfoData));
     }
 
     void StandardMaterial::setEmissiveTexture(const TextureInfo &texture) {
@@ -135,40 +146,49 @@ namespace lysa {
         if (texture.texture.image != INVALID_ID) {
             imageManager.use(texture.texture.image);
         }
-        upload();
+        upload(offsetof(MaterialData, emissiveTexture), sizeof(TextureInfoData));
     }
 
     void StandardMaterial::setMetallicFactor(const float metallic) {
         this->metallicFactor = metallic;
-        upload();
+        upload(offsetof(MaterialData, metallicFactor), sizeof(MaterialData::metallicFactor));
     }
 
     void StandardMaterial::setEmissiveStrength(const float strength) {
         this->emissiveStrength = strength;
-        upload();
+        upload(offsetof(MaterialData, emissiveFactor), sizeof(MaterialData::emissiveFactor));
     }
 
     void StandardMaterial::setRoughnessFactor(const float roughness) {
         this->roughnessFactor = roughness;
-        upload();
+        upload(offsetof(MaterialData, roughnessFactor), sizeof(MaterialData::roughnessFactor));
     }
 
     void StandardMaterial::setEmissiveFactor(const float3& factor) {
         emissiveFactor = factor;
-        upload();
+        upload(offsetof(MaterialData, emissiveFactor), sizeof(MaterialData::emissiveFactor));
     }
 
     void StandardMaterial::setNormalScale(const float scale) {
         normalScale = scale;
-        upload();
+        upload(offsetof(MaterialData, normalScale), sizeof(MaterialData::normalScale));
     }
 
-    pipeline_id StandardMaterial::getPipelineId() const {
-        const auto name = std::format("{0}{1}{2}",
+    std::vector<unique_id> StandardMaterial::getImages() const {
+        auto images = std::vector<unique_id>{};
+        for (const auto* textureInfo : {&diffuseTexture, &normalTexture, &metallicTexture, &roughnessTexture, &emissiveTexture}) {
+            if (textureInfo->texture.image != INVALID_ID) {
+                images.push_back(textureInfo->texture.image);
+            }
+        }
+        return images;
+    }
+
+    std::string StandardMaterial::getPipelineKey() const {
+        return std::format("{0}:{1}:{2}",
             DEFAULT_PIPELINE_ID,
             static_cast<uint32>(getTransparency()),
             static_cast<uint32>(getCullMode()));
-        return XXH32(name.c_str(), name.size(), 0);
     }
 
     ShaderMaterial::ShaderMaterial(Context& ctx, const std::shared_ptr<ShaderMaterial> &orig):
@@ -178,6 +198,7 @@ namespace lysa {
         for (int i = 0; i < SHADER_MATERIAL_MAX_PARAMETERS; i++) {
             parameters[i] = orig->parameters[i];
         }
+        updatePipelineId();
         upload();
     }
 
@@ -187,32 +208,33 @@ namespace lysa {
         Material{ctx, SHADER},
         fragFileName{fragShaderFileName},
         vertFileName{vertShaderFileName} {
+        updatePipelineId();
     }
 
     void ShaderMaterial::setParameter(const int index, const float4& value) {
         parameters[index] = value;
-        upload();
+        upload(offsetof(MaterialData, parameters) + index * sizeof(float4), sizeof(float4));
     }
 
-    pipeline_id ShaderMaterial::getPipelineId() const {
-        const auto name = vertFileName + fragFileName;
-        return XXH32(name.c_str(), name.size(), 0);
+    std::string ShaderMaterial::getPipelineKey() const {
+        return "shader:" + vertFileName + ":" + fragFileName;
     }
 
     MaterialData ShaderMaterial::getMaterialData() const {
         return {
-            .pipelineId = getPipelineId(),
             .parameters = {
                 parameters[0],
                 parameters[1],
                 parameters[2],
                 parameters[3],
-            }
+            },
+            .flags = static_cast<uint32>(getTransparency()) & MATERIAL_FLAG_TRANSPARENCY_MASK,
+            .alphaScissor = getAlphaScissor(),
         };
     }
 
     MaterialManager::MaterialManager(Context& ctx, const size_t capacity) :
-        ResourcesManager(ctx, capacity, "MaterialManager"),
+        ResourcesManager(ctx, capacity, "MaterialManager", capacity),
         memoryArray {
             ctx.vireo,
             sizeof(MaterialData),
@@ -244,26 +266,56 @@ namespace lysa {
     }
 
     void MaterialManager::upload(const Material& material) {
-        if (material.bypassUpload) { return; }
-        needUpload.insert(material.id);
+        upload(material, 0, sizeof(MaterialData));
+    }
+
+    void MaterialManager::upload(const Material& material, const size_t offset, const size_t size) {
+        // Materials are uploaded once allocated by the manager
+        if (material.bypassUpload || material.id == INVALID_ID) { return; }
+        auto lock = std::unique_lock(mutex);
+        const auto [it, inserted] = needUpload.try_emplace(material.id, DirtyRange{offset, offset + size});
+        if (!inserted) {
+            it->second.first = std::min(it->second.first, offset);
+            it->second.last = std::max(it->second.last, offset + size);
+        }
     }
 
     void MaterialManager::flush() {
-        if (!needUpload.empty()) {
-            auto lock = std::unique_lock(mutex);
-            for (const auto id : needUpload) {
-                auto& material = (*this)[id];
-                if (!material.isUploaded()) {
-                    material.memoryBloc = memoryArray.alloc(1);
-                }
-                const auto materialData = material.getMaterialData();
-                memoryArray.write(material.memoryBloc, &materialData);
+        auto lock = std::unique_lock(mutex);
+        if (needUpload.empty()) { return; }
+        struct Write {
+            const Material* material;
+            DirtyRange range;
+        };
+        auto writes = std::vector<Write>{};
+        writes.reserve(needUpload.size());
+        for (const auto& [id, range] : needUpload) {
+            auto& material = (*this)[id];
+            if (!material.isUploaded()) {
+                material.memoryBloc = memoryArray.alloc(1);
+                writes.push_back({&material, {0, sizeof(MaterialData)}});
+            } else {
+                writes.push_back({&material, range});
             }
-            needUpload.clear();
-            const auto command = ctx.asyncQueue.beginCommand(vireo::CommandType::TRANSFER);
-            memoryArray.flush(*command.commandList);
-            ctx.asyncQueue.endCommand(command);
         }
+        needUpload.clear();
+        // Write in GPU memory order so the ranges of neighbor materials end up in the same copy region
+        std::ranges::sort(writes, {}, [](const Write& write) {
+            return write.material->memoryBloc.offset + write.range.first;
+        });
+        for (const auto& write : writes) {
+            const auto materialData = write.material->getMaterialData();
+            memoryArray.write(
+                {
+                    write.material->memoryBloc.instanceIndex,
+                    write.material->memoryBloc.offset + write.range.first,
+                    write.range.last - write.range.first
+                },
+                reinterpret_cast<const std::byte*>(&materialData) + write.range.first);
+        }
+        const auto command = ctx.asyncQueue.beginCommand(vireo::CommandType::TRANSFER);
+        memoryArray.flush(*command.commandList);
+        ctx.asyncQueue.endCommand(command);
     }
 
     bool MaterialManager::destroy(const unique_id id) {
@@ -271,7 +323,10 @@ namespace lysa {
         if (material.refCounter <= 1 && material.isUploaded()) {
             memoryArray.free(material.memoryBloc);
         }
-        needUpload.erase(id);
+        {
+            auto lock = std::unique_lock(mutex);
+            needUpload.erase(id);
+        }
         return ResourcesManager::destroy(id);
     }
 
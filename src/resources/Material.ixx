@@ -36,32 +36,47 @@ export namespace lysa {
         // SCISSOR_ALPHA = 3,
     };
 
+    /**
+     * Texture index in MaterialData, stored in the low 16 bits of TextureInfoData::index
+     */
+    constexpr uint32 TEXTURE_NONE{0xffff};
+
+    /**
+     * Transparency mode in the low 8 bits of MaterialData::flags
+     */
+    constexpr uint32 MATERIAL_FLAG_TRANSPARENCY_MASK{0xff};
+
     struct TextureInfoData {
-        int32    index{-1};
-        uint32   samplerIndex{0};
-        float4x4 transform{1.0f};
+        // Texture index (low 16 bits, TEXTURE_NONE if unused) + sampler index (high 16 bits)
+        uint32 index{TEXTURE_NONE};
+        // Two first rows of the UV transform, as seen by the shaders
+        float  transform0[3]{1.0f, 0.0f, 0.0f};
+        float  transform1[3]{0.0f, 1.0f, 0.0f};
     };
 
+    /**
+     * GPU material description, mirrors the Material struct of resources.inc.slang
+     */
     struct MaterialData {
         float4 albedoColor{0.9f, 0.0f, 0.6f, 1.0f};
-        uint32 pipelineId;
+        float4 emissiveFactor{0.0f, 0.0f, 0.0f, 1.0f}; // factor + strength
+        float4 parameters[SHADER_MATERIAL_MAX_PARAMETERS]{};
 
-        int    transparency{0};
+        uint32 flags{0};
         float  alphaScissor{0.1f};
         float  normalScale{1.0f};
-
         float  metallicFactor{0.0f};
         float  roughnessFactor{1.0f};
-        float4 emissiveFactor{0.0f, 0.0f, 0.0f, 1.0f}; // factor + strength
 
         TextureInfoData diffuseTexture{};
         TextureInfoData normalTexture{};
         TextureInfoData metallicTexture{};
         TextureInfoData roughnessTexture{};
         TextureInfoData emissiveTexture{};
-        float4 parameters[SHADER_MATERIAL_MAX_PARAMETERS]{};
     };
 
+    static_assert(sizeof(MaterialData) == 256, "MaterialData must match the Material shader struct");
+
     /**
      * Base class for all materials of models surfaces
      */
@@ -80,7 +95,7 @@ export namespace lysa {
          * Sets the CullMode.
          * Determines which side of the triangle to cull depending on whether the triangle faces towards or away from the camera.
          */
-        void setCullMode(const vireo::CullMode mode) { cullMode = mode; }
+        void setCullMode(vireo::CullMode mode);
 
         /**
          * Returns the transparency mode
@@ -90,7 +105,7 @@ export namespace lysa {
         /**
          * Sets the transparency mode
          */
-        void setTransparency(const Transparency transparencyMode) { transparency = transparencyMode; }
+        void setTransparency(Transparency transparencyMode);
 
         /**
          * Returns the alpha scissor threshold value
@@ -104,15 +119,30 @@ export namespace lysa {
          * If the material becomes too opaque at a distance, try increasing this value.
          * If the material disappears at a distance, try decreasing this value.
          */
-        void setAlphaScissor(const float scissor) { alphaScissor = scissor; }
+        void setAlphaScissor(float scissor);
 
         auto isUploaded() const { return memoryBloc.size > 0; }
 
         void upload() const;
 
+        /**
+         * Schedules the upload of a part of the material data
+         * @param offset Offset in bytes in MaterialData
+         * @param size Size in bytes
+         */
+        void upload(size_t offset, size_t size) const;
+
         virtual MaterialData getMaterialData() const = 0;
 
-        virtual pipeline_id getPipelineId() const = 0;
+        /**
+         * Returns the interned id of the pipeline used to render the material
+         */
+        pipeline_id getPipelineId() const { return pipelineId; }
+
+        /**
+         * Returns the pipeline-state key of the material, interned into the pipeline id
+         */
+        virtual std::string getPipelineKey() const = 0;
 
         const auto& getIndex() const { return memoryBloc.instanceIndex; }
 
@@ -124,6 +154,9 @@ export namespace lysa {
         Context& ctx;
         Material(Context& ctx, Type type);
 
+        // Computes and interns the pipeline key, called when a pipeline-affecting property changes
+        void updatePipelineId();
+
     private:
         friend class MaterialManager;
         const Type type;
@@ -132,6 +165,7 @@ export namespace lysa {
         float alphaScissor{0.1f};
         MemoryBlock memoryBloc;
         bool bypassUpload{false};
+        pipeline_id pipelineId{0};
     };
 
     /**
@@ -266,9 +300,14 @@ export namespace lysa {
          */
         void setNormalScale(float scale);
 
+        /**
+         * Returns the images used by the textures of the material
+         */
+        std::vector<unique_id> getImages() const;
+
         MaterialData getMaterialData() const override;
 
-        pipeline_id getPipelineId() const override;
+        std::string getPipelineKey() const override;
 
     private:
         ImageManager& imageManager;
@@ -283,6 +322,8 @@ export namespace lysa {
         TextureInfo  emissiveTexture;
         TextureInfo  normalTexture;
         float        normalScale{1.0f};
+
+        TextureInfoData getTextureInfoData(const TextureInfo& textureInfo) const;
     };
 
     /**
@@ -305,7 +346,7 @@ export namespace lysa {
                        const std::string &fragShaderFileName,
                        const std::string &vertShaderFileName);
 
-        pipeline_id getPipelineId() const override;
+        std::string getPipelineKey() const override;
 
         /**
          * Returns the fragment shader file path, relative to the application directory
@@ -353,6 +394,12 @@ export namespace lysa {
 
         void upload(const Material& material);
 
+        void upload(const Material& material, size_t offset, size_t size);
+
+        /**
+         * Writes the modified parts of the materials into the GPU array, once per frame.
+         * The changes made to a material during a frame are coalesced in one byte range.
+         */
         void flush();
 
         auto getBuffer() const { return memoryArray.getBuffer(); }
@@ -368,7 +415,12 @@ export namespace lysa {
         DeviceMemoryArray memoryArray;
         /** Mutex to guard mutations to memory array. */
         std::mutex mutex;
-        std::unordered_set<unique_id> needUpload;
+        /** Modified byte range of a material */
+        struct DirtyRange {
+            size_t first;
+            size_t last;
+        };
+        std::unordered_map<unique_id, DirtyRange> needUpload;
     };
 
 }
@@ -8,6 +8,8 @@ module;
 #include <cstddef>
 module lysa.resources.mesh;
 
+import lysa.mesh_clusterizer;
+import lysa.mesh_simplifier;
 import lysa.renderers.graphic_pipeline_data;
 
 namespace lysa {
@@ -52,12 +54,191 @@ namespace lysa {
     }
 
     bool Mesh::operator==(const Mesh &other) const {
-        return vertices == other.vertices &&
-               indices == other.indices &&
+        return getVertices() == other.getVertices() &&
+               getIndices() == other.getIndices() &&
                surfaces == other.surfaces &&
                materials == other.materials;
     }
 
+    uint32 Mesh::getVertexCount() const {
+        return dataResident ? static_cast<uint32>(vertices.size()) : vertexCount;
+    }
+
+    uint32 Mesh::getIndexCount() const {
+        return dataResident ? static_cast<uint32>(indices.size()) : indexCount;
+    }
+
+    float3 Mesh::getPosition(const uint32 vertexIndex) const {
+        if (!dataResident && !compactPositions.empty()) {
+            assert([&]{ return vertexIndex < vertexCount; }, "Invalid vertex index");
+            const auto* q = &compactPositions[vertexIndex * 3];
+            const auto extent = (localAABB.max - localAABB.min) / 65535.0f;
+            return localAABB.min + float3{static_cast<float>(q[0]), static_cast<float>(q[1]), static_cast<float>(q[2])} * extent;
+        }
+        return getVertices()[vertexIndex].position;
+    }
+
+    uint32 Mesh::getIndex(const uint32 index) const {
+        if (!dataResident && !isIndicesGenerated()) {
+            if (!compactIndices16.empty()) { return compactIndices16[index]; }
+            if (!compactIndices32.empty()) { return compactIndices32[index]; }
+        }
+        assert([&]{ return dataResident || isIndicesGenerated(); }, "Mesh CPU data released, call fetchData() first");
+        return indices[index];
+    }
+
+    void Mesh::fetchData() {
+        auto lock = std::lock_guard(dataMutex);
+        readDataSource();
+    }
+
+    void Mesh::readDataSource() {
+        if (dataResident) { return; }
+        if (!dataSource) {
+            throw Exception("Mesh ", name, " : CPU data discarded without a source to re-fetch it from");
+        }
+        if (isIndicesGenerated()) {
+            // The source only has the full surfaces, the kept indices are reordered and extended
+            auto sourceIndices = std::vector<uint32>{};
+            dataSource(vertices, sourceIndices);
+        } else {
+            dataSource(vertices, indices);
+        }
+        dataResident = true;
+    }
+
+    void Mesh::generateClusters() {
+        if (lodsGenerated) {
+            throw Exception("Mesh ", name, " : clusters must be generated before the detail levels");
+        }
+        auto lock = std::lock_guard(dataMutex);
+        readDataSource();
+        const auto clusters = buildClusters();
+        for (auto i = 0; i < surfaces.size(); i++) {
+            surfaces[i].clusters = clusters[i];
+        }
+        clustersGenerated = true;
+    }
+
+    std::vector<std::vector<MeshCluster>> Mesh::buildClusters() {
+        auto positions = std::vector<float3>(vertices.size());
+        for (auto i = 0; i < vertices.size(); i++) {
+            positions[i] = vertices[i].position;
+        }
+        auto clusters = std::vector<std::vector<MeshCluster>>(surfaces.size());
+        for (auto i = 0; i < surfaces.size(); i++) {
+            const auto& surface = surfaces[i];
+            // A single cluster would only duplicate the instance culling
+            if (surface.indexCount <= MESH_CLUSTER_MAX_TRIANGLES * 3) { continue; }
+            const auto clusterizer = MeshClusterizer(positions, {indices.data() + surface.firstIndex, surface.indexCount});
+            for (const auto& cluster : clusterizer.getClusters()) {
+                clusters[i].push_back({
+                    .firstIndex = surface.firstIndex + cluster.firstIndex,
+                    .indexCount = cluster.indexCount,
+                    .center = cluster.center,
+                    .radius = cluster.radius,
+                    .coneAxis = cluster.coneAxis,
+                    .coneCutoff = cluster.coneCutoff,
+                });
+            }
+        }
+        return clusters;
+    }
+
+    void Mesh::generateLods() {
+        auto lock = std::lock_guard(dataMutex);
+        readDataSource();
+        const auto lods = buildLods();
+        for (auto i = 0; i < surfaces.size(); i++) {
+            surfaces[i].lods = lods[i];
+        }
+        lodsGenerated = true;
+    }
+
+    std::vector<std::vector<MeshLod>> Mesh::buildLods() {
+        auto sourceIndexCount = uint32{0};
+        for (const auto& surface : surfaces) {
+            sourceIndexCount = std::max(sourceIndexCount, surface.firstIndex + surface.indexCount);
+        }
+        indices.resize(sourceIndexCount);
+        auto positions = std::vector<float3>(vertices.size());
+        for (auto i = 0; i < vertices.size(); i++) {
+            positions[i] = vertices[i].position;
+        }
+
+        auto lods = std::vector<std::vector<MeshLod>>(surfaces.size());
+        for (auto i = 0; i < surfaces.size(); i++) {
+            const auto& surface = surfaces[i];
+            // Each level is simplified from the previous one, to about half of its triangles
+            auto simplifier = MeshSimplifier(positions, {indices.data() + surface.firstIndex, surface.indexCount});
+            auto indexCount = surface.indexCount;
+            for (auto level = 1; level < MESH_LODS_MAX; level++) {
+                const auto target = indexCount / 6 * 3;
+                auto simplified = simplifier.simplify(target);
+                // Not worth a level if the simplification is blocked by the borders
+                if (simplified.indices.empty() || simplified.indices.size() > indexCount * 3 / 4) {
+                    break;
+                }
+                lods[i].push_back({
+                    static_cast<uint32>(indices.size()),
+                    static_cast<uint32>(simplified.indices.size()),
+                    simplified.error,
+                });
+                indices.insert(indices.end(), simplified.indices.begin(), simplified.indices.end());
+                indexCount = static_cast<uint32>(simplified.indices.size());
+            }
+        }
+        return lods;
+    }
+
+    void Mesh::releaseData() {
+        auto lock = std::lock_guard(dataMutex);
+        if (!dataResident || dataPolicy == MeshDataPolicy::KEEP || !isUploaded()) { return; }
+        // The data could not be re-fetched for the detail levels, the clusters or a restoration after an eviction
+        if (!dataSource) { return; }
+        vertexCount = static_cast<uint32>(vertices.size());
+        indexCount = static_cast<uint32>(indices.size());
+        if (dataPolicy == MeshDataPolicy::COMPACT && compactPositions.empty()) {
+            buildCompactData();
+        }
+        std::vector<Vertex>{}.swap(vertices);
+        // The generated indices are kept, the clustering and the simplification are not run again on re-fetch
+        if (!isIndicesGenerated()) {
+            std::vector<uint32>{}.swap(indices);
+        }
+        dataResident = false;
+    }
+
+    void Mesh::buildCompactData() {
+        const auto extent = localAABB.max - localAABB.min;
+        const auto scale = float3{
+            extent.x > 0.0f ? 65535.0f / extent.x : 0.0f,
+            extent.y > 0.0f ? 65535.0f / extent.y : 0.0f,
+            extent.z > 0.0f ? 65535.0f / extent.z : 0.0f};
+        compactPositions.resize(vertices.size() * 3);
+        for (auto i = 0; i < vertices.size(); i++) {
+            const auto q = round(clamp((vertices[i].position - localAABB.min) * scale, float3{0.0f}, float3{65535.0f}));
+            compactPositions[i * 3 + 0] = static_cast<uint16>(static_cast<float>(q.x));
+            compactPositions[i * 3 + 1] = static_cast<uint16>(static_cast<float>(q.y));
+            compactPositions[i * 3 + 2] = static_cast<uint16>(static_cast<float>(q.z));
+        }
+        // The generated indices are kept in full
+        if (isIndicesGenerated()) { return; }
+        if (vertices.size() <= std::numeric_limits<uint16>::max() + 1) {
+            compactIndices16.assign(indices.begin(), indices.end());
+        } else {
+            compactIndices32 = indices;
+        }
+    }
+
+    size_t Mesh::getDataMemorySize() const {
+        return vertices.capacity() * sizeof(Vertex) +
+               indices.capacity() * sizeof(uint32) +
+               compactPositions.capacity() * sizeof(uint16) +
+               compactIndices16.capacity() * sizeof(uint16) +
+               compactIndices32.capacity() * sizeof(uint32);
+    }
+
     void Mesh::buildAABB() {
         auto min = float3{std::numeric_limits<float>::max()};
         auto max = float3{std::numeric_limits<float>::lowest()};
@@ -80,9 +261,11 @@ namespace lysa {
         const size_t capacity,
         const size_t vertexCapacity,
         const size_t indexCapacity,
-        const size_t surfaceCapacity) :
+        const size_t surfaceCapacity,
+        const size_t clusterCapacity) :
         ResourcesManager(ctx, capacity, "MeshManager"),
         materialManager(ctx.res.get<MaterialManager>()),
+        residencyManager(ctx.res.get<ResidencyManager>()),
         vertexArray {
             ctx.vireo,
             sizeof(VertexData),
@@ -103,26 +286,108 @@ namespace lysa {
             surfaceCapacity,
             surfaceCapacity,
             vireo::BufferType::DEVICE_STORAGE,
-            "MeshSurface Array"} {
+            "MeshSurface Array"},
+        meshClusterArray {
+            ctx.vireo,
+            sizeof(MeshClusterData),
+            clusterCapacity,
+            clusterCapacity,
+            vireo::BufferType::DEVICE_STORAGE,
+            "MeshCluster Array"} {
         ctx.res.enroll(*this);
+        residencyManager.setHandler(ResidencyType::MESH, {
+            .evict = [this](const unique_id id) { evict(id); },
+            .restore = [this](const unique_id id) {
+                upload(id);
+                flush();
+                return true;
+            },
+            // The GPU data is rebuilt from the CPU data, which may have to be re-fetched
+            .isRestorable = [this](const unique_id id) { return (*this)[id].isDataAvailable(); },
+            // The blocks go back to the vertex, index, surface & cluster arrays, allocated once
+            .pooled = true,
+        });
+    }
+
+    void MeshManager::evict(const unique_id id) {
+        auto& mesh = (*this)[id];
+        if (!mesh.isUploaded()) { return; }
+        auto lock = std::unique_lock(mutex);
+        vertexArray.free(mesh.verticesMemoryBlock);
+        indexArray.free(mesh.indicesMemoryBlock);
+        meshSurfaceArray.free(mesh.surfacesMemoryBlock);
+        if (mesh.clustersMemoryBlock.size > 0) {
+            meshClusterArray.free(mesh.clustersMemoryBlock);
+        }
+        mesh.verticesMemoryBlock = {};
+        mesh.indicesMemoryBlock = {};
+        mesh.surfacesMemoryBlock = {};
+        mesh.clustersMemoryBlock = {};
+    }
+
+    bool MeshManager::alloc(Mesh& mesh) {
+        auto clustersCount = size_t{0};
+        for (const auto& surface : mesh.surfaces) {
+            clustersCount += surface.clusters.size();
+        }
+        while (true) {
+            if (vertexArray.canAlloc(mesh.vertices.size()) &&
+                indexArray.canAlloc(mesh.indices.size()) &&
+                meshSurfaceArray.canAlloc(mesh.surfaces.size()) &&
+                (clustersCount == 0 || meshClusterArray.canAlloc(clustersCount))) {
+                const auto verticesBlock = vertexArray.tryAlloc(mesh.vertices.size());
+                const auto indicesBlock = indexArray.tryAlloc(mesh.indices.size());
+                const auto surfacesBlock = meshSurfaceArray.tryAlloc(mesh.surfaces.size());
+                const auto clustersBlock = clustersCount > 0 ?
+                    meshClusterArray.tryAlloc(clustersCount) : std::optional{MemoryBlock{}};
+                if (verticesBlock && indicesBlock && surfacesBlock && clustersBlock) {
+                    mesh.verticesMemoryBlock = *verticesBlock;
+                    mesh.indicesMemoryBlock = *indicesBlock;
+                    mesh.surfacesMemoryBlock = *surfacesBlock;
+                    mesh.clustersMemoryBlock = *clustersBlock;
+                    return true;
+                }
+                // Allocated by another thread since the check, the partial blocks go back to their arrays
+                if (verticesBlock) { vertexArray.free(*verticesBlock); }
+                if (indicesBlock) { indexArray.free(*indicesBlock); }
+                if (surfacesBlock) { meshSurfaceArray.free(*surfacesBlock); }
+                if (clustersBlock && clustersCount > 0) { meshClusterArray.free(*clustersBlock); }
+            }
+            if (!residencyManager.evictLeastRecentlyUsed(ResidencyType::MESH)) {
+                return false;
+            }
+        }
     }
 
       void MeshManager::upload(const unique_id id) {
         needUpload.insert(id);
     }
 
+    void MeshManager::generate(Mesh& mesh) const {
+        // The clusters reorder the source indices, they can't be made once the levels are built from them
+        if (clustersGenerationEnabled && !mesh.isClustersGenerated() && !mesh.isLodsGenerated()) {
+            mesh.generateClusters();
+        }
+        if (lodsGenerationEnabled && !mesh.isLodsGenerated()) {
+            mesh.generateLods();
+        }
+    }
+
     Mesh& MeshManager::create(
         const std::vector<Vertex>& vertices,
         const std::vector<uint32>& indices,
         const std::vector<MeshSurface>&surfaces,
         const std::string& name) {
-        auto& mesh =  allocate(std::make_unique<Mesh>(ctx, vertices, indices, surfaces, name));
+        auto& mesh = ResourcesManager::create(vertices, indices, surfaces, name);
+        mesh.setDataPolicy(defaultDataPolicy);
+        generate(mesh);
         upload(mesh.id);
         return mesh;
     }
 
     Mesh& MeshManager::create(const std::string& name) {
         auto& mesh = ResourcesManager::create(name);
+        mesh.setDataPolicy(defaultDataPolicy);
         upload(mesh.id);
         return mesh;
     }
@@ -133,6 +398,12 @@ namespace lysa {
             vertexArray.free(mesh.verticesMemoryBlock);
             indexArray.free(mesh.indicesMemoryBlock);
             meshSurfaceArray.free(mesh.surfacesMemoryBlock);
+            if (mesh.clustersMemoryBlock.size > 0) {
+                meshClusterArray.free(mesh.clustersMemoryBlock);
+            }
+        }
+        if (mesh.refCounter <= 1) {
+            residencyManager.untrack(ResidencyType::MESH, id);
         }
         needUpload.erase(id);
         return ResourcesManager::destroy(id);
@@ -142,29 +413,35 @@ namespace lysa {
         if (needUpload.empty()) return;
         for (const auto id : needUpload) {
             auto& mesh = (*this)[id];
+            // A mesh already in VRAM with released CPU data only needs its surfaces to be updated
+            const auto writeGeometry = !mesh.isUploaded() || mesh.isDataResident();
             if (!mesh.isUploaded()) {
-                mesh.verticesMemoryBlock = vertexArray.alloc(mesh.vertices.size());
-                mesh.indicesMemoryBlock = indexArray.alloc(mesh.indices.size());
-                mesh.surfacesMemoryBlock = meshSurfaceArray.alloc(mesh.surfaces.size());
+                mesh.fetchData();
+                if (!alloc(mesh)) {
+                    throw Exception("Out of GPU memory for the mesh ", mesh.getName());
+                }
             }
 
             auto lock = std::unique_lock(mutex);
 
-            // Uploading all vertices
-            auto vertexData = std::vector<VertexData>(mesh.vertices.size());
-            for (int i = 0; i < mesh.vertices.size(); i++) {
-                const auto& v = mesh.vertices[i];
-                vertexData[i].position = float4(v.position.x, v.position.y, v.position.z, v.uv.x);
-                vertexData[i].normal = float4(v.normal.x, v.normal.y, v.normal.z, v.uv.y);
-                vertexData[i].tangent = v.tangent;
-            }
-            vertexArray.write(mesh.verticesMemoryBlock, vertexData.data());
+            if (writeGeometry) {
+                // Uploading all vertices
+                auto vertexData = std::vector<VertexData>(mesh.vertices.size());
+                for (int i = 0; i < mesh.vertices.size(); i++) {
+                    const auto& v = mesh.vertices[i];
+                    vertexData[i].position = float4(v.position.x, v.position.y, v.position.z, v.uv.x);
+                    vertexData[i].normal = float4(v.normal.x, v.normal.y, v.normal.z, v.uv.y);
+                    vertexData[i].tangent = v.tangent;
+                }
+                vertexArray.write(mesh.verticesMemoryBlock, vertexData.data());
 
-            // Uploading all indices
-            indexArray.write(mesh.indicesMemoryBlock, mesh.indices.data());
+                // Uploading all indices
+                indexArray.write(mesh.indicesMemoryBlock, mesh.indices.data());
+            }
 
-            // Uploading all surfaces & materials
+            // Uploading all surfaces, clusters & materials
             auto surfaceData = std::vector<MeshSurfaceData>(mesh.surfaces.size());
+            auto clusterData = std::vector<MeshClusterData>{};
             for (int i = 0; i < mesh.surfaces.size(); i++) {
                 const auto& surface = mesh.surfaces[i];
                 const auto& material = materialManager[surface.material];
@@ -174,8 +451,42 @@ namespace lysa {
                 surfaceData[i].indexCount = surface.indexCount;
                 surfaceData[i].indicesIndex = mesh.indicesMemoryBlock.instanceIndex + surface.firstIndex;
                 surfaceData[i].verticesIndex = mesh.verticesMemoryBlock.instanceIndex;
+                // The first level is the full surface
+                surfaceData[i].lodsCount = 1 + static_cast<uint32>(surface.lods.size());
+                surfaceData[i].lods[0] = {
+                    .indexCount = surface.indexCount,
+                    .indicesIndex = surfaceData[i].indicesIndex,
+                };
+                for (auto level = 0; level < surface.lods.size(); level++) {
+                    surfaceData[i].lods[level + 1] = {
+                        .indexCount = surface.lods[level].indexCount,
+                        .indicesIndex = mesh.indicesMemoryBlock.instanceIndex + surface.lods[level].firstIndex,
+                        .error = surface.lods[level].error,
+                    };
+                }
+                surfaceData[i].clustersIndex = mesh.clustersMemoryBlock.instanceIndex + static_cast<uint32>(clusterData.size());
+                surfaceData[i].clustersCount = static_cast<uint32>(surface.clusters.size());
+                for (const auto& cluster : surface.clusters) {
+                    clusterData.push_back({
+                        .sphere = float4{cluster.center, cluster.radius},
+                        .cone = float4{cluster.coneAxis, cluster.coneCutoff},
+                        .indexCount = cluster.indexCount,
+                        .indicesIndex = mesh.indicesMemoryBlock.instanceIndex + cluster.firstIndex,
+                    });
+                }
             }
             meshSurfaceArray.write(mesh.surfacesMemoryBlock, surfaceData.data());
+            if (!clusterData.empty()) {
+                meshClusterArray.write(mesh.clustersMemoryBlock, clusterData.data());
+            }
+
+            residencyManager.track(ResidencyType::MESH, id,
+                mesh.verticesMemoryBlock.size + mesh.indicesMemoryBlock.size + mesh.surfacesMemoryBlock.size +
+                mesh.clustersMemoryBlock.size);
+        }
+        // The staging buffers now hold a copy of the data
+        for (const auto id : needUpload) {
+            (*this)[id].releaseData();
         }
         needUpload.clear();
 
@@ -184,9 +495,16 @@ namespace lysa {
         vertexArray.flush(*command.commandList);
         indexArray.flush(*command.commandList);
         meshSurfaceArray.flush(*command.commandList);
+        meshClusterArray.flush(*command.commandList);
         ctx.asyncQueue.endCommand(command);
     }
 
+    size_t MeshManager::getDataMemoryUsage() const {
+        auto total = size_t{0};
+        forEach([&](const Mesh& mesh) { total += mesh.getDataMemorySize(); });
+        return total;
+    }
+
 #ifdef LUA_BINDING
     Mesh& MeshManager::create( const luabridge::LuaRef& vertices,
           const luabridge::LuaRef& indices,
@@ -15,9 +15,15 @@ import lysa.memory;
 import lysa.resources;
 import lysa.resources.material;
 import lysa.resources.manager;
+import lysa.resources.residency;
 
 export namespace lysa {
 
+    /**
+     * Maximum number of detail levels of a mesh surface, the full one included
+     */
+    constexpr uint32 MESH_LODS_MAX{4};
+
     /**
      * %A Mesh vertex
      */
@@ -39,10 +45,73 @@ export namespace lysa {
         }
     };
 
+    /**
+     * What a Mesh does with its CPU data once uploaded into VRAM
+     */
+    enum class MeshDataPolicy : uint8 {
+        //! The vertices and indices are kept in RAM
+        KEEP,
+        //! Only a quantized copy of the positions and the indices is kept, for the CPU-side queries (picking, ...)
+        COMPACT,
+        //! The vertices and indices are released and re-fetched from their source by Mesh::fetchData(),
+        //! the indices reordered by the clusters and extended with the detail levels are kept
+        DISCARD,
+    };
+
+    struct MeshLodData {
+        uint32 indexCount;
+        uint32 indicesIndex;
+        float  error;
+        uint32 padding;
+    };
+
     struct MeshSurfaceData {
         uint32 indexCount;
         uint32 indicesIndex;
         uint32 verticesIndex;
+        uint32 lodsCount;
+        MeshLodData lods[MESH_LODS_MAX];
+        uint32 clustersIndex;
+        uint32 clustersCount;
+        uint32 padding[2];
+    };
+
+    struct MeshClusterData {
+        float4 sphere; // center + radius
+        float4 cone;   // axis + cutoff
+        uint32 indexCount;
+        uint32 indicesIndex;
+        uint32 padding[2];
+    };
+
+    /**
+     * Simplified detail level of a Mesh surface
+     */
+    struct MeshLod {
+        //! Index of the first vertex of the level
+        uint32 firstIndex{0};
+        //! Number of vertices
+        uint32 indexCount{0};
+        //! Distance between the level and the full surface, in the mesh local space
+        float error{0.0f};
+    };
+
+    /**
+     * Cluster of neighbor triangles of a Mesh surface, culled independently
+     */
+    struct MeshCluster {
+        //! Index of the first vertex of the cluster
+        uint32 firstIndex{0};
+        //! Number of vertices
+        uint32 indexCount{0};
+        //! Center of the bounding sphere, in the mesh local space
+        float3 center{0.0f};
+        //! Radius of the bounding sphere
+        float radius{0.0f};
+        //! Mean normal of the triangles
+        float3 coneAxis{0.0f, 0.0f, 1.0f};
+        //! Sine of the largest angle between the normals and the axis, 1 if the cluster can face any direction
+        float coneCutoff{1.0f};
     };
 
     /**
@@ -55,6 +124,10 @@ export namespace lysa {
         uint32 indexCount{0};
         //! Material
         unique_id material{INVALID_ID};
+        //! Simplified detail levels, from the finest to the coarsest, stored after the surfaces indices
+        std::vector<MeshLod> lods{};
+        //! Clusters of the full detail level, in the order of the surface indices. Empty if the surface fits in one cluster
+        std::vector<MeshCluster> clusters{};
 
         MeshSurface(uint32 firstIndex, uint32 count);
 
@@ -72,6 +145,11 @@ export namespace lysa {
      */
     class Mesh : public ManagedResource {
     public:
+        /**
+         * Callback used to re-fetch discarded vertices and indices from their source (i.e. an AssetsPack)
+         */
+        using DataSource = std::function<void(std::vector<Vertex>& vertices, std::vector<uint32>& indices)>;
+
         /**
          * Creates a Mesh from vertices
          * @param ctx
@@ -120,24 +198,123 @@ export namespace lysa {
         const std::vector<MeshSurface>& getSurfaces() const { return surfaces; }
 
         /**
-         * Returns all the vertices
+         * Returns all the vertices, the data must be resident (see fetchData())
+         */
+        std::vector<Vertex>& getVertices() {
+            assert([&]{ return dataResident; }, "Mesh CPU data released, call fetchData() first");
+            return vertices;
+        }
+
+        /**
+         * Return all the vertices indexes, the data must be resident (see fetchData())
+         */
+        std::vector<uint32>& getIndices() {
+            assert([&]{ return dataResident; }, "Mesh CPU data released, call fetchData() first");
+            return indices;
+        }
+
+        /**
+         * Returns all the vertices, the data must be resident (see fetchData())
+         */
+        const std::vector<Vertex>& getVertices() const {
+            assert([&]{ return dataResident; }, "Mesh CPU data released, call fetchData() first");
+            return vertices;
+        }
+
+        /**
+         * Return all the vertices indexes, the data must be resident (see fetchData())
+         */
+        const std::vector<uint32>& getIndices() const {
+            assert([&]{ return dataResident; }, "Mesh CPU data released, call fetchData() first");
+            return indices;
+        }
+
+        /**
+         * Returns the number of vertices, without re-fetching the CPU data
+         */
+        uint32 getVertexCount() const;
+
+        /**
+         * Returns the number of indices, without re-fetching the CPU data
+         */
+        uint32 getIndexCount() const;
+
+        /**
+         * Returns the local position of a vertex.
+         * Uses the quantized copy for a COMPACT mesh, the precision is 1/65535 of the AABB size.
+         */
+        float3 getPosition(uint32 vertexIndex) const;
+
+        /**
+         * Returns a vertex index
+         */
+        uint32 getIndex(uint32 index) const;
+
+        /**
+         * Returns what the mesh does with its CPU data once uploaded
          */
-        std::vector<Vertex>& getVertices() { return vertices; }
+        auto getDataPolicy() const { return dataPolicy; }
 
         /**
-         * Return all the vertices indexes
+         * Sets what the mesh does with its CPU data once uploaded.
+         * The policy is applied on the next upload or by releaseData().
          */
-        std::vector<uint32>& getIndices() { return indices; }
+        void setDataPolicy(const MeshDataPolicy policy) { dataPolicy = policy; }
 
         /**
-         * Returns all the vertices
+         * Sets the callback used to re-fetch the discarded data.
+         * Without a source the data is never released, whatever the data policy.
          */
-        const std::vector<Vertex>& getVertices() const { return vertices; }
+        void setDataSource(const DataSource& source) { dataSource = source; }
 
         /**
-         * Return all the vertices indexes
+         * Returns true if the full vertices and indices are in RAM
          */
-        const std::vector<uint32>& getIndices() const { return indices; }
+        auto isDataResident() const { return dataResident; }
+
+        /**
+         * Returns true if the full vertices and indices are in RAM or can be re-fetched from their source
+         */
+        auto isDataAvailable() const { return dataResident || dataSource != nullptr; }
+
+        /**
+         * Releases the CPU data according to the data policy, once uploaded and if it can be re-fetched
+         */
+        void releaseData();
+
+        /**
+         * Re-fetches the CPU data released by releaseData() from the data source, does nothing if the data is resident.
+         * Only the vertices are read again when the clusters or the detail levels have been generated, their indices
+         * being kept. Can be called from any thread, this is the only function reading the data source.
+         */
+        void fetchData();
+
+        /**
+         * Returns the RAM used by the CPU data, full and compact
+         */
+        size_t getDataMemorySize() const;
+
+        /**
+         * Generates the simplified detail levels of the surfaces, appended to the indices.
+         * Must be called before the first upload.
+         */
+        void generateLods();
+
+        /**
+         * Returns true if generateLods() has been called
+         */
+        auto isLodsGenerated() const { return lodsGenerated; }
+
+        /**
+         * Splits the surfaces in clusters of neighbor triangles, reordering their indices.
+         * Must be called before the first upload and before generateLods().
+         */
+        void generateClusters();
+
+        /**
+         * Returns true if generateClusters() has been called
+         */
+        auto isClustersGenerated() const { return clustersGenerated; }
 
         /**
          * Returns the local space axis aligned bounding box
@@ -152,6 +329,8 @@ export namespace lysa {
 
         auto getSurfacesIndex() const { return surfacesMemoryBlock.instanceIndex; }
 
+        auto getClustersIndex() const { return clustersMemoryBlock.instanceIndex; }
+
         auto& getMaterials() { return materials; }
 
         const auto& getMaterials() const { return materials; }
@@ -166,6 +345,7 @@ export namespace lysa {
         Context& ctx;
         const std::string name;
         AABB localAABB;
+        // Full CPU data, released according to the data policy and re-fetched by fetchData()
         std::vector<Vertex> vertices;
         std::vector<uint32> indices;
 
@@ -177,6 +357,37 @@ export namespace lysa {
         MemoryBlock verticesMemoryBlock;
         MemoryBlock indicesMemoryBlock;
         MemoryBlock surfacesMemoryBlock;
+        MemoryBlock clustersMemoryBlock;
+
+        MeshDataPolicy dataPolicy{MeshDataPolicy::KEEP};
+        DataSource dataSource;
+        // Guards the CPU data while it is released, re-fetched or generated
+        std::mutex dataMutex;
+        bool dataResident{true};
+        bool lodsGenerated{false};
+        bool clustersGenerated{false};
+        // Counts of the released data
+        uint32 vertexCount{0};
+        uint32 indexCount{0};
+        // Positions quantized in the local AABB, 3 per vertex
+        std::vector<uint16> compactPositions;
+        // Indices of COMPACT meshes, on 16 bits when possible
+        std::vector<uint16> compactIndices16;
+        std::vector<uint32> compactIndices32;
+
+        // Reads the released data from the source, dataMutex locked
+        void readDataSource();
+
+        // The generated indices are not in the source, they are kept when the data is released
+        auto isIndicesGenerated() const { return clustersGenerated || lodsGenerated; }
+
+        // Appends the simplified levels of the surfaces to the indices, returns their ranges
+        std::vector<std::vector<MeshLod>> buildLods();
+
+        // Reorders the indices of the surfaces cluster by cluster, returns the clusters
+        std::vector<std::vector<MeshCluster>> buildClusters();
+
+        void buildCompactData();
     };
 
     class MeshManager : public ResourcesManager<Context, Mesh> {
@@ -184,7 +395,7 @@ export namespace lysa {
         /**
          * Construct a manager bound to the given runtime context.
          * @param ctx Instance wide context
-         * @param capacity maximum capacity
+         * @param capacity Initial capacity, the pool grows on demand
          * @param vertexCapacity
          * @param indexCapacity
          * @param surfaceCapacity
@@ -194,7 +405,8 @@ export namespace lysa {
             size_t capacity,
             size_t vertexCapacity,
             size_t indexCapacity,
-            size_t surfaceCapacity);
+            size_t surfaceCapacity,
+            size_t clusterCapacity);
 
         Mesh& create(const std::vector<Vertex>& vertices,
              const std::vector<uint32>& indices,
@@ -208,14 +420,61 @@ export namespace lysa {
               const std::string& name = "") ;
 #endif
 
+        /**
+         * Creates an empty mesh, the caller filling its data then calling generate()
+         */
         Mesh& create(const std::string& name = "");
 
         void upload(unique_id id);
 
+        /**
+         * Generates the clusters and the detail levels of a mesh, as enabled, when its data is imported or
+         * loaded, flush() only uploading them. Called by create() for the meshes created with their data.
+         * Can be called from a loading thread, before the first upload of the mesh.
+         */
+        void generate(Mesh& mesh) const;
+
         void flush();
 
+        /**
+         * Returns the data policy given to the new meshes
+         */
+        auto getDefaultDataPolicy() const { return defaultDataPolicy; }
+
+        /**
+         * Sets the data policy given to the new meshes
+         */
+        void setDefaultDataPolicy(const MeshDataPolicy policy) { defaultDataPolicy = policy; }
+
+        /**
+         * Returns true if the detail levels of the meshes are generated by generate()
+         */
+        auto isLodsGenerationEnabled() const { return lodsGenerationEnabled; }
+
+        /**
+         * Enables the generation of the detail levels of the meshes by generate()
+         */
+        void setLodsGenerationEnabled(const bool enabled) { lodsGenerationEnabled = enabled; }
+
+        /**
+         * Returns true if the surfaces of the meshes are split in clusters by generate()
+         */
+        auto isClustersGenerationEnabled() const { return clustersGenerationEnabled; }
+
+        /**
+         * Enables the split of the surfaces of the meshes in clusters by generate()
+         */
+        void setClustersGenerationEnabled(const bool enabled) { clustersGenerationEnabled = enabled; }
+
+        /**
+         * Returns the RAM used by the CPU data of all the meshes
+         */
+        size_t getDataMemoryUsage() const;
+
         auto getMeshSurfaceBuffer() const { return meshSurfaceArray.getBuffer(); }
 
+        auto getMeshClusterBuffer() const { return meshClusterArray.getBuffer(); }
+
         auto getVertexBuffer() const { return vertexArray.getBuffer(); }
 
         auto getIndexBuffer() const { return indexArray.getBuffer(); }
@@ -226,15 +485,28 @@ export namespace lysa {
 
     private:
         MaterialManager& materialManager;
+        /** GPU memory budget manager */
+        ResidencyManager& residencyManager;
         /** Device memory array that stores all vertex buffers. */
         DeviceMemoryArray vertexArray;
         /** Device memory array that stores all index buffers. */
         DeviceMemoryArray indexArray;
         /** Device memory array that stores mesh surface descriptors. */
         DeviceMemoryArray meshSurfaceArray;
+        /** Device memory array that stores the clusters of the mesh surfaces. */
+        DeviceMemoryArray meshClusterArray;
         /** Mutex to guard mutations to memory array. */
         std::mutex mutex;
         std::unordered_set<unique_id> needUpload;
+        MeshDataPolicy defaultDataPolicy{MeshDataPolicy::KEEP};
+        bool lodsGenerationEnabled{true};
+        bool clustersGenerationEnabled{true};
+
+        void evict(unique_id id);
+
+        // Allocates the blocks of a mesh in the vertex, index, surface & cluster arrays, evicting the least recently
+        // seen meshes until all the arrays have room. Returns false, without any block allocated, if nothing can be evicted
+        bool alloc(Mesh& mesh);
     };
 }
 
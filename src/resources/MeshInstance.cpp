@@ -16,7 +16,8 @@ namespace lysa {
           materialManager(ctx.res.get<MaterialManager>()),
           meshManager(ctx.res.get<MeshManager>()),
           mesh(mesh),
-          name(name) {
+          name(name),
+          worldAABB(mesh.getAABB()) {
         meshManager.use(mesh.id);
     }
 
@@ -27,6 +28,8 @@ namespace lysa {
         name(name),
         visible(mi.visible),
         castShadows(mi.castShadows),
+        minScreenSizeScale(mi.minScreenSizeScale),
+        staticInstance(mi.staticInstance),
         worldAABB(mi.worldAABB),
         worldTransform(mi.worldTransform) {
         meshManager.use(mesh.id);
@@ -39,6 +42,8 @@ namespace lysa {
         name(orig.name),
         visible(orig.visible),
         castShadows(orig.castShadows),
+        minScreenSizeScale(orig.minScreenSizeScale),
+        staticInstance(orig.staticInstance),
         worldAABB(orig.worldAABB),
         worldTransform(orig.worldTransform) {
         meshManager.use(mesh.id);
@@ -55,13 +60,32 @@ namespace lysa {
         return mesh.getSurfaces()[surfaceIndex].material;
     }
 
+    void MeshInstance::setTransforms(
+        const std::span<MeshInstance* const> meshInstances,
+        const std::span<const float4x4> transforms) {
+        auto localAABBs = std::vector<AABB>{};
+        localAABBs.reserve(meshInstances.size());
+        for (auto i = 0; i < meshInstances.size(); i++) {
+            meshInstances[i]->worldTransform = transforms[i];
+            localAABBs.push_back(meshInstances[i]->mesh.getAABB());
+        }
+        auto worldAABBs = std::vector<AABB>(meshInstances.size());
+        AABB::toGlobal(localAABBs, transforms, worldAABBs);
+        for (auto i = 0; i < meshInstances.size(); i++) {
+            meshInstances[i]->worldAABB = worldAABBs[i];
+        }
+    }
+
     MeshInstanceData MeshInstance::getData() const {
+        const auto& aabb = getAABB();
         return {
             .transform = worldTransform,
-            .aabbMin = worldAABB.min,
-            .aabbMax = worldAABB.max,
+            .aabbMin = aabb.min,
+            .aabbMax = aabb.max,
             .visible = visible ? 1u : 0u,
             .castShadows = castShadows ? 1u : 0u,
+            .minScreenSizeScale = minScreenSizeScale,
+            .isStatic = staticInstance ? 1u : 0u,
         };
     }
 
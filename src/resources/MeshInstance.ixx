@@ -26,6 +26,8 @@ export namespace lysa {
         float3   aabbMax;
         uint     visible;
         uint     castShadows;
+        float    minScreenSizeScale;
+        uint     isStatic;
     };
 
     /**
@@ -49,13 +51,47 @@ export namespace lysa {
 
         void setCastShadow(const bool castShadows) { this->castShadows = castShadows; }
 
+        float getMinScreenSizeScale() const { return minScreenSizeScale; }
+
+        /**
+         * Scales the projected size under which the culling discards the instance, 0 to never discard it for its size
+         */
+        void setMinScreenSizeScale(const float scale) { minScreenSizeScale = scale; }
+
+        bool isStatic() const { return staticInstance; }
+
+        /**
+         * Marks the instance as never moving, its shadow is cached in the shadow maps of the lights
+         * until it is modified or removed
+         */
+        void setStatic(const bool isStatic) { staticInstance = isStatic; }
+
+        /**
+         * Returns the world AABB, computed from the mesh AABB by the last setTransform()
+         */
         const AABB& getAABB() const { return worldAABB; }
 
+        /**
+         * Overrides the world AABB, until the next setTransform()
+         */
         void setAABB(const AABB& aabb) { worldAABB = aabb; }
 
         const float4x4& getTransform() const { return worldTransform; }
 
-        void setTransform(const float4x4& transform) { worldTransform = transform; }
+        /**
+         * Sets the world transform and recomputes the world AABB
+         */
+        void setTransform(const float4x4& transform) {
+            worldTransform = transform;
+            worldAABB = mesh.getAABB().toGlobal(transform);
+        }
+
+        /**
+         * Sets the world transforms of a batch of mesh instances, their world AABB being recomputed in one pass
+         * @param meshInstances Mesh instances to update
+         * @param transforms World transforms, one per mesh instance
+         */
+        static void setTransforms(std::span<MeshInstance* const> meshInstances, std::span<const float4x4> transforms);
 
         unique_id getSurfaceMaterial(uint32 surfaceIndex) const;
 
@@ -78,6 +114,8 @@ export namespace lysa {
         const std::string name;
         bool visible{true};
         bool castShadows{false};
+        float minScreenSizeScale{1.0f};
+        bool staticInstance{false};
         AABB worldAABB{};
         float4x4 worldTransform{float4x4::identity()};
         std::unordered_map<uint32, unique_id> materialsOverride;
@@ -0,0 +1,78 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.resources.pipeline_registry;
+
+import std;
+import lysa.context;
+import lysa.exception;
+import lysa.types;
+
+export namespace lysa {
+
+    /**
+     * Interns the pipeline-state keys of the materials into small, dense pipeline ids.
+     *
+     * Materials compute their key only when a pipeline-affecting property changes and
+     * store the resulting id, so the renderers never hash keys in their loops. Ids are
+     * allocated sequentially from zero and never recycled, they can be used to index
+     * flat per-pipeline arrays.
+     */
+    class PipelineRegistry {
+    public:
+        PipelineRegistry(Context& ctx) {
+            ctx.res.enroll(*this);
+        }
+
+        /**
+         * Returns the id associated with a pipeline key, allocating a new one for an unknown key
+         * @param key Pipeline-state key
+         */
+        pipeline_id intern(const std::string& key) {
+            {
+                auto lock = std::shared_lock{mutex};
+                if (const auto it = ids.find(key); it != ids.end()) {
+                    return it->second;
+                }
+            }
+            auto lock = std::unique_lock{mutex};
+            const auto [it, inserted] = ids.try_emplace(key, static_cast<pipeline_id>(keys.size()));
+            if (inserted) {
+                keys.push_back(key);
+            }
+            return it->second;
+        }
+
+        /**
+         * Returns the key of an interned pipeline id
+         */
+        std::string getKey(const pipeline_id id) const {
+            auto lock = std::shared_lock{mutex};
+            assert([&]{ return id < keys.size(); }, "PipelineRegistry : invalid pipeline id");
+            return keys[id];
+        }
+
+        /**
+         * Returns the number of interned pipeline ids, all ids are lower than this value
+         */
+        size_t getCount() const {
+            auto lock = std::shared_lock{mutex};
+            return keys.size();
+        }
+
+        PipelineRegistry(PipelineRegistry&) = delete;
+        PipelineRegistry& operator=(PipelineRegistry&) = delete;
+
+    private:
+        // Key to id
+        std::unordered_map<std::string, pipeline_id> ids;
+        // Id to key
+        std::vector<std::string> keys;
+        // Materials can be created from the loading threads
+        mutable std::shared_mutex mutex;
+    };
+
+}
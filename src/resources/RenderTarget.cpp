@@ -146,7 +146,7 @@ namespace lysa {
         if (!swapChain->acquire(frame.inFlightFence)) { return; }
         frame.commandAllocator->reset();
         for (auto& view : views) {
-            view.scene.processDeferredOperations(frameIndex);
+            view.scene.processDeferredOperations();
             auto& data = view.scene.get(frameIndex);
             if (data.isMaterialsUpdated()) {
                 renderer->updatePipelines(data);
@@ -0,0 +1,183 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+module lysa.resources.residency;
+
+import lysa.exception;
+import lysa.log;
+
+namespace lysa {
+
+    ResidencyManager::ResidencyManager(Context& ctx, const size_t budget) :
+        framesInFlight(ctx.config.framesInFlight),
+        budget(budget) {
+        ctx.res.enroll(*this);
+    }
+
+    void ResidencyManager::setHandler(const ResidencyType type, const ResidencyHandler& handler) {
+        auto lock = std::lock_guard(mutex);
+        handlers[static_cast<size_t>(type)] = handler;
+    }
+
+    void ResidencyManager::setReloadCallback(const ResidencyType type, const unique_id id, const ReloadCallback& callback) {
+        auto lock = std::lock_guard(mutex);
+        entries[static_cast<size_t>(type)][id].reload = callback;
+    }
+
+    void ResidencyManager::track(const ResidencyType type, const unique_id id, const size_t bytes) {
+        auto lock = std::lock_guard(mutex);
+        const auto pooled = handlers[static_cast<size_t>(type)].pooled;
+        auto& entry = entries[static_cast<size_t>(type)][id];
+        if (entry.resident && !pooled) {
+            usedBytes -= entry.bytes;
+        }
+        entry.bytes = bytes;
+        entry.resident = true;
+        entry.lastUsedFrame = currentFrame;
+        if (!pooled) {
+            usedBytes += bytes;
+        }
+    }
+
+    void ResidencyManager::untrack(const ResidencyType type, const unique_id id) {
+        auto lock = std::lock_guard(mutex);
+        auto& typeEntries = entries[static_cast<size_t>(type)];
+        const auto it = typeEntries.find(id);
+        if (it == typeEntries.end()) { return; }
+        if (it->second.resident && !handlers[static_cast<size_t>(type)].pooled) {
+            usedBytes -= it->second.bytes;
+        }
+        typeEntries.erase(it);
+    }
+
+    void ResidencyManager::acquire(const ResidencyType type, const unique_id id) {
+        auto evicted{false};
+        {
+            auto lock = std::lock_guard(mutex);
+            auto& entry = entries[static_cast<size_t>(type)][id];
+            entry.references += 1;
+            evicted = entry.bytes > 0 && !entry.resident;
+        }
+        if (evicted) {
+            restore(type, id);
+        }
+    }
+
+    void ResidencyManager::release(const ResidencyType type, const unique_id id) {
+        auto lock = std::lock_guard(mutex);
+        auto& typeEntries = entries[static_cast<size_t>(type)];
+        const auto it = typeEntries.find(id);
+        if (it == typeEntries.end()) { return; }
+        if (it->second.references > 0) {
+            it->second.references -= 1;
+        }
+        it->second.releasedFrame = currentFrame;
+    }
+
+    void ResidencyManager::touch(const ResidencyType type, const unique_id id) {
+        auto lock = std::lock_guard(mutex);
+        auto& typeEntries = entries[static_cast<size_t>(type)];
+        const auto it = typeEntries.find(id);
+        if (it != typeEntries.end()) {
+            it->second.lastUsedFrame = currentFrame;
+        }
+    }
+
+    bool ResidencyManager::isResident(const ResidencyType type, const unique_id id) const {
+        auto lock = std::lock_guard(mutex);
+        const auto& typeEntries = entries[static_cast<size_t>(type)];
+        const auto it = typeEntries.find(id);
+        return it != typeEntries.end() && it->second.resident;
+    }
+
+    void ResidencyManager::restore(const ResidencyType type, const unique_id id) {
+        const auto& handler = handlers[static_cast<size_t>(type)];
+        if (handler.restore && handler.restore(id)) {
+            restorationsCount += 1;
+            return;
+        }
+        auto reload = ReloadCallback{};
+        {
+            auto lock = std::lock_guard(mutex);
+            reload = entries[static_cast<size_t>(type)][id].reload;
+        }
+        if (!reload) {
+            throw Exception("ResidencyManager : evicted resource ", id, " can't be restored");
+        }
+        reload(id);
+        restorationsCount += 1;
+    }
+
+    bool ResidencyManager::isEvictable(const ResidencyHandler& handler, const unique_id id, const Entry& entry) const {
+        return entry.resident &&
+               entry.references == 0 &&
+               (std::max(entry.lastUsedFrame, entry.releasedFrame) + framesInFlight) < currentFrame &&
+               (entry.reload || (handler.isRestorable && handler.isRestorable(id)));
+    }
+
+    void ResidencyManager::evict(const ResidencyType type, const unique_id id) {
+        handlers[static_cast<size_t>(type)].evict(id);
+        auto lock = std::lock_guard(mutex);
+        auto& entry = entries[static_cast<size_t>(type)][id];
+        entry.resident = false;
+        if (!handlers[static_cast<size_t>(type)].pooled) {
+            usedBytes -= entry.bytes;
+        }
+        evictionsCount += 1;
+    }
+
+    bool ResidencyManager::evictLeastRecentlyUsed(const ResidencyType type) {
+        auto candidate = INVALID_ID;
+        {
+            auto lock = std::lock_guard(mutex);
+            const auto& handler = handlers[static_cast<size_t>(type)];
+            if (!handler.evict) { return false; }
+            auto lastUsedFrame = std::numeric_limits<uint64>::max();
+            for (const auto& [id, entry] : entries[static_cast<size_t>(type)]) {
+                if (entry.lastUsedFrame < lastUsedFrame && isEvictable(handler, id, entry)) {
+                    candidate = id;
+                    lastUsedFrame = entry.lastUsedFrame;
+                }
+            }
+        }
+        if (candidate == INVALID_ID) { return false; }
+        evict(type, candidate);
+        return true;
+    }
+
+    void ResidencyManager::update() {
+        struct Candidate {
+            ResidencyType type;
+            unique_id id;
+            uint64 lastUsedFrame;
+        };
+        auto candidates = std::vector<Candidate>{};
+        {
+            auto lock = std::lock_guard(mutex);
+            currentFrame += 1;
+            if (budget == 0 || usedBytes <= budget) { return; }
+            for (auto typeIndex = 0; typeIndex < TYPES_COUNT; ++typeIndex) {
+                const auto& handler = handlers[typeIndex];
+                // Evicting the pooled resources would not free any VRAM
+                if (!handler.evict || handler.pooled) { continue; }
+                for (const auto& [id, entry] : entries[typeIndex]) {
+                    if (isEvictable(handler, id, entry)) {
+                        candidates.push_back({static_cast<ResidencyType>(typeIndex), id, entry.lastUsedFrame});
+                    }
+                }
+            }
+        }
+        if (candidates.empty()) { return; }
+        std::ranges::sort(candidates, [](const Candidate& a, const Candidate& b) {
+            return a.lastUsedFrame < b.lastUsedFrame;
+        });
+        for (const auto& candidate : candidates) {
+            if (usedBytes <= budget) { break; }
+            evict(candidate.type, candidate.id);
+        }
+    }
+
+}
@@ -0,0 +1,174 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.resources.residency;
+
+import lysa.context;
+import lysa.types;
+
+export namespace lysa {
+
+    /**
+     * Kind of resources whose GPU memory is tracked by the ResidencyManager
+     */
+    enum class ResidencyType : uint8 {
+        MESH  = 0,
+        IMAGE = 1,
+    };
+
+    /**
+     * Per-type callbacks registered by the resources managers
+     */
+    struct ResidencyHandler {
+        //! Releases the GPU memory of a resource, the resource itself stays alive
+        std::function<void(unique_id)> evict;
+        //! Restores the GPU memory of a resource from its CPU data, returns false if it must be reloaded from its source
+        std::function<bool(unique_id)> restore;
+        //! Returns true if the GPU memory of a resource can be restored without a reload callback
+        std::function<bool(unique_id)> isRestorable;
+        //! The resources are sub-allocated in fixed-size GPU arrays : evicting them makes room in the arrays
+        //! without freeing any VRAM, so they are not counted in the budget and are only evicted with
+        //! evictLeastRecentlyUsed() when an array is full
+        bool pooled{false};
+    };
+
+    /**
+     * GPU memory budget & LRU eviction for the meshes and images.
+     *
+     * The managers report the GPU bytes used by each resource with track() and untrack().
+     * The scenes reference the resources they draw with acquire() and release() : a referenced
+     * resource is never evicted. The scenes mark the resources of the mesh instances kept by their
+     * frustum culling with touch(), giving the last frame each resource has been seen. When the
+     * VRAM used by the tracked resources is over budget, update() evicts the unreferenced (but still
+     * alive) resources, least recently seen first. The pooled resources, whose eviction does not
+     * free VRAM, are evicted by their manager when their pool is full. An evicted resource is
+     * restored on the next acquire(), either by its manager or by the reload callback registered by
+     * its loader (i.e. the AssetsPack it comes from).
+     */
+    class ResidencyManager {
+    public:
+        /**
+         * Callback used to reload an evicted resource from its source
+         */
+        using ReloadCallback = std::function<void(unique_id)>;
+
+        /**
+         * Creates the residency manager.
+         * @param ctx Instance wide context
+         * @param budget GPU memory budget in bytes, 0 to disable the eviction
+         */
+        ResidencyManager(Context& ctx, size_t budget);
+
+        /**
+         * Registers the eviction & restoration callbacks for a type of resources
+         */
+        void setHandler(ResidencyType type, const ResidencyHandler& handler);
+
+        /**
+         * Registers the callback used to reload an evicted resource from its source
+         */
+        void setReloadCallback(ResidencyType type, unique_id id, const ReloadCallback& callback);
+
+        /**
+         * Records the GPU memory used by a resource uploaded into VRAM
+         */
+        void track(ResidencyType type, unique_id id, size_t bytes);
+
+        /**
+         * Forgets a destroyed resource
+         */
+        void untrack(ResidencyType type, unique_id id);
+
+        /**
+         * References a resource used by a scene, restoring it if it has been evicted
+         */
+        void acquire(ResidencyType type, unique_id id);
+
+        /**
+         * Releases a reference taken with acquire()
+         */
+        void release(ResidencyType type, unique_id id);
+
+        /**
+         * Marks a resource as seen during the current frame
+         */
+        void touch(ResidencyType type, unique_id id);
+
+        /**
+         * Evicts the least recently seen unreferenced resource of a type, used by the managers
+         * of the pooled resources to make room in their pools
+         * @return false if no resource of the type can be evicted
+         */
+        bool evictLeastRecentlyUsed(ResidencyType type);
+
+        /**
+         * Returns true if the resource is tracked and in VRAM
+         */
+        bool isResident(ResidencyType type, unique_id id) const;
+
+        /**
+         * Evicts the least recently seen unreferenced resources until the VRAM used by the
+         * tracked resources fits in the budget. Called once per frame.
+         */
+        void update();
+
+        /** Returns the GPU memory budget in bytes, 0 if the eviction is disabled */
+        auto getBudget() const { return budget; }
+
+        /** Changes the GPU memory budget in bytes, 0 to disable the eviction */
+        void setBudget(const size_t budget) { this->budget = budget; }
+
+        /** Returns the VRAM used by the tracked and resident resources, without the pooled resources */
+        auto getUsedBytes() const { return usedBytes; }
+
+        /** Returns the number of evictions since the start */
+        auto getEvictionsCount() const { return evictionsCount; }
+
+        /** Returns the number of restorations since the start */
+        auto getRestorationsCount() const { return restorationsCount; }
+
+        ResidencyManager(ResidencyManager&) = delete;
+        ResidencyManager& operator=(ResidencyManager&) = delete;
+
+    private:
+        static constexpr auto TYPES_COUNT{2};
+
+        struct Entry {
+            // GPU memory used by the resource
+            size_t bytes{0};
+            // Last frame the resource was seen by a frustum culling
+            uint64 lastUsedFrame{0};
+            // Last frame the resource was released by a scene, the frames in flight may still draw it
+            uint64 releasedFrame{0};
+            // Number of scenes references
+            uint32 references{0};
+            // Resource is in VRAM
+            bool resident{false};
+            // Reload from source callback
+            ReloadCallback reload;
+        };
+
+        // Number of frames to wait before evicting a resource still used by in-flight frames
+        const uint32 framesInFlight;
+        size_t budget;
+        size_t usedBytes{0};
+        uint64 currentFrame{0};
+        uint64 evictionsCount{0};
+        uint64 restorationsCount{0};
+        std::array<ResidencyHandler, TYPES_COUNT> handlers;
+        std::array<std::unordered_map<unique_id, Entry>, TYPES_COUNT> entries;
+        mutable std::mutex mutex;
+
+        void restore(ResidencyType type, unique_id id);
+
+        // The resource can be evicted : unreferenced, no longer used by the frames in flight and restorable
+        bool isEvictable(const ResidencyHandler& handler, unique_id id, const Entry& entry) const;
+
+        // Evicts a resource, without the lock
+        void evict(ResidencyType type, unique_id id);
+    };
+
+}
@@ -14,15 +14,39 @@ import lysa.resources;
 export namespace lysa {
 
     /**
-     * Generic object/resources manager using ID-based access.
+     * Returns the slot index encoded in the low 32 bits of a resource handle.
+     */
+    constexpr uint32 handle_index(const unique_id id) {
+        return static_cast<uint32>(static_cast<uint64>(id) & 0xffffffffull);
+    }
+
+    /**
+     * Returns the generation encoded in the high bits of a resource handle.
+     */
+    constexpr uint32 handle_generation(const unique_id id) {
+        return static_cast<uint32>(static_cast<uint64>(id) >> 32);
+    }
+
+    /**
+     * Builds a resource handle from a slot index and a generation.
+     * The generation is kept on 31 bits so a valid handle is never negative (and never INVALID_ID).
+     */
+    constexpr unique_id make_handle(const uint32 index, const uint32 generation) {
+        return static_cast<unique_id>((static_cast<uint64>(generation & 0x7fffffffu) << 32) | index);
+    }
+
+    /**
+     * Generic object/resources manager using handle-based access.
      *
-     * Manages a contiguous pool (vector) of resources of type T addressed by a small integral
-     * unique identifier (unique_id). Instances are created into available slots and retrieved
-     * via their ID. Destruction returns the slot to a free list for reuse.
+     * Resources are stored in fixed-size chunks of slots. A chunk is never moved or freed once
+     * allocated, so references returned by create() and operator[] stay valid while the pool grows.
+     * Resources of type T created with create() are constructed in-place inside the chunk storage,
+     * resources of derived types given to allocate() are owned by their slot.
      *
-     * The manager does not perform dynamic growth; capacity is fixed at construction. All
-     * accessors are O(1) by direct indexing. This class is intended to be used as a base for
-     * concrete resource managers (e.g., textures, windows).
+     * The unique_id of a resource is a generational handle : the low 32 bits are the slot index and
+     * the high bits the generation of the slot. The generation is incremented each time the slot is
+     * released, so stale handles are detected by have() and operator[] (in debug builds) instead of
+     * silently aliasing a newer resource. Use handle_index() to get a dense index (i.e. a GPU array slot).
      *
      * @tparam T Resource type stored by the manager. T is expected to contain a public field
      *           named 'id' of type unique_id that will be assigned upon creation.
@@ -30,12 +54,22 @@ export namespace lysa {
     template<typename CTX, typename T>
     class ResourcesManager {
     public:
+        /** Number of slots in each storage chunk. */
+        static constexpr uint32 CHUNK_SIZE{64};
+
         /**
-       * Create a new unique resource
-       */
+         * Create a new unique resource, constructed in-place in the pool storage
+         */
         template<typename... Args>
         T& create(Args&&... args) {
-            return allocate(std::make_unique<T>(ctx, std::forward<Args>(args)...));
+            if (isFull()) { throw Exception(name, " : no more free slots"); }
+            const auto index = acquireSlot();
+            auto& slot = getSlot(index);
+            auto* storage = &getChunk(index).storage[(index % CHUNK_SIZE) * sizeof(T)];
+            slot.resource = std::construct_at(reinterpret_cast<T*>(storage), ctx, std::forward<Args>(args)...);
+            slot.inPlace = true;
+            slot.resource->id = make_handle(index, slot.generation);
+            return *slot.resource;
         }
 
         /**
@@ -45,7 +79,7 @@ export namespace lysa {
          */
         inline T& operator[](const unique_id id) {
             assert([&]{ return have(id); }, name  + " : invalid id ");
-            return *resources[id];
+            return *getSlot(handle_index(id)).resource;
         }
 
         /**
@@ -55,15 +89,18 @@ export namespace lysa {
          */
         inline const T& operator[](const unique_id id) const {
             assert([&]{ return have(id); }, name  + " : invalid id ");
-            return *resources[id];
+            return *getSlot(handle_index(id)).resource;
         }
 
         virtual ~ResourcesManager() {
-            for (auto& res : resources) {
-                if (res) destroy(res->id);
+            for (auto index = 0u; index < slotsCount; ++index) {
+                if (const auto* res = getSlot(index).resource) { destroy(res->id); }
             }
-            assert([&]{ return freeList.size() == resources.size(); },
+            assert([&]{ return static_cast<unique_id>(freeList.size()) == getCapacity(); },
                 name  + " : resources still in use");
+            for (auto index = 0u; index < slotsCount; ++index) {
+                release(getSlot(index));
+            }
         }
 
         ResourcesManager(ResourcesManager&) = delete;
@@ -72,12 +109,15 @@ export namespace lysa {
         // Release a resource, returning its slot to the free list.
         virtual bool destroy(const unique_id id) {
             assert([&]{ return have(id); }, name  + " : invalid id ");
-            if (resources[id]->refCounter > 0) {
-                resources[id]->refCounter -= 1;
+            auto& slot = getSlot(handle_index(id));
+            if (slot.resource->refCounter > 0) {
+                slot.resource->refCounter -= 1;
             }
-            if (resources[id]->refCounter == 0) {
-                resources[id].reset();
-                freeList.push_back(id);
+            if (slot.resource->refCounter == 0) {
+                release(slot);
+                slot.generation = (slot.generation + 1) & 0x7fffffffu;
+                freeList.push_back(handle_index(id));
+                liveCount -= 1;
                 return true;
             }
             return false;
@@ -90,12 +130,53 @@ export namespace lysa {
         // Increment the reference counter of the resources
         void use(const unique_id id) {
             assert([&]{ return have(id); }, name  + " : invalid id ");
-            resources[id]->refCounter += 1;
+            getSlot(handle_index(id)).resource->refCounter += 1;
         }
 
-        bool have(const unique_id id) const { return id < resources.size() && resources.at(id) != nullptr; }
+        /**
+         * Returns true if the handle references a live resource of this manager.
+         * Handles of destroyed resources are rejected even if their slot has been reused.
+         */
+        bool have(const unique_id id) const {
+            if (id < 0) { return false; }
+            const auto index = handle_index(id);
+            if (index >= slotsCount) { return false; }
+            const auto& slot = getSlot(index);
+            return slot.resource != nullptr && slot.generation == handle_generation(id);
+        }
 
-        unique_id getCapacity() const { return resources.size(); }
+        /**
+         * Calls `fn(T&)` for each live resource, in slot order.
+         */
+        template<typename F>
+        void forEach(F&& fn) {
+            for (auto& chunk : chunks) {
+                for (auto& slot : chunk->slots) {
+                    if (slot.resource) { fn(*slot.resource); }
+                }
+            }
+        }
+
+        /**
+         * Calls `fn(const T&)` for each live resource, in slot order.
+         */
+        template<typename F>
+        void forEach(F&& fn) const {
+            for (const auto& chunk : chunks) {
+                for (const auto& slot : chunk->slots) {
+                    if (slot.resource) { fn(std::as_const(*slot.resource)); }
+                }
+            }
+        }
+
+        /** Returns the number of live resources. */
+        size_t getCount() const { return liveCount; }
+
+        /** Returns the number of allocated slots. */
+        unique_id getCapacity() const { return static_cast<unique_id>(std::min(static_cast<size_t>(slotsCount), maxCapacity)); }
+
+        /** Returns the maximum number of slots, the pool never grows past this limit. */
+        size_t getMaxCapacity() const { return maxCapacity; }
 
         constexpr CTX& getContext() const { return ctx; }
 
@@ -104,38 +185,107 @@ export namespace lysa {
         // Reference to the owning application context.
         CTX& ctx;
 
-        // Construct a manager with a fixed number of slots.
-        ResourcesManager(CTX& ctx, const size_t capacity, const std::string& name) :
+        /**
+         * Construct a manager.
+         * @param ctx Owning context
+         * @param capacity Initial number of slots
+         * @param name Name for debug & error messages
+         * @param maxCapacity Maximum number of slots. Use the initial capacity for managers with
+         *        a fixed-size GPU counterpart (i.e. bindless arrays indexed by handle_index())
+         */
+        ResourcesManager(
+            CTX& ctx,
+            const size_t capacity,
+            const std::string& name,
+            const size_t maxCapacity = std::numeric_limits<uint32>::max()) :
             ctx(ctx),
-            resources(capacity),
-            name(name) {
-            for (auto id = capacity; id > 0; --id) {
-                freeList.push_back(id-1);
+            name(name),
+            maxCapacity(std::max(capacity, std::min(maxCapacity, static_cast<size_t>(std::numeric_limits<uint32>::max())))) {
+            while (slotsCount < capacity) {
+                grow();
             }
         }
 
-        // Allocate a new resource
+        // Allocate a new resource of T or of a type derived from T, owned by its slot
         T& allocate(std::unique_ptr<T> instance) {
-            assert([&]{ return !isFull(); }, name  + " : no more free slots");
-            auto id = freeList.back();
-            freeList.pop_back();
-            resources[id] = std::move(instance);
-            resources[id]->id = id;
-            return *(resources[id]);
+            if (isFull()) { throw Exception(name, " : no more free slots"); }
+            const auto index = acquireSlot();
+            auto& slot = getSlot(index);
+            slot.owned = std::move(instance);
+            slot.resource = slot.owned.get();
+            slot.inPlace = false;
+            slot.resource->id = make_handle(index, slot.generation);
+            return *slot.resource;
         }
 
-        // Contiguous storage for all resources managed by this instance.
-        std::vector<std::unique_ptr<T>> resources;
-
         bool isFull() const {
-            return freeList.empty();
+            return freeList.empty() && slotsCount >= maxCapacity;
         }
 
     private:
+        struct Slot {
+            // Live resource or nullptr if the slot is free
+            T* resource{nullptr};
+            // Owner of resources created with allocate()
+            std::unique_ptr<T> owned;
+            // Incremented each time the slot is released
+            uint32 generation{0};
+            // True if the resource lives in the chunk storage
+            bool inPlace{false};
+        };
+
+        struct Chunk {
+            Slot slots[CHUNK_SIZE];
+            alignas(T) std::byte storage[sizeof(T) * CHUNK_SIZE];
+        };
+
         // Name for debug & error messages
         const std::string name;
-        // Stack-like list of free slot IDs available for future creations.
-        std::vector<unique_id> freeList{};
+        // Maximum number of slots
+        const size_t maxCapacity;
+        // Stable storage for all resources managed by this instance.
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        // Number of slots in usable chunks
+        uint32 slotsCount{0};
+        // Number of live resources
+        size_t liveCount{0};
+        // Stack-like list of free slot indices available for future creations.
+        std::vector<uint32> freeList{};
+
+        Chunk& getChunk(const uint32 index) const { return *chunks[index / CHUNK_SIZE]; }
+
+        Slot& getSlot(const uint32 index) { return getChunk(index).slots[index % CHUNK_SIZE]; }
+
+        const Slot& getSlot(const uint32 index) const { return getChunk(index).slots[index % CHUNK_SIZE]; }
+
+        // Add a chunk of free slots, lowest indices are used first
+        void grow() {
+            chunks.push_back(std::make_unique<Chunk>());
+            const auto first = slotsCount;
+            slotsCount += CHUNK_SIZE;
+            const auto last = static_cast<uint32>(std::min(static_cast<size_t>(slotsCount), maxCapacity));
+            for (auto index = last; index > first; --index) {
+                freeList.push_back(index - 1);
+            }
+        }
+
+        uint32 acquireSlot() {
+            if (freeList.empty()) { grow(); }
+            const auto index = freeList.back();
+            freeList.pop_back();
+            liveCount += 1;
+            return index;
+        }
+
+        void release(Slot& slot) {
+            if (slot.resource == nullptr) { return; }
+            if (slot.inPlace) {
+                std::destroy_at(slot.resource);
+            } else {
+                slot.owned.reset();
+            }
+            slot.resource = nullptr;
+        }
     };
 
-}
\ No newline at end of file
+}
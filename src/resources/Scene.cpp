@@ -19,13 +19,14 @@ namespace lysa {
         imageManager(ctx.res.get<ImageManager>()),
         materialManager(ctx.res.get<MaterialManager>()),
         meshManager(ctx.res.get<MeshManager>()),
-        maxAsyncNodesUpdatedPerFrame(config.asyncObjectUpdatesPerFrame) {
+        maxAsyncNodesUpdatedPerFrame(config.asyncObjectUpdatesPerFrame),
+        instancesData(ctx, config.maxMeshInstances, config.maxMeshSurfacePerPipeline) {
         framesData.resize(ctx.config.framesInFlight);
         for (auto& data : framesData) {
-            data.scene =std::make_unique<SceneFrameData>(
+            data = std::make_unique<SceneFrameData>(
                 ctx,
+                instancesData,
                 config.maxLights,
-                config.maxMeshInstances,
                 config.maxMeshSurfacePerPipeline);
         }
     }
@@ -37,7 +38,7 @@ namespace lysa {
     void Scene::setEnvironment(const Environment& environment) {
         auto lock = std::lock_guard(frameDataMutex);
         for (const auto& data : framesData) {
-            data.scene->setEnvironment(environment);
+            data->setEnvironment(environment);
         }
     }
 
@@ -48,14 +49,21 @@ namespace lysa {
     void Scene::addLight(const Light& light) {
         auto lock = std::lock_guard(frameDataMutex);
         for (const auto& frame : framesData) {
-            frame.scene->addLight(&light);
+            frame->addLight(&light);
         }
     }
 
     void Scene::removeLight(const Light& light) {
         auto lock = std::lock_guard(frameDataMutex);
         for (const auto& frame : framesData) {
-            frame.scene->addLight(&light);
+            frame->removeLight(&light);
+        }
+    }
+
+    void Scene::updateLight(const Light& light) {
+        auto lock = std::lock_guard(frameDataMutex);
+        for (const auto& frame : framesData) {
+            frame->updateLight(&light);
         }
     }
 
@@ -64,83 +72,126 @@ namespace lysa {
         assert([&]{return !meshInstances.contains(pMeshInstance);}, "MeshInstance already in scene");
         meshInstances.insert(pMeshInstance);
         auto lock = std::lock_guard(frameDataMutex);
-        for (auto& frame : framesData) {
-            if (async) {
-                frame.addedNodesAsync.insert(pMeshInstance);
-            } else {
-                frame.addedNodes.insert(pMeshInstance);
-            }
+        if (async) {
+            addedNodesAsync.insert(pMeshInstance);
+        } else {
+            addedNodes.insert(pMeshInstance);
         }
     }
 
     void Scene::updateInstance(const MeshInstance& meshInstance) {
         const auto* pMeshInstance = &meshInstance;
         assert([&]{return meshInstances.contains(pMeshInstance);}, "MeshInstance not in scene");
+        auto lock = std::lock_guard(frameDataMutex);
         updatedNodes.insert(pMeshInstance);
     }
 
+    void Scene::updateInstances(const std::vector<const MeshInstance*>& instances) {
+        assert([&]{ return std::ranges::all_of(instances, [&](const MeshInstance* mi) {
+            return meshInstances.contains(mi); }); }, "MeshInstance not in scene");
+        auto lock = std::lock_guard(frameDataMutex);
+        updatedNodes.insert(instances.begin(), instances.end());
+    }
+
     void Scene::removeInstance(const MeshInstance& meshInstance, const bool async) {
         const auto* pMeshInstance = &meshInstance;
         assert([&]{return meshInstances.contains(pMeshInstance);}, "MeshInstance not in scene");
         meshInstances.erase(pMeshInstance);
         auto lock = std::lock_guard(frameDataMutex);
-        for (auto& frame : framesData) {
-            if (async) {
-                frame.removedNodesAsync.insert(pMeshInstance);
-            } else {
-                frame.removedNodes.insert(pMeshInstance);
-            }
+        updatedNodes.erase(pMeshInstance);
+        if (async) {
+            removedNodesAsync.insert(pMeshInstance);
+        } else {
+            removedNodes.insert(pMeshInstance);
+        }
+    }
+
+    void Scene::updateStaticShadowCaster(
+        const MeshInstance* meshInstance,
+        const bool removed,
+        std::vector<AABB>& modifiedAABBs) {
+        const auto it = staticShadowCasters.find(meshInstance);
+        if (it != staticShadowCasters.end()) {
+            modifiedAABBs.push_back(it->second);
+            staticShadowCasters.erase(it);
+        }
+        if (!removed && meshInstance->isStatic() && meshInstance->isCastShadows()) {
+            const auto& aabb = meshInstance->getAABB();
+            modifiedAABBs.push_back(aabb);
+            staticShadowCasters.insert({meshInstance, aabb});
         }
     }
 
-    void Scene::processDeferredOperations(const uint32 frameIndex) {
+    void Scene::processDeferredOperations() {
         auto lock = std::lock_guard(frameDataMutex);
-        auto &data = framesData[frameIndex];
+        // Volumes of the static shadow casters to render again in the cached shadow maps
+        auto modifiedAABBs = std::vector<AABB>{};
         // Remove from the renderer the nodes previously removed from the scene tree
         // Immediate removes
-        if (!data.removedNodes.empty()) {
-            for (const auto *mi : data.removedNodes) {
-                data.scene->removeInstance(mi);
-                updatedNodes.erase(mi);
+        if (!removedNodes.empty()) {
+            for (const auto *mi : removedNodes) {
+                instancesData.removeInstance(mi);
+                spatialIndex.remove(mi);
+                updateStaticShadowCaster(mi, true, modifiedAABBs);
             }
-            data.removedNodes.clear();
+            removedNodes.clear();
         }
         // Async removes
-        if (!data.removedNodesAsync.empty()) {
+        if (!removedNodesAsync.empty()) {
             auto count = 0;
-            for (auto it = data.removedNodesAsync.begin(); it != data.removedNodesAsync.end();) {
+            for (auto it = removedNodesAsync.begin(); it != removedNodesAsync.end();) {
                 const auto* mi = *it;
-                data.scene->removeInstance(mi);
-                updatedNodes.erase(mi);
-                it = data.removedNodesAsync.erase(it);
+                instancesData.removeInstance(mi);
+                spatialIndex.remove(mi);
+                updateStaticShadowCaster(mi, true, modifiedAABBs);
+                it = removedNodesAsync.erase(it);
                 count += 1;
                 if (count > maxAsyncNodesUpdatedPerFrame) { break; }
             }
         }
         // Add to the scene the nodes previously added to the scene tree
         // Immediate additions
-        if (!data.addedNodes.empty()) {
-            for (const auto* mi : data.addedNodes) {
-                data.scene->addInstance(mi);
-                updatedNodes.erase(mi);
+        if (!addedNodes.empty()) {
+            for (const auto* mi : addedNodes) {
+                instancesData.addInstance(mi);
+                spatialIndex.insert(mi);
+                updateStaticShadowCaster(mi, false, modifiedAABBs);
             }
-            data.addedNodes.clear();
+            addedNodes.clear();
         }
         // Async additions
-        if (!data.addedNodesAsync.empty()) {
+        if (!addedNodesAsync.empty()) {
             auto count = 0;
-            for (auto it = data.addedNodesAsync.begin(); it != data.addedNodesAsync.end();) {
+            for (auto it = addedNodesAsync.begin(); it != addedNodesAsync.end();) {
                 const auto* mi = *it;
-                data.scene->addInstance(mi);
-                updatedNodes.erase(mi);
-                it = data.addedNodesAsync.erase(it);
+                instancesData.addInstance(mi);
+                spatialIndex.insert(mi);
+                updateStaticShadowCaster(mi, false, modifiedAABBs);
+                it = addedNodesAsync.erase(it);
                 count += 1;
                 if (count > maxAsyncNodesUpdatedPerFrame) { break; }
             }
         }
+        // Write the updated nodes once in the shared store.
+        // Nodes not yet added will be written with their last data when added.
+        auto updated = std::vector<const MeshInstance*>{};
         for (const auto* mi : updatedNodes) {
-            data.scene->updateInstance(mi);
+            if (instancesData.haveInstance(mi)) {
+                updated.push_back(mi);
+            }
+        }
+        instancesData.updateInstances(updated);
+        spatialIndex.update(updated);
+        for (const auto* mi : updated) {
+            updateStaticShadowCaster(mi, false, modifiedAABBs);
+        }
+        updatedInstancesCount = static_cast<uint32>(updated.size());
+        updatedNodes.clear();
+        if (!modifiedAABBs.empty()) {
+            for (const auto& frame : framesData) {
+                frame->invalidateShadowMapsStaticCache(modifiedAABBs);
+            }
         }
     }
 
-}
\ No newline at end of file
+}
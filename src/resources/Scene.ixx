@@ -6,10 +6,12 @@
 */
 export module lysa.resources.scene;
 
+import lysa.aabb;
 import lysa.context;
 import lysa.math;
 import lysa.renderers.graphic_pipeline_data;
 import lysa.renderers.scene_frame_data;
+import lysa.renderers.scene_instances_data;
 import lysa.resources;
 import lysa.resources.manager;
 import lysa.resources.environment;
@@ -18,6 +20,7 @@ import lysa.resources.light;
 import lysa.resources.material;
 import lysa.resources.mesh;
 import lysa.resources.mesh_instance;
+import lysa.resources.spatial_index;
 import lysa.resources.texture;
 
 export namespace lysa {
@@ -29,7 +32,7 @@ export namespace lysa {
         /** Number of nodes updates per frame for asynchronous scene updates. */
         uint32 asyncObjectUpdatesPerFrame{50};
         /** Maximum number of lights per scene. */
-        size_t maxLights{10};
+        size_t maxLights{4096};
         /** Maximum number of mesh instances per frame per scene. */
         size_t maxMeshInstances{10000};
         /** Maximum number of mesh surfaces instances per pipeline. */
@@ -41,7 +44,8 @@ export namespace lysa {
      *
      * The Scene class manages the high-level representation of a scene, including
      * its environment, lights, and mesh instances. It handles deferred operations
-     * for adding/removing instances across multiple frames.
+     * for adding/removing instances, applied once to the mesh instances store
+     * shared by the frames in flight.
      */
     class Scene : public UniqueResource {
     public:
@@ -82,6 +86,12 @@ export namespace lysa {
          */
         void updateInstance(const MeshInstance& meshInstance);
 
+        /**
+         * Updates a batch of existing mesh instances, with only one lock of the deferred operations.
+         * @param instances The mesh instances to update.
+         */
+        void updateInstances(const std::vector<const MeshInstance*>& instances);
+
         /**
          * Removes a mesh instance from the scene.
          * @param meshInstance The mesh instance to remove.
@@ -102,17 +112,35 @@ export namespace lysa {
         void removeLight(const Light& light);
 
         /**
-         * Processes deferred scene operations for a specific frame.
-         * @param frameIndex The index of the frame to process.
+         * Forces the upload of the parameters of an existing light to the GPU.
+         * The modified lights are detected and uploaded by each frame without calling this method.
+         * @param light The light to update.
+         */
+        void updateLight(const Light& light);
+
+        /**
+         * Processes deferred scene operations, before the update of the next frame.
          */
-        void processDeferredOperations(uint32 frameIndex);
+        void processDeferredOperations();
 
         /**
          * Gets the frame-specific data for a given frame index.
          * @param frameIndex The index of the frame.
          * @return A reference to the SceneFrameData for the frame.
          */
-        SceneFrameData& get(const uint32 frameIndex) const { return *framesData[frameIndex].scene; }
+        SceneFrameData& get(const uint32 frameIndex) const { return *framesData[frameIndex]; }
+
+        /**
+         * Returns the number of modified mesh instances written by the last
+         * processDeferredOperations() call.
+         */
+        uint32 getUpdatedInstancesCount() const { return updatedInstancesCount; }
+
+        /**
+         * Returns the spatial index of the mesh instances, for the proximity, visibility and ray queries.
+         * The index is updated by processDeferredOperations() and can be queried from any thread.
+         */
+        const SpatialIndex& getSpatialIndex() const { return spatialIndex; }
 
     protected:
         /** Reference to the engine context. */
@@ -125,29 +153,35 @@ export namespace lysa {
         MeshManager& meshManager;
 
     private:
-        /*Per-frame state and deferred operations processed at frame boundaries.*/
-        struct FrameData {
-            /* Nodes to add on the next frame (synchronous path). */
-            std::unordered_set<const MeshInstance*> addedNodes;
-            /* Nodes to add on the next frame (async path). */
-            std::unordered_set<const MeshInstance*> addedNodesAsync;
-            /* Nodes to remove on the next frame (synchronous path). */
-            std::unordered_set<const MeshInstance*> removedNodes;
-            /* Nodes to remove on the next frame (async path). */
-            std::unordered_set<const MeshInstance*> removedNodesAsync;
-            /* Scene instance associated with this frame. */
-            std::unique_ptr<SceneFrameData> scene;
-        };
         /* Maximum number of nodes to update asynchronously per frame. */
         const uint32 maxAsyncNodesUpdatedPerFrame;
-        /* Vector of per-frame data. */
-        std::vector<FrameData> framesData;
-        /* Mutex to guard access to frame data. */
+        /* Mesh instances store shared by the frames in flight. */
+        SceneInstancesData instancesData;
+        /* Per-frame data, referencing instancesData. */
+        std::vector<std::unique_ptr<SceneFrameData>> framesData;
+        /* Mutex to guard access to frame data and deferred operations. */
         std::mutex frameDataMutex;
         /* Set of all mesh instances currently in the scene. */
         std::unordered_set<const MeshInstance*> meshInstances;
-        /* Set of nodes that have been updated and need synchronization. */
+        /* Nodes to add on the next frame (synchronous path). */
+        std::unordered_set<const MeshInstance*> addedNodes;
+        /* Nodes to add on the next frames (async path). */
+        std::unordered_set<const MeshInstance*> addedNodesAsync;
+        /* Nodes to remove on the next frame (synchronous path). */
+        std::unordered_set<const MeshInstance*> removedNodes;
+        /* Nodes to remove on the next frames (async path). */
+        std::unordered_set<const MeshInstance*> removedNodesAsync;
+        /* Nodes updated since the last processDeferredOperations(), multiple updates are coalesced. */
         std::unordered_set<const MeshInstance*> updatedNodes;
+        /* Number of modified instances written by the last processDeferredOperations(). */
+        uint32 updatedInstancesCount{0};
+        /* World AABB hierarchy of the mesh instances added to the instances store. */
+        SpatialIndex spatialIndex;
+        /* World AABB of the static shadow casters in the instances store, when last written. */
+        std::unordered_map<const MeshInstance*, AABB> staticShadowCasters;
+
+        /* Collects the AABB covered by a static shadow caster before and after a modification or a removal. */
+        void updateStaticShadowCaster(const MeshInstance* meshInstance, bool removed, std::vector<AABB>& modifiedAABBs);
     };
 
 }
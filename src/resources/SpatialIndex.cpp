@@ -0,0 +1,436 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+module lysa.resources.spatial_index;
+
+import lysa.exception;
+
+namespace lysa {
+
+    static AABB merge(const AABB& a, const AABB& b) {
+        return { min(a.min, b.min), max(a.max, b.max) };
+    }
+
+    // Half of the surface area, the cost of a node in the surface area heuristic
+    static float area(const AABB& aabb) {
+        const float3 size = aabb.max - aabb.min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    static bool encloses(const AABB& outer, const AABB& inner) {
+        return all(outer.min <= inner.min) && all(outer.max >= inner.max);
+    }
+
+    static bool overlaps(const AABB& a, const AABB& b) {
+        return all(a.min <= b.max) && all(a.max >= b.min);
+    }
+
+    SpatialIndex::SpatialIndex(const float margin, const float rebuildRatio) :
+        margin{margin},
+        rebuildRatio{rebuildRatio} {
+    }
+
+    uint32 SpatialIndex::allocateNode() {
+        if (freeNodes.empty()) {
+            nodes.push_back({});
+            return static_cast<uint32>(nodes.size() - 1);
+        }
+        const auto index = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[index] = {};
+        return index;
+    }
+
+    void SpatialIndex::freeNode(const uint32 index) {
+        nodes[index].meshInstance = nullptr;
+        freeNodes.push_back(index);
+    }
+
+    AABB SpatialIndex::enlarge(const AABB& aabb) const {
+        return { aabb.min - margin, aabb.max + margin };
+    }
+
+    void SpatialIndex::insert(const MeshInstance* meshInstance) {
+        auto lock = std::unique_lock{mutex};
+        assert([&]{ return !leaves.contains(meshInstance); }, "SpatialIndex : MeshInstance already in index");
+        const auto leaf = allocateNode();
+        nodes[leaf].aabb = enlarge(meshInstance->getAABB());
+        nodes[leaf].meshInstance = meshInstance;
+        leaves[meshInstance] = leaf;
+        insertLeaf(leaf);
+        countChange();
+    }
+
+    void SpatialIndex::remove(const MeshInstance* meshInstance) {
+        auto lock = std::unique_lock{mutex};
+        const auto it = leaves.find(meshInstance);
+        if (it == leaves.end()) { return; }
+        removeLeaf(it->second);
+        freeNode(it->second);
+        leaves.erase(it);
+        countChange();
+    }
+
+    void SpatialIndex::update(const MeshInstance* meshInstance) {
+        auto lock = std::unique_lock{mutex};
+        updateLeaf(meshInstance);
+    }
+
+    void SpatialIndex::update(const std::span<const MeshInstance* const> meshInstances) {
+        auto lock = std::unique_lock{mutex};
+        for (const auto* meshInstance : meshInstances) {
+            updateLeaf(meshInstance);
+        }
+    }
+
+    void SpatialIndex::updateLeaf(const MeshInstance* meshInstance) {
+        const auto it = leaves.find(meshInstance);
+        assert([&]{ return it != leaves.end(); }, "SpatialIndex : MeshInstance not in index");
+        const auto& aabb = meshInstance->getAABB();
+        auto& leaf = nodes[it->second];
+        // Small moves stay inside the enlarged box
+        if (encloses(leaf.aabb, aabb)) { return; }
+        leaf.aabb = enlarge(aabb);
+        refit(leaf.parent);
+        countChange();
+    }
+
+    bool SpatialIndex::contains(const MeshInstance* meshInstance) const {
+        auto lock = std::shared_lock{mutex};
+        return leaves.contains(meshInstance);
+    }
+
+    size_t SpatialIndex::getCount() const {
+        auto lock = std::shared_lock{mutex};
+        return leaves.size();
+    }
+
+    void SpatialIndex::clear() {
+        auto lock = std::unique_lock{mutex};
+        nodes.clear();
+        freeNodes.clear();
+        leaves.clear();
+        root = NONE;
+        changesCount = 0;
+    }
+
+    void SpatialIndex::countChange() {
+        changesCount += 1;
+        if (changesCount > std::max(size_t{64}, static_cast<size_t>(leaves.size() * rebuildRatio))) {
+            rebuildTree();
+        }
+    }
+
+    void SpatialIndex::insertLeaf(const uint32 leaf) {
+        if (root == NONE) {
+            root = leaf;
+            nodes[leaf].parent = NONE;
+            return;
+        }
+        // Descend to the sibling with the lowest cost : area of the new parent plus the growth of the ancestors
+        const auto leafAABB = nodes[leaf].aabb;
+        auto index = root;
+        while (!nodes[index].isLeaf()) {
+            const auto& node = nodes[index];
+            const auto combinedArea = area(merge(node.aabb, leafAABB));
+            // Cost of creating a new parent for this node and the new leaf
+            const auto cost = 2.0f * combinedArea;
+            // Minimum cost of pushing the leaf further down the tree
+            const auto inheritanceCost = 2.0f * (combinedArea - area(node.aabb));
+            const auto childCost = [&](const uint32 child) {
+                const auto& childAABB = nodes[child].aabb;
+                const auto childArea = area(merge(childAABB, leafAABB));
+                return (nodes[child].isLeaf() ? childArea : childArea - area(childAABB)) + inheritanceCost;
+            };
+            const auto cost1 = childCost(node.child1);
+            const auto cost2 = childCost(node.child2);
+            if (cost < cost1 && cost < cost2) { break; }
+            index = cost1 < cost2 ? node.child1 : node.child2;
+        }
+
+        const auto sibling = index;
+        const auto oldParent = nodes[sibling].parent;
+        const auto newParent = allocateNode();
+        nodes[newParent].parent = oldParent;
+        nodes[newParent].aabb = merge(leafAABB, nodes[sibling].aabb);
+        nodes[newParent].child1 = sibling;
+        nodes[newParent].child2 = leaf;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+        if (oldParent == NONE) {
+            root = newParent;
+        } else {
+            if (nodes[oldParent].child1 == sibling) {
+                nodes[oldParent].child1 = newParent;
+            } else {
+                nodes[oldParent].child2 = newParent;
+            }
+            refit(oldParent);
+        }
+    }
+
+    void SpatialIndex::removeLeaf(const uint32 leaf) {
+        if (leaf == root) {
+            root = NONE;
+            return;
+        }
+        // The sibling replaces the parent
+        const auto parent = nodes[leaf].parent;
+        const auto grandParent = nodes[parent].parent;
+        const auto sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+        if (grandParent == NONE) {
+            root = sibling;
+            nodes[sibling].parent = NONE;
+        } else {
+            if (nodes[grandParent].child1 == parent) {
+                nodes[grandParent].child1 = sibling;
+            } else {
+                nodes[grandParent].child2 = sibling;
+            }
+            nodes[sibling].parent = grandParent;
+            refit(grandParent);
+        }
+        freeNode(parent);
+    }
+
+    void SpatialIndex::refit(uint32 index) {
+        while (index != NONE) {
+            auto& node = nodes[index];
+            const auto aabb = merge(nodes[node.child1].aabb, nodes[node.child2].aabb);
+            // The upper levels are not modified if this box is not modified
+            if (all(aabb.min == node.aabb.min) && all(aabb.max == node.aabb.max)) { return; }
+            node.aabb = aabb;
+            index = node.parent;
+        }
+    }
+
+    void SpatialIndex::rebuild() {
+        auto lock = std::unique_lock{mutex};
+        rebuildTree();
+    }
+
+    void SpatialIndex::rebuildTree() {
+        changesCount = 0;
+        if (leaves.empty()) { return; }
+        // Keep the leaves, free the inner nodes
+        auto leafNodes = std::vector<uint32>{};
+        leafNodes.reserve(leaves.size());
+        freeNodes.clear();
+        for (auto index = 0u; index < nodes.size(); index++) {
+            if (nodes[index].isLeaf() && nodes[index].meshInstance) {
+                leafNodes.push_back(index);
+            } else {
+                freeNodes.push_back(index);
+            }
+        }
+        root = build(leafNodes, NONE);
+    }
+
+    uint32 SpatialIndex::build(const std::span<uint32> leafNodes, const uint32 parent) {
+        if (leafNodes.size() == 1) {
+            nodes[leafNodes[0]].parent = parent;
+            return leafNodes[0];
+        }
+        // Median split along the largest axis of the centers bounds
+        auto centersMin = float3{std::numeric_limits<float>::max()};
+        auto centersMax = float3{std::numeric_limits<float>::lowest()};
+        for (const auto leaf : leafNodes) {
+            // Twice the center, only the order matters
+            const float3 center = nodes[leaf].aabb.min + nodes[leaf].aabb.max;
+            centersMin = min(centersMin, center);
+            centersMax = max(centersMax, center);
+        }
+        const float3 size = centersMax - centersMin;
+        const auto axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        const auto middle = leafNodes.begin() + leafNodes.size() / 2;
+        std::nth_element(leafNodes.begin(), middle, leafNodes.end(), [&](const uint32 a, const uint32 b) {
+            return nodes[a].aabb.min[axis] + nodes[a].aabb.max[axis] <
+                   nodes[b].aabb.min[axis] + nodes[b].aabb.max[axis];
+        });
+
+        const auto index = allocateNode();
+        nodes[index].parent = parent;
+        const auto child1 = build(leafNodes.subspan(0, leafNodes.size() / 2), index);
+        const auto child2 = build(leafNodes.subspan(leafNodes.size() / 2), index);
+        // nodes can't be referenced before the recursive calls, they can reallocate the array
+        nodes[index].child1 = child1;
+        nodes[index].child2 = child2;
+        nodes[index].aabb = merge(nodes[child1].aabb, nodes[child2].aabb);
+        return index;
+    }
+
+    void SpatialIndex::collect(const uint32 index, std::vector<const MeshInstance*>& results) const {
+        auto stack = std::vector<uint32>{index};
+        while (!stack.empty()) {
+            const auto& node = nodes[stack.back()];
+            stack.pop_back();
+            if (node.isLeaf()) {
+                results.push_back(node.meshInstance);
+            } else {
+                stack.push_back(node.child1);
+                stack.push_back(node.child2);
+            }
+        }
+    }
+
+    template<typename Overlaps>
+    void SpatialIndex::traverse(const Overlaps& overlaps, std::vector<const MeshInstance*>& results) const {
+        auto lock = std::shared_lock{mutex};
+        if (root == NONE) { return; }
+        auto stack = std::vector<uint32>{root};
+        while (!stack.empty()) {
+            const auto& node = nodes[stack.back()];
+            stack.pop_back();
+            if (!overlaps(node.aabb)) { continue; }
+            if (node.isLeaf()) {
+                results.push_back(node.meshInstance);
+            } else {
+                stack.push_back(node.child1);
+                stack.push_back(node.child2);
+            }
+        }
+    }
+
+    void SpatialIndex::query(const AABB& aabb, std::vector<const MeshInstance*>& results) const {
+        traverse([&](const AABB& nodeAABB) {
+            return overlaps(nodeAABB, aabb);
+        }, results);
+    }
+
+    void SpatialIndex::query(const float3& center, const float radius, std::vector<const MeshInstance*>& results) const {
+        const auto radiusSquared = radius * radius;
+        traverse([&](const AABB& nodeAABB) {
+            const float3 delta = center - clamp(center, nodeAABB.min, nodeAABB.max);
+            const float distanceSquared = dot(delta, delta);
+            return distanceSquared <= radiusSquared;
+        }, results);
+    }
+
+    void SpatialIndex::query(const Frustum::Plane planes[6], std::vector<const MeshInstance*>& results) const {
+        auto lock = std::shared_lock{mutex};
+        if (root == NONE) { return; }
+        auto stack = std::vector<uint32>{root};
+        while (!stack.empty()) {
+            const auto index = stack.back();
+            const auto& node = nodes[index];
+            stack.pop_back();
+            auto inside = true;
+            auto outside = false;
+            for (auto i = 0; i < 6 && !outside; i++) {
+                const float3 normal = planes[i].data.xyz;
+                const float distance = planes[i].data.w;
+                // Nearest and farthest corners along the plane normal
+                const float3 positiveNormal = normal >= float3(0.0f);
+                const float3 positive = select(positiveNormal, node.aabb.max, node.aabb.min);
+                const float3 negative = select(positiveNormal, node.aabb.min, node.aabb.max);
+                const float positiveDistance = dot(normal, positive) + distance;
+                const float negativeDistance = dot(normal, negative) + distance;
+                if (positiveDistance < 0.0f) {
+                    outside = true;
+                } else if (negativeDistance < 0.0f) {
+                    inside = false;
+                }
+            }
+            if (outside) { continue; }
+            if (inside) {
+                // The whole subtree is visible, no more tests
+                collect(index, results);
+            } else if (node.isLeaf()) {
+                results.push_back(node.meshInstance);
+            } else {
+                stack.push_back(node.child1);
+                stack.push_back(node.child2);
+            }
+        }
+    }
+
+    void SpatialIndex::query(const float4x4& projectionView, std::vector<const MeshInstance*>& results) const {
+        Frustum::Plane planes[6];
+        Frustum::extractPlanes(planes, projectionView);
+        query(planes, results);
+    }
+
+    // Slab test, returns the entry distance or a negative value if the box is missed
+    static float intersect(
+        const AABB& aabb,
+        const float3& origin,
+        const float3& inverseDirection,
+        const float maxDistance) {
+        const float3 t1 = (aabb.min - origin) * inverseDirection;
+        const float3 t2 = (aabb.max - origin) * inverseDirection;
+        const float3 tMin = min(t1, t2);
+        const float3 tMax = max(t1, t2);
+        const float entry = std::max({tMin[0], tMin[1], tMin[2], 0.0f});
+        const float exit = std::min({tMax[0], tMax[1], tMax[2], maxDistance});
+        return entry <= exit ? entry : -1.0f;
+    }
+
+    void SpatialIndex::raycast(
+        const float3& origin,
+        const float3& direction,
+        const float maxDistance,
+        std::vector<RayHit>& results) const {
+        const float3 inverseDirection = 1.0f / direction;
+        const auto first = results.size();
+        {
+            auto lock = std::shared_lock{mutex};
+            if (root == NONE) { return; }
+            auto stack = std::vector<uint32>{root};
+            while (!stack.empty()) {
+                const auto& node = nodes[stack.back()];
+                stack.pop_back();
+                const auto distance = intersect(node.aabb, origin, inverseDirection, maxDistance);
+                if (distance < 0.0f) { continue; }
+                if (node.isLeaf()) {
+                    results.push_back({node.meshInstance, distance});
+                } else {
+                    stack.push_back(node.child1);
+                    stack.push_back(node.child2);
+                }
+            }
+        }
+        std::sort(results.begin() + first, results.end(), [](const RayHit& a, const RayHit& b) {
+            return a.distance < b.distance;
+        });
+    }
+
+    std::optional<RayHit> SpatialIndex::raycast(
+        const float3& origin,
+        const float3& direction,
+        const float maxDistance) const {
+        const float3 inverseDirection = 1.0f / direction;
+        auto lock = std::shared_lock{mutex};
+        if (root == NONE) { return std::nullopt; }
+        auto nearest = std::optional<RayHit>{};
+        auto nearestDistance = maxDistance;
+        auto stack = std::vector<uint32>{root};
+        while (!stack.empty()) {
+            const auto& node = nodes[stack.back()];
+            stack.pop_back();
+            // The nodes farther than the nearest hit are skipped
+            const auto distance = intersect(node.aabb, origin, inverseDirection, nearestDistance);
+            if (distance < 0.0f) { continue; }
+            if (node.isLeaf()) {
+                nearest = RayHit{node.meshInstance, distance};
+                nearestDistance = distance;
+            } else {
+                // Visit the nearest child first, the stack is LIFO
+                const auto distance1 = intersect(nodes[node.child1].aabb, origin, inverseDirection, nearestDistance);
+                const auto distance2 = intersect(nodes[node.child2].aabb, origin, inverseDirection, nearestDistance);
+                if (distance1 >= 0.0f && distance2 >= 0.0f) {
+                    stack.push_back(distance1 < distance2 ? node.child2 : node.child1);
+                    stack.push_back(distance1 < distance2 ? node.child1 : node.child2);
+                } else if (distance1 >= 0.0f) {
+                    stack.push_back(node.child1);
+                } else if (distance2 >= 0.0f) {
+                    stack.push_back(node.child2);
+                }
+            }
+        }
+        return nearest;
+    }
+
+}
@@ -0,0 +1,189 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.resources.spatial_index;
+
+import lysa.aabb;
+import lysa.frustum;
+import lysa.math;
+import lysa.types;
+import lysa.resources.mesh_instance;
+
+export namespace lysa {
+
+    /**
+     * Result of a ray query
+     */
+    struct RayHit {
+        /** Mesh instance hit by the ray */
+        const MeshInstance* meshInstance{nullptr};
+        /** Distance along the ray to the entry point in the world AABB of the mesh instance */
+        float distance{0.0f};
+    };
+
+    /**
+     * Dynamic bounding volume hierarchy over the world AABB of mesh instances, for spatial queries.
+     *
+     * The leaves store the world AABB enlarged by a margin : a mesh instance moving inside its enlarged
+     * box does not modify the tree, otherwise the leaf is refitted in place and the boxes of its ancestors
+     * are recomputed. New leaves are inserted next to the sibling with the lowest surface area cost.
+     * Refits and insertions degrade the tree : after a number of changes proportional to the number of
+     * leaves the whole tree is rebuilt top-down.
+     *
+     * Queries only read the tree and can be run from any number of threads, modifications are exclusive.
+     * The results are computed with the enlarged boxes and can contain instances slightly outside the query.
+     */
+    class SpatialIndex {
+    public:
+        /**
+         * Creates an empty index.
+         * @param margin Distance added on each side of the world AABB of the leaves
+         * @param rebuildRatio Number of changes, relative to the number of leaves, triggering a full rebuild
+         */
+        SpatialIndex(float margin = 0.1f, float rebuildRatio = 0.5f);
+
+        /**
+         * Adds a mesh instance, using its current world AABB
+         */
+        void insert(const MeshInstance* meshInstance);
+
+        /**
+         * Removes a mesh instance
+         */
+        void remove(const MeshInstance* meshInstance);
+
+        /**
+         * Updates the leaf of a mesh instance after a modification of its world AABB
+         */
+        void update(const MeshInstance* meshInstance);
+
+        /**
+         * Updates the leaves of a batch of mesh instances, with only one lock
+         */
+        void update(std::span<const MeshInstance* const> meshInstances);
+
+        /**
+         * Returns true if the mesh instance is in the index
+         */
+        bool contains(const MeshInstance* meshInstance) const;
+
+        /**
+         * Rebuilds the whole tree from the current leaves boxes
+         */
+        void rebuild();
+
+        /**
+         * Removes all the mesh instances
+         */
+        void clear();
+
+        /**
+         * Appends to results the mesh instances overlapping a box
+         */
+        void query(const AABB& aabb, std::vector<const MeshInstance*>& results) const;
+
+        /**
+         * Appends to results the mesh instances overlapping a sphere
+         */
+        void query(const float3& center, float radius, std::vector<const MeshInstance*>& results) const;
+
+        /**
+         * Appends to results the mesh instances inside or intersecting a frustum
+         * @param planes Frustum planes, as extracted by Frustum::extractPlanes()
+         * @param results Mesh instances found
+         */
+        void query(const Frustum::Plane planes[6], std::vector<const MeshInstance*>& results) const;
+
+        /**
+         * Appends to results the mesh instances inside or intersecting the frustum of a projection-view matrix
+         */
+        void query(const float4x4& projectionView, std::vector<const MeshInstance*>& results) const;
+
+        /**
+         * Appends to results all the mesh instances hit by a ray, sorted by distance
+         * @param origin Origin of the ray
+         * @param direction Normalized direction of the ray
+         * @param maxDistance Length of the ray
+         * @param results Hits found
+         */
+        void raycast(
+            const float3& origin,
+            const float3& direction,
+            float maxDistance,
+            std::vector<RayHit>& results) const;
+
+        /**
+         * Returns the nearest mesh instance hit by a ray
+         * @param origin Origin of the ray
+         * @param direction Normalized direction of the ray
+         * @param maxDistance Length of the ray
+         */
+        std::optional<RayHit> raycast(
+            const float3& origin,
+            const float3& direction,
+            float maxDistance = std::numeric_limits<float>::max()) const;
+
+        /**
+         * Returns the number of mesh instances
+         */
+        size_t getCount() const;
+
+        SpatialIndex(SpatialIndex&) = delete;
+        SpatialIndex& operator=(SpatialIndex&) = delete;
+
+    private:
+        // Invalid node index
+        static constexpr uint32 NONE{std::numeric_limits<uint32>::max()};
+
+        // Tree node, a leaf if child1 == NONE
+        struct Node {
+            AABB aabb;
+            uint32 parent{NONE};
+            uint32 child1{NONE};
+            uint32 child2{NONE};
+            const MeshInstance* meshInstance{nullptr};
+
+            bool isLeaf() const { return child1 == NONE; }
+        };
+
+        const float margin;
+        const float rebuildRatio;
+        std::vector<Node> nodes;
+        std::vector<uint32> freeNodes;
+        uint32 root{NONE};
+        // Leaf node of each mesh instance
+        std::unordered_map<const MeshInstance*, uint32> leaves;
+        // Number of insertions, removals and refits since the last rebuild
+        size_t changesCount{0};
+        mutable std::shared_mutex mutex;
+
+        uint32 allocateNode();
+
+        void freeNode(uint32 index);
+
+        AABB enlarge(const AABB& aabb) const;
+
+        void insertLeaf(uint32 leaf);
+
+        void removeLeaf(uint32 leaf);
+
+        void refit(uint32 index);
+
+        void updateLeaf(const MeshInstance* meshInstance);
+
+        void rebuildTree();
+
+        uint32 build(std::span<uint32> leafNodes, uint32 parent);
+
+        void countChange();
+
+        void collect(uint32 index, std::vector<const MeshInstance*>& results) const;
+
+        template<typename Overlaps>
+        void traverse(const Overlaps& overlaps, std::vector<const MeshInstance*>& results) const;
+    };
+
+}
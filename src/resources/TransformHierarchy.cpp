@@ -0,0 +1,278 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+module lysa.resources.transform_hierarchy;
+
+import lysa.exception;
+
+namespace lysa {
+
+    TransformHierarchy::TransformHierarchy(const size_t capacity) {
+        slots.reserve(capacity);
+        localTransforms.reserve(capacity);
+        worldTransforms.reserve(capacity);
+        parents.reserve(capacity);
+        firstChildren.reserve(capacity);
+        childrenCounts.reserve(capacity);
+        depths.reserve(capacity);
+        meshInstances.reserve(capacity);
+        nodeSlots.reserve(capacity);
+        dirty.reserve(capacity);
+    }
+
+    unique_id TransformHierarchy::create(
+        const float4x4& localTransform,
+        const unique_id parent,
+        MeshInstance* meshInstance) {
+        const auto parentIndex = parent == INVALID_ID ? NONE : getIndex(parent);
+        auto slotIndex = uint32{0};
+        if (freeSlots.empty()) {
+            slotIndex = static_cast<uint32>(slots.size());
+            slots.push_back({});
+        } else {
+            slotIndex = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        // New nodes are appended, they are moved to their level by the next sort()
+        const auto index = static_cast<uint32>(localTransforms.size());
+        slots[slotIndex].index = index;
+        localTransforms.push_back(localTransform);
+        worldTransforms.push_back(localTransform);
+        parents.push_back(parentIndex);
+        firstChildren.push_back(0);
+        childrenCounts.push_back(0);
+        depths.push_back(parentIndex == NONE ? 0 : depths[parentIndex] + 1);
+        meshInstances.push_back(meshInstance);
+        nodeSlots.push_back(slotIndex);
+        dirty.push_back(0);
+        markDirty(index);
+        nodesCount += 1;
+        orderDirty = true;
+        return make_handle(slotIndex, slots[slotIndex].generation);
+    }
+
+    void TransformHierarchy::destroy(const unique_id node) {
+        // The children ranges are needed to find the descendants
+        if (orderDirty) { sort(); }
+        auto removed = std::vector<uint32>{getIndex(node)};
+        for (auto i = 0; i < removed.size(); i++) {
+            const auto index = removed[i];
+            for (auto child = firstChildren[index]; child < firstChildren[index] + childrenCounts[index]; child++) {
+                removed.push_back(child);
+            }
+        }
+        for (const auto index : removed) {
+            auto& slot = slots[nodeSlots[index]];
+            slot.index = NONE;
+            slot.generation = (slot.generation + 1) & 0x7fffffffu;
+            freeSlots.push_back(nodeSlots[index]);
+            nodeSlots[index] = NONE;
+            meshInstances[index] = nullptr;
+        }
+        nodesCount -= removed.size();
+        orderDirty = true;
+    }
+
+    bool TransformHierarchy::isValid(const unique_id node) const {
+        if (node == INVALID_ID) { return false; }
+        const auto slotIndex = handle_index(node);
+        return slotIndex < slots.size() &&
+            slots[slotIndex].index != NONE &&
+            slots[slotIndex].generation == handle_generation(node);
+    }
+
+    uint32 TransformHierarchy::getIndex(const unique_id node) const {
+        assert([&]{ return isValid(node); }, "TransformHierarchy : invalid node");
+        return slots[handle_index(node)].index;
+    }
+
+    void TransformHierarchy::setParent(const unique_id node, const unique_id parent) {
+        const auto index = getIndex(node);
+        const auto parentIndex = parent == INVALID_ID ? NONE : getIndex(parent);
+        assert([&]{
+            for (auto ancestor = parentIndex; ancestor != NONE; ancestor = parents[ancestor]) {
+                if (ancestor == index) { return false; }
+            }
+            return true;
+        }, "TransformHierarchy : a node can't be moved under one of its descendants");
+        parents[index] = parentIndex;
+        markDirty(index);
+        orderDirty = true;
+    }
+
+    unique_id TransformHierarchy::getParent(const unique_id node) const {
+        const auto parentIndex = parents[getIndex(node)];
+        if (parentIndex == NONE) { return INVALID_ID; }
+        const auto slotIndex = nodeSlots[parentIndex];
+        return make_handle(slotIndex, slots[slotIndex].generation);
+    }
+
+    void TransformHierarchy::setLocalTransform(const unique_id node, const float4x4& transform) {
+        const auto index = getIndex(node);
+        localTransforms[index] = transform;
+        markDirty(index);
+    }
+
+    const float4x4& TransformHierarchy::getLocalTransform(const unique_id node) const {
+        return localTransforms[getIndex(node)];
+    }
+
+    const float4x4& TransformHierarchy::getWorldTransform(const unique_id node) const {
+        return worldTransforms[getIndex(node)];
+    }
+
+    void TransformHierarchy::setMeshInstance(const unique_id node, MeshInstance* meshInstance) {
+        const auto index = getIndex(node);
+        meshInstances[index] = meshInstance;
+        markDirty(index);
+    }
+
+    MeshInstance* TransformHierarchy::getMeshInstance(const unique_id node) const {
+        return meshInstances[getIndex(node)];
+    }
+
+    void TransformHierarchy::markDirty(const uint32 index) {
+        if (!dirty[index]) {
+            dirty[index] = 1;
+            dirtyNodes.push_back(index);
+        }
+    }
+
+    void TransformHierarchy::sort() {
+        const auto count = static_cast<uint32>(parents.size());
+        // Group the nodes by parent (counting sort), the root nodes are in the last group
+        auto groupsStart = std::vector<uint32>(count + 2, 0);
+        for (auto index = 0u; index < count; index++) {
+            if (nodeSlots[index] != NONE) {
+                groupsStart[(parents[index] == NONE ? count : parents[index]) + 1] += 1;
+            }
+        }
+        std::inclusive_scan(groupsStart.begin(), groupsStart.end(), groupsStart.begin());
+        auto grouped = std::vector<uint32>(nodesCount);
+        auto cursors = std::vector<uint32>(groupsStart.begin(), groupsStart.end() - 1);
+        for (auto index = 0u; index < count; index++) {
+            if (nodeSlots[index] != NONE) {
+                grouped[cursors[parents[index] == NONE ? count : parents[index]]++] = index;
+            }
+        }
+
+        // Breadth-first traversal : the levels are contiguous and the children of a node are contiguous
+        auto order = std::vector<uint32>{};
+        order.reserve(nodesCount);
+        order.insert(order.end(), grouped.begin() + groupsStart[count], grouped.begin() + groupsStart[count + 1]);
+        auto newIndices = std::vector<uint32>(count, NONE);
+        auto newFirstChildren = std::vector<uint32>(nodesCount);
+        auto newChildrenCounts = std::vector<uint32>(nodesCount);
+        auto newDepths = std::vector<uint32>(nodesCount);
+        levelsStart.clear();
+        for (auto i = 0u; i < order.size(); i++) {
+            const auto index = order[i];
+            const auto parent = parents[index];
+            newIndices[index] = i;
+            newDepths[i] = parent == NONE ? 0 : newDepths[newIndices[parent]] + 1;
+            if (levelsStart.size() == newDepths[i]) {
+                levelsStart.push_back(i);
+            }
+            newFirstChildren[i] = static_cast<uint32>(order.size());
+            newChildrenCounts[i] = groupsStart[index + 1] - groupsStart[index];
+            order.insert(order.end(), grouped.begin() + groupsStart[index], grouped.begin() + groupsStart[index + 1]);
+        }
+        levelsStart.push_back(static_cast<uint32>(order.size()));
+
+        auto newParents = std::vector<uint32>(nodesCount);
+        for (auto i = 0u; i < order.size(); i++) {
+            const auto parent = parents[order[i]];
+            newParents[i] = parent == NONE ? NONE : newIndices[parent];
+        }
+        const auto permute = [&]<typename T>(std::vector<T>& values) {
+            auto sorted = std::vector<T>(order.size());
+            for (auto i = 0u; i < order.size(); i++) {
+                sorted[i] = values[order[i]];
+            }
+            values = std::move(sorted);
+        };
+        permute(localTransforms);
+        permute(worldTransforms);
+        permute(meshInstances);
+        permute(nodeSlots);
+        permute(dirty);
+        parents = std::move(newParents);
+        firstChildren = std::move(newFirstChildren);
+        childrenCounts = std::move(newChildrenCounts);
+        depths = std::move(newDepths);
+
+        dirtyNodes.clear();
+        for (auto i = 0u; i < order.size(); i++) {
+            slots[nodeSlots[i]].index = i;
+            if (dirty[i]) {
+                dirtyNodes.push_back(i);
+            }
+        }
+        orderDirty = false;
+    }
+
+    void TransformHierarchy::updateNode(const uint32 index) {
+        const auto parent = parents[index];
+        worldTransforms[index] = parent == NONE ?
+            localTransforms[index] :
+            mul(localTransforms[index], worldTransforms[parent]);
+    }
+
+    uint32 TransformHierarchy::update() {
+        updatedMeshInstances.clear();
+        drivenMeshInstances.clear();
+        drivenTransforms.clear();
+        if (orderDirty) { sort(); }
+        if (dirtyNodes.empty()) { return 0; }
+        const auto levelsCount = levelsStart.size() - 1;
+        dirtyLevels.resize(levelsCount);
+        for (const auto index : dirtyNodes) {
+            dirtyLevels[depths[index]].push_back(index);
+        }
+        dirtyNodes.clear();
+        // A level only depends on the upper levels : the nodes of a level are updated in parallel
+        for (auto depth = 0; depth < levelsCount; depth++) {
+            auto& level = dirtyLevels[depth];
+            if (level.empty()) { continue; }
+            if (level.size() >= PARALLEL_THRESHOLD) {
+                std::for_each(std::execution::par, level.begin(), level.end(), [this](const uint32 index) {
+                    updateNode(index);
+                });
+            } else {
+                for (const auto index : level) {
+                    updateNode(index);
+                }
+            }
+            for (const auto index : level) {
+                dirty[index] = 0;
+                if (meshInstances[index]) {
+                    updatedMeshInstances.push_back(meshInstances[index]);
+                    drivenMeshInstances.push_back(meshInstances[index]);
+                    drivenTransforms.push_back(worldTransforms[index]);
+                }
+                // The descendants of a modified node are modified too
+                for (auto child = firstChildren[index]; child < firstChildren[index] + childrenCounts[index]; child++) {
+                    if (!dirty[child]) {
+                        dirty[child] = 1;
+                        dirtyLevels[depth + 1].push_back(child);
+                    }
+                }
+            }
+            level.clear();
+        }
+        MeshInstance::setTransforms(drivenMeshInstances, drivenTransforms);
+        return static_cast<uint32>(updatedMeshInstances.size());
+    }
+
+    uint32 TransformHierarchy::update(Scene& scene) {
+        const auto count = update();
+        if (count > 0) {
+            scene.updateInstances(updatedMeshInstances);
+        }
+        return count;
+    }
+
+}
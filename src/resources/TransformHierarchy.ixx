@@ -0,0 +1,181 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.resources.transform_hierarchy;
+
+import lysa.math;
+import lysa.types;
+import lysa.resources.manager;
+import lysa.resources.mesh_instance;
+import lysa.resources.scene;
+
+export namespace lysa {
+
+    /**
+     * Hierarchy of local transforms propagated to world transforms.
+     *
+     * The nodes are stored in structure-of-arrays form, sorted by depth in breadth-first order:
+     * the children of a node are contiguous and stored after all the nodes of the upper levels.
+     * Only the modified nodes and their descendants are updated by update(), level by level. The
+     * nodes of a level are independent of each other, large levels are updated in parallel.
+     *
+     * A node can drive a MeshInstance : the world transforms of the modified mesh instances are
+     * written with their world AABB in one batch (see MeshInstance::setTransforms()) and the
+     * modified mesh instances are sent in bulk to the scene by update(Scene&).
+     * A mesh instance must be driven by only one node.
+     *
+     * Nodes are referenced by generational handles (see make_handle()), stale handles are detected
+     * by isValid(). Structural changes (create, destroy, setParent) re-sort the arrays on the next update.
+     */
+    class TransformHierarchy {
+    public:
+        /**
+         * Creates an empty hierarchy.
+         * @param capacity Number of nodes to reserve memory for
+         */
+        TransformHierarchy(size_t capacity = 0);
+
+        /**
+         * Creates a node.
+         * @param localTransform Transform relative to the parent node
+         * @param parent Parent node, INVALID_ID for a root node
+         * @param meshInstance Optional mesh instance driven by the node
+         * @return The handle of the node
+         */
+        unique_id create(
+            const float4x4& localTransform = float4x4::identity(),
+            unique_id parent = INVALID_ID,
+            MeshInstance* meshInstance = nullptr);
+
+        /**
+         * Destroys a node and all its descendants.
+         */
+        void destroy(unique_id node);
+
+        /**
+         * Returns true if the handle references an existing node.
+         */
+        bool isValid(unique_id node) const;
+
+        /**
+         * Moves a node and its descendants under another parent.
+         * @param node Node to move
+         * @param parent New parent node, INVALID_ID to make the node a root node
+         */
+        void setParent(unique_id node, unique_id parent);
+
+        /**
+         * Returns the parent of a node, INVALID_ID for a root node.
+         */
+        unique_id getParent(unique_id node) const;
+
+        /**
+         * Sets the transform of a node relative to its parent and marks the node and its descendants as modified.
+         */
+        void setLocalTransform(unique_id node, const float4x4& transform);
+
+        /**
+         * Returns the transform of a node relative to its parent.
+         */
+        const float4x4& getLocalTransform(unique_id node) const;
+
+        /**
+         * Returns the world transform of a node, as computed by the last update().
+         */
+        const float4x4& getWorldTransform(unique_id node) const;
+
+        /**
+         * Sets the mesh instance driven by a node, nullptr to detach the current one.
+         */
+        void setMeshInstance(unique_id node, MeshInstance* meshInstance);
+
+        /**
+         * Returns the mesh instance driven by a node, or nullptr.
+         */
+        MeshInstance* getMeshInstance(unique_id node) const;
+
+        /**
+         * Propagates the local transforms of the modified nodes to the world transforms of their subtrees
+         * and updates the world transforms of the driven mesh instances.
+         * @return Number of updated mesh instances
+         */
+        uint32 update();
+
+        /**
+         * Same as update(), the updated mesh instances are then sent to the scene with Scene::updateInstances().
+         * All the driven mesh instances must belong to the scene.
+         * @return Number of updated mesh instances
+         */
+        uint32 update(Scene& scene);
+
+        /**
+         * Returns the mesh instances updated by the last update().
+         */
+        const auto& getUpdatedMeshInstances() const { return updatedMeshInstances; }
+
+        /**
+         * Returns the number of nodes.
+         */
+        auto getCount() const { return nodesCount; }
+
+        /**
+         * Returns the depth of the deepest level plus one, as sorted by the last update().
+         */
+        auto getLevelsCount() const { return levelsStart.empty() ? 0 : levelsStart.size() - 1; }
+
+        TransformHierarchy(TransformHierarchy&) = delete;
+        TransformHierarchy& operator=(TransformHierarchy&) = delete;
+
+    private:
+        // Parent index of root nodes & slot index of destroyed nodes
+        static constexpr uint32 NONE{std::numeric_limits<uint32>::max()};
+        // Minimum number of nodes in a level to update it in parallel
+        static constexpr size_t PARALLEL_THRESHOLD{1024};
+
+        // Handle slot, index of the node in the arrays
+        struct Slot {
+            uint32 index{NONE};
+            uint32 generation{0};
+        };
+        std::vector<Slot> slots;
+        std::vector<uint32> freeSlots;
+        size_t nodesCount{0};
+
+        // Nodes arrays, indexed by node index
+        std::vector<float4x4> localTransforms;
+        std::vector<float4x4> worldTransforms;
+        std::vector<uint32> parents;
+        std::vector<uint32> firstChildren;
+        std::vector<uint32> childrenCounts;
+        std::vector<uint32> depths;
+        std::vector<MeshInstance*> meshInstances;
+        std::vector<uint32> nodeSlots;
+        std::vector<uint8> dirty;
+
+        // First node index of each level, plus the end of the last level
+        std::vector<uint32> levelsStart;
+        // Nodes modified since the last update, not including their descendants
+        std::vector<uint32> dirtyNodes;
+        // Set by the structural changes, the arrays must be sorted again
+        bool orderDirty{false};
+        // Result of the last update
+        std::vector<const MeshInstance*> updatedMeshInstances;
+        // Updated mesh instances and their world transforms, for MeshInstance::setTransforms()
+        std::vector<MeshInstance*> drivenMeshInstances;
+        std::vector<float4x4> drivenTransforms;
+        // Modified nodes of each level, kept between updates to avoid allocations
+        std::vector<std::vector<uint32>> dirtyLevels;
+
+        uint32 getIndex(unique_id node) const;
+
+        void markDirty(uint32 index);
+
+        void sort();
+
+        void updateNode(uint32 index);
+    };
+
+}
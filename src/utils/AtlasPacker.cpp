@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2025-present Henri Michelon
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+*/
+module lysa.atlas_packer;
+
+namespace lysa {
+
+    AtlasPacker::AtlasPacker(const uint32 size, const uint32 minSize) :
+        size{std::bit_ceil(size)},
+        minSize{std::min(std::bit_ceil(minSize), std::bit_ceil(size))} {
+        freeAreas.resize(getLevel(this->minSize) + 1);
+        freeAreas[0].insert({0, 0});
+    }
+
+    uint32 AtlasPacker::getLevel(const uint32 areaSize) const {
+        return static_cast<uint32>(std::countr_zero(size) - std::countr_zero(areaSize));
+    }
+
+    AtlasPacker::Area AtlasPacker::allocate(const uint32 requestedSize) {
+        const auto areaSize = std::max(std::bit_ceil(requestedSize), minSize);
+        if (areaSize > size) { return {}; }
+        const auto level = getLevel(areaSize);
+        // Smallest free quadrant containing the area
+        auto freeLevel = static_cast<int32>(level);
+        while (freeLevel >= 0 && freeAreas[freeLevel].empty()) {
+            freeLevel--;
+        }
+        if (freeLevel < 0) { return {}; }
+        auto [y, x] = *freeAreas[freeLevel].begin();
+        freeAreas[freeLevel].erase(freeAreas[freeLevel].begin());
+        // Split it down to the area size, keeping the top-left quadrant of each split
+        for (auto splitLevel = freeLevel + 1; splitLevel <= level; splitLevel++) {
+            const auto half = size >> splitLevel;
+            freeAreas[splitLevel].insert({y, x + half});
+            freeAreas[splitLevel].insert({y + half, x});
+            freeAreas[splitLevel].insert({y + half, x + half});
+        }
+        usedArea += static_cast<uint64>(areaSize) * areaSize;
+        return {x, y, areaSize};
+    }
+
+    void AtlasPacker::free(const Area& area) {
+        if (area.size == 0) { return; }
+        usedArea -= static_cast<uint64>(area.size) * area.size;
+        auto x = area.x;
+        auto y = area.y;
+        auto level = getLevel(area.size);
+        // Merge with the three other quadrants of the parent while they are free
+        while (level > 0) {
+            const auto parentSize = size >> (level - 1);
+            const auto parentX = x & ~(parentSize - 1);
+            const auto parentY = y & ~(parentSize - 1);
+            const auto half = parentSize / 2;
+            const std::pair<uint32, uint32> quadrants[] = {
+                {parentY, parentX}, {parentY, parentX + half},
+                {parentY + half, parentX}, {parentY + half, parentX + half} };
+            auto& levelAreas = freeAreas[level];
+            const auto mergeable = std::ranges::all_of(quadrants, [&](const auto& quadrant) {
+                return quadrant == std::pair{y, x} || levelAreas.contains(quadrant);
+            });
+            if (!mergeable) { break; }
+            for (const auto& quadrant : quadrants) {
+                levelAreas.erase(quadrant);
+            }
+            x = parentX;
+            y = parentY;
+            level--;
+        }
+        freeAreas[level].insert({y, x});
+    }
+
+}
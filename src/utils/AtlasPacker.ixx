@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2025-present Henri Michelon
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+*/
+export module lysa.atlas_packer;
+
+import lysa.math;
+
+export namespace lysa {
+
+    /**
+     * Allocates square areas with a power of two size in a square atlas.
+     *
+     * The atlas is recursively split in four quadrants (a quadtree buddy allocator), an area is
+     * taken from the smallest free quadrant large enough and a freed area is merged back with its
+     * three free neighbors. The areas can be allocated and freed one by one without moving the
+     * others, and the free space stays in large quadrants.
+     */
+    class AtlasPacker {
+    public:
+        /**
+         * Allocated area, in texels from the top-left corner of the atlas
+         */
+        struct Area {
+            uint32 x{0};
+            uint32 y{0};
+            //! Width and height, 0 for no area
+            uint32 size{0};
+
+            bool operator==(const Area&) const = default;
+        };
+
+        /**
+         * Creates an empty atlas
+         * @param size Width and height of the atlas, rounded up to a power of two
+         * @param minSize Size of the smallest areas, rounded up to a power of two
+         */
+        AtlasPacker(uint32 size, uint32 minSize);
+
+        /**
+         * Allocates an area
+         * @param size Requested size, rounded up to a power of two and to the smallest areas size
+         * @return The area, or an empty area if there is no free quadrant large enough
+         */
+        Area allocate(uint32 size);
+
+        /**
+         * Frees an area returned by allocate(), ignores an empty area
+         */
+        void free(const Area& area);
+
+        /**
+         * Returns the width and height of the atlas
+         */
+        auto getSize() const { return size; }
+
+        /**
+         * Returns the number of allocated texels
+         */
+        auto getUsedArea() const { return usedArea; }
+
+    private:
+        const uint32 size;
+        const uint32 minSize;
+        uint64 usedArea{0};
+        // Free quadrants of each level, {y, x} for the allocations to fill the atlas from its top-left corner.
+        // The quadrants of the level i are of size >> i.
+        std::vector<std::set<std::pair<uint32, uint32>>> freeAreas;
+
+        uint32 getLevel(uint32 areaSize) const;
+    };
+
+}
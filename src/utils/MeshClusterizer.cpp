@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2025-present Henri Michelon
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+*/
+module lysa.mesh_clusterizer;
+
+namespace lysa {
+
+    MeshClusterizer::MeshClusterizer(const std::vector<float3>& positions, const std::span<uint32> indices) {
+        const auto trianglesCount = static_cast<uint32>(indices.size() / 3);
+        auto vertexTriangles = std::unordered_map<uint32, std::vector<uint32>>{};
+        for (auto triangle = 0u; triangle < trianglesCount; triangle++) {
+            for (auto corner = 0; corner < 3; corner++) {
+                vertexTriangles[indices[triangle * 3 + corner]].push_back(triangle);
+            }
+        }
+
+        auto clustered = std::vector<uint32>{};
+        clustered.reserve(trianglesCount * 3);
+        auto assigned = std::vector<bool>(trianglesCount, false);
+        auto nextSeed = 0u;
+        while (clustered.size() < trianglesCount * 3) {
+            while (assigned[nextSeed]) { nextSeed++; }
+            const auto firstIndex = static_cast<uint32>(clustered.size());
+            auto vertices = std::unordered_set<uint32>{};
+            auto frontier = std::vector<uint32>{ nextSeed };
+            auto clusterTriangles = 0u;
+            while (clusterTriangles < MESH_CLUSTER_MAX_TRIANGLES) {
+                // Neighbor triangle adding the fewest vertices, the first one on ties to keep the source order
+                auto best = std::optional<uint32>{};
+                auto bestNewVertices = 4u;
+                std::erase_if(frontier, [&](const uint32 triangle) { return assigned[triangle]; });
+                for (const auto triangle : frontier) {
+                    auto newVertices = 0u;
+                    for (auto corner = 0; corner < 3; corner++) {
+                        newVertices += vertices.contains(indices[triangle * 3 + corner]) ? 0 : 1;
+                    }
+                    if (newVertices < bestNewVertices || (newVertices == bestNewVertices && triangle < *best)) {
+                        best = triangle;
+                        bestNewVertices = newVertices;
+                    }
+                }
+                if (!best || vertices.size() + bestNewVertices > MESH_CLUSTER_MAX_VERTICES) {
+                    break;
+                }
+                assigned[*best] = true;
+                clusterTriangles++;
+                for (auto corner = 0; corner < 3; corner++) {
+                    const auto vertex = indices[*best * 3 + corner];
+                    clustered.push_back(vertex);
+                    if (vertices.insert(vertex).second) {
+                        const auto& neighbors = vertexTriangles[vertex];
+                        frontier.insert(frontier.end(), neighbors.begin(), neighbors.end());
+                    }
+                }
+            }
+            auto cluster = computeBounds(positions, std::span<const uint32>{clustered}.subspan(firstIndex));
+            cluster.firstIndex = firstIndex;
+            cluster.indexCount = static_cast<uint32>(clustered.size()) - firstIndex;
+            clusters.push_back(cluster);
+        }
+        std::ranges::copy(clustered, indices.begin());
+    }
+
+    MeshClusterizer::Cluster MeshClusterizer::computeBounds(
+        const std::vector<float3>& positions,
+        const std::span<const uint32> indices) {
+        auto cluster = Cluster{};
+        auto boundsMin = float3{std::numeric_limits<float>::max()};
+        auto boundsMax = float3{std::numeric_limits<float>::lowest()};
+        for (const auto index : indices) {
+            boundsMin = min(boundsMin, positions[index]);
+            boundsMax = max(boundsMax, positions[index]);
+        }
+        cluster.center = (boundsMin + boundsMax) * 0.5f;
+        for (const auto index : indices) {
+            cluster.radius = std::max(cluster.radius, static_cast<float>(length(positions[index] - cluster.center)));
+        }
+
+        // Normal cone : the cluster is back facing for all the points of view outside the cone
+        auto normals = std::vector<float3>{};
+        auto axis = float3{0.0f};
+        for (auto i = 0; i + 2 < indices.size(); i += 3) {
+            const auto& p0 = positions[indices[i]];
+            const auto normal = cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+            const auto area = length(normal);
+            if (area <= 0.0f) { continue; }
+            normals.push_back(normal / area);
+            axis += normal;
+        }
+        const auto axisLength = length(axis);
+        if (axisLength <= 0.0f) {
+            return cluster;
+        }
+        cluster.coneAxis = axis / axisLength;
+        auto minDot = 1.0f;
+        for (const auto& normal : normals) {
+            minDot = std::min(minDot, static_cast<float>(dot(normal, cluster.coneAxis)));
+        }
+        // A cone wider than a half-space never culls anything
+        if (minDot > 0.1f) {
+            cluster.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+        return cluster;
+    }
+
+}
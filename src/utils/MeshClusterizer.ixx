@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2025-present Henri Michelon
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+*/
+export module lysa.mesh_clusterizer;
+
+import lysa.math;
+
+export namespace lysa {
+
+    /**
+     * Maximum number of distinct vertices of a mesh cluster
+     */
+    constexpr uint32 MESH_CLUSTER_MAX_VERTICES{64};
+
+    /**
+     * Maximum number of triangles of a mesh cluster
+     */
+    constexpr uint32 MESH_CLUSTER_MAX_TRIANGLES{124};
+
+    /**
+     * Splits a triangle list in small clusters of neighbor triangles (meshlets) that can be
+     * culled independently.
+     *
+     * The triangles are reordered in place so each cluster is a contiguous range of indices
+     * drawn with a regular indexed draw. A cluster grows from a seed triangle by adding the
+     * neighbor triangle sharing the most vertices with it, until it reaches
+     * MESH_CLUSTER_MAX_VERTICES or MESH_CLUSTER_MAX_TRIANGLES.
+     */
+    class MeshClusterizer {
+    public:
+        /**
+         * Range of triangles and bounds of a cluster
+         */
+        struct Cluster {
+            //! Index of the first index of the cluster, relative to the start of the triangle list
+            uint32 firstIndex{0};
+            //! Number of indices
+            uint32 indexCount{0};
+            //! Center of the bounding sphere
+            float3 center{0.0f};
+            //! Radius of the bounding sphere
+            float radius{0.0f};
+            //! Mean normal of the triangles
+            float3 coneAxis{0.0f, 0.0f, 1.0f};
+            //! Sine of the largest angle between the normals and the axis, 1 if the cluster can face any direction
+            float coneCutoff{1.0f};
+        };
+
+        /**
+         * Clusters and reorders a triangle list
+         * @param positions Positions of all the vertices indexed by indices
+         * @param indices Counterclockwise triangles, reordered cluster by cluster
+         */
+        MeshClusterizer(const std::vector<float3>& positions, std::span<uint32> indices);
+
+        /**
+         * Returns the clusters, in the order of their triangles
+         */
+        const auto& getClusters() const { return clusters; }
+
+    private:
+        std::vector<Cluster> clusters;
+
+        static Cluster computeBounds(const std::vector<float3>& positions, std::span<const uint32> indices);
+    };
+
+}
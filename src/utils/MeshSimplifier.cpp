@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2025-present Henri Michelon
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+*/
+module lysa.mesh_simplifier;
+
+namespace lysa {
+
+    MeshSimplifier::Quadric& MeshSimplifier::Quadric::operator+=(const Quadric& other) {
+        a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+        b2 += other.b2; bc += other.bc; bd += other.bd;
+        c2 += other.c2; cd += other.cd;
+        d2 += other.d2;
+        weight += other.weight;
+        return *this;
+    }
+
+    double MeshSimplifier::Quadric::evaluate(const float3& point) const {
+        const double x = point.x;
+        const double y = point.y;
+        const double z = point.z;
+        const auto sum = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x +
+                         b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y +
+                         c2 * z * z + 2.0 * cd * z +
+                         d2;
+        return weight > 0.0 ? std::max(sum / weight, 0.0) : 0.0;
+    }
+
+    MeshSimplifier::Quadric MeshSimplifier::Quadric::fromPlane(const float3& normal, const float distance, const float weight) {
+        const double a = normal.x;
+        const double b = normal.y;
+        const double c = normal.z;
+        const double d = distance;
+        const double w = weight;
+        return {
+            w * a * a, w * a * b, w * a * c, w * a * d,
+            w * b * b, w * b * c, w * b * d,
+            w * c * c, w * c * d,
+            w * d * d,
+            w,
+        };
+    }
+
+    MeshSimplifier::MeshSimplifier(const std::vector<float3>& positions, const std::span<const uint32> indices) :
+        positions{positions} {
+        // Weld the vertices by position, the attributes seams must not open
+        classes.resize(positions.size());
+        auto positionsClasses = std::map<std::array<uint32, 3>, uint32>{};
+        for (auto i = 0; i < positions.size(); i++) {
+            const auto key = std::array<uint32, 3>{
+                std::bit_cast<uint32>(static_cast<float>(positions[i].x)),
+                std::bit_cast<uint32>(static_cast<float>(positions[i].y)),
+                std::bit_cast<uint32>(static_cast<float>(positions[i].z)),
+            };
+            classes[i] = positionsClasses.try_emplace(key, static_cast<uint32>(i)).first->second;
+        }
+
+        triangles.reserve(indices.size() / 3);
+        auto edges = std::map<std::pair<uint32, uint32>, uint32>{};
+        for (auto i = 0; i + 2 < indices.size(); i += 3) {
+            const auto triangle = std::array<uint32, 3>{ indices[i], indices[i + 1], indices[i + 2] };
+            const auto a = classOf(triangle[0]);
+            const auto b = classOf(triangle[1]);
+            const auto c = classOf(triangle[2]);
+            if (a == b || b == c || a == c) { continue; }
+            const auto triangleIndex = static_cast<uint32>(triangles.size());
+            triangles.push_back(triangle);
+
+            const auto& p0 = positions[a];
+            const auto normal = cross(positions[b] - p0, positions[c] - p0);
+            const auto area = length(normal);
+            if (area > 0.0f) {
+                const auto unitNormal = normal / area;
+                const auto plane = Quadric::fromPlane(unitNormal, -dot(unitNormal, p0), area * 0.5f);
+                for (const auto vertexClass : { a, b, c }) {
+                    quadrics[vertexClass] += plane;
+                }
+            }
+            for (const auto vertexClass : { a, b, c }) {
+                classTriangles[vertexClass].push_back(triangleIndex);
+            }
+            for (const auto& [from, to] : { std::pair{a, b}, std::pair{b, c}, std::pair{c, a} }) {
+                edges[{std::min(from, to), std::max(from, to)}]++;
+            }
+        }
+        removedTriangles.resize(triangles.size(), false);
+        trianglesCount = static_cast<uint32>(triangles.size());
+
+        // Open borders and non-manifold edges keep their vertices
+        for (const auto& [edge, count] : edges) {
+            if (count != 2) {
+                lockedClasses.insert(edge.first);
+                lockedClasses.insert(edge.second);
+            }
+        }
+        for (const auto& edge : std::views::keys(edges)) {
+            pushCollapses(edge.first, edge.second);
+        }
+    }
+
+    MeshSimplifier::Level MeshSimplifier::simplify(const uint32 targetIndexCount, const float maxError) {
+        const auto maxCost = static_cast<double>(maxError) * static_cast<double>(maxError);
+        while (trianglesCount * 3 > targetIndexCount && !collapses.empty()) {
+            const auto candidate = collapses.top();
+            if (removedClasses.contains(candidate.from) ||
+                removedClasses.contains(candidate.to) ||
+                versions[candidate.from] != candidate.fromVersion ||
+                versions[candidate.to] != candidate.toVersion) {
+                collapses.pop();
+                continue;
+            }
+            if (candidate.cost > maxCost) {
+                // Kept for a next call with a higher maximum error
+                break;
+            }
+            collapses.pop();
+            // An invalid collapse is pushed again when the neighborhood of its vertices changes
+            if (isValid(candidate)) {
+                collapse(candidate);
+            }
+        }
+
+        auto level = Level{ .error = static_cast<float>(std::sqrt(error)) };
+        level.indices.reserve(trianglesCount * 3);
+        for (auto i = 0; i < triangles.size(); i++) {
+            if (!removedTriangles[i]) {
+                level.indices.insert(level.indices.end(), triangles[i].begin(), triangles[i].end());
+            }
+        }
+        return level;
+    }
+
+    void MeshSimplifier::pushCollapses(const uint32 a, const uint32 b) {
+        auto quadric = quadrics[a];
+        quadric += quadrics[b];
+        if (!lockedClasses.contains(a)) {
+            collapses.push({ quadric.evaluate(positions[b]), a, b, versions[a], versions[b] });
+        }
+        if (!lockedClasses.contains(b)) {
+            collapses.push({ quadric.evaluate(positions[a]), b, a, versions[b], versions[a] });
+        }
+    }
+
+    std::unordered_set<uint32> MeshSimplifier::getNeighbors(const uint32 vertexClass) const {
+        auto neighbors = std::unordered_set<uint32>{};
+        for (const auto triangleIndex : classTriangles.at(vertexClass)) {
+            if (removedTriangles[triangleIndex]) { continue; }
+            for (const auto vertex : triangles[triangleIndex]) {
+                if (classOf(vertex) != vertexClass) {
+                    neighbors.insert(classOf(vertex));
+                }
+            }
+        }
+        return neighbors;
+    }
+
+    bool MeshSimplifier::isValid(const Collapse& collapse) const {
+        // Link condition : the two vertices only share the opposite vertices of the collapsed edge,
+        // otherwise the collapse pinches the surface
+        auto sharedTriangles = 0;
+        for (const auto triangleIndex : classTriangles.at(collapse.from)) {
+            if (removedTriangles[triangleIndex]) { continue; }
+            for (const auto vertex : triangles[triangleIndex]) {
+                if (classOf(vertex) == collapse.to) {
+                    sharedTriangles++;
+                    break;
+                }
+            }
+        }
+        const auto toNeighbors = getNeighbors(collapse.to);
+        auto sharedNeighbors = 0;
+        for (const auto neighbor : getNeighbors(collapse.from)) {
+            if (toNeighbors.contains(neighbor)) { sharedNeighbors++; }
+        }
+        if (sharedNeighbors != sharedTriangles) { return false; }
+
+        // The moved triangles must not flip nor become degenerate
+        const auto& target = positions[collapse.to];
+        for (const auto triangleIndex : classTriangles.at(collapse.from)) {
+            if (removedTriangles[triangleIndex]) { continue; }
+            const auto& triangle = triangles[triangleIndex];
+            float3 corners[3];
+            auto collapsed = false;
+            for (auto i = 0; i < 3; i++) {
+                const auto vertexClass = classOf(triangle[i]);
+                collapsed |= vertexClass == collapse.to;
+                corners[i] = positions[vertexClass];
+            }
+            if (collapsed) { continue; }
+            const auto before = cross(corners[1] - corners[0], corners[2] - corners[0]);
+            for (auto i = 0; i < 3; i++) {
+                if (classOf(triangle[i]) == collapse.from) {
+                    corners[i] = target;
+                }
+            }
+            const auto after = cross(corners[1] - corners[0], corners[2] - corners[0]);
+            if (dot(before, after) <= 0.0f || length(after) <= length(before) * 1e-3f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void MeshSimplifier::collapse(const Collapse& collapse) {
+        auto& fromTriangles = classTriangles[collapse.from];
+        auto& toTriangles = classTriangles[collapse.to];
+
+        // Each moved vertex takes the attributes of the vertex it is welded to in a removed triangle
+        auto replacements = std::unordered_map<uint32, uint32>{};
+        for (const auto triangleIndex : fromTriangles) {
+            if (removedTriangles[triangleIndex]) { continue; }
+            const auto& triangle = triangles[triangleIndex];
+            auto from = std::optional<uint32>{};
+            auto to = std::optional<uint32>{};
+            for (const auto vertex : triangle) {
+                if (classOf(vertex) == collapse.from) { from = vertex; }
+                if (classOf(vertex) == collapse.to) { to = vertex; }
+            }
+            if (from && to) {
+                replacements.try_emplace(*from, *to);
+                removedTriangles[triangleIndex] = true;
+                trianglesCount--;
+            }
+        }
+        for (const auto triangleIndex : fromTriangles) {
+            if (removedTriangles[triangleIndex]) { continue; }
+            for (auto& vertex : triangles[triangleIndex]) {
+                if (classOf(vertex) == collapse.from) {
+                    const auto it = replacements.find(vertex);
+                    vertex = it == replacements.end() ? collapse.to : it->second;
+                }
+            }
+            toTriangles.push_back(triangleIndex);
+        }
+        std::erase_if(toTriangles, [&](const uint32 triangleIndex) { return removedTriangles[triangleIndex]; });
+
+        quadrics[collapse.to] += quadrics[collapse.from];
+        removedClasses.insert(collapse.from);
+        classTriangles.erase(collapse.from);
+        versions[collapse.to]++;
+        error = std::max(error, collapse.cost);
+
+        for (const auto neighbor : getNeighbors(collapse.to)) {
+            pushCollapses(collapse.to, neighbor);
+        }
+    }
+
+}
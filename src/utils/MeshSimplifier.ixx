@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2025-present Henri Michelon
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+*/
+export module lysa.mesh_simplifier;
+
+import lysa.math;
+
+export namespace lysa {
+
+    /**
+     * Simplifies a triangle list with successive edge collapses ordered by quadric error.
+     *
+     * Each collapse moves a vertex onto one of its neighbors, so the simplified triangles
+     * index the vertices of the source mesh and share its vertex buffer. The vertices at
+     * the same position are collapsed together, the vertices on an open border or on a
+     * non-manifold edge are never moved.
+     *
+     * The simplification can be continued by calling simplify() again with a lower target,
+     * each level being built from the previous one.
+     */
+    class MeshSimplifier {
+    public:
+        /**
+         * Simplified triangle list
+         */
+        struct Level {
+            //! Indices of the remaining triangles, in the source vertices
+            std::vector<uint32> indices;
+            //! Largest mean distance of a collapsed vertex to its source triangles, in the positions space
+            float error{0.0f};
+        };
+
+        /**
+         * Prepares the simplification of a triangle list
+         * @param positions Positions of all the vertices indexed by indices
+         * @param indices Counterclockwise triangles
+         */
+        MeshSimplifier(const std::vector<float3>& positions, std::span<const uint32> indices);
+
+        /**
+         * Collapses edges until the triangle list fits in targetIndexCount or until no
+         * collapse can be done under maxError, and returns the remaining triangles.
+         * @param targetIndexCount Maximum number of indices of the simplified triangle list
+         * @param maxError Maximum error of the collapses, in the positions space
+         */
+        Level simplify(uint32 targetIndexCount, float maxError = std::numeric_limits<float>::max());
+
+    private:
+        // Sum of the squared distances to a set of planes, weighted by the areas of their triangles
+        struct Quadric {
+            double a2{0}, ab{0}, ac{0}, ad{0};
+            double b2{0}, bc{0}, bd{0};
+            double c2{0}, cd{0};
+            double d2{0};
+            double weight{0};
+
+            Quadric& operator+=(const Quadric& other);
+
+            // Mean squared distance to the planes
+            double evaluate(const float3& point) const;
+
+            static Quadric fromPlane(const float3& normal, float distance, float weight);
+        };
+
+        // Moves the vertices of the class from onto the position of the class to
+        struct Collapse {
+            double cost;
+            uint32 from;
+            uint32 to;
+            uint32 fromVersion;
+            uint32 toVersion;
+
+            bool operator>(const Collapse& other) const {
+                return cost > other.cost || (cost == other.cost && (from > other.from || (from == other.from && to > other.to)));
+            }
+        };
+
+        const std::vector<float3>& positions;
+        // Vertices at the same position share a class, identified by the first of them
+        std::vector<uint32> classes;
+        std::vector<std::array<uint32, 3>> triangles;
+        std::vector<bool> removedTriangles;
+        uint32 trianglesCount{0};
+        // Triangles using each class, including the removed ones until the next collapse on the class
+        std::unordered_map<uint32, std::vector<uint32>> classTriangles;
+        std::unordered_map<uint32, Quadric> quadrics;
+        std::unordered_map<uint32, uint32> versions;
+        std::unordered_set<uint32> lockedClasses;
+        std::unordered_set<uint32> removedClasses;
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> collapses;
+        double error{0.0};
+
+        uint32 classOf(uint32 vertex) const { return classes[vertex]; }
+
+        void pushCollapses(uint32 a, uint32 b);
+
+        bool isValid(const Collapse& collapse) const;
+
+        void collapse(const Collapse& collapse);
+
+        std::unordered_set<uint32> getNeighbors(uint32 vertexClass) const;
+    };
+
+}
@@ -0,0 +1,143 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import std;
+import lysa.math;
+import lysa.renderers.pipelines.light_clustering;
+import lysa.resources.camera;
+import lysa.resources.light;
+import lysa.test;
+
+namespace lysa {
+
+    LightData omniLight(const float3& position, const float range) {
+        return LightData{
+            .type = static_cast<int32>(LightType::LIGHT_OMNI),
+            .range = range,
+            .position = float4{position, 1.0f},
+        };
+    }
+
+    // Cluster of a world space point in the view of the camera
+    uint32 clusterOf(const Camera& camera, const float3& point) {
+        const auto viewPoint = mul(float4{point, 1.0f}, inverse(camera.transform));
+        const auto clip = mul(float4{viewPoint.xyz, 1.0f}, camera.projection);
+        const auto ndc = clip.xy / clip.w;
+        const auto slices = LightClustering::getSliceScaleBias(camera);
+        const auto tile = [](const float coordinate, const uint32 count) {
+            return std::clamp(
+                static_cast<uint32>((coordinate * 0.5f + 0.5f) * static_cast<float>(count)),
+                0u, count - 1);
+        };
+        const auto slice = std::clamp(
+            static_cast<uint32>(std::log(-static_cast<float>(viewPoint.z)) * slices.x + slices.y),
+            0u, LIGHTS_CLUSTERS_Z - 1);
+        return tile(ndc.x, LIGHTS_CLUSTERS_X) +
+               tile(ndc.y, LIGHTS_CLUSTERS_Y) * LIGHTS_CLUSTERS_X +
+               slice * LIGHTS_CLUSTERS_X * LIGHTS_CLUSTERS_Y;
+    }
+
+    bool clusterContains(const LightClusters& clusters, const uint32 cluster, const uint32 light) {
+        const auto first = clusters.lights.begin() + cluster * LIGHTS_CLUSTER_MAX_LIGHTS;
+        return std::find(first, first + clusters.lightsCounts[cluster], light) != first + clusters.lightsCounts[cluster];
+    }
+
+    uint32 clustersContaining(const LightClusters& clusters, const uint32 light) {
+        auto count = 0u;
+        for (auto cluster = 0u; cluster < LIGHTS_CLUSTERS_COUNT; cluster++) {
+            if (clusterContains(clusters, cluster, light)) { count++; }
+        }
+        return count;
+    }
+
+    void lightClusteringPerspective() {
+        // Moved away from the origin to check the view transform
+        const auto camera = Camera{
+            float4x4::translation(float3{100.0f, 0.0f, 0.0f}),
+            perspective(radians(90.0f), 16.0f / 9.0f, 0.1f, 100.0f),
+            0.1f, 100.0f};
+        const auto lights = std::vector{
+            omniLight(float3{100.0f, 0.0f, -10.0f}, 1.0f),
+            omniLight(float3{0.0f, 0.0f, -10.0f}, 1.0f),
+        };
+        const auto clusters = LightClustering::assignLights(camera, lights);
+        const auto lightCluster = clusterOf(camera, float3{100.0f, 0.0f, -10.0f});
+        test::check(clusterContains(clusters, lightCluster, 0), "light missing from the cluster of its center");
+        const auto farCluster = clusterOf(camera, float3{130.0f, 15.0f, -50.0f});
+        test::check(farCluster != lightCluster, "same clusters");
+        test::check(!clusterContains(clusters, farCluster, 0), "light in a distant cluster");
+        // The light is only a few clusters wide
+        const auto count = clustersContaining(clusters, 0);
+        test::check(count > 0 && count < 64, std::format("light in {} clusters", count));
+        test::check(clustersContaining(clusters, 1) == 0, "light behind the camera frustum in a cluster");
+        test::check(clusters.overflowCount == 0, "overflow without overflowing lights");
+    }
+
+    void lightClusteringOrthographic() {
+        const auto camera = Camera{
+            float4x4::identity(),
+            orthographic(-10.0f, 10.0f, 10.0f, -10.0f, 0.1f, 100.0f),
+            0.1f, 100.0f};
+        const auto lights = std::vector{
+            omniLight(float3{5.0f, 5.0f, -20.0f}, 1.0f),
+            omniLight(float3{50.0f, 0.0f, -20.0f}, 1.0f),
+        };
+        const auto clusters = LightClustering::assignLights(camera, lights);
+        test::check(clusterContains(clusters, clusterOf(camera, float3{5.0f, 5.0f, -20.0f}), 0),
+            "light missing from the cluster of its center");
+        test::check(!clusterContains(clusters, clusterOf(camera, float3{-5.0f, -5.0f, -20.0f}), 0),
+            "light in a distant cluster");
+        test::check(clustersContaining(clusters, 1) == 0, "light outside of the view in a cluster");
+    }
+
+    void lightClusteringDirectional() {
+        const auto camera = Camera{
+            float4x4::identity(),
+            perspective(radians(60.0f), 1.0f, 0.5f, 500.0f),
+            0.5f, 500.0f};
+        const auto lights = std::vector{
+            LightData{ .type = static_cast<int32>(LightType::LIGHT_DIRECTIONAL) },
+            // Invisible light, covering the whole frustum
+            LightData{ .type = -1, .range = 1000.0f, .position = float4{0.0f, 0.0f, -10.0f, 1.0f} },
+        };
+        const auto clusters = LightClustering::assignLights(camera, lights);
+        for (auto cluster = 0u; cluster < LIGHTS_CLUSTERS_COUNT; cluster++) {
+            test::check(clusters.lightsCounts[cluster] == 1, std::format("cluster {} has {} lights", cluster, clusters.lightsCounts[cluster]));
+            test::check(clusters.lights[cluster * LIGHTS_CLUSTER_MAX_LIGHTS] == 0, "directional light missing");
+        }
+    }
+
+    void lightClusteringOverflow() {
+        const auto camera = Camera{
+            float4x4::identity(),
+            perspective(radians(75.0f), 16.0f / 9.0f, 0.1f, 100.0f),
+            0.1f, 100.0f};
+        auto lights = std::vector<LightData>{};
+        for (auto i = 0u; i < LIGHTS_CLUSTER_MAX_LIGHTS + 44; i++) {
+            lights.push_back(omniLight(float3{0.0f, 0.0f, -10.0f}, 1000.0f));
+        }
+        const auto clusters = LightClustering::assignLights(camera, lights);
+        for (auto cluster = 0u; cluster < LIGHTS_CLUSTERS_COUNT; cluster++) {
+            test::check(clusters.lightsCounts[cluster] == LIGHTS_CLUSTER_MAX_LIGHTS,
+                std::format("cluster {} has {} lights", cluster, clusters.lightsCounts[cluster]));
+            // The first lights are kept, in order
+            for (auto light = 0u; light < LIGHTS_CLUSTER_MAX_LIGHTS; light++) {
+                test::check(clusters.lights[cluster * LIGHTS_CLUSTER_MAX_LIGHTS + light] == light,
+                    std::format("light {} of cluster {} out of order", light, cluster));
+            }
+        }
+        test::check(clusters.overflowCount == LIGHTS_CLUSTERS_COUNT,
+            std::format("{} overflowed clusters", clusters.overflowCount));
+    }
+
+    const auto lightClusteringRegistrations = std::array{
+        test::Registration{"LightClustering/perspective camera", lightClusteringPerspective},
+        test::Registration{"LightClustering/orthographic camera", lightClusteringOrthographic},
+        test::Registration{"LightClustering/directional lights", lightClusteringDirectional},
+        test::Registration{"LightClustering/clusters overflow", lightClusteringOverflow},
+    };
+
+}
@@ -0,0 +1,186 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import std;
+import lysa.math;
+import lysa.mesh_simplifier;
+import lysa.test;
+
+namespace lysa {
+
+    struct TestMesh {
+        std::vector<float3> positions;
+        std::vector<uint32> indices;
+    };
+
+    // Counterclockwise seen from +y, the height of each vertex given by height(x, z)
+    TestMesh grid(const uint32 size, const std::function<float(uint32, uint32)>& height) {
+        auto mesh = TestMesh{};
+        for (auto z = 0u; z <= size; z++) {
+            for (auto x = 0u; x <= size; x++) {
+                mesh.positions.push_back(float3{static_cast<float>(x), height(x, z), static_cast<float>(z)});
+            }
+        }
+        for (auto z = 0u; z < size; z++) {
+            for (auto x = 0u; x < size; x++) {
+                const auto v = z * (size + 1) + x;
+                mesh.indices.insert(mesh.indices.end(), { v, v + size + 1, v + 1 });
+                mesh.indices.insert(mesh.indices.end(), { v + 1, v + size + 1, v + size + 2 });
+            }
+        }
+        return mesh;
+    }
+
+    // Closed unit sphere centered on the origin, the poles and the seam sharing their vertices
+    TestMesh sphere(const uint32 slices, const uint32 stacks) {
+        auto mesh = TestMesh{};
+        mesh.positions.push_back(float3{0.0f, 1.0f, 0.0f});
+        for (auto stack = 1u; stack < stacks; stack++) {
+            const auto phi = std::numbers::pi_v<float> * static_cast<float>(stack) / static_cast<float>(stacks);
+            for (auto slice = 0u; slice < slices; slice++) {
+                const auto theta = 2.0f * std::numbers::pi_v<float> * static_cast<float>(slice) / static_cast<float>(slices);
+                mesh.positions.push_back(float3{
+                    std::sin(phi) * std::cos(theta),
+                    std::cos(phi),
+                    std::sin(phi) * std::sin(theta)});
+            }
+        }
+        const auto south = static_cast<uint32>(mesh.positions.size());
+        mesh.positions.push_back(float3{0.0f, -1.0f, 0.0f});
+        const auto ring = [&](const uint32 stack, const uint32 slice) {
+            return 1 + (stack - 1) * slices + slice % slices;
+        };
+        for (auto slice = 0u; slice < slices; slice++) {
+            mesh.indices.insert(mesh.indices.end(), { 0, ring(1, slice + 1), ring(1, slice) });
+            mesh.indices.insert(mesh.indices.end(), { south, ring(stacks - 1, slice), ring(stacks - 1, slice + 1) });
+            for (auto stack = 1u; stack < stacks - 1; stack++) {
+                mesh.indices.insert(mesh.indices.end(), { ring(stack, slice), ring(stack, slice + 1), ring(stack + 1, slice) });
+                mesh.indices.insert(mesh.indices.end(), { ring(stack, slice + 1), ring(stack + 1, slice + 1), ring(stack + 1, slice) });
+            }
+        }
+        return mesh;
+    }
+
+    float3 normalOf(const std::vector<float3>& positions, const std::span<const uint32> indices, const uint32 first) {
+        const auto& p0 = positions[indices[first]];
+        return cross(positions[indices[first + 1]] - p0, positions[indices[first + 2]] - p0);
+    }
+
+    bool contains(const std::vector<uint32>& indices, const uint32 vertex) {
+        return std::ranges::find(indices, vertex) != indices.end();
+    }
+
+    void simplifierReachesTarget() {
+        const auto mesh = sphere(32, 16);
+        auto simplifier = MeshSimplifier(mesh.positions, mesh.indices);
+        auto indexCount = static_cast<uint32>(mesh.indices.size());
+        for (auto level = 1; level < 4; level++) {
+            const auto target = indexCount / 6 * 3;
+            const auto simplified = simplifier.simplify(target);
+            test::check(simplified.indices.size() <= target,
+                std::format("level {} has {} indices for a target of {}", level, simplified.indices.size(), target));
+            test::check(simplified.indices.size() % 3 == 0, "incomplete triangle");
+            indexCount = static_cast<uint32>(simplified.indices.size());
+        }
+    }
+
+    void simplifierKeepsBorders() {
+        auto random = std::mt19937{42};
+        auto distribution = std::uniform_real_distribution{0.0f, 0.1f};
+        const auto mesh = grid(16, [&](uint32, uint32) { return distribution(random); });
+        auto simplifier = MeshSimplifier(mesh.positions, mesh.indices);
+        const auto simplified = simplifier.simplify(0);
+        test::check(simplified.indices.size() < mesh.indices.size(), "nothing simplified");
+        for (auto i = 0u; i <= 16; i++) {
+            for (const auto vertex : { i, 16 * 17 + i, i * 17, i * 17 + 16 }) {
+                test::check(contains(simplified.indices, vertex), std::format("border vertex {} removed", vertex));
+            }
+        }
+    }
+
+    void simplifierKeepsNonManifoldEdges() {
+        // A vertical fin standing on the middle line z = 8 of a flat grid, its bottom edges shared by three triangles
+        auto mesh = grid(16, [](uint32, uint32) { return 0.0f; });
+        const auto finFirst = static_cast<uint32>(mesh.positions.size());
+        for (auto y = 0u; y <= 4; y++) {
+            for (auto x = 0u; x <= 16; x++) {
+                mesh.positions.push_back(float3{static_cast<float>(x), static_cast<float>(y), 8.0f});
+            }
+        }
+        for (auto y = 0u; y < 4; y++) {
+            for (auto x = 0u; x < 16; x++) {
+                const auto v = finFirst + y * 17 + x;
+                mesh.indices.insert(mesh.indices.end(), { v, v + 1, v + 17 });
+                mesh.indices.insert(mesh.indices.end(), { v + 1, v + 18, v + 17 });
+            }
+        }
+        auto simplifier = MeshSimplifier(mesh.positions, mesh.indices);
+        const auto simplified = simplifier.simplify(0);
+        test::check(simplified.indices.size() < mesh.indices.size(), "nothing simplified");
+        // The fin bottom vertices are welded to the grid vertices of the middle line
+        for (auto x = 0u; x <= 16; x++) {
+            const auto gridVertex = 8 * 17 + x;
+            test::check(
+                contains(simplified.indices, gridVertex) || contains(simplified.indices, finFirst + x),
+                std::format("non-manifold vertex {} removed", x));
+        }
+    }
+
+    void simplifierDoesNotFlipTriangles() {
+        const auto mesh = sphere(32, 16);
+        auto simplifier = MeshSimplifier(mesh.positions, mesh.indices);
+        for (const auto target : { 1536u, 768u, 384u, 192u }) {
+            const auto simplified = simplifier.simplify(target);
+            for (auto i = 0u; i < simplified.indices.size(); i += 3) {
+                const auto normal = normalOf(mesh.positions, simplified.indices, i);
+                const auto center = (mesh.positions[simplified.indices[i]] +
+                                     mesh.positions[simplified.indices[i + 1]] +
+                                     mesh.positions[simplified.indices[i + 2]]) / 3.0f;
+                test::check(dot(normal, center) > 0.0f,
+                    std::format("triangle {} flipped at {} indices", i / 3, simplified.indices.size()));
+            }
+        }
+
+        auto random = std::mt19937{42};
+        auto distribution = std::uniform_real_distribution{0.0f, 0.5f};
+        const auto terrain = grid(32, [&](uint32, uint32) { return distribution(random); });
+        auto terrainSimplifier = MeshSimplifier(terrain.positions, terrain.indices);
+        const auto simplified = terrainSimplifier.simplify(static_cast<uint32>(terrain.indices.size() / 4));
+        // The triangles between aligned vertices stand vertical, none must face downward
+        for (auto i = 0u; i < simplified.indices.size(); i += 3) {
+            test::check(static_cast<float>(normalOf(terrain.positions, simplified.indices, i).y) >= 0.0f,
+                std::format("terrain triangle {} flipped", i / 3));
+        }
+    }
+
+    void simplifierErrorIsMonotonic() {
+        const auto mesh = sphere(32, 16);
+        auto simplifier = MeshSimplifier(mesh.positions, mesh.indices);
+        auto previous = MeshSimplifier::Level{ .indices = mesh.indices };
+        for (auto indexCount = static_cast<uint32>(mesh.indices.size()) / 2; indexCount >= 48; indexCount /= 2) {
+            const auto simplified = simplifier.simplify(indexCount);
+            test::check(simplified.error >= previous.error,
+                std::format("error {} lower than {} at {} indices", simplified.error, previous.error, indexCount));
+            test::check(simplified.indices.size() <= previous.indices.size(), "indices added");
+            previous = simplified;
+        }
+        test::check(previous.error > 0.0f, "no error on a curved surface");
+
+        // Coplanar triangles collapse without error
+        const auto plane = grid(16, [](uint32, uint32) { return 0.0f; });
+        auto planeSimplifier = MeshSimplifier(plane.positions, plane.indices);
+        test::check(planeSimplifier.simplify(0).error < 1e-4f, "error on a plane");
+    }
+
+    const auto simplifierRegistrations = std::array{
+        test::Registration{"MeshSimplifier/reaches the target index count", simplifierReachesTarget},
+        test::Registration{"MeshSimplifier/keeps the border vertices", simplifierKeepsBorders},
+        test::Registration{"MeshSimplifier/keeps the non-manifold vertices", simplifierKeepsNonManifoldEdges},
+        test::Registration{"MeshSimplifier/does not flip triangles", simplifierDoesNotFlipTriangles},
+        test::Registration{"MeshSimplifier/error is monotonic", simplifierErrorIsMonotonic},
+    };
+
+}
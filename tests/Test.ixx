@@ -0,0 +1,74 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+export module lysa.test;
+
+import std;
+
+export namespace lysa::test {
+
+    /**
+     * Failed check, ends the test case that raised it
+     */
+    class Failure : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * Registers a test case at static initialization time.<br>
+     * Each test source file declares one static Registration per test case, named "Suite/case".
+     */
+    class Registration {
+    public:
+        Registration(const std::string& name, std::function<void()> run) {
+            getTests().push_back({name, std::move(run)});
+        }
+
+        /**
+         * Runs the registered test cases whose name contains the filter, all of them if the filter is empty
+         * @return Number of failed test cases
+         */
+        static int runAll(const std::string& filter) {
+            auto failed = 0;
+            for (const auto& test : getTests()) {
+                if (!filter.empty() && !test.name.contains(filter)) { continue; }
+                try {
+                    test.run();
+                    std::println("[ OK ] {}", test.name);
+                } catch (const std::exception& e) {
+                    std::println("[FAIL] {} : {}", test.name, e.what());
+                    failed++;
+                }
+            }
+            return failed;
+        }
+
+    private:
+        struct Test {
+            std::string name;
+            std::function<void()> run;
+        };
+
+        static std::vector<Test>& getTests() {
+            static std::vector<Test> tests;
+            return tests;
+        }
+    };
+
+    /**
+     * Throws a Failure with the location of the call if the condition is false
+     */
+    void check(
+        const bool condition,
+        const std::string& message,
+        const std::source_location location = std::source_location::current()) {
+        if (!condition) {
+            throw Failure(std::format("{}:{} {}", location.file_name(), location.line(), message));
+        }
+    }
+
+}
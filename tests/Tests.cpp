@@ -0,0 +1,13 @@
+/*
+* Copyright (c) 2025-present Henri Michelon
+*
+* This software is released under the MIT License.
+* https://opensource.org/licenses/MIT
+*/
+import std;
+import lysa.test;
+
+// Usage : lysa_tests [name filter]
+int main(const int argc, char** argv) {
+    return lysa::test::Registration::runAll(argc > 1 ? argv[1] : "") == 0 ? 0 : 1;
+}